@@ -9,14 +9,26 @@ typedef struct {
     time_t created_time;
     time_t last_accessed;
     time_t last_modified;
+    long version;           // bumped on every content change
     char read_users[512];   // comma-separated list of users with read access
     char write_users[512];  // comma-separated list of users with write access
+    // Content counts (doccount.h), valid while the document's size and mtime match the stamp
+    long words;
+    long chars;
+    long sentences;
+    long long counted_size;
+    struct timespec counted_mtime;
 } FileMetadata;
 
+// Entries in the shared (file, user) -> permission cache (see acl_cache_init)
+#define ACL_CACHE_SLOTS 4096
+
 // Function prototypes
+int acl_cache_init(void);
 int create_metadata_file(const char *filename, const char *owner);
 int read_metadata_file(const char *filename, FileMetadata *meta);
 int update_metadata_file(const char *filename, FileMetadata *meta);
+int delete_metadata_file(const char *filename);
 int check_read_access(const char *filename, const char *username);
 int check_write_access(const char *filename, const char *username);
 int add_read_access(const char *filename, const char *username);
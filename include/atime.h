@@ -0,0 +1,17 @@
+#ifndef ATIME_H
+#define ATIME_H
+
+#include <time.h>
+
+// Access times are not written on every READ. Workers report them with atime_touch(),
+// which coalesces them in memory; a flusher thread writes them to the metadata store in
+// batches (single writer).
+#define ATIME_FLUSH_INTERVAL 30     // seconds between batch flushes
+#define ATIME_MAX_PENDING 1024      // flush early once this many files are pending
+
+void atime_init(void);
+void atime_touch(const char *filename);
+void atime_flush(void);
+time_t atime_effective(const char *filename, time_t stored);
+
+#endif
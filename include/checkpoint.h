@@ -5,6 +5,7 @@
 #include <time.h>
 
 #define MAX_CHECKPOINT_TAG 128
+#define CHECKPOINT_PAGE_SIZE 20   // LISTCHECKPOINTS ... PAGE <n> default
 
 // Function prototypes for checkpoint operations
 int checkpoint_create(int client_sock, const char *filename, const char *tag, 
@@ -13,7 +14,14 @@ int checkpoint_view(int client_sock, const char *filename, const char *tag,
                    const char *username, int storage_id);
 int checkpoint_revert(int client_sock, const char *filename, const char *tag, 
                      const char *username, int storage_id);
-int checkpoint_list(int client_sock, const char *filename, 
-                   const char *username, int storage_id);
+// page 0 lists every checkpoint; otherwise page (from 1) of per_page entries
+int checkpoint_list(int client_sock, const char *filename, const char *username,
+                    int sort_by_tag, int page, int per_page, int storage_id);
+// Load the per-file checkpoint manifests (importing older checkpoints). Called at startup.
+void checkpoint_index_init(int storage_id);
+// DIFF <file> <tagA> [<tagB>|CURRENT]: sentence-level diff, streamed as hunks
+int checkpoint_diff(int client_sock, const char *filename, const char *tag_a, const char *tag_b,
+                    const char *username, int storage_id);
+void checkpoint_remove_all(const char *filename, int storage_id);
 
 #endif // CHECKPOINT_H
\ No newline at end of file
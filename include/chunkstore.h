@@ -0,0 +1,43 @@
+#ifndef CHUNKSTORE_H
+#define CHUNKSTORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Content-defined chunk store shared by every checkpoint on this SS. storage<N>/chunks/
+// holds each distinct chunk once, named by its content hash. Boundaries are picked by a
+// gear rolling hash over the bytes themselves, so an edit only changes the chunks around
+// it and near-identical versions share the rest. A checkpoint is a manifest listing its
+// chunks. Chunks are reference counted; the counts are rebuilt from the manifests at
+// startup, which also sweeps chunks no manifest references (e.g. after a crash).
+//
+// On filesystems with copy-on-write support (FICLONE: btrfs, XFS, ...) a checkpoint is
+// instead a reflink of the document, and REVERT reflinks it back: both are constant time
+// and share blocks until one side is modified. Elsewhere the chunk manifests are used.
+#define CHUNK_MANIFEST_MAGIC "DSCM1"
+#define CHUNK_PACKED_MAGIC "DSZ1"     // chunk files are LZ-compressed (compress.h) when it pays
+#define CHUNK_MIN 512
+#define CHUNK_AVG_BITS 11           // ~2 KB average chunk
+#define CHUNK_MAX 16384
+
+// Called once at startup: rebuild reference counts, drop unreferenced chunks
+void chunkstore_init(void);
+
+// Snapshot the file at src_path to manifest_path (atomically): a reflink where supported,
+// otherwise its chunks go into the store and a manifest is written. *size receives the
+// content length. Returns 0 or -1.
+int chunkstore_put(const char *src_path, const char *manifest_path, uint64_t *size);
+
+// Stream the content a manifest describes to sink, in order; a non-zero return from sink
+// stops early. Raw checkpoints (reflinks, or full copies from before the chunk store)
+// are read as-is.
+typedef int (*ChunkSink)(const char *data, size_t len, void *user);
+int chunkstore_read(const char *manifest_path, ChunkSink sink, void *user);
+int chunkstore_size(const char *manifest_path, uint64_t *size);
+// Write the content to a new file at dest_path (reflinked where possible)
+int chunkstore_restore(const char *manifest_path, const char *dest_path);
+
+// Delete a manifest and release its chunks; chunks left unreferenced are deleted
+int chunkstore_release(const char *manifest_path);
+
+#endif // CHUNKSTORE_H
@@ -0,0 +1,12 @@
+#ifndef CLIENT_STREAM_H
+#define CLIENT_STREAM_H
+
+// STREAM straight from the storage server (found with LOCATE), reconnecting and resuming
+// from the last progress cursor if the connection drops
+void client_stream(const char *command, const char *username, const char *password);
+
+// Print a MGET (each document whole, as it completes) or MSTREAM (pieces as they arrive)
+// reply read from sock
+void client_multi(int sock, int mstream);
+
+#endif
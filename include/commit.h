@@ -0,0 +1,69 @@
+#ifndef COMMIT_H
+#define COMMIT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include "document.h"
+
+// ETIRW commits write only the bytes that changed. The edited region is found by comparing
+// the new serialisation from the edited sentence on with the file as it was loaded (common
+// prefix / suffix); equal lengths are patched in place with pwrite(), otherwise the tail is
+// rewritten from the first changed byte and the file truncated. The new bytes are first
+// written to storage<N>/swap/<file>.journal and fdatasync'd, so a crash mid-commit is
+// completed on the next start (commit_recover) instead of leaving a torn document.
+#define COMMIT_JOURNAL_MAGIC "DSJ1"
+#define COMMIT_LOCK_STRIPES 64
+
+// Concurrent WRITE sessions on different sentences are merged: each commit bumps a per-file
+// version, and a session whose version is no longer current has its edit replayed onto the
+// current document (its sentence index adjusted for sentences earlier commits inserted)
+// instead of writing back its stale snapshot.
+#define COMMIT_HISTORY 64               // commits remembered per file for index adjustment
+
+// Load filename for a WRITE session; *version is the committed version it reflects
+Document *commit_load(const char *filename, struct stat *st, uint64_t *version);
+
+// Commit a WRITE session's edit: sentences [at, at + added) of doc replace `removed` (0 or 1)
+// sentences at `at` in version `base` (loaded with stat `loaded`), whose text was then
+// `original`. Returns 0 on success, -2 if that sentence can no longer be found unchanged in
+// the current version (it was edited, or more than COMMIT_HISTORY commits landed), -1 on
+// error. The edited sentences are normalised (doc_normalize) so numbering matches a
+// re-read of the file. The metadata version and LAST_MODIFIED are bumped under the lock.
+int commit_edit(const char *filename, Document *doc, size_t at, size_t removed, size_t added,
+                const char *original, uint64_t base, const struct stat *loaded);
+
+// UNDO / REDO: replace the expect_len bytes at off, which must currently read `expect`,
+// with repl as one journalled commit. at / delta: the sentence renumbering this causes.
+// Returns 0, -2 if the file does not hold `expect` there, -1 on error. Caller holds
+// commit_write_lock; the undo history is left to the caller.
+int commit_splice(const char *filename, uint64_t off, const char *expect, size_t expect_len,
+                  const char *repl, size_t repl_len, size_t at, long delta);
+
+// Replay (or discard, if incomplete) journals left by a crash. Called once at startup.
+void commit_recover(void);
+
+// Readers that must not observe a commit half-applied (READ, MGET, STREAM, SEARCH indexing)
+void commit_read_lock(const char *filename);
+void commit_read_unlock(const char *filename);
+// Writers outside commit_edit that must be ordered with commits (UNDO / REDO)
+void commit_write_lock(const char *filename);
+void commit_write_unlock(const char *filename);
+
+// Readers that send at the client's pace (READ, MGET, STREAM) copy what they will send
+// while holding commit_read_lock and send the copy after unlocking, so a slow client does
+// not hold back commits to the document. Up to mem_max bytes are copied into memory, more
+// into an unlinked file in swap/ (in the kernel where it can).
+typedef struct {
+    char *buf;                  // the bytes, when copied into memory
+    int fd;                     // otherwise the copy, from offset 0 (file position 0)
+    uint64_t len;
+} CommitSnapshot;
+
+#define COMMIT_SNAPSHOT_MEM (256 * 1024)
+
+// Copy len bytes of the open document fd from off. Caller holds commit_read_lock. 0 or -1.
+int commit_snapshot(int fd, uint64_t off, uint64_t len, uint64_t mem_max, CommitSnapshot *snap);
+void commit_snapshot_free(CommitSnapshot *snap);
+
+#endif // COMMIT_H
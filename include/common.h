@@ -18,6 +18,30 @@
 #define STORAGE_SERVER_IP "127.0.0.1"
 #define NAME_SERVER_IP "172.19.82.9"
 
+// Metadata trailer: when a request carries a "META:1" header line, the storage server
+// ends READ/WRITE/UNDO/REVERT responses with
+//   META_TRAILER_MARK "META <version> <size> <last_modified> <last_accessed>\n"
+// and the name server strips it and applies it to its index (no follow-up INFO).
+#define META_TRAILER_MARK '\x1e'
+#define META_TRAILER_MAX 128
+
+// A successful READ reply is READ_LENGTH_HEADER "<n>\n" followed by exactly n bytes of the
+// document (or of the requested range); errors are a text line without the header
+#define READ_LENGTH_HEADER "LENGTH: "
+
+// MGET / MSTREAM replies are a sequence of per-document frames:
+//   "FILE <name> <n>\n" and n bytes of the document (MGET) or of its word stream (MSTREAM)
+//   "DONE <name>\n" once all of a document has been sent
+//   "ERROR <name> <reason>\n" in place of the above for a document that cannot be sent
+// A document's frames are in order, but frames of different documents may be interleaved:
+// the name server merges the storage servers' replies as they arrive.
+#define MULTI_MAX_FILES 64
+#define MULTI_PIECE_MAX (256 * 1024)    // largest FILE frame, so no document holds up the rest
+
+// Sentence write locks are leases: a WRITE session that sends nothing (edits or "RENEW"
+// lines) for this many seconds may lose its lock to another writer
+#define WRITE_LOCK_LEASE 60
+
 int get_storage_id(void);
 
 #endif
\ No newline at end of file
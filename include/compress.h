@@ -0,0 +1,32 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stddef.h>
+
+// Built-in LZ77 codec (LZ4-style byte-aligned sequences: a token with literal and match
+// lengths, the literals, a 16-bit back offset) used for data the SS keeps but rarely
+// reads: checkpoint chunks, undo history and cold documents. Text typically shrinks 2-3x;
+// compression runs at a few hundred MB/s and decompression faster, with no dependencies.
+//
+// SS_COMPRESS=0 turns compression off (existing compressed data is still read). Each area
+// counts bytes in / out and the thread CPU time spent, reported by STATS.
+typedef enum {
+    LZ_CHECKPOINT,
+    LZ_UNDO,
+    LZ_COLD,
+    LZ_AREAS
+} LzArea;
+
+int lz_enabled(void);
+size_t lz_bound(size_t n);      // dst size lz_compress needs for n input bytes
+
+// Compress n bytes into dst (lz_bound(n) bytes). Returns the compressed size, or 0 if
+// compression is off or would not save space (store the data raw then).
+size_t lz_compress(LzArea area, const char *src, size_t n, char *dst);
+// Decompress exactly out_len bytes; -1 if the input is corrupt
+int lz_decompress(LzArea area, const char *src, size_t n, char *dst, size_t out_len);
+
+// Per-area ratio and CPU cost since startup, for STATS
+void lz_describe(char *out, size_t sz);
+
+#endif // COMPRESS_H
@@ -0,0 +1,18 @@
+#ifndef DIFF_H
+#define DIFF_H
+
+#include <stddef.h>
+
+// Shortest edit script between sequences a[0, n) and b[0, m) (Myers' O((N+M)D) algorithm),
+// with elements compared through eq. Common leading and trailing runs are stripped first,
+// so the cost follows the size of the change rather than the documents. On return
+// a_del[i] is set for each element of a that was removed and b_ins[j] for each element of
+// b that was added (both zeroed by the caller). Past DIFF_MAX_EDITS differences the rest
+// of the middle is reported as replaced wholesale instead of minimised.
+#define DIFF_MAX_EDITS 1024
+
+typedef int (*DiffEqual)(size_t i, size_t j, void *user);
+
+int diff_mark(size_t n, size_t m, DiffEqual eq, void *user, unsigned char *a_del, unsigned char *b_ins);
+
+#endif // DIFF_H
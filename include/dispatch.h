@@ -0,0 +1,30 @@
+#ifndef DISPATCH_H
+#define DISPATCH_H
+
+// Storage server connection handling: acceptor threads (one epoll loop per listening
+// socket, SO_REUSEPORT when there are several) read each request header frame without
+// blocking, then hand the connection to a pool of worker threads. A frame is header lines
+// ending with a newline-terminated "CMD:<command>\n" line; one that does not arrive whole
+// within SS_REQUEST_MAX bytes and SS_FRAME_TIMEOUT seconds is dropped.
+//
+// Tunables (environment variables, defaults below):
+//   SS_WORKERS      worker threads started up front
+//   SS_MAX_WORKERS  the pool grows on demand up to this (a WRITE session holds a worker)
+//   SS_BACKLOG      listen() backlog per listening socket
+//   SS_ACCEPTORS    number of SO_REUSEPORT listening sockets / acceptor threads
+#define SS_DEFAULT_WORKERS 8
+#define SS_DEFAULT_MAX_WORKERS 128
+#define SS_DEFAULT_BACKLOG 128
+#define SS_DEFAULT_ACCEPTORS 1
+#define SS_WORKER_STACK (1024 * 1024)
+#define SS_REQUEST_MAX 4096                 // largest request header frame (USER/PASS/META/CMD)
+#define SS_FRAME_TIMEOUT 10                 // seconds allowed to send a complete frame
+
+// Handles one request; `request` is the NUL-terminated header frame. The connection is
+// closed by the dispatcher when the handler returns.
+typedef void (*RequestHandler)(int client_sock, char *request);
+
+// Bind the listening socket(s) on port and serve forever. Returns -1 on setup failure.
+int dispatch_run(int port, RequestHandler handler);
+
+#endif // DISPATCH_H
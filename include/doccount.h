@@ -0,0 +1,52 @@
+#ifndef DOCCOUNT_H
+#define DOCCOUNT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include "tier.h"
+
+// Word, character and sentence counts of each document, kept in its metadata record so
+// VIEW -l and INFO answer without reading documents. Words are runs of anything but ' ',
+// '\n' and '\t', characters are bytes, sentences are split as the document model splits
+// them (document.h). Every commit (WRITE, UNDO / REDO) adds the delta of the bytes it
+// replaced, found from the region and the text just around it. The counts are stamped
+// with the size and mtime of the document they describe; a document whose stamp does not
+// match (changed some other way, or never counted) is recounted once when next asked.
+typedef struct {
+    long words;
+    long chars;
+    long sentences;         // -1 if unknown
+} DocCounts;
+
+// What surrounds a replaced region: the bytes just before and just after it, and the
+// nearest bytes before and after it that are not whitespace (-1 where there is none)
+typedef struct {
+    int prev, next;
+    int prev_text, next_text;
+} DocEdge;
+
+// Edge of [off, end) in text (len bytes), or in the open document fd (size bytes)
+void doccount_edge(const char *text, size_t len, size_t off, size_t end, DocEdge *edge);
+int doccount_edge_fd(int fd, uint64_t size, uint64_t off, uint64_t end, DocEdge *edge);
+
+// Counts added by replacing old_len bytes `old` with repl where edge surrounds them
+void doccount_delta(const DocEdge *edge, const char *old, size_t old_len, const char *repl,
+                    size_t repl_len, DocCounts *delta);
+
+// After a commit took the document from stat `before` to `after`: apply delta if the
+// stored counts described `before`. Caller holds the file's commit write lock.
+void doccount_commit(const char *filename, const struct stat *before, const struct stat *after,
+                     const DocCounts *delta);
+
+// Counts of a document in files/ whose stat is st (NULL: always recount), recounting and
+// storing them if the stored ones are stale. Returns 0, or -1 if it cannot be read.
+int doccount_get(const char *filename, const struct stat *st, DocCounts *out);
+// Counts of a cold document: stored ones if they describe the archived copy, else the
+// words the tier recorded with sentences unknown
+void doccount_cold(const char *filename, const TierInfo *info, DocCounts *out);
+// Count text, the document's bytes as of st, and store the result
+void doccount_store(const char *filename, const struct stat *st, const char *text, size_t len,
+                    DocCounts *out);
+
+#endif // DOCCOUNT_H
@@ -0,0 +1,52 @@
+#ifndef DOCUMENT_H
+#define DOCUMENT_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+// In-memory document model used by WRITE. A document is a sequence of sentences (text up
+// to and including '.', '!' or '?'), kept in an order-statistic treap so that finding,
+// replacing or inserting sentence k costs O(log n). Sentence text is a piece table: spans
+// point into the original file buffer or into an append-only add buffer, so unchanged
+// sentences are never copied. Whitespace between sentences is kept as each sentence's
+// "lead", and serialising the document reproduces untouched text byte for byte.
+typedef struct Document Document;
+
+Document *doc_load(const char *path, struct stat *st);   // NULL if unreadable; st (optional) gets its fstat
+Document *doc_from_text(const char *text, size_t len);
+void doc_free(Document *doc);
+
+size_t doc_sentence_count(const Document *doc);
+size_t doc_length(const Document *doc);              // serialised size in bytes
+int doc_ends_with_delim(const Document *doc);        // last sentence is terminated (or doc is empty)
+
+// Body of sentence k (without its leading whitespace) as a malloc'd string, or NULL
+char *doc_sentence(const Document *doc, size_t k);
+// Byte offset of sentence k's span (including its lead) in the serialised document
+size_t doc_sentence_offset(const Document *doc, size_t k);
+
+// Call cb for each sentence from index first on, in order, with its body's byte offset
+// and length in the serialised document: O(log n) to reach first, then O(1) per sentence
+void doc_each_sentence(const Document *doc, size_t first,
+                       void (*cb)(size_t off, size_t len, void *user), void *user);
+
+// Replace the body of sentence k, keeping its lead; k == count appends a new sentence
+int doc_set_sentence(Document *doc, size_t k, const char *body);
+// Insert a new sentence before position k (k == count appends)
+int doc_insert_sentence(Document *doc, size_t k, const char *body);
+// Join each sentence in [first, last] that lacks a closing delimiter with the one after it,
+// as re-reading the serialised text would (an edit can leave "z" in front of "S2.")
+void doc_normalize(Document *doc, size_t first, size_t last);
+
+int doc_write(const Document *doc, FILE *fp);
+// Serialised bytes from sentence first's span to the end, as a malloc'd buffer (*len bytes)
+char *doc_render(const Document *doc, size_t first, size_t *len);
+// The file contents the document was loaded from (unchanged by edits)
+const char *doc_original(const Document *doc, size_t *len);
+
+// Sentence splitting helpers shared with the editing code
+int doc_is_delim(char c);
+size_t doc_next_sentence(const char *text, size_t len);   // bytes up to and including the first delimiter
+
+#endif // DOCUMENT_H
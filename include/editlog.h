@@ -0,0 +1,27 @@
+#ifndef EDITLOG_H
+#define EDITLOG_H
+
+// Per-session edit journal: storage<N>/swap/<file>.<n>.edits starts with the session owner
+// and the sentence as it was when locked, followed by one record per "<index> <content>"
+// edit, each a single O_APPEND write. A journal still present when the sentence is next
+// locked was left by an interrupted session (server crash); if the same user locks the
+// same, unchanged sentence, its edits are replayed into the new session.
+//
+// SS_EDIT_SYNC=1 makes every append durable before it is acknowledged; concurrent sessions
+// share fdatasync passes (group commit) instead of each syncing on its own.
+#define EDITLOG_MAGIC "DSWJ1"
+
+typedef struct EditLog EditLog;
+
+// Called for each edit recovered from an interrupted session; return 0 if it applied
+typedef int (*EditReplay)(long index, const char *content, void *user);
+
+// Start the journal for a session. An interrupted session's journal for the same owner and
+// original sentence is replayed through replay first (*replayed = edits applied).
+EditLog *editlog_open(const char *filename, int sentence, const char *owner, const char *original,
+                      EditReplay replay, void *user, int *replayed);
+int editlog_append(EditLog *log, long index, const char *content);
+// End the session: the journal is removed (it is only needed until ETIRW or abandonment)
+void editlog_close(EditLog *log);
+
+#endif // EDITLOG_H
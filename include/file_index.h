@@ -4,6 +4,7 @@
 #include <stddef.h>
 #include <time.h>
 #define MAX_SS 32
+#define FILE_INDEX_MAX_LEVEL 16   // skip list height (p = 1/4, plenty for any realistic file count)
 
 typedef struct FileMeta {
     char name[256];
@@ -13,14 +14,23 @@ typedef struct FileMeta {
     time_t created_time;
     time_t last_modified;
     time_t last_accessed;
+    long version;           // content version reported by the storage server
+    long long size;         // file size in bytes
     char read_users[512];   // comma-separated usernames
     char write_users[512];  // comma-separated usernames
-    struct FileMeta *next;
+    struct FileMeta *next;  // hash bucket chain
+    // Ordered name index (skip list), maintained alongside the hash buckets
+    struct FileMeta *skip[FILE_INDEX_MAX_LEVEL];
+    int skip_level;
 } FileMeta;
 
 typedef struct FileIndex {
     FileMeta **buckets;
     size_t num_buckets;
+    FileMeta *head[FILE_INDEX_MAX_LEVEL];  // skip list heads, sorted by name
+    int level;
+    size_t count;
+    unsigned long rng;
 } FileIndex;
 
 void file_index_init(FileIndex *index, size_t num_buckets);
@@ -31,4 +41,19 @@ void file_index_remove(FileIndex *index, const char *name, int ss_id);
 void file_index_iter(FileIndex *index, void (*cb)(FileMeta *, void *), void *user);
 unsigned long hash_filename(const char *str);
 
+// Insert a heap-allocated entry (index takes ownership); replaces any entry with the same name
+void file_index_insert(FileIndex *index, FileMeta *meta);
+// Drop an entry entirely, regardless of which storage servers hold it
+void file_index_delete(FileIndex *index, const char *name);
+
+// Ordered access: first entry whose name is >= key (NULL key = first entry)
+FileMeta *file_index_seek(FileIndex *index, const char *key);
+FileMeta *file_index_next(FileMeta *meta);
+// Visit entries with lo <= name < hi (NULL bound = open), at most limit (0 = no limit).
+// Returns the number of entries visited. Cost is O(log n + k).
+size_t file_index_range(FileIndex *index, const char *lo, const char *hi, size_t limit,
+                        void (*cb)(FileMeta *, void *), void *user);
+size_t file_index_prefix(FileIndex *index, const char *prefix, size_t limit,
+                         void (*cb)(FileMeta *, void *), void *user);
+
 #endif // FILE_INDEX_H
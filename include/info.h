@@ -2,5 +2,6 @@
 #define INFO_H
 
 void file_info(int client_sock, const char *filename, const char *username);
+void send_meta_trailer(int client_sock, const char *filename, const char *username);
 
 #endif
@@ -0,0 +1,35 @@
+#ifndef META_STORE_H
+#define META_STORE_H
+
+#include <stdint.h>
+#include "acl.h"
+
+// Per-storage-server metadata store: storage<N>/meta.db, a memory-mapped open-addressing
+// table of fixed-size records. Each slot holds two shadow copies (CRC + generation); an
+// update writes the older copy, so a torn write never destroys the previous value.
+// The old per-file .meta text format is kept for import (first start) and EXPORTMETA.
+#define META_STORE_INITIAL_SLOTS 1024
+#define META_STORE_MAX_LOAD 70        // percent of slots in use before the table doubles
+#define META_STORE_SYNC 1             // msync() ownership/ACL/content updates before returning
+
+// Where a record lives and which write produced it; generations are unique store-wide,
+// so a ref stays valid exactly until the record is next written (or deleted).
+typedef struct {
+    uint64_t slot;
+    uint64_t gen;
+} MetaRef;
+
+int meta_store_open(int storage_id);
+int meta_store_get(const char *name, FileMetadata *out, MetaRef *ref);
+int meta_store_ref_valid(const MetaRef *ref);
+int meta_store_put(const char *name, const FileMetadata *meta);
+int meta_store_delete(const char *name);
+int meta_store_bump_version(const char *name, time_t mtime);
+int meta_store_edit_acl(const char *name, int (*edit)(FileMetadata *meta, void *arg), void *arg);
+int meta_store_set_atime(const char *name, time_t when);
+int meta_store_set_counts(const char *name, const FileMetadata *counts);
+void meta_store_iter(void (*cb)(const char *name, const FileMetadata *meta, void *user), void *user);
+int meta_store_import(const char *dir);
+int meta_store_export(const char *dir);
+
+#endif // META_STORE_H
@@ -0,0 +1,21 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+// One inverted index per storage server: a term dictionary whose postings are delta +
+// varint coded (document, sentence) lists across all of its documents. Sentences keep
+// stable ids, so a content change re-posts only the sentences it rewrote. The index is
+// held in memory and journaled to storage<N>/search/index.log; startup replays the journal
+// and reindexes documents whose size / inode / mtime stamp no longer matches.
+#define SEARCH_MAX_TERM 64
+#define SEARCH_MAX_TERMS 8              // terms per query
+#define SEARCH_MAX_RESULTS 50           // shown by the NM after ranking across servers
+#define SEARCH_MAX_SENTENCE_LIST 480    // chars of sentence numbers per RESULT line
+#define SEARCH_COMPACT_MIN (1 << 20)    // journal bytes before it may be rewritten
+
+void search_init(void);
+int search_index_update(const char *filename);
+void search_index_remove(const char *filename);
+void search_index_sync(void);
+void search_files(int client_sock, const char *query, const char *username);
+
+#endif
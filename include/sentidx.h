@@ -0,0 +1,29 @@
+#ifndef SENTIDX_H
+#define SENTIDX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include "document.h"
+
+// Per-document sentence boundary index: storage<N>/sentidx/<file>.sidx holds a header
+// (stamped with the document's size and mtime) followed by one fixed-size entry per
+// sentence (body offset, body length), so sentence k is found with a single pread().
+// A stamp mismatch means the index is stale; it is then rebuilt from the document.
+#define SENTIDX_MAGIC "DSSX"
+
+// After ETIRW: entries before `from` are kept if the index matched the document as it was
+// (`before`); entries from `from` on are rewritten. `now` is the stat of the file that
+// doc was written to, taken before it was renamed into place.
+int sentidx_update(const char *filename, const Document *doc, size_t from,
+                   const struct stat *before, const struct stat *now);
+int sentidx_rebuild(const char *filename);   // UNDO / REVERT: the whole document changed
+void sentidx_remove(const char *filename);
+
+// Byte range [*off, *off + *len) of sentences first..last (inclusive) in the document
+// whose stat is st (fstat of the descriptor the caller reads from). Returns 0 on success,
+// -2 if last is out of range (*count is set to the number of sentences), -1 on error.
+int sentidx_range(const char *filename, const struct stat *st, size_t first, size_t last,
+                  uint64_t *off, uint64_t *len, uint64_t *count);
+
+#endif // SENTIDX_H
@@ -0,0 +1,25 @@
+#ifndef SENTLOCK_H
+#define SENTLOCK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Sentence write locks, held in the storage server process (no lock files). A lock is a
+// lease of WRITE_LOCK_LEASE seconds, extended by every line of the WRITE session (or an
+// explicit RENEW); a lapsed lease is taken over by the next writer. Writers that asked to
+// wait queue up FIFO, and a released lock is handed directly to the first of them.
+#define SENTLOCK_BUCKETS 1024
+#define SENTLOCK_DEFAULT_WAIT 30            // WRITE <file> <n> WAIT without a timeout
+#define SENTLOCK_MAX_WAIT 600
+
+// Acquire (filename, sentence) for owner, waiting up to wait_secs (0 = try once). Returns
+// a non-zero token identifying this hold, or 0 if another writer still holds it.
+uint64_t sentlock_acquire(const char *filename, int sentence, const char *owner, int wait_secs);
+// Extend the lease. Returns -1 if the lock was lost (lapsed and taken by another writer).
+int sentlock_renew(const char *filename, int sentence, uint64_t token);
+void sentlock_release(const char *filename, int sentence, uint64_t token);
+
+// Text listing of held locks (all files, or only filename's), one per line
+void sentlock_describe(const char *filename, char *out, size_t outsz);
+
+#endif // SENTLOCK_H
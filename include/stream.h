@@ -1,6 +1,54 @@
 #ifndef STREAM_H
 #define STREAM_H
 
-void stream_file(int client_sock, const char *filename, const char *username);
+#include <stdint.h>
+
+// STREAM <file> [WORD <n>|BYTE <offset>] [RATE <words/s>|RATE MAX]
+//
+// Paced streams (default STREAM_DEFAULT_RATE words/s) do not hold a worker: the request
+// hands the connection to a single pacer thread driven by a timer wheel. Each time a
+// stream comes due it is sent every word it has earned since its last turn, as one
+// write, so a fast stream costs one syscall per tick rather than one per word. A client
+// that reads slowly gets its unsent bytes retried on later ticks; it never blocks others.
+//
+// RATE MAX sends the document unthrottled with sendfile(), corked together with the
+// end marker; the bytes arrive exactly as stored rather than re-spaced word by word.
+#define STREAM_DEFAULT_RATE 10          // words per second (the old 100 ms per word)
+#define STREAM_MAX_RATE 1000000
+#define STREAM_TICK_MS 10
+#define STREAM_WHEEL_SLOTS 256          // 2.56 s per turn; longer delays count turns
+#define STREAM_BATCH_MAX (64 * 1024)    // bytes of words assembled per turn at most
+#define STREAM_END_MARK "\n--- End of Stream ---\n"
+
+// WORD n starts after the first n words, BYTE at that offset of the document. With a
+// "CURSOR:1" header line the output is framed, so a client whose connection drops knows
+// exactly how far it got and can resume with BYTE:
+//   STREAM_CURSOR_MARK "V <version>\n" first: the document version being streamed (its
+//       size and mtime). A resume sends it back in a "RESUME:<version>" header line and is
+//       refused, with an error line, if the document has changed since
+//   STREAM_CURSOR_MARK "W <len> <next>\n" and len bytes of words; once all of them have
+//       arrived the stream resumes at byte <next>
+//   STREAM_CURSOR_MARK "B <len> <next>\n" and the document's bytes up to offset <next>
+//       (RATE MAX); a frame cut short resumes at <next> - <len> + bytes received
+//   STREAM_CURSOR_MARK "E\n" STREAM_END_MARK
+// Errors are a text line without frames.
+#define STREAM_CURSOR_MARK '\x1d'
+#define STREAM_FRAME_ROOM 288           // longest frame header (FILE with a 255-byte name)
+#define STREAM_RESUME_TRIES 5           // client reconnects in a row without progress
+#define STREAM_VERSION_MAX 64
+
+typedef struct {
+    unsigned rate;          // words per second, or 0 for unthrottled
+    uint64_t start;         // words to skip, or a byte offset if start_at_byte
+    int start_at_byte;
+    int cursor;             // frame the output (CURSOR:1)
+    char version[STREAM_VERSION_MAX];   // RESUME: the version streamed so far, or ""
+} StreamRequest;
+
+void stream_file(int client_sock, const char *filename, const char *username, const StreamRequest *req);
+
+// MSTREAM <f1> <f2> ... [RATE <words/s>|RATE MAX]: the documents one after another on this
+// connection, framed per document as MGET is (common.h); rate 0 is unthrottled
+void stream_files(int client_sock, char *const *filenames, size_t count, const char *username, unsigned rate);
 
 #endif
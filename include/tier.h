@@ -0,0 +1,52 @@
+#ifndef TIER_H
+#define TIER_H
+
+#include <stdint.h>
+#include <time.h>
+
+// Cold tier: documents nobody has read or written for SS_COLD_AFTER seconds (default a
+// week; 0 turns tiering off) are moved by a background thread out of storage<N>/files/ into
+// storage<N>/cold/archive, one append-only file of LZ-compressed records (compress.h).
+// files/ then holds only the working set. Commands that touch a document's bytes promote
+// it back first (tier_acquire), restoring it byte-for-byte with its mtime. Metadata, ACLs,
+// checkpoints, undo history and the search index stay where they are, so VIEW, INFO, ACL
+// checks and SEARCH answer for cold documents without promoting them.
+//
+// Archive record: TierRecord, the name, then the payload. A record with raw_len ==
+// TIER_TOMBSTONE marks the document hot again. On startup the archive is replayed into
+// an in-memory index, a torn tail is cut off, and a document found in files/ as well
+// (a crash between the two steps of a move) is taken from files/. Space held by promoted
+// records is reclaimed by rewriting the archive once it outweighs the live records.
+#define TIER_MAGIC "DSC1"
+#define TIER_DEFAULT_COLD_AFTER (7 * 24 * 3600)
+#define TIER_SCAN_INTERVAL 60       // seconds between demotion passes (at most)
+#define TIER_BATCH 64               // documents demoted per pass
+#define TIER_COMPACT_MIN (1 << 20)  // dead archive bytes before a rewrite is considered
+#define TIER_TOMBSTONE UINT64_MAX
+
+typedef struct {
+    uint64_t size;          // document length
+    uint32_t words;         // as VIEW -l counts them
+    time_t mtime;
+    long mtime_nsec;
+} TierInfo;
+
+// Called once at startup, after commit recovery and before anything lists documents:
+// load the index. tier_start() then starts the demotion thread, once the server is ready.
+void tier_init(void);
+void tier_start(void);
+
+// Around every command that reads or changes a document's bytes: a cold document is
+// promoted, and no document is demoted while a command holds it. Returns -1 if a cold
+// document could not be restored (its record stays in the archive).
+int tier_acquire(const char *filename);
+void tier_release(const char *filename);
+
+// 1 and *info if the document is cold, else 0
+int tier_lookup(const char *filename, TierInfo *info);
+void tier_foreach(void (*cb)(const char *filename, const TierInfo *info, void *user), void *user);
+
+// Cold tier size and activity since start, for STATS
+void tier_describe(char *out, size_t sz);
+
+#endif // TIER_H
@@ -1,6 +1,25 @@
 #ifndef UNDO_H
 #define UNDO_H
 
-void undo_last_change(int client_sock, const char* filename, const char* username);
+#include <stddef.h>
+#include <stdint.h>
 
-#endif
\ No newline at end of file
+// Undo history: storage<N>/undo/<file> is a stack of the byte-range deltas committed WRITEs
+// made (offset, bytes before, bytes after, sentence renumbering), with a cursor separating
+// undoable entries from redoable ones. UNDO applies the inverse of the entry below the
+// cursor, REDO re-applies the one above it; both only touch the bytes the edit changed.
+// A new commit drops the redoable entries. At least UNDO_LEVELS entries are kept; entry
+// bodies are LZ-compressed (compress.h) when that saves space.
+#define UNDO_MAGIC "DSU2"
+#define UNDO_LEVELS 32
+
+// Called by commit for each committed change, under the file's commit lock
+void undo_record(const char *filename, uint64_t off, const char *old, size_t old_len,
+                 const char *new_text, size_t new_len, size_t at, long delta);
+// The file changed in a way the history cannot describe (REVERT, DELETE, full rewrite)
+void undo_forget(const char *filename);
+
+void undo_last_change(int client_sock, const char* filename, const char* username, int levels);
+void redo_last_change(int client_sock, const char* filename, const char* username, int levels);
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef WRITE_H
 #define WRITE_H
 
-void write_to_file(int client_sock, const char *filename, int sentence_num, const char *username);
+// wait_secs > 0 queues for a sentence held by another writer instead of failing at once
+void write_to_file(int client_sock, const char *filename, int sentence_num, const char *username, int wait_secs);
 
 #endif
@@ -6,25 +6,62 @@
 #include <strings.h>
 #include "../../include/common.h"
 #include "../../include/client_write.h"
+#include "../../include/client_stream.h"
 
 static void print_command_menu(void) {
     printf("\n");
     printf("═══════════════════════ Available Commands ═══════════════════════\n");
     printf("  VIEW | VIEW -a | VIEW -l | VIEW -al\n");
+    printf("  VIEW [-l] <prefix>*   NM index; -l: owner, times, SS (no counts)\n");
     printf("  CREATE <file>         DELETE <file>          INFO <file>\n");
-    printf("  READ <file> <n>       WRITE <file> <n>       STREAM <file>\n");
-    printf("  LOCATE <file>         UNDO <file>\n");
+    printf("  READ <file> [<n>[-<m>] | BYTES <a>-[<b>]]  WRITE <file> <n> [WAIT [<secs>]]\n");
+    printf("  STREAM <file> [WORD <n>|BYTE <off>] [RATE <n>|RATE MAX]\n");
+    printf("  MGET <file> <file> ...          MSTREAM <file> <file> ... [RATE <n>|RATE MAX]\n");
+    printf("  LOCATE <file>         SEARCH <terms>\n");
+    printf("  UNDO <file> [<n>]     REDO <file> [<n>]      LOCKS [<file>]\n");
     printf("  ADDACCESS -R|-W <file> <user>   REMACCESS <file> <user>\n");
     printf("  CHECKPOINT <file> <tag>         VIEWCHECKPOINT <file> <tag>\n");
     printf("  REVERT <file> <tag>             LISTCHECKPOINTS <file>\n");
+    printf("  DIFF <file> <tagA> [<tagB>|CURRENT]     STATS\n");
     printf("  MENU / HELP (show this list)    EXIT / QUIT (leave)\n");
     printf("══════════════════════════════════════════════════════════════════\n\n");
 }
 
+// READ: the reply starts with the length header, so a short body is reported rather than
+// passed off as the whole document. Error replies come without it and are shown as they are.
+static void print_read_response(int sock) {
+    char head[64], buf[4096];
+    size_t head_len = 0;
+    while (head_len < sizeof(head) - 1 && read(sock, head + head_len, 1) == 1) {
+        if (head[head_len++] == '\n') break;
+    }
+    head[head_len] = '\0';
+
+    printf("\n--- Server Response ---\n");
+    unsigned long long expected = 0, got = 0;
+    int framed = sscanf(head, READ_LENGTH_HEADER "%llu", &expected) == 1;
+    if (!framed) fwrite(head, 1, head_len, stdout);
+    ssize_t bytes;
+    while ((bytes = read(sock, buf, sizeof(buf))) > 0) {
+        fwrite(buf, 1, (size_t)bytes, stdout);
+        got += (unsigned long long)bytes;
+    }
+
+    if (!framed) {
+        printf("\n[INFO] Response complete.\n");
+    } else if (expected == 0) {
+        printf("(File is empty)\n");
+    } else if (got < expected) {
+        printf("\n[ERROR] Connection lost after %llu of %llu bytes.\n", got, expected);
+    } else {
+        printf("\n[INFO] Response complete (%llu bytes).\n", expected);
+    }
+}
+
 int main() {
     int sock;
     struct sockaddr_in server_addr;
-    char buffer[2048], command[100];
+    char buffer[2048], command[1024];
     int target_port;
     char target_ip[64];
     char username[64], password[64];
@@ -135,63 +172,14 @@ int main() {
             continue;
         }
 
-        // Decide where to connect: STREAM should go straight to storage server
-        // Special handling for STREAM command
-if (strncmp(command, "STREAM", 6) == 0) {
-    // Extract filename
-    char filename[256];
-    sscanf(command + 7, "%s", filename);
-
-    // Step 1: Ask NM for SS IP and port using LOCATE command
-    sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock < 0) {
-        perror("Socket creation failed");
-        continue;
-    }
-
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(NAME_SERVER_PORT);
-    server_addr.sin_addr.s_addr = inet_addr(NAME_SERVER_IP);
-
-    if (connect(sock, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
-        perror("Connection to Name Server failed");
-        close(sock);
-        continue;
-    }
-
-    // Send LOCATE command to get SS location
-    char locate_cmd[512];
-    snprintf(locate_cmd, sizeof(locate_cmd), "LOCATE %s", filename);
-    send(sock, locate_cmd, strlen(locate_cmd), 0);
-
-    // Read response (expecting: SS_IP: ...\nSS_PORT: ...\n or error)
-    char locate_response[512] = "";
-    ssize_t bytes = read(sock, locate_response, sizeof(locate_response) - 1);
-    if (bytes > 0) locate_response[bytes] = '\0';
-    close(sock);
-
-    char ss_ip[64] = "";
-    int ss_port = -1;
-    char *ip_line = strstr(locate_response, "SS_IP:");
-    char *port_line = strstr(locate_response, "SS_PORT:");
-    if (ip_line && port_line) {
-        sscanf(ip_line, "SS_IP: %63s", ss_ip);
-        sscanf(port_line, "SS_PORT: %d", &ss_port);
-    }
-    if (strlen(ss_ip) == 0 || ss_port <= 0) {
-        printf("Error: Could not find storage server for file '%s'\n", filename);
-        printf("%s\n", locate_response);
-        continue;
-    }
-    // Step 2: Connect to the correct storage server
-    target_port = ss_port;
-    strncpy(target_ip, ss_ip, sizeof(target_ip)-1);
-    target_ip[sizeof(target_ip)-1] = '\0';
-} else {
-    target_port = NAME_SERVER_PORT;
-    strncpy(target_ip, NAME_SERVER_IP, sizeof(target_ip)-1);
-    target_ip[sizeof(target_ip)-1] = '\0';
-}
+        // STREAM goes straight to the storage server (and resumes there if cut off)
+        if (strncmp(command, "STREAM", 6) == 0) {
+            client_stream(command, username, password);
+            continue;
+        }
+        target_port = NAME_SERVER_PORT;
+        strncpy(target_ip, NAME_SERVER_IP, sizeof(target_ip)-1);
+        target_ip[sizeof(target_ip)-1] = '\0';
 
         sock = socket(AF_INET, SOCK_STREAM, 0);
         if (sock < 0) {
@@ -216,21 +204,11 @@ if (strncmp(command, "STREAM", 6) == 0) {
         
         send(sock, authenticated_cmd, strlen(authenticated_cmd), 0);
 
-        // If STREAM we read directly from storage server
-        if (strncmp(command, "STREAM", 6) == 0) {
-            printf("\n--- Streaming Content ---\n");
-
-            ssize_t bytes;
-            while ((bytes = read(sock, buffer, sizeof(buffer) - 1)) > 0) {
-                buffer[bytes] = '\0';
-                printf("%s", buffer);
-                fflush(stdout);
-            }
-
-            if (bytes == 0)
-                printf("\n\n[INFO] Stream ended successfully.\n");
-            else
-                printf("\n\n[ERROR] Connection lost while streaming (server may have gone down).\n");
+        if (strncmp(command, "READ ", 5) == 0) {
+            print_read_response(sock);
+        }
+        else if (strncmp(command, "MGET ", 5) == 0 || strncmp(command, "MSTREAM ", 8) == 0) {
+            client_multi(sock, command[1] == 'S');
         }
         else if(strncmp(command, "WRITE", 5) == 0) {
             char filename[256];
@@ -0,0 +1,299 @@
+#include "../../include/common.h"
+#include "../../include/client_stream.h"
+#include "../../include/stream.h"
+
+// Where a framed stream is (see stream.h); pos is the document byte offset received up to
+typedef struct {
+    enum { IN_TEXT, IN_HEAD, IN_BODY } state;
+    char head[STREAM_FRAME_ROOM];
+    size_t head_len;
+    char kind;
+    unsigned long long len, next, got;
+    char *words;            // a W frame is printed once it is complete
+    unsigned long long pos;
+    int have_pos;
+    char version[STREAM_VERSION_MAX];   // of the document being streamed
+    int framed, text;       // frames / plain text seen on this connection
+    int done;
+} Cursor;
+
+static void cursor_frame(Cursor *c) {
+    c->head[c->head_len] = '\0';
+    c->state = IN_TEXT;
+    if (c->head[1] == 'E') {
+        c->done = 1;
+    } else if (c->head[1] == 'V') {
+        char fmt[16];
+        snprintf(fmt, sizeof(fmt), "V %%%ds", STREAM_VERSION_MAX - 1);
+        if (sscanf(c->head + 1, fmt, c->version) != 1) c->version[0] = '\0';
+    } else if (sscanf(c->head + 1, "%c %llu %llu", &c->kind, &c->len, &c->next) == 3 &&
+               (c->kind == 'W' || c->kind == 'B') && c->len <= c->next && c->len > 0) {
+        c->words = c->kind == 'W' ? malloc(c->len) : NULL;
+        if (c->kind == 'B' || c->words) {
+            c->got = 0;
+            c->state = IN_BODY;
+            if (c->kind == 'B') {
+                c->pos = c->next - c->len;
+                c->have_pos = 1;
+            }
+        }
+    }
+    c->framed = 1;
+}
+
+static void cursor_feed(Cursor *c, const char *buf, size_t n) {
+    size_t i = 0;
+    while (i < n) {
+        if (c->state == IN_TEXT) {
+            const char *mark = memchr(buf + i, STREAM_CURSOR_MARK, n - i);
+            size_t upto = mark ? (size_t)(mark - buf) : n;
+            if (upto > i) {
+                fwrite(buf + i, 1, upto - i, stdout);
+                if (!c->framed) c->text = 1;
+            }
+            i = upto;
+            if (mark) {
+                c->state = IN_HEAD;
+                c->head_len = 0;
+            }
+        } else if (c->state == IN_HEAD) {
+            c->head[c->head_len++] = buf[i++];
+            if (c->head[c->head_len - 1] == '\n' || c->head_len == sizeof(c->head) - 1) cursor_frame(c);
+        } else {
+            size_t take = n - i < c->len - c->got ? n - i : (size_t)(c->len - c->got);
+            if (c->words) {
+                memcpy(c->words + c->got, buf + i, take);
+            } else {
+                fwrite(buf + i, 1, take, stdout);
+                c->pos += take;
+            }
+            c->got += take;
+            i += take;
+            if (c->got == c->len) {
+                if (c->words) {
+                    fwrite(c->words, 1, c->len, stdout);
+                    free(c->words);
+                    c->words = NULL;
+                }
+                c->pos = c->next;
+                c->have_pos = 1;
+                c->state = IN_TEXT;
+            }
+        }
+    }
+    fflush(stdout);
+}
+
+// Ask the name server which storage server holds filename; its reply is printed if not found
+static int locate(const char *filename, char *ip, size_t ip_sz, int *port) {
+    char response[512] = "";
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) return -1;
+    struct sockaddr_in addr;
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(NAME_SERVER_PORT);
+    addr.sin_addr.s_addr = inet_addr(NAME_SERVER_IP);
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("Connection to Name Server failed");
+        close(sock);
+        return -1;
+    }
+    char locate_cmd[512];
+    snprintf(locate_cmd, sizeof(locate_cmd), "LOCATE %s", filename);
+    send(sock, locate_cmd, strlen(locate_cmd), 0);
+    ssize_t bytes = read(sock, response, sizeof(response) - 1);
+    if (bytes > 0) response[bytes] = '\0';
+    close(sock);
+
+    char *ip_line = strstr(response, "SS_IP:");
+    char *port_line = strstr(response, "SS_PORT:");
+    char fmt[32];
+    snprintf(fmt, sizeof(fmt), "SS_IP: %%%zus", ip_sz - 1);
+    *port = -1;
+    if (!ip_line || !port_line || sscanf(ip_line, fmt, ip) != 1 ||
+        sscanf(port_line, "SS_PORT: %d", port) != 1 || *port <= 0) {
+        printf("Error: Could not find storage server for file '%s'\n", filename);
+        printf("%s\n", response);
+        return -1;
+    }
+    return 0;
+}
+
+void client_stream(const char *command, const char *username, const char *password) {
+    char filename[256] = "", opt[4][24], rate[32] = "";
+    int fields = sscanf(command + 6, "%255s %23s %23s %23s %23s", filename, opt[0], opt[1], opt[2], opt[3]);
+    if (fields < 1) {
+        printf("Error: Please specify a filename\n");
+        return;
+    }
+    // A resumed stream keeps the pace it was asked for
+    for (int i = 0; i + 1 < fields - 1; i += 2) {
+        if (strcmp(opt[i], "RATE") == 0) snprintf(rate, sizeof(rate), " RATE %s", opt[i + 1]);
+    }
+
+    printf("\n--- Streaming Content ---\n");
+    Cursor c;
+    memset(&c, 0, sizeof(c));
+    int failures = 0;
+    while (1) {
+        char ip[64];
+        int port, sock = -1;
+        int located = locate(filename, ip, sizeof(ip), &port) == 0;
+        if (!located && !c.have_pos) return;
+        if (located && (sock = socket(AF_INET, SOCK_STREAM, 0)) >= 0) {
+            struct sockaddr_in addr;
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(port);
+            addr.sin_addr.s_addr = inet_addr(ip);
+            if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+                close(sock);
+                sock = -1;
+            }
+        }
+
+        unsigned long long before = c.pos;
+        if (sock >= 0) {
+            char cmd[512], resume[STREAM_VERSION_MAX + 8] = "", request[1024];
+            if (c.have_pos) snprintf(cmd, sizeof(cmd), "STREAM %s BYTE %llu%s", filename, c.pos, rate);
+            else snprintf(cmd, sizeof(cmd), "%s", command);
+            // The server refuses the resume if the document is no longer the version begun
+            if (c.have_pos && c.version[0]) snprintf(resume, sizeof(resume), "RESUME:%s\n", c.version);
+            snprintf(request, sizeof(request), "USER:%s\nPASS:%s\nCURSOR:1\n%sCMD:%s\n", username, password, resume, cmd);
+            send(sock, request, strlen(request), 0);
+
+            char buffer[4096];
+            ssize_t bytes;
+            c.state = IN_TEXT;
+            c.framed = c.text = 0;
+            while ((bytes = read(sock, buffer, sizeof(buffer))) > 0) {
+                cursor_feed(&c, buffer, (size_t)bytes);
+            }
+            free(c.words);
+            c.words = NULL;
+            close(sock);
+        }
+
+        if (c.done) {
+            printf("\n[INFO] Stream ended successfully.\n");
+            return;
+        }
+        if (c.text && !c.framed) return;        // an error reply, already shown
+        if (c.pos != before) failures = 0;
+        if (++failures > STREAM_RESUME_TRIES) {
+            printf("\n\n[ERROR] Connection lost while streaming (server may have gone down).\n");
+            return;
+        }
+        printf("\n[INFO] Connection lost at byte %llu; reconnecting (%d/%d)...\n", c.pos, failures,
+               STREAM_RESUME_TRIES);
+        sleep(1);
+    }
+}
+
+// Buffered reads of a framed MGET / MSTREAM reply
+typedef struct {
+    int sock;
+    char buf[4096];
+    size_t len, pos;
+} Reader;
+
+static int reader_fill(Reader *r) {
+    if (r->pos < r->len) return 1;
+    ssize_t n = read(r->sock, r->buf, sizeof(r->buf));
+    if (n <= 0) return 0;
+    r->len = (size_t)n;
+    r->pos = 0;
+    return 1;
+}
+
+// One line without its newline; 0 at the end of the reply
+static int reader_line(Reader *r, char *line, size_t sz) {
+    size_t n = 0;
+    int got = 0;
+    while (reader_fill(r)) {
+        char c = r->buf[r->pos++];
+        got = 1;
+        if (c == '\n') break;
+        if (n + 1 < sz) line[n++] = c;
+    }
+    line[n] = '\0';
+    return got;
+}
+
+static int reader_exact(Reader *r, char *out, size_t len) {
+    while (len > 0 && reader_fill(r)) {
+        size_t take = r->len - r->pos < len ? r->len - r->pos : len;
+        memcpy(out, r->buf + r->pos, take);
+        r->pos += take;
+        out += take;
+        len -= take;
+    }
+    return len == 0;
+}
+
+void client_multi(int sock, int mstream) {
+    typedef struct {
+        char name[256];
+        char *data;
+        size_t len;
+    } Doc;
+    Doc docs[MULTI_MAX_FILES];
+    int ndocs = 0, ok = 0, failed = 0;
+    Reader r = {sock, {0}, 0, 0};
+    char line[1024], name[256];
+    unsigned long long n;
+
+    printf("\n--- Server Response ---\n");
+    while (reader_line(&r, line, sizeof(line))) {
+        if (sscanf(line, "FILE %255s %llu", name, &n) == 2 && n <= MULTI_PIECE_MAX) {
+            char *body = malloc(n + 1);
+            if (!body || !reader_exact(&r, body, (size_t)n)) {
+                free(body);
+                printf("\n[ERROR] Connection lost in the middle of '%s'.\n", name);
+                break;
+            }
+            if (mstream) {
+                printf("[%s] %.*s\n", name, (int)n, body);
+                fflush(stdout);
+                free(body);
+                continue;
+            }
+            // MGET: a document is shown whole once its last piece is in
+            int i = 0;
+            while (i < ndocs && strcmp(docs[i].name, name) != 0) i++;
+            if (i == ndocs && ndocs < MULTI_MAX_FILES) {
+                snprintf(docs[ndocs].name, sizeof(docs[ndocs].name), "%s", name);
+                docs[ndocs].data = NULL;
+                docs[ndocs++].len = 0;
+            }
+            char *grown = i < ndocs ? realloc(docs[i].data, docs[i].len + n) : NULL;
+            if (grown) {
+                memcpy(grown + docs[i].len, body, (size_t)n);
+                docs[i].data = grown;
+                docs[i].len += (size_t)n;
+            }
+            free(body);
+        } else if (sscanf(line, "DONE %255s", name) == 1) {
+            ok++;
+            if (mstream) {
+                printf("[%s] --- End of Stream ---\n", name);
+                continue;
+            }
+            int i = 0;
+            while (i < ndocs && strcmp(docs[i].name, name) != 0) i++;
+            printf("===== %s (%zu bytes) =====\n", name, i < ndocs ? docs[i].len : (size_t)0);
+            if (i < ndocs) {
+                fwrite(docs[i].data, 1, docs[i].len, stdout);
+                printf("\n");
+                free(docs[i].data);
+                docs[i] = docs[--ndocs];
+            }
+        } else if (strncmp(line, "ERROR ", 6) == 0 && sscanf(line, "ERROR %255s", name) == 1) {
+            failed++;
+            printf(mstream ? "[%s] ERROR: %s\n" : "===== %s: ERROR: %s =====\n", name, line + 7 + strlen(name));
+        } else {
+            printf("%s\n", line);
+        }
+    }
+    for (int i = 0; i < ndocs; ++i) free(docs[i].data);
+    printf("\n[INFO] %d document(s) received, %d failed.\n", ok, failed);
+}
@@ -1,11 +1,33 @@
 #include "../../include/common.h"
 #include "../../include/write.h"
+#include <pthread.h>
 
-void client_write(int sock, const char *filename, int sentence_num) {
-    char cmd[256];
-    sprintf(cmd, "WRITE %s %d", filename, sentence_num);
-    send(sock, cmd, strlen(cmd), 0);
+// Keeps the sentence lock's lease alive while the user is typing: sends "RENEW" (which
+// the storage server does not answer) every third of the lease
+typedef struct {
+    int sock;
+    int stop;
+    pthread_mutex_t mu;     // also serialises sends on sock
+    pthread_cond_t cv;
+} Heartbeat;
+
+static void *heartbeat_main(void *arg) {
+    Heartbeat *hb = (Heartbeat *)arg;
+    pthread_mutex_lock(&hb->mu);
+    while (!hb->stop) {
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_sec += WRITE_LOCK_LEASE / 3;
+        if (pthread_cond_timedwait(&hb->cv, &hb->mu, &until) != 0 && !hb->stop) {
+            send(hb->sock, "RENEW\n", 6, MSG_NOSIGNAL);
+        }
+    }
+    pthread_mutex_unlock(&hb->mu);
+    return NULL;
+}
 
+void client_write(int sock, const char *filename, int sentence_num) {
+    // The WRITE command itself went out with the credentials; wait for the lock reply
     char buf[1024];
     memset(buf, 0, sizeof(buf));
     ssize_t r = recv(sock, buf, sizeof(buf) - 1, 0);
@@ -13,16 +35,23 @@ void client_write(int sock, const char *filename, int sentence_num) {
         buf[r] = '\0';
         printf("%s", buf); // prints the "locked + instructions"
     }
+    if (r <= 0 || strncmp(buf, "ERROR", 5) == 0) return;
+
+    Heartbeat hb = {sock, 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER};
+    pthread_t hb_thread;
+    int hb_running = pthread_create(&hb_thread, NULL, heartbeat_main, &hb) == 0;
 
     while (1) {
         char input[512];
         printf("> "); // prompt for user
         fflush(stdout);
-        
+
         if (!fgets(input, sizeof(input), stdin)) break;
-        
+
         // Send input to server
+        pthread_mutex_lock(&hb.mu);
         send(sock, input, strlen(input), 0);
+        pthread_mutex_unlock(&hb.mu);
 
         // Receive response
         memset(buf, 0, sizeof(buf));
@@ -38,4 +67,12 @@ void client_write(int sock, const char *filename, int sentence_num) {
         if (strncmp(input, "ETIRW", 5) == 0)
             break;
     }
+
+    if (hb_running) {
+        pthread_mutex_lock(&hb.mu);
+        hb.stop = 1;
+        pthread_cond_signal(&hb.cv);
+        pthread_mutex_unlock(&hb.mu);
+        pthread_join(hb_thread, NULL);
+    }
 }
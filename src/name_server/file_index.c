@@ -12,6 +12,10 @@ unsigned long hash_filename(const char *str) {
 void file_index_init(FileIndex *index, size_t num_buckets) {
     index->buckets = calloc(num_buckets, sizeof(FileMeta*));
     index->num_buckets = num_buckets;
+    memset(index->head, 0, sizeof(index->head));
+    index->level = 1;
+    index->count = 0;
+    index->rng = 0x2545F4914F6CDD1DUL;
 }
 
 void file_index_free(FileIndex *index) {
@@ -24,6 +28,8 @@ void file_index_free(FileIndex *index) {
         }
     }
     free(index->buckets);
+    memset(index->head, 0, sizeof(index->head));
+    index->count = 0;
 }
 
 FileMeta *file_index_get(FileIndex *index, const char *name) {
@@ -36,6 +42,63 @@ FileMeta *file_index_get(FileIndex *index, const char *name) {
     return NULL;
 }
 
+// --- Ordered name index (skip list) ---
+
+static int random_level(FileIndex *index) {
+    int level = 1;
+    // xorshift64; two bits per level gives p = 1/4
+    unsigned long x = index->rng;
+    x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+    index->rng = x;
+    while (level < FILE_INDEX_MAX_LEVEL && (x & 3) == 0) {
+        level++;
+        x >>= 2;
+    }
+    return level;
+}
+
+// Fill update[] with the last node before `name` at every level (NULL = list head)
+static void skip_find(FileIndex *index, const char *name, FileMeta **update) {
+    FileMeta *x = NULL;
+    for (int lvl = index->level - 1; lvl >= 0; --lvl) {
+        FileMeta *nxt = x ? x->skip[lvl] : index->head[lvl];
+        while (nxt && strcmp(nxt->name, name) < 0) {
+            x = nxt;
+            nxt = x->skip[lvl];
+        }
+        update[lvl] = x;
+    }
+}
+
+static void skip_link(FileIndex *index, FileMeta *meta) {
+    FileMeta *update[FILE_INDEX_MAX_LEVEL];
+    skip_find(index, meta->name, update);
+    int lvl = random_level(index);
+    if (lvl > index->level) {
+        for (int i = index->level; i < lvl; ++i) update[i] = NULL;
+        index->level = lvl;
+    }
+    meta->skip_level = lvl;
+    for (int i = 0; i < lvl; ++i) {
+        FileMeta **slot = update[i] ? &update[i]->skip[i] : &index->head[i];
+        meta->skip[i] = *slot;
+        *slot = meta;
+    }
+    for (int i = lvl; i < FILE_INDEX_MAX_LEVEL; ++i) meta->skip[i] = NULL;
+    index->count++;
+}
+
+static void skip_unlink(FileIndex *index, FileMeta *meta) {
+    FileMeta *update[FILE_INDEX_MAX_LEVEL];
+    skip_find(index, meta->name, update);
+    for (int i = 0; i < meta->skip_level; ++i) {
+        FileMeta **slot = update[i] ? &update[i]->skip[i] : &index->head[i];
+        if (*slot == meta) *slot = meta->skip[i];
+    }
+    while (index->level > 1 && index->head[index->level - 1] == NULL) index->level--;
+    index->count--;
+}
+
 void file_index_put(FileIndex *index, const char *name, int ss_id) {
     unsigned long h = hash_filename(name) % index->num_buckets;
     FileMeta *cur = index->buckets[h];
@@ -55,6 +118,30 @@ void file_index_put(FileIndex *index, const char *name, int ss_id) {
     meta->ss_ids[meta->ss_count++] = ss_id;
     meta->next = index->buckets[h];
     index->buckets[h] = meta;
+    skip_link(index, meta);
+}
+
+void file_index_insert(FileIndex *index, FileMeta *meta) {
+    file_index_delete(index, meta->name);
+    unsigned long h = hash_filename(meta->name) % index->num_buckets;
+    meta->next = index->buckets[h];
+    index->buckets[h] = meta;
+    skip_link(index, meta);
+}
+
+void file_index_delete(FileIndex *index, const char *name) {
+    unsigned long h = hash_filename(name) % index->num_buckets;
+    FileMeta **cur = &index->buckets[h];
+    while (*cur) {
+        if (strcmp((*cur)->name, name) == 0) {
+            FileMeta *to_free = *cur;
+            *cur = to_free->next;
+            skip_unlink(index, to_free);
+            free(to_free);
+            return;
+        }
+        cur = &(*cur)->next;
+    }
 }
 
 void file_index_remove(FileIndex *index, const char *name, int ss_id) {
@@ -72,6 +159,7 @@ void file_index_remove(FileIndex *index, const char *name, int ss_id) {
                 // Remove entry
                 FileMeta *to_free = *cur;
                 *cur = (*cur)->next;
+                skip_unlink(index, to_free);
                 free(to_free);
             }
             return;
@@ -80,12 +168,52 @@ void file_index_remove(FileIndex *index, const char *name, int ss_id) {
     }
 }
 
+// Iterates in name order
 void file_index_iter(FileIndex *index, void (*cb)(FileMeta *, void *), void *user) {
-    for (size_t i = 0; i < index->num_buckets; ++i) {
-        FileMeta *cur = index->buckets[i];
-        while (cur) {
-            cb(cur, user);
-            cur = cur->next;
-        }
+    FileMeta *cur = index->head[0];
+    while (cur) {
+        FileMeta *next = cur->skip[0];
+        cb(cur, user);
+        cur = next;
     }
 }
+
+FileMeta *file_index_seek(FileIndex *index, const char *key) {
+    if (!key) return index->head[0];
+    FileMeta *update[FILE_INDEX_MAX_LEVEL];
+    skip_find(index, key, update);
+    return update[0] ? update[0]->skip[0] : index->head[0];
+}
+
+FileMeta *file_index_next(FileMeta *meta) {
+    return meta ? meta->skip[0] : NULL;
+}
+
+size_t file_index_range(FileIndex *index, const char *lo, const char *hi, size_t limit,
+                        void (*cb)(FileMeta *, void *), void *user) {
+    size_t visited = 0;
+    FileMeta *cur = file_index_seek(index, lo);
+    while (cur && (!hi || strcmp(cur->name, hi) < 0) && (limit == 0 || visited < limit)) {
+        FileMeta *next = cur->skip[0];
+        cb(cur, user);
+        visited++;
+        cur = next;
+    }
+    return visited;
+}
+
+size_t file_index_prefix(FileIndex *index, const char *prefix, size_t limit,
+                         void (*cb)(FileMeta *, void *), void *user) {
+    size_t plen = strlen(prefix);
+    if (plen == 0) return file_index_range(index, NULL, NULL, limit, cb, user);
+
+    // Upper bound: prefix with its last byte incremented (dropping trailing 0xFF bytes)
+    char hi[256];
+    if (plen >= sizeof(hi)) plen = sizeof(hi) - 1;
+    memcpy(hi, prefix, plen);
+    while (plen > 0 && (unsigned char)hi[plen - 1] == 0xFF) plen--;
+    if (plen == 0) return file_index_range(index, prefix, NULL, limit, cb, user);
+    hi[plen - 1] = (char)((unsigned char)hi[plen - 1] + 1);
+    hi[plen] = '\0';
+    return file_index_range(index, prefix, hi, limit, cb, user);
+}
@@ -3,12 +3,17 @@
 
 #include "../../include/list.h"
 #include "../../include/file_index.h"
+#include "../../include/search.h"
 
 #include <netinet/in.h>
 #include <errno.h>
 #include <signal.h>
 #include <sys/wait.h>
 #include <sys/select.h>
+#include <fnmatch.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <math.h>
 
 // Storage server registry (kept in parent process)
 #define MAX_SS 32
@@ -27,103 +32,132 @@ static int num_storage_servers = 0;
 
 
 static FileIndex file_index;
-void refresh_filemeta_from_storage(const char *filename, int ss_id) {
-    StorageServerInfo *ssi = NULL;
-    for (int i = 0; i < num_storage_servers; ++i) {
-        if (storage_servers[i].id == ss_id) {
-            ssi = &storage_servers[i];
-            break;
-        }
+
+// Metadata deltas: forked children strip the SS metadata trailer from READ/WRITE/UNDO/REDO/REVERT
+// responses and hand it to the parent over this pipe; the parent applies them before it
+// serves the next request. Each record is smaller than PIPE_BUF, so writes are atomic.
+typedef struct {
+    char name[256];
+    long version;
+    long long size;
+    time_t last_modified;
+    time_t last_accessed;
+} MetaDelta;
+
+static int meta_pipe[2] = {-1, -1};
+
+static void apply_meta_delta(const MetaDelta *d) {
+    FileMeta *meta = file_index_get(&file_index, d->name);
+    if (!meta) return;
+    meta->version = d->version;
+    meta->size = d->size;
+    meta->last_modified = d->last_modified;
+    meta->last_accessed = d->last_accessed;
+    log_event(LOG_DEBUG, "[SYNC] Applied metadata delta for '%s' (version %ld, %lld bytes)", d->name, d->version, d->size);
+}
+
+static void drain_meta_deltas(void) {
+    MetaDelta d;
+    while (read(meta_pipe[0], &d, sizeof(d)) == (ssize_t)sizeof(d)) {
+        d.name[sizeof(d.name) - 1] = '\0';
+        apply_meta_delta(&d);
     }
-    if (!ssi) return;
-    int ss_sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (ss_sock < 0) return;
-    struct sockaddr_in sa;
-    sa.sin_family = AF_INET;
-    sa.sin_port = htons(ssi->client_port);
-    sa.sin_addr.s_addr = inet_addr(ssi->ip);
-    struct timeval tv; tv.tv_sec = 1; tv.tv_usec = 0;
-    setsockopt(ss_sock, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof tv);
-    setsockopt(ss_sock, SOL_SOCKET, SO_SNDTIMEO, (const char*)&tv, sizeof tv);
-    if (connect(ss_sock, (struct sockaddr*)&sa, sizeof(sa)) != 0) {
-        close(ss_sock);
-        return;
+}
+
+static void send_all(int sock, const char *buf, size_t len) {
+    size_t sent = 0;
+    while (sent < len) {
+        ssize_t s = send(sock, buf + sent, len - sent, 0);
+        if (s <= 0) return;
+        sent += s;
     }
-    char info_cmd[512];
-    snprintf(info_cmd, sizeof(info_cmd), "USER:admin\nPASS:admin123\nCMD:INFO %s\n", filename);
-    send(ss_sock, info_cmd, strlen(info_cmd), 0);
-    char info_buf[2048] = {0};
-    ssize_t n = recv(ss_sock, info_buf, sizeof(info_buf)-1, 0);
-    if (n > 0) {
-        info_buf[n] = '\0';
-        log_event(LOG_DEBUG, "INFO response from SS %d received (%zd bytes)", ss_id, n);
-        FileMeta meta = {0};
-        strncpy(meta.name, filename, sizeof(meta.name)-1);
-        meta.ss_ids[0] = ss_id;
-        meta.ss_count = 1;
-        // Parse fields from info_buf (simple parsing)
-        char *p = strstr(info_buf, "Owner          : ");
-        if (p) sscanf(p, "Owner          : %63[^\n]", meta.owner);
-        p = strstr(info_buf, "Created        : ");
-        if (p) {
-            char tbuf[64];
-            if (sscanf(p, "Created        : %63[^\n]", tbuf) == 1) {
-                struct tm tm; if (strptime(tbuf, "%Y-%m-%d %H:%M:%S", &tm)) meta.created_time = mktime(&tm);
-            }
+}
+
+// Relays storage server output to the client while holding back anything that could be
+// the metadata trailer (from a META_TRAILER_MARK byte onward) until the stream ends.
+typedef struct {
+    char hold[META_TRAILER_MAX];
+    size_t held;
+} MetaTrailer;
+
+static void trailer_relay(MetaTrailer *tr, int out_sock, const char *buf, size_t n) {
+    size_t i = 0;
+    while (i < n) {
+        if (tr->held == 0) {
+            const char *mark = memchr(buf + i, META_TRAILER_MARK, n - i);
+            size_t upto = mark ? (size_t)(mark - buf) : n;
+            if (upto > i) send_all(out_sock, buf + i, upto - i);
+            i = upto;
+            if (!mark) break;
         }
-        p = strstr(info_buf, "Last Modified  : ");
-        if (p) {
-            char tbuf[64];
-            if (sscanf(p, "Last Modified  : %63[^\n]", tbuf) == 1) {
-                struct tm tm; if (strptime(tbuf, "%Y-%m-%d %H:%M:%S", &tm)) meta.last_modified = mktime(&tm);
-            }
+        if (tr->held == sizeof(tr->hold)) {
+            // Too long to be a trailer: release it up to the next mark, if any
+            char *next = memchr(tr->hold + 1, META_TRAILER_MARK, tr->held - 1);
+            size_t cut = next ? (size_t)(next - tr->hold) : tr->held;
+            send_all(out_sock, tr->hold, cut);
+            memmove(tr->hold, tr->hold + cut, tr->held - cut);
+            tr->held -= cut;
+            if (tr->held == 0) continue;
         }
-        p = strstr(info_buf, "Last Access    : ");
-        if (p) {
-            char tbuf[64];
-            if (sscanf(p, "Last Access    : %63[^\n]", tbuf) == 1) {
-                struct tm tm; if (strptime(tbuf, "%Y-%m-%d %H:%M:%S", &tm)) meta.last_accessed = mktime(&tm);
-            }
+        tr->hold[tr->held++] = buf[i++];
+    }
+}
+
+// Called once the storage server closed; forwards the delta to the parent if a trailer was found
+static void trailer_finish(MetaTrailer *tr, int out_sock, const char *filename) {
+    if (tr->held == 0) return;
+    char text[META_TRAILER_MAX + 1];
+    memcpy(text, tr->hold, tr->held);
+    text[tr->held] = '\0';
+    MetaDelta d;
+    memset(&d, 0, sizeof(d));
+    long mtime = 0, atime = 0;
+    if (text[0] == META_TRAILER_MARK && text[tr->held - 1] == '\n' &&
+        sscanf(text + 1, "META %ld %lld %ld %ld", &d.version, &d.size, &mtime, &atime) == 4) {
+        strncpy(d.name, filename, sizeof(d.name) - 1);
+        d.last_modified = (time_t)mtime;
+        d.last_accessed = (time_t)atime;
+        if (write(meta_pipe[1], &d, sizeof(d)) != (ssize_t)sizeof(d)) {
+            log_event(LOG_WARN, "Could not queue metadata delta for '%s'", filename);
         }
-        p = strstr(info_buf, "Read Access    : ");
-        if (p) sscanf(p, "Read Access    : %511[^\n]", meta.read_users);
-        p = strstr(info_buf, "Write Access   : ");
-        if (p) sscanf(p, "Write Access   : %511[^\n]", meta.write_users);
-        // Insert or update in hashmap
-        FileMeta *existing = file_index_get(&file_index, meta.name);
-        if (!existing) {
-            log_event(LOG_DEBUG, "Adding new file '%s' to hashmap from SS %d", meta.name, ss_id);
-            FileMeta *newmeta = malloc(sizeof(FileMeta));
-            *newmeta = meta;
-            unsigned long h = hash_filename(meta.name) % file_index.num_buckets;
-            newmeta->next = file_index.buckets[h];
-            file_index.buckets[h] = newmeta;
-        } else {
-            log_event(LOG_DEBUG, "Updating file '%s' metadata in hashmap (last_modified: %ld -> %ld, last_accessed: %ld -> %ld)", 
-                      meta.name, existing->last_modified, meta.last_modified, existing->last_accessed, meta.last_accessed);
-            // Update fields but preserve next pointer and ss_ids list
-            FileMeta *preserve_next = existing->next;
-            int preserve_ss_ids[MAX_SS];
-            int preserve_ss_count = existing->ss_count;
-            memcpy(preserve_ss_ids, existing->ss_ids, sizeof(existing->ss_ids));
-            
-            // Update metadata fields
-            strncpy(existing->owner, meta.owner, sizeof(existing->owner) - 1);
-            existing->created_time = meta.created_time;
-            existing->last_modified = meta.last_modified;
-            existing->last_accessed = meta.last_accessed;
-            strncpy(existing->read_users, meta.read_users, sizeof(existing->read_users) - 1);
-            strncpy(existing->write_users, meta.write_users, sizeof(existing->write_users) - 1);
-            
-            // Restore preserved fields
-            existing->next = preserve_next;
-            memcpy(existing->ss_ids, preserve_ss_ids, sizeof(existing->ss_ids));
-            existing->ss_count = preserve_ss_count;
+    } else {
+        send_all(out_sock, tr->hold, tr->held);
+    }
+    tr->held = 0;
+}
+
+// READ replies: the length header is passed on, then the announced body unscanned (a
+// document may contain the trailer mark itself), then whatever follows through the trailer
+// filter. A reply without the header (an error line) goes through the filter whole.
+static void relay_read(int storage_sock, int client_sock, MetaTrailer *tr) {
+    char relay[4096], head[64];
+    size_t head_len = 0;
+    int in_head = 1;
+    unsigned long long body = 0;
+    ssize_t rcv;
+    while ((rcv = recv(storage_sock, relay, sizeof(relay), 0)) > 0) {
+        size_t i = 0, n = (size_t)rcv;
+        while (in_head && i < n) {
+            head[head_len++] = relay[i++];
+            if (head[head_len - 1] != '\n' && head_len < sizeof(head) - 1) continue;
+            head[head_len] = '\0';
+            in_head = 0;
+            if (sscanf(head, READ_LENGTH_HEADER "%llu", &body) == 1) {
+                send_all(client_sock, head, head_len);
+            } else {
+                body = 0;
+                trailer_relay(tr, client_sock, head, head_len);
+            }
         }
-        log_event(LOG_INFO, "[SYNC] Refreshed metadata for '%s' from SS %d", filename, ss_id);
+        size_t take = n - i < body ? n - i : (size_t)body;
+        send_all(client_sock, relay + i, take);
+        body -= take;
+        i += take;
+        if (i < n) trailer_relay(tr, client_sock, relay + i, n - i);
     }
-    close(ss_sock);
+    if (in_head) trailer_relay(tr, client_sock, head, head_len);
 }
+
 // Update file index from a storage server by sending VIEW and parsing the result
 void update_file_index_from_ss(const char *ip, int client_port, int ss_id) {
     int ss_sock = socket(AF_INET, SOCK_STREAM, 0);
@@ -210,9 +244,7 @@ void update_file_index_from_ss(const char *ip, int client_port, int ss_id) {
                         if (!existing) {
                             FileMeta *newmeta = malloc(sizeof(FileMeta));
                             *newmeta = meta;
-                            unsigned long h = hash_filename(meta.name) % file_index.num_buckets;
-                            newmeta->next = file_index.buckets[h];
-                            file_index.buckets[h] = newmeta;
+                            file_index_insert(&file_index, newmeta);
                         } else {
                             // Update ss_ids if needed
                             int found = 0;
@@ -307,8 +339,9 @@ void sigchld_handler(int s) {
     while (waitpid(-1, NULL, WNOHANG) > 0) {}
 }
 
-// Proxy data between two sockets bidirectionally until both sides close
-void proxy_bidirectional(int a_sock, int b_sock) {
+// Proxy data between two sockets bidirectionally until both sides close.
+// If filter is set, data from b to a goes through it (metadata trailer stripping).
+void proxy_bidirectional(int a_sock, int b_sock, MetaTrailer *filter, const char *filename) {
     fd_set read_fds;
     int maxfd = (a_sock > b_sock) ? a_sock : b_sock;
     char buf[4096];
@@ -344,8 +377,11 @@ void proxy_bidirectional(int a_sock, int b_sock) {
         if (b_open && FD_ISSET(b_sock, &read_fds)) {
             ssize_t n = recv(b_sock, buf, sizeof(buf), 0);
             if (n <= 0) {
+                if (filter) trailer_finish(filter, a_sock, filename);
                 shutdown(a_sock, SHUT_WR);
                 b_open = 0;
+            } else if (filter) {
+                trailer_relay(filter, a_sock, buf, (size_t)n);
             } else {
                 ssize_t sent = 0;
                 while (sent < n) {
@@ -372,6 +408,411 @@ static void log_req(const char *level, const char *op,
       extra ? extra : "");
 }
 
+// VIEW <pattern>: listing served from the ordered name index. Its long form shows what the
+// index holds (owner, times, SS), not the SS long view: word / char counts stay on the SS.
+typedef struct {
+    const char *pattern;
+    int show_all;
+    int show_long;
+    char *out;
+    size_t len;
+    size_t cap;
+    int count;
+} ViewListing;
+
+static void view_listing_cb(FileMeta *meta, void *user) {
+    ViewListing *vl = (ViewListing *)user;
+    if (!vl->show_all && meta->name[0] == '.') return;
+    if (fnmatch(vl->pattern, meta->name, 0) != 0) return;
+
+    char line[512];
+    if (vl->show_long) {
+        char mod_buf[32] = "-", access_buf[32] = "-";
+        if (meta->last_modified > 0) strftime(mod_buf, sizeof(mod_buf), "%Y-%m-%d %H:%M", localtime(&meta->last_modified));
+        if (meta->last_accessed > 0) strftime(access_buf, sizeof(access_buf), "%Y-%m-%d %H:%M", localtime(&meta->last_accessed));
+        snprintf(line, sizeof(line), "%-24s %-12s %-17s %-17s %d\n",
+                 meta->name, meta->owner[0] ? meta->owner : "unknown", mod_buf, access_buf,
+                 meta->ss_count > 0 ? meta->ss_ids[0] : -1);
+    } else {
+        snprintf(line, sizeof(line), "%s\n", meta->name);
+    }
+    size_t l = strlen(line);
+    if (vl->len + l + 1 > vl->cap) {
+        size_t newcap = vl->cap ? vl->cap * 2 : 4096;
+        while (newcap < vl->len + l + 1) newcap *= 2;
+        char *nb = realloc(vl->out, newcap);
+        if (!nb) return;
+        vl->out = nb;
+        vl->cap = newcap;
+    }
+    memcpy(vl->out + vl->len, line, l + 1);
+    vl->len += l;
+    vl->count++;
+}
+
+// Returns 1 if the VIEW arguments carry a name pattern (and the request was answered here)
+static int handle_view_pattern(int client_sock, const char *args) {
+    char argbuf[1024];
+    strncpy(argbuf, args, sizeof(argbuf) - 1);
+    argbuf[sizeof(argbuf) - 1] = '\0';
+
+    ViewListing vl = {0};
+    char *saveptr = NULL;
+    for (char *tok = strtok_r(argbuf, " \t", &saveptr); tok; tok = strtok_r(NULL, " \t", &saveptr)) {
+        if (tok[0] == '-') {
+            if (strchr(tok, 'a')) vl.show_all = 1;
+            if (strchr(tok, 'l')) vl.show_long = 1;
+        } else if (!vl.pattern) {
+            vl.pattern = tok;
+        }
+    }
+    if (!vl.pattern) return 0;
+
+    // Everything before the first glob metacharacter is a literal prefix: seek to it,
+    // then walk the index in order until names stop sharing that prefix.
+    char prefix[256];
+    size_t plen = strcspn(vl.pattern, "*?[\\");
+    if (plen >= sizeof(prefix)) plen = sizeof(prefix) - 1;
+    memcpy(prefix, vl.pattern, plen);
+    prefix[plen] = '\0';
+
+    if (vl.show_long) {
+        char hdr[256];
+        snprintf(hdr, sizeof(hdr), "%-24s %-12s %-17s %-17s %s\n", "Name", "Owner", "Modified", "Last Access", "SS");
+        send(client_sock, hdr, strlen(hdr), 0);
+    }
+    file_index_prefix(&file_index, prefix, 0, view_listing_cb, &vl);
+    if (vl.count > 0) {
+        send(client_sock, vl.out, vl.len, 0);
+    } else {
+        const char *msg = "(no files match pattern)\n";
+        send(client_sock, msg, strlen(msg), 0);
+    }
+    free(vl.out);
+    return 1;
+}
+
+// SEARCH <terms>: query every active storage server in parallel. Each reports its document
+// count and per-term document frequencies ("DF ...") and, per match, the matching sentence
+// count of each term; results are ranked by tf-idf over the totals of all servers.
+typedef struct {
+    double score;
+    char file[256];
+    char sentences[512];
+    int ss_id;
+    int ntf;                    // -1: no per-term counts, score is the server's own
+    long tf[SEARCH_MAX_TERMS];
+} SearchResult;
+
+static int search_result_cmp(const void *a, const void *b) {
+    const SearchResult *ra = a, *rb = b;
+    if (ra->score != rb->score) return ra->score < rb->score ? 1 : -1;
+    return strcmp(ra->file, rb->file);
+}
+
+static void handle_search(int client_sock, const char *cmd, const char *username, const char *password) {
+    struct pollfd pfds[MAX_SS];
+    char *bufs[MAX_SS] = {0};
+    size_t lens[MAX_SS] = {0}, caps[MAX_SS] = {0};
+    int ids[MAX_SS];
+    int nsock = 0;
+
+    char auth_cmd[8192];
+    snprintf(auth_cmd, sizeof(auth_cmd), "USER:%s\nPASS:%s\nCMD:%s\n", username, password, cmd);
+    for (int i = 0; i < num_storage_servers; ++i) {
+        if (!storage_servers[i].active) continue;
+        int s = socket(AF_INET, SOCK_STREAM, 0);
+        if (s < 0) continue;
+        struct timeval tv; tv.tv_sec = 1; tv.tv_usec = 0;
+        setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, (const char*)&tv, sizeof tv);
+        struct sockaddr_in sa_ss; sa_ss.sin_family = AF_INET; sa_ss.sin_port = htons(storage_servers[i].client_port); sa_ss.sin_addr.s_addr = inet_addr(storage_servers[i].ip);
+        if (connect(s, (struct sockaddr*)&sa_ss, sizeof(sa_ss)) < 0 || send(s, auth_cmd, strlen(auth_cmd), 0) <= 0) {
+            log_event(LOG_WARN, "SEARCH: storage server %d unreachable", storage_servers[i].id);
+            close(s);
+            continue;
+        }
+        pfds[nsock].fd = s;
+        pfds[nsock].events = POLLIN;
+        ids[nsock] = storage_servers[i].id;
+        nsock++;
+    }
+
+    // Collect all responses as they arrive
+    int open_count = nsock;
+    while (open_count > 0) {
+        int rc = poll(pfds, nsock, 5000);
+        if (rc < 0 && errno == EINTR) continue;
+        if (rc <= 0) break;
+        for (int i = 0; i < nsock; ++i) {
+            if (pfds[i].fd < 0 || !(pfds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            if (lens[i] + 4096 + 1 > caps[i]) {
+                size_t newcap = caps[i] ? caps[i] * 2 : 8192;
+                char *nb = realloc(bufs[i], newcap);
+                if (!nb) { close(pfds[i].fd); pfds[i].fd = -1; open_count--; continue; }
+                bufs[i] = nb;
+                caps[i] = newcap;
+            }
+            ssize_t r = recv(pfds[i].fd, bufs[i] + lens[i], 4096, 0);
+            if (r <= 0) {
+                close(pfds[i].fd);
+                pfds[i].fd = -1;
+                open_count--;
+            } else {
+                lens[i] += r;
+            }
+        }
+    }
+
+    size_t rcap = 64, nres = 0;
+    SearchResult *results = malloc(rcap * sizeof(SearchResult));
+    long ndocs = 0, df[SEARCH_MAX_TERMS] = {0};
+    int nterms = -1;            // per-term totals, unless some server did not send them
+    for (int i = 0; i < nsock; ++i) {
+        if (pfds[i].fd >= 0) close(pfds[i].fd);
+        if (!bufs[i]) continue;
+        bufs[i][lens[i]] = '\0';
+        int has_df = 0;
+        char *saveptr = NULL;
+        for (char *line = strtok_r(bufs[i], "\n", &saveptr); line && results; line = strtok_r(NULL, "\n", &saveptr)) {
+            if (strncmp(line, "DF ", 3) == 0) {
+                char *p = line + 3, *endp;
+                ndocs += strtol(p, &endp, 10);
+                int t = 0;
+                for (p = endp; t < SEARCH_MAX_TERMS; ++t, p = endp) {
+                    long v = strtol(p, &endp, 10);
+                    if (endp == p) break;
+                    df[t] += v;
+                }
+                if (nterms < 0 || t < nterms) nterms = t;
+                has_df = 1;
+                continue;
+            }
+            SearchResult r;
+            char tf[128] = "";
+            r.sentences[0] = '\0';
+            if (sscanf(line, "RESULT %lf %255s %511s %127s", &r.score, r.file, r.sentences, tf) < 2) continue;
+            r.ss_id = ids[i];
+            r.ntf = 0;
+            for (char *p = tf, *endp; *tf && r.ntf < SEARCH_MAX_TERMS; p = endp + (*endp == ',')) {
+                r.tf[r.ntf] = strtol(p, &endp, 10);
+                if (endp == p) break;
+                r.ntf++;
+            }
+            if (!has_df || r.ntf == 0) r.ntf = -1;
+            if (nres == rcap) {
+                rcap *= 2;
+                SearchResult *nr = realloc(results, rcap * sizeof(SearchResult));
+                if (!nr) break;
+                results = nr;
+            }
+            results[nres++] = r;
+        }
+        if (!has_df) nterms = 0;    // an older server: keep every server's own scores
+        free(bufs[i]);
+    }
+
+    // Same formula as the servers', with the document frequencies of all of them
+    for (size_t i = 0; i < nres && nterms > 0; ++i) {
+        if (results[i].ntf < nterms) continue;
+        double score = 0.0;
+        for (int t = 0; t < nterms; ++t) {
+            if (results[i].tf[t] <= 0 || df[t] <= 0) continue;
+            score += (1.0 + log((double)results[i].tf[t])) * log(1.0 + (double)ndocs / (double)df[t]);
+        }
+        results[i].score = score;
+    }
+    if (nres > 0) qsort(results, nres, sizeof(SearchResult), search_result_cmp);
+
+    char line[1024];
+    snprintf(line, sizeof(line), "Search results for '%s' (%zu match%s):\n", cmd + 7, nres, nres == 1 ? "" : "es");
+    send(client_sock, line, strlen(line), 0);
+    for (size_t i = 0; i < nres && i < SEARCH_MAX_RESULTS; ++i) {
+        snprintf(line, sizeof(line), "%3zu. %-24s score %-8.3f SS %-3d sentences: %s\n",
+                 i + 1, results[i].file, results[i].score, results[i].ss_id,
+                 results[i].sentences[0] ? results[i].sentences : "-");
+        send(client_sock, line, strlen(line), 0);
+    }
+    if (nres > SEARCH_MAX_RESULTS) {
+        snprintf(line, sizeof(line), "  ... %zu more\n", nres - SEARCH_MAX_RESULTS);
+        send(client_sock, line, strlen(line), 0);
+    }
+    log_event(LOG_INFO, "SEARCH by '%s' for '%s': %zu results from %d storage server(s)", username, cmd + 7, nres, nsock);
+    free(results);
+}
+
+// MGET / MSTREAM: each storage server is sent one request for the documents it holds, and
+// whole frames (common.h) are relayed from all of them as they arrive
+typedef struct {
+    int fd;
+    int ss_id;
+    char cmd[4096];             // "<verb> <names>..."; the names are tracked in names[]
+    char *names[MULTI_MAX_FILES];
+    int done[MULTI_MAX_FILES];
+    int count;
+    char *buf;                  // bytes received but not yet relayed
+    size_t len, cap;
+} MultiSource;
+
+static void multi_mark_done(MultiSource *src, const char *name, size_t name_len) {
+    for (int i = 0; i < src->count; ++i) {
+        if (!src->done[i] && strlen(src->names[i]) == name_len && strncmp(src->names[i], name, name_len) == 0) {
+            src->done[i] = 1;
+            return;
+        }
+    }
+}
+
+// Relay the complete frames in src->buf. A frame goes out only once all of it has arrived
+// (frames are at most MULTI_PIECE_MAX), so one cut off by a failing server never reaches
+// the client and frames of different documents never mix. -1: source broken.
+static int multi_relay(MultiSource *src, int client_sock) {
+    size_t pos = 0;
+    int rc = 0;
+    while (pos < src->len) {
+        char *nl = memchr(src->buf + pos, '\n', src->len - pos);
+        if (!nl) {
+            if (src->len - pos > 512) rc = -1;
+            break;
+        }
+        size_t frame_len = (size_t)(nl - (src->buf + pos)) + 1;
+        char name[256];
+        unsigned long long body = 0;
+        if (sscanf(src->buf + pos, "FILE %255s %llu", name, &body) == 2) {
+            if (body > MULTI_PIECE_MAX) {
+                rc = -1;
+                break;
+            }
+            if (src->len - pos < frame_len + body) break;
+            frame_len += (size_t)body;
+        } else if (strncmp(src->buf + pos, "DONE ", 5) == 0 || strncmp(src->buf + pos, "ERROR ", 6) == 0) {
+            const char *n = src->buf + pos + (src->buf[pos] == 'D' ? 5 : 6);
+            multi_mark_done(src, n, strcspn(n, " \n"));
+        }
+        send_all(client_sock, src->buf + pos, frame_len);
+        pos += frame_len;
+    }
+    memmove(src->buf, src->buf + pos, src->len - pos);
+    src->len -= pos;
+    return rc;
+}
+
+static void handle_multi(int client_sock, const char *cmd, const char *username, const char *password) {
+    int mstream = strncmp(cmd, "MSTREAM ", 8) == 0;
+    char args[4096], rate[32] = "", line[512];
+    snprintf(args, sizeof(args), "%s", cmd + (mstream ? 8 : 5));
+
+    char *tokens[MULTI_MAX_FILES + 2];
+    int ntok = 0;
+    char *saveptr = NULL;
+    for (char *tok = strtok_r(args, " \t", &saveptr); tok; tok = strtok_r(NULL, " \t", &saveptr)) {
+        if (ntok == MULTI_MAX_FILES + 2) { ntok = -1; break; }
+        tokens[ntok++] = tok;
+    }
+    int bad_rate = 0;
+    if (mstream && ntok >= 2 && strcmp(tokens[ntok - 2], "RATE") == 0) {
+        char *end;
+        bad_rate = strcmp(tokens[ntok - 1], "MAX") != 0 && (strtol(tokens[ntok - 1], &end, 10) < 1 || *end != '\0');
+        snprintf(rate, sizeof(rate), " RATE %s", tokens[ntok - 1]);
+        ntok -= 2;
+    }
+    if (ntok <= 0 || ntok > MULTI_MAX_FILES || bad_rate) {
+        snprintf(line, sizeof(line), "Usage: %s <file1> <file2> ... (at most %d files)%s\n", mstream ? "MSTREAM" : "MGET",
+                 MULTI_MAX_FILES, mstream ? " [RATE <words_per_second>|RATE MAX]" : "");
+        send(client_sock, line, strlen(line), 0);
+        return;
+    }
+
+    // Group the documents by the storage server to ask
+    MultiSource *srcs = calloc(MAX_SS, sizeof(MultiSource));
+    if (!srcs) return;
+    int nsrc = 0;
+    for (int t = 0; t < ntok; ++t) {
+        FileMeta *meta = find_filemeta(tokens[t]);
+        int ss_id = -1;
+        for (int i = 0; meta && i < meta->ss_count; ++i) {
+            StorageServerInfo *ssi = find_ss_by_id(meta->ss_ids[i]);
+            if (ssi && ssi->active) { ss_id = ssi->id; break; }
+        }
+        if (ss_id < 0) {
+            snprintf(line, sizeof(line), "ERROR %s File not found\n", tokens[t]);
+            send_all(client_sock, line, strlen(line));
+            continue;
+        }
+        int k = 0;
+        while (k < nsrc && srcs[k].ss_id != ss_id) k++;
+        if (k == nsrc) {
+            srcs[nsrc].ss_id = ss_id;
+            snprintf(srcs[nsrc].cmd, sizeof(srcs[nsrc].cmd), "%s", mstream ? "MSTREAM" : "MGET");
+            nsrc++;
+        }
+        size_t used = strlen(srcs[k].cmd);
+        snprintf(srcs[k].cmd + used, sizeof(srcs[k].cmd) - used, " %s", tokens[t]);
+        srcs[k].names[srcs[k].count++] = tokens[t];
+    }
+
+    // Fan out
+    struct pollfd pfds[MAX_SS];
+    for (int k = 0; k < nsrc; ++k) {
+        StorageServerInfo *ssi = find_ss_by_id(srcs[k].ss_id);
+        char auth_cmd[8192];
+        snprintf(auth_cmd, sizeof(auth_cmd), "USER:%s\nPASS:%s\nCMD:%s%s\n", username, password, srcs[k].cmd, rate);
+        int s = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in sa_ss; sa_ss.sin_family = AF_INET; sa_ss.sin_port = htons(ssi->client_port); sa_ss.sin_addr.s_addr = inet_addr(ssi->ip);
+        if (s < 0 || connect(s, (struct sockaddr*)&sa_ss, sizeof(sa_ss)) < 0 || send(s, auth_cmd, strlen(auth_cmd), 0) <= 0) {
+            log_event(LOG_WARN, "%s: storage server %d unreachable", mstream ? "MSTREAM" : "MGET", srcs[k].ss_id);
+            if (s >= 0) close(s);
+            s = -1;
+        }
+        srcs[k].fd = s;
+        pfds[k].fd = s;
+        pfds[k].events = POLLIN;
+    }
+
+    // Relay frames from whichever server has some, until all are done
+    int open_count = 0;
+    for (int k = 0; k < nsrc; ++k) open_count += srcs[k].fd >= 0;
+    while (open_count > 0) {
+        int rc = poll(pfds, nsrc, -1);
+        if (rc < 0 && errno == EINTR) continue;
+        if (rc <= 0) break;
+        for (int k = 0; k < nsrc; ++k) {
+            if (pfds[k].fd < 0 || !(pfds[k].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            MultiSource *src = &srcs[k];
+            if (src->cap - src->len < 16384) {
+                size_t newcap = src->cap ? src->cap * 2 : 65536;
+                char *nb = newcap <= 4 * MULTI_PIECE_MAX ? realloc(src->buf, newcap) : NULL;
+                if (nb) {
+                    src->buf = nb;
+                    src->cap = newcap;
+                }
+            }
+            ssize_t r = src->cap > src->len ? recv(src->fd, src->buf + src->len, src->cap - src->len, 0) : -1;
+            if (r > 0) src->len += (size_t)r;
+            if (r <= 0 || multi_relay(src, client_sock) != 0) {
+                close(src->fd);
+                src->fd = pfds[k].fd = -1;
+                open_count--;
+            }
+        }
+    }
+
+    // Whatever a server did not finish is reported, so every document gets DONE or ERROR
+    int failed = 0;
+    for (int k = 0; k < nsrc; ++k) {
+        if (srcs[k].fd >= 0) close(srcs[k].fd);
+        free(srcs[k].buf);
+        for (int i = 0; i < srcs[k].count; ++i) {
+            if (srcs[k].done[i]) continue;
+            snprintf(line, sizeof(line), "ERROR %s Storage server %d did not finish\n", srcs[k].names[i], srcs[k].ss_id);
+            send_all(client_sock, line, strlen(line));
+            failed++;
+        }
+    }
+    log_event(LOG_INFO, "%s by '%s': %d file(s) from %d storage server(s), %d unfinished",
+              mstream ? "MSTREAM" : "MGET", username, ntok, nsrc, failed);
+    free(srcs);
+}
+
 // Example logging in command handlers
 void handle_write(int client_sock, const char *filename, const char *username, const char *client_ip, int client_port) {
     log_req(LOG_INFO, "WRITE", username, client_ip, client_port, filename, -1, "START");
@@ -398,6 +839,15 @@ int main() {
     // Initialize file index
     file_index_init(&file_index, 4096);
 
+    // Children report metadata deltas back through this pipe. Both ends are non-blocking:
+    // the parent drains it between requests, and a child never stalls on a full pipe.
+    if (pipe(meta_pipe) < 0) {
+        perror("pipe");
+        exit(1);
+    }
+    fcntl(meta_pipe[0], F_SETFL, fcntl(meta_pipe[0], F_GETFL) | O_NONBLOCK);
+    fcntl(meta_pipe[1], F_SETFL, fcntl(meta_pipe[1], F_GETFL) | O_NONBLOCK);
+
     // Handle SIGCHLD to avoid zombies
     struct sigaction sa;
     sa.sa_handler = sigchld_handler;
@@ -447,6 +897,9 @@ int main() {
             continue;
         }
 
+        // Apply metadata reported by children since the last request
+        drain_meta_deltas();
+
         char client_ip[64];
         unsigned short client_port = 0;
         inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, sizeof(client_ip));
@@ -635,7 +1088,7 @@ int main() {
                                 if (connect(storage_sock, (struct sockaddr*)&sa_ss, sizeof(sa_ss)) == 0) {
                                     // Forward CREATE command
                                     char auth_cmd[8192];
-                                    snprintf(auth_cmd, sizeof(auth_cmd), "USER:%s\nPASS:%s\nCMD:%s", peek_username, peek_password, peek_command);
+                                    snprintf(auth_cmd, sizeof(auth_cmd), "USER:%s\nPASS:%s\nCMD:%s\n", peek_username, peek_password, peek_command);
                                     send(storage_sock, auth_cmd, strlen(auth_cmd), 0);
                                     
                                     // Read response
@@ -655,13 +1108,12 @@ int main() {
                                             newmeta->created_time = now;
                                             newmeta->last_modified = now;
                                             newmeta->last_accessed = now;
+                                            newmeta->version = 1;
                                             newmeta->ss_ids[0] = ss_id_target;
                                             newmeta->ss_count = 1;
                                             snprintf(newmeta->read_users, sizeof(newmeta->read_users), "%s", peek_username);
                                             snprintf(newmeta->write_users, sizeof(newmeta->write_users), "%s", peek_username);
-                                            unsigned long h = hash_filename(filename) % file_index.num_buckets;
-                                            newmeta->next = file_index.buckets[h];
-                                            file_index.buckets[h] = newmeta;
+                                            file_index_insert(&file_index, newmeta);
                                             log_event(LOG_INFO, "[PARENT] File '%s' created by '%s' and metadata added to index", filename, peek_username);
                                         }
                                     }
@@ -692,7 +1144,7 @@ int main() {
                                 if (connect(storage_sock, (struct sockaddr*)&sa_ss, sizeof(sa_ss)) == 0) {
                                     // Forward DELETE command
                                     char auth_cmd[8192];
-                                    snprintf(auth_cmd, sizeof(auth_cmd), "USER:%s\nPASS:%s\nCMD:%s", peek_username, peek_password, peek_command);
+                                    snprintf(auth_cmd, sizeof(auth_cmd), "USER:%s\nPASS:%s\nCMD:%s\n", peek_username, peek_password, peek_command);
                                     send(storage_sock, auth_cmd, strlen(auth_cmd), 0);
                                     
                                     // Read response
@@ -704,23 +1156,9 @@ int main() {
                                         
                                         // Check if successful, then remove from hashmap
                                         if (strstr(response, "Success") != NULL || strstr(response, "success") != NULL || strstr(response, "deleted") != NULL) {
-                                            unsigned long h = hash_filename(filename) % file_index.num_buckets;
-                                            FileMeta **bucket = &file_index.buckets[h];
-                                            FileMeta *prev = NULL;
-                                            FileMeta *curr = *bucket;
-                                            while (curr) {
-                                                if (strcmp(curr->name, filename) == 0) {
-                                                    if (prev) {
-                                                        prev->next = curr->next;
-                                                    } else {
-                                                        *bucket = curr->next;
-                                                    }
-                                                    free(curr);
-                                                    log_event(LOG_INFO, "[PARENT] File '%s' deleted and removed from index", filename);
-                                                    break;
-                                                }
-                                                prev = curr;
-                                                curr = curr->next;
+                                            if (find_filemeta(filename)) {
+                                                file_index_delete(&file_index, filename);
+                                                log_event(LOG_INFO, "[PARENT] File '%s' deleted and removed from index", filename);
                                             }
                                         }
                                     }
@@ -918,7 +1356,7 @@ int main() {
             char read_cmd[512]; 
             snprintf(read_cmd, sizeof(read_cmd), "READ %s", filename);
             char auth_read_cmd[8192];
-            snprintf(auth_read_cmd, sizeof(auth_read_cmd), "USER:%s\nPASS:%s\nCMD:%s", username, password, read_cmd);
+            snprintf(auth_read_cmd, sizeof(auth_read_cmd), "USER:%s\nPASS:%s\nCMD:%s\n", username, password, read_cmd);
             send(storage_sock, auth_read_cmd, strlen(auth_read_cmd), 0);
             
             // Read file content from storage server
@@ -942,7 +1380,20 @@ int main() {
             
             if (file_buf) file_buf[len] = '\0';
             close(storage_sock);
-            
+
+            // The reply is the length header and the script, or an error line to pass on
+            char *script = file_buf;
+            unsigned long long script_len = 0;
+            if (file_buf && sscanf(file_buf, READ_LENGTH_HEADER "%llu", &script_len) == 1 && strchr(file_buf, '\n')) {
+                script = strchr(file_buf, '\n') + 1;
+                len = script_len;
+            } else if (file_buf) {
+                send(client_sock, file_buf, len, 0);
+                free(file_buf);
+                close(client_sock);
+                exit(0);
+            }
+
             if (!file_buf || len == 0) {
                 const char *fmt = "Error: Could not read file '%s' or empty\n"; 
                 char msg[512]; 
@@ -955,7 +1406,7 @@ int main() {
             
             // Execute each line and send output to client
             char *saveptr2 = NULL; 
-            char *line = strtok_r(file_buf, "\n", &saveptr2);
+            char *line = strtok_r(script, "\n", &saveptr2);
             while (line) { 
                 // Trim leading whitespace
                 while (*line == ' ' || *line == '\t') line++; 
@@ -983,6 +1434,18 @@ int main() {
         }
 
 
+        if (strncmp(buf, "MGET ", 5) == 0 || strncmp(buf, "MSTREAM ", 8) == 0) {
+            handle_multi(client_sock, buf, username, password);
+            close(client_sock);
+            exit(0);
+        }
+
+        if (strncmp(buf, "SEARCH ", 7) == 0) {
+            handle_search(client_sock, buf, username, password);
+            close(client_sock);
+            exit(0);
+        }
+
         if (strcmp(buf, "LIST") == 0) {
             list_users(client_sock, username, client_ip, client_port);
             close(client_sock);
@@ -991,8 +1454,14 @@ int main() {
 
 
 
-        // VIEW must go to all storage servers and aggregate
-        if (strncmp(buf, "VIEW ", 5) == 0 || strcmp(buf, "VIEW") == 0) {
+        // VIEW <pattern> (e.g. VIEW report_*) is answered from the ordered name index
+        if (strncmp(buf, "VIEW ", 5) == 0 && handle_view_pattern(client_sock, buf + 5)) {
+            close(client_sock);
+            exit(0);
+        }
+
+        // VIEW and STATS must go to all storage servers and aggregate
+        if (strncmp(buf, "VIEW ", 5) == 0 || strcmp(buf, "VIEW") == 0 || strcmp(buf, "STATS") == 0) {
             char aggregate[65536];
             aggregate[0] = '\0';
             for (int i = 0; i < num_storage_servers; ++i) {
@@ -1004,7 +1473,7 @@ int main() {
                 if (connect(ss_sock, (struct sockaddr*)&sa_ss, sizeof(sa_ss)) < 0) { close(ss_sock); continue; }
                 // send VIEW command with credentials
                 char auth_view_cmd[8192];
-                snprintf(auth_view_cmd, sizeof(auth_view_cmd), "USER:%s\nPASS:%s\nCMD:%s", username, password, buf);
+                snprintf(auth_view_cmd, sizeof(auth_view_cmd), "USER:%s\nPASS:%s\nCMD:%s\n", username, password, buf);
                 send(ss_sock, auth_view_cmd, strlen(auth_view_cmd), 0);
                 // read response
                 char rbuf[4096]; ssize_t r;
@@ -1024,7 +1493,7 @@ int main() {
 
 
         // Other file-based commands: choose storage server and forward
-        const char *cmds_with_file[] = {"READ", "STREAM", "DELETE", "WRITE", "CREATE"};
+        const char *cmds_with_file[] = {"READ", "STREAM", "DELETE", "WRITE", "CREATE", "UNDO", "REDO", "REVERT", "LOCKS", "DIFF"};
         int is_file_cmd = 0; const char *file_part = NULL; char filename[256]; filename[0]='\0';
         for (size_t i=0;i<sizeof(cmds_with_file)/sizeof(cmds_with_file[0]);++i) {
             size_t clen = strlen(cmds_with_file[i]);
@@ -1069,10 +1538,14 @@ int main() {
         struct sockaddr_in sa_ss; sa_ss.sin_family = AF_INET; sa_ss.sin_port = htons(ssi->client_port); sa_ss.sin_addr.s_addr = inet_addr(ssi->ip);
         if (connect(storage_sock, (struct sockaddr*)&sa_ss, sizeof(sa_ss)) < 0) { const char *msg = "Error: connect to storage failed\n"; send(client_sock,msg,strlen(msg),0); close(storage_sock); close(client_sock); exit(0);}        
 
-        // Forward original command
-        // Forward original command with authentication
+        // Forward original command with authentication. Commands that read or change a file
+        // also ask for the metadata trailer so the index is refreshed without another INFO.
+        int want_meta = strncmp(buf, "READ", 4) == 0 || strncmp(buf, "WRITE", 5) == 0 ||
+                        strncmp(buf, "UNDO", 4) == 0 || strncmp(buf, "REDO", 4) == 0 ||
+                        strncmp(buf, "REVERT", 6) == 0;
         char auth_cmd[8192];
-        snprintf(auth_cmd, sizeof(auth_cmd), "USER:%s\nPASS:%s\nCMD:%s", username, password, buf);
+        snprintf(auth_cmd, sizeof(auth_cmd), "USER:%s\nPASS:%s\n%sCMD:%s\n", username, password,
+                 want_meta ? "META:1\n" : "", buf);
         send(storage_sock, auth_cmd, strlen(auth_cmd), 0);
 
         // Handle INFO command in name server using hashmap
@@ -1115,31 +1588,26 @@ int main() {
             close(client_sock);
             exit(0);
         } else if (strncmp(buf, "WRITE", 5) == 0) {
-            // WRITE command needs bidirectional proxying for interactive session
-            proxy_bidirectional(client_sock, storage_sock);
-            // After WRITE, refresh metadata from storage server
-            char filename[256] = "";
-            sscanf(buf + 5, "%255s", filename);
-            if (filename[0] != '\0') {
-                refresh_filemeta_from_storage(filename, ss_id_target);
-            }
+            // WRITE command needs bidirectional proxying for interactive session;
+            // the metadata trailer arrives after "Write Successful!"
+            MetaTrailer trailer = {{0}, 0};
+            proxy_bidirectional(client_sock, storage_sock, &trailer, filename);
             close(storage_sock);
             close(client_sock);
             exit(0);
-        } else if (strncmp(buf, "READ", 4) == 0) {
-            // READ command: relay response, then refresh metadata
-            char filename[256] = "";
-            sscanf(buf + 4, "%255s", filename);
-            // Simple response relay until storage closes (for non-interactive commands)
-            char relay[4096]; 
-            ssize_t rcv;
-            while ((rcv = recv(storage_sock, relay, sizeof(relay)-1, 0)) > 0) { 
-                relay[rcv]='\0'; 
-                send(client_sock, relay, strlen(relay), 0); 
-            }
-            if (filename[0] != '\0') {
-                refresh_filemeta_from_storage(filename, ss_id_target);
+        } else if (want_meta) {
+            // READ / UNDO / REDO / REVERT: relay response, picking up the metadata trailer at the end
+            MetaTrailer trailer = {{0}, 0};
+            if (strncmp(buf, "READ", 4) == 0) {
+                relay_read(storage_sock, client_sock, &trailer);
+            } else {
+                char relay[4096];
+                ssize_t rcv;
+                while ((rcv = recv(storage_sock, relay, sizeof(relay), 0)) > 0) {
+                    trailer_relay(&trailer, client_sock, relay, (size_t)rcv);
+                }
             }
+            trailer_finish(&trailer, client_sock, filename);
             close(storage_sock);
             close(client_sock);
             exit(0);
@@ -1174,7 +1642,7 @@ int main() {
         }
 
         // Now proxy the rest bidirectionally
-        proxy_bidirectional(client_sock, storage_sock);
+        proxy_bidirectional(client_sock, storage_sock, NULL, NULL);
 
         close(storage_sock);
         close(client_sock);
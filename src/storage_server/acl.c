@@ -1,84 +1,42 @@
 #include "../include/acl.h"
 #include "../include/common.h"
+#include "../include/meta_store.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <sys/mman.h>
 
-extern int get_storage_id(void);
-
-// Create metadata file for a new file
+// Create metadata record for a new file
 int create_metadata_file(const char *filename, const char *owner) {
-    char meta_path[512];
-    snprintf(meta_path, sizeof(meta_path), "%s/storage%d/meta/%s.meta", 
-             STORAGE_DIR, get_storage_id(), filename);
-    
-    FILE *fp = fopen(meta_path, "w");
-    if (!fp) return -1;
-    
+    FileMetadata meta;
+    memset(&meta, 0, sizeof(meta));
+
     time_t now = time(NULL);
-    fprintf(fp, "OWNER:%s\n", owner);
-    fprintf(fp, "CREATED:%ld\n", (long)now);
-    fprintf(fp, "LAST_MODIFIED:%ld\n", (long)now);
-    fprintf(fp, "LAST_ACCESS:%ld\n", (long)now);
-    fprintf(fp, "READ_USERS:%s\n", owner);  // Owner has read access by default
-    fprintf(fp, "WRITE_USERS:%s\n", owner); // Owner has write access by default
-    
-    fclose(fp);
-    return 0;
+    strncpy(meta.owner, owner, sizeof(meta.owner) - 1);
+    meta.created_time = now;
+    meta.last_modified = now;
+    meta.last_accessed = now;
+    meta.version = 1;
+    strncpy(meta.read_users, owner, sizeof(meta.read_users) - 1);   // Owner has read access by default
+    strncpy(meta.write_users, owner, sizeof(meta.write_users) - 1); // Owner has write access by default
+
+    return meta_store_put(filename, &meta);
 }
 
-// Read metadata from file
+// Read metadata record (O(1) lookup in the storage server's metadata store)
 int read_metadata_file(const char *filename, FileMetadata *meta) {
-    char meta_path[512];
-    snprintf(meta_path, sizeof(meta_path), "%s/storage%d/meta/%s.meta", 
-             STORAGE_DIR, get_storage_id(), filename);
-    
-    FILE *fp = fopen(meta_path, "r");
-    if (!fp) return -1;
-    
-    char line[1024];
-    memset(meta, 0, sizeof(FileMetadata));
-    
-    while (fgets(line, sizeof(line), fp)) {
-        line[strcspn(line, "\n")] = 0;
-        
-        if (strncmp(line, "OWNER:", 6) == 0) {
-            strncpy(meta->owner, line + 6, sizeof(meta->owner) - 1);
-        } else if (strncmp(line, "CREATED:", 8) == 0) {
-            meta->created_time = (time_t)atol(line + 8);
-        } else if (strncmp(line, "LAST_MODIFIED:", 14) == 0) {
-            meta->last_modified = (time_t)atol(line + 14);
-        } else if (strncmp(line, "LAST_ACCESS:", 12) == 0) {
-            meta->last_accessed = (time_t)atol(line + 12);
-        } else if (strncmp(line, "READ_USERS:", 11) == 0) {
-            strncpy(meta->read_users, line + 11, sizeof(meta->read_users) - 1);
-        } else if (strncmp(line, "WRITE_USERS:", 12) == 0) {
-            strncpy(meta->write_users, line + 12, sizeof(meta->write_users) - 1);
-        }
-    }
-    
-    fclose(fp);
-    return 0;
+    return meta_store_get(filename, meta, NULL);
 }
 
-// Update metadata file
+// Update metadata record
 int update_metadata_file(const char *filename, FileMetadata *meta) {
-    char meta_path[512];
-    snprintf(meta_path, sizeof(meta_path), "%s/storage%d/meta/%s.meta", 
-             STORAGE_DIR, get_storage_id(), filename);
-    
-    FILE *fp = fopen(meta_path, "w");
-    if (!fp) return -1;
-    
-    fprintf(fp, "OWNER:%s\n", meta->owner);
-    fprintf(fp, "CREATED:%ld\n", (long)meta->created_time);
-    fprintf(fp, "LAST_MODIFIED:%ld\n", (long)meta->last_modified);
-    fprintf(fp, "LAST_ACCESS:%ld\n", (long)meta->last_accessed);
-    fprintf(fp, "READ_USERS:%s\n", meta->read_users);
-    fprintf(fp, "WRITE_USERS:%s\n", meta->write_users);
-    
-    fclose(fp);
-    return 0;
+    return meta_store_put(filename, meta);
+}
+
+// Drop the metadata record of a deleted file
+int delete_metadata_file(const char *filename) {
+    return meta_store_delete(filename);
 }
 
 // Helper function to check if a user is in a comma-separated list
@@ -108,32 +66,97 @@ static int user_in_list(const char *list, const char *username) {
     return 0;
 }
 
-// Check if user has read access
-int check_read_access(const char *filename, const char *username) {
+// --- ACL decision cache ---
+// Direct-mapped table of (file, user) -> decision, in shared anonymous memory mapped at
+// startup, so a decision made by one worker serves all of them.
+// Each entry remembers the metadata record it was derived from (MetaRef); any write to
+// that record (ADDACCESS, REMACCESS, DELETE, content changes) bumps its generation and
+// makes the entry stale.
+#define ACL_DECIDE_READ  1
+#define ACL_DECIDE_WRITE 2
+
+typedef struct {
+    uint32_t busy;          // per-entry try-lock; a contended entry is treated as a miss
+    uint32_t decision;
+    MetaRef ref;
+    char file[256];
+    char user[64];
+} AclCacheEntry;
+
+static AclCacheEntry *acl_cache = NULL;
+
+int acl_cache_init(void) {
+    void *mem = mmap(NULL, sizeof(AclCacheEntry) * ACL_CACHE_SLOTS, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        perror("acl cache mmap");
+        return -1;  // not fatal: every check goes to the metadata store
+    }
+    acl_cache = (AclCacheEntry *)mem;
+    return 0;
+}
+
+static AclCacheEntry *acl_cache_entry(const char *filename, const char *username) {
+    unsigned long h = 5381;
+    for (const char *p = filename; *p; ++p) h = ((h << 5) + h) + (unsigned char)*p;
+    h = ((h << 5) + h) + '/';
+    for (const char *p = username; *p; ++p) h = ((h << 5) + h) + (unsigned char)*p;
+    return &acl_cache[h % ACL_CACHE_SLOTS];
+}
+
+static int acl_cache_lookup(const char *filename, const char *username, uint32_t *decision) {
+    if (!acl_cache) return 0;
+    AclCacheEntry *e = acl_cache_entry(filename, username);
+    if (__atomic_exchange_n(&e->busy, 1, __ATOMIC_ACQUIRE)) return 0;
+    int hit = strcmp(e->file, filename) == 0 && strcmp(e->user, username) == 0;
+    MetaRef ref = e->ref;
+    *decision = e->decision;
+    __atomic_store_n(&e->busy, 0, __ATOMIC_RELEASE);
+    return hit && meta_store_ref_valid(&ref);
+}
+
+static void acl_cache_store(const char *filename, const char *username, const MetaRef *ref, uint32_t decision) {
+    if (!acl_cache || strlen(filename) >= sizeof(acl_cache->file) || strlen(username) >= sizeof(acl_cache->user)) return;
+    AclCacheEntry *e = acl_cache_entry(filename, username);
+    if (__atomic_exchange_n(&e->busy, 1, __ATOMIC_ACQUIRE)) return;
+    strcpy(e->file, filename);
+    strcpy(e->user, username);
+    e->ref = *ref;
+    e->decision = decision;
+    __atomic_store_n(&e->busy, 0, __ATOMIC_RELEASE);
+}
+
+// Read/write permission bits for a user, from the cache or the metadata record
+static uint32_t access_decision(const char *filename, const char *username) {
+    uint32_t decision;
+    if (acl_cache_lookup(filename, username, &decision)) return decision;
+
     FileMetadata meta;
-    if (read_metadata_file(filename, &meta) < 0) {
-        return 0; // No metadata = no access
+    MetaRef ref;
+    if (meta_store_get(filename, &meta, &ref) < 0) {
+        return 0; // No metadata = no access (not cached: the file may be created later)
     }
-    
+
+    decision = 0;
     // Owner always has access
-    if (strcmp(meta.owner, username) == 0) return 1;
-    
-    // Check read_users list
-    return user_in_list(meta.read_users, username);
+    if (strcmp(meta.owner, username) == 0) {
+        decision = ACL_DECIDE_READ | ACL_DECIDE_WRITE;
+    } else {
+        if (user_in_list(meta.read_users, username)) decision |= ACL_DECIDE_READ;
+        if (user_in_list(meta.write_users, username)) decision |= ACL_DECIDE_WRITE;
+    }
+    acl_cache_store(filename, username, &ref, decision);
+    return decision;
+}
+
+// Check if user has read access
+int check_read_access(const char *filename, const char *username) {
+    return (access_decision(filename, username) & ACL_DECIDE_READ) != 0;
 }
 
 // Check if user has write access
 int check_write_access(const char *filename, const char *username) {
-    FileMetadata meta;
-    if (read_metadata_file(filename, &meta) < 0) {
-        return 0; // No metadata = no access
-    }
-    
-    // Owner always has access
-    if (strcmp(meta.owner, username) == 0) return 1;
-    
-    // Check write_users list
-    return user_in_list(meta.write_users, username);
+    return (access_decision(filename, username) & ACL_DECIDE_WRITE) != 0;
 }
 
 // Add user to a list (helper function)
@@ -179,36 +202,37 @@ static void remove_user_from_list(char *list, size_t list_size, const char *user
     list[list_size - 1] = '\0';
 }
 
+// Edits applied to the metadata record under the store lock (meta_store_edit_acl)
+static int grant_read(FileMetadata *meta, void *user) {
+    add_user_to_list(meta->read_users, sizeof(meta->read_users), (const char *)user);
+    return 0;
+}
+
+static int grant_write(FileMetadata *meta, void *user) {
+    add_user_to_list(meta->write_users, sizeof(meta->write_users), (const char *)user);
+    return 0;
+}
+
+static int revoke_all(FileMetadata *meta, void *user) {
+    // Don't allow removing owner's access
+    if (strcmp(meta->owner, (const char *)user) == 0) return -2;
+
+    remove_user_from_list(meta->read_users, sizeof(meta->read_users), (const char *)user);
+    remove_user_from_list(meta->write_users, sizeof(meta->write_users), (const char *)user);
+    return 0;
+}
+
 // Add read access for a user
 int add_read_access(const char *filename, const char *username) {
-    FileMetadata meta;
-    if (read_metadata_file(filename, &meta) < 0) return -1;
-    
-    add_user_to_list(meta.read_users, sizeof(meta.read_users), username);
-    
-    return update_metadata_file(filename, &meta);
+    return meta_store_edit_acl(filename, grant_read, (void *)username);
 }
 
 // Add write access for a user
 int add_write_access(const char *filename, const char *username) {
-    FileMetadata meta;
-    if (read_metadata_file(filename, &meta) < 0) return -1;
-    
-    add_user_to_list(meta.write_users, sizeof(meta.write_users), username);
-    
-    return update_metadata_file(filename, &meta);
+    return meta_store_edit_acl(filename, grant_write, (void *)username);
 }
 
 // Remove all access for a user
 int remove_all_access(const char *filename, const char *username) {
-    FileMetadata meta;
-    if (read_metadata_file(filename, &meta) < 0) return -1;
-    
-    // Don't allow removing owner's access
-    if (strcmp(meta.owner, username) == 0) return -2;
-    
-    remove_user_from_list(meta.read_users, sizeof(meta.read_users), username);
-    remove_user_from_list(meta.write_users, sizeof(meta.write_users), username);
-    
-    return update_metadata_file(filename, &meta);
+    return meta_store_edit_acl(filename, revoke_all, (void *)username);
 }
@@ -0,0 +1,104 @@
+#include "../../include/common.h"
+#include "../../include/atime.h"
+#include "../../include/meta_store.h"
+#include <pthread.h>
+
+typedef struct {
+    char name[256];
+    time_t when;
+} AtimeRecord;
+
+#define ATIME_SLOTS (ATIME_MAX_PENDING * 2)
+
+// Pending table (open addressing), shared by the worker threads. INFO / VIEW -l read it
+// through atime_effective() so they show access times that are not flushed yet.
+static AtimeRecord pending[ATIME_SLOTS];
+static int pending_count = 0;
+static time_t last_flush = 0;
+static pthread_mutex_t pending_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t flush_cond = PTHREAD_COND_INITIALIZER;
+
+static unsigned long atime_hash(const char *str) {
+    unsigned long hash = 5381;
+    int c;
+    while ((c = *str++)) hash = ((hash << 5) + hash) + c;
+    return hash;
+}
+
+static AtimeRecord *pending_slot(const char *filename) {
+    unsigned long h = atime_hash(filename) % ATIME_SLOTS;
+    for (int probe = 0; probe < ATIME_SLOTS; ++probe) {
+        AtimeRecord *r = &pending[(h + probe) % ATIME_SLOTS];
+        if (r->name[0] == '\0' || strcmp(r->name, filename) == 0) return r;
+    }
+    return NULL;
+}
+
+// Called with pending_lock held
+static void flush_locked(void) {
+    int written = 0;
+    for (int i = 0; i < ATIME_SLOTS; ++i) {
+        if (pending[i].name[0] == '\0') continue;
+        if (meta_store_set_atime(pending[i].name, pending[i].when) == 0) written++;
+        pending[i].name[0] = '\0';
+    }
+    if (pending_count > 0) printf("[ATIME] Flushed %d access time update(s) for %d file(s)\n", written, pending_count);
+    pending_count = 0;
+    last_flush = time(NULL);
+}
+
+// Single writer: flushes every ATIME_FLUSH_INTERVAL seconds, or early when signalled
+static void *atime_flusher(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&pending_lock);
+    while (1) {
+        struct timespec due = {last_flush + ATIME_FLUSH_INTERVAL, 0};
+        while (pending_count < ATIME_MAX_PENDING && time(NULL) < due.tv_sec) {
+            pthread_cond_timedwait(&flush_cond, &pending_lock, &due);
+        }
+        if (pending_count > 0) flush_locked();
+        else last_flush = time(NULL);
+    }
+    return NULL;
+}
+
+void atime_init(void) {
+    last_flush = time(NULL);
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, atime_flusher, NULL) != 0) {
+        perror("atime flusher");
+        return;
+    }
+    pthread_detach(tid);
+}
+
+// Record an access. If the table is full the update is dropped; access times are advisory.
+void atime_touch(const char *filename) {
+    time_t now = time(NULL);
+    pthread_mutex_lock(&pending_lock);
+    AtimeRecord *slot = pending_slot(filename);
+    if (!slot || strlen(filename) >= sizeof(slot->name)) {
+        printf("[ATIME] Dropped access time update for '%s'\n", filename);
+    } else if (slot->name[0] == '\0') {
+        strcpy(slot->name, filename);
+        slot->when = now;
+        if (++pending_count >= ATIME_MAX_PENDING) pthread_cond_signal(&flush_cond);
+    } else if (now > slot->when) {
+        slot->when = now;
+    }
+    pthread_mutex_unlock(&pending_lock);
+}
+
+void atime_flush(void) {
+    pthread_mutex_lock(&pending_lock);
+    flush_locked();
+    pthread_mutex_unlock(&pending_lock);
+}
+
+time_t atime_effective(const char *filename, time_t stored) {
+    pthread_mutex_lock(&pending_lock);
+    AtimeRecord *slot = pending_slot(filename);
+    if (slot && slot->name[0] != '\0' && slot->when > stored) stored = slot->when;
+    pthread_mutex_unlock(&pending_lock);
+    return stored;
+}
@@ -1,11 +1,21 @@
 
 #include "../../include/common.h"
 #include "../../include/checkpoint.h"
+#include "../../include/chunkstore.h"
+#include "../../include/commit.h"
+#include "../../include/diff.h"
+#include "../../include/doccount.h"
+#include "../../include/document.h"
+#include "../../include/meta_store.h"
 #include "../../include/acl.h"
+#include "../../include/search.h"
+#include "../../include/sentidx.h"
+#include "../../include/undo.h"
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <dirent.h>
 #include <errno.h>
+#include <pthread.h>
 #include <time.h>
 
 #define MAX_PATH 1024
@@ -44,33 +54,219 @@ static void sanitize_filename(const char *input, char *output, size_t out_size)
     output[j] = '\0';
 }
 
-// Function to copy file content
-static int copy_file(const char *src, const char *dest) {
-    FILE *source = fopen(src, "rb");
-    if (!source) {
-        return -1;
+// Checkpoint index: every checkpoint of a file, in creation order, kept in memory and in
+// that file's manifest checkpoints/<sanitized>.list ("filename=<file>" then one
+// "<tag>\t<timestamp>\t<size>\t<creator>" line per checkpoint). Listing a file's
+// checkpoints touches only its own entries instead of scanning the whole directory.
+#define CKPT_INDEX_BUCKETS 1024
+
+typedef struct {
+    char tag[MAX_TAG];
+    long timestamp;
+    uint64_t size;
+    char creator[64];
+    unsigned long seq;      // order recorded, breaks timestamp ties
+} CkptEntry;
+
+typedef struct CkptFile {
+    struct CkptFile *next;
+    char filename[MAX_FILENAME];
+    CkptEntry *entries;
+    size_t count, cap;
+} CkptFile;
+
+static pthread_mutex_t index_lock = PTHREAD_MUTEX_INITIALIZER;
+static CkptFile *ckpt_index[CKPT_INDEX_BUCKETS];
+static unsigned long index_seq;
+
+// Checkpoints being created, by manifest path: a tag is claimed here under index_lock before
+// its chunks are stored, so two CHECKPOINTs with the same tag cannot both store them
+typedef struct CkptPending {
+    struct CkptPending *next;
+    char path[MAX_PATH];
+} CkptPending;
+
+static CkptPending *ckpt_pending;
+
+// Caller holds index_lock
+static CkptFile *index_file(const char *filename, int create) {
+    uint32_t h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)filename; *p; ++p) h = (h ^ *p) * 16777619u;
+    CkptFile **slot = &ckpt_index[h % CKPT_INDEX_BUCKETS];
+    CkptFile *f = *slot;
+    while (f && strcmp(f->filename, filename) != 0) f = f->next;
+    if (!f && create && (f = calloc(1, sizeof(CkptFile))) != NULL) {
+        snprintf(f->filename, sizeof(f->filename), "%s", filename);
+        f->next = *slot;
+        *slot = f;
     }
+    return f;
+}
 
-    FILE *destination = fopen(dest, "wb");
-    if (!destination) {
-        fclose(source);
-        return -1;
+static CkptEntry *index_find(CkptFile *f, const char *tag) {
+    for (size_t i = 0; f && i < f->count; ++i) {
+        if (strcmp(f->entries[i].tag, tag) == 0) return &f->entries[i];
     }
+    return NULL;
+}
 
-    char buffer[MAX_BUFFER];
-    size_t bytes;
-    
-    while ((bytes = fread(buffer, 1, MAX_BUFFER, source)) > 0) {
-        if (fwrite(buffer, 1, bytes, destination) != bytes) {
-            fclose(source);
-            fclose(destination);
-            return -1;
+static int index_add(CkptFile *f, const CkptEntry *e) {
+    if (f->count == f->cap) {
+        size_t cap = f->cap ? f->cap * 2 : 8;
+        CkptEntry *grown = realloc(f->entries, cap * sizeof(CkptEntry));
+        if (!grown) return -1;
+        f->entries = grown;
+        f->cap = cap;
+    }
+    f->entries[f->count] = *e;
+    f->entries[f->count++].seq = ++index_seq;
+    return 0;
+}
+
+// Claim checkpoint_path for filename / tag: 0, or -1 if the checkpoint exists or is being
+// created (-2 on allocation failure)
+static int tag_reserve(const char *filename, const char *tag, const char *checkpoint_path) {
+    struct stat st;
+    int rc = 0;
+    pthread_mutex_lock(&index_lock);
+    CkptPending *p = ckpt_pending;
+    while (p && strcmp(p->path, checkpoint_path) != 0) p = p->next;
+    if (p || index_find(index_file(filename, 0), tag) || stat(checkpoint_path, &st) == 0) {
+        rc = -1;
+    } else if ((p = calloc(1, sizeof(CkptPending))) == NULL) {
+        rc = -2;
+    } else {
+        snprintf(p->path, sizeof(p->path), "%s", checkpoint_path);
+        p->next = ckpt_pending;
+        ckpt_pending = p;
+    }
+    pthread_mutex_unlock(&index_lock);
+    return rc;
+}
+
+static void tag_release(const char *checkpoint_path) {
+    pthread_mutex_lock(&index_lock);
+    for (CkptPending **p = &ckpt_pending; *p; p = &(*p)->next) {
+        if (strcmp((*p)->path, checkpoint_path) == 0) {
+            CkptPending *done = *p;
+            *p = done->next;
+            free(done);
+            break;
         }
     }
+    pthread_mutex_unlock(&index_lock);
+}
 
-    fclose(source);
-    fclose(destination);
-    return 0;
+static void list_path(char *buf, size_t sz, const char *filename, int storage_id) {
+    char sanitized[MAX_FILENAME];
+    sanitize_filename(filename, sanitized, MAX_FILENAME);
+    snprintf(buf, sz, "%s/storage%d/checkpoints/%s.list", STORAGE_DIR, storage_id, sanitized);
+}
+
+// Append one entry to the file's manifest (written with its header if new)
+static int list_append(const char *filename, const CkptEntry *e, int storage_id) {
+    char path[MAX_PATH];
+    list_path(path, sizeof(path), filename, storage_id);
+    struct stat st;
+    int fresh = stat(path, &st) != 0;
+    FILE *fp = fopen(path, "a");
+    if (!fp) return -1;
+    if (fresh) fprintf(fp, "filename=%s\n", filename);
+    fprintf(fp, "%s\t%ld\t%llu\t%s\n", e->tag, e->timestamp, (unsigned long long)e->size, e->creator);
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+static int by_time(const void *a, const void *b) {
+    const CkptEntry *x = (const CkptEntry *)a, *y = (const CkptEntry *)b;
+    if (x->timestamp != y->timestamp) return x->timestamp < y->timestamp ? -1 : 1;
+    return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+static int by_tag(const void *a, const void *b) {
+    return strcmp(((const CkptEntry *)a)->tag, ((const CkptEntry *)b)->tag);
+}
+
+// Read a legacy checkpoint's .meta into an entry; returns the owning filename or ""
+static void read_meta(const char *meta_path, char *owner, size_t owner_sz, CkptEntry *e) {
+    owner[0] = '\0';
+    FILE *meta = fopen(meta_path, "r");
+    if (!meta) return;
+    char line[512];
+    while (fgets(line, sizeof(line), meta)) {
+        line[strcspn(line, "\n")] = '\0';
+        if (strncmp(line, "filename=", 9) == 0) snprintf(owner, owner_sz, "%s", line + 9);
+        else if (strncmp(line, "tag=", 4) == 0) snprintf(e->tag, sizeof(e->tag), "%s", line + 4);
+        else if (strncmp(line, "timestamp=", 10) == 0) e->timestamp = atol(line + 10);
+        else if (strncmp(line, "created_by=", 11) == 0) snprintf(e->creator, sizeof(e->creator), "%s", line + 11);
+    }
+    fclose(meta);
+}
+
+void checkpoint_index_init(int storage_id) {
+    char dir_path[MAX_PATH];
+    snprintf(dir_path, MAX_PATH, "%s/storage%d/checkpoints", STORAGE_DIR, storage_id);
+    pthread_mutex_lock(&index_lock);
+
+    // Per-file manifests first
+    size_t loaded = 0, imported = 0;
+    DIR *dir = opendir(dir_path);
+    struct dirent *entry;
+    while (dir && (entry = readdir(dir)) != NULL) {
+        size_t n = strlen(entry->d_name);
+        if (n <= 5 || strcmp(entry->d_name + n - 5, ".list") != 0) continue;
+        char path[MAX_PATH], line[512];
+        int written = snprintf(path, MAX_PATH, "%s/%s", dir_path, entry->d_name);
+        FILE *fp = written > 0 && written < MAX_PATH ? fopen(path, "r") : NULL;
+        CkptFile *f = NULL;
+        while (fp && fgets(line, sizeof(line), fp)) {
+            line[strcspn(line, "\n")] = '\0';
+            CkptEntry e;
+            unsigned long long size;
+            memset(&e, 0, sizeof(e));
+            if (strncmp(line, "filename=", 9) == 0) {
+                f = index_file(line + 9, 1);
+            } else if (f && sscanf(line, "%127[^\t]\t%ld\t%llu\t%63s", e.tag, &e.timestamp, &size, e.creator) >= 3 &&
+                       !index_find(f, e.tag)) {
+                e.size = size;
+                if (index_add(f, &e) == 0) loaded++;
+            }
+        }
+        if (fp) fclose(fp);
+    }
+
+    // Then checkpoints from before the manifests existed, recorded only by their .meta
+    if (dir) rewinddir(dir);
+    while (dir && (entry = readdir(dir)) != NULL) {
+        size_t n = strlen(entry->d_name);
+        if (n <= 5 || strcmp(entry->d_name + n - 5, ".meta") != 0) continue;
+        char meta_path[MAX_PATH], ckpt_path[MAX_PATH], owner[MAX_FILENAME];
+        int written = snprintf(meta_path, MAX_PATH, "%s/%s", dir_path, entry->d_name);
+        if (written < 0 || written >= MAX_PATH) continue;
+        CkptEntry e;
+        memset(&e, 0, sizeof(e));
+        snprintf(e.creator, sizeof(e.creator), "Unknown");
+        read_meta(meta_path, owner, sizeof(owner), &e);
+        if (!owner[0] || !e.tag[0] || index_find(index_file(owner, 0), e.tag)) continue;
+        written = snprintf(ckpt_path, MAX_PATH, "%s/%.*s.ckpt", dir_path, (int)(n - 5), entry->d_name);
+        if (written < 0 || written >= MAX_PATH || chunkstore_size(ckpt_path, &e.size) != 0) continue;
+        CkptFile *f = index_file(owner, 1);
+        if (f && index_add(f, &e) == 0) {
+            list_append(owner, &e, storage_id);
+            imported++;
+        }
+    }
+    if (dir) closedir(dir);
+
+    for (size_t b = 0; b < CKPT_INDEX_BUCKETS; ++b) {
+        for (CkptFile *f = ckpt_index[b]; f; f = f->next) qsort(f->entries, f->count, sizeof(CkptEntry), by_time);
+    }
+    pthread_mutex_unlock(&index_lock);
+    printf("Checkpoint index: %zu checkpoint(s) loaded, %zu imported\n", loaded, imported);
+}
+
+// Sends restored checkpoint content to a client socket
+static int send_sink(const char *data, size_t len, void *user) {
+    return send(*(int *)user, data, len, MSG_NOSIGNAL) == (ssize_t)len ? 0 : -1;
 }
 
 // Create a checkpoint
@@ -117,17 +313,30 @@ int checkpoint_create(int client_sock, const char *filename, const char *tag,
     snprintf(checkpoint_path, MAX_PATH, "%s/storage%d/checkpoints/%s_%s.ckpt", 
              STORAGE_DIR, storage_id, sanitized, tag);
 
-    // Check if checkpoint already exists
-    if (stat(checkpoint_path, &st) == 0) {
+    // Check if checkpoint already exists, and claim the tag until it is recorded
+    int reserved = tag_reserve(filename, tag, checkpoint_path);
+    if (reserved == -1) {
         snprintf(response, sizeof(response), 
                 "Error: Checkpoint '%s' already exists for file '%s'\n", 
                 tag, filename);
         send(client_sock, response, strlen(response), 0);
         return -1;
     }
+    if (reserved == -2) {
+        snprintf(response, sizeof(response), 
+                "Error: Failed to create checkpoint\n");
+        send(client_sock, response, strlen(response), 0);
+        return -1;
+    }
 
-    // Copy file to checkpoint
-    if (copy_file(file_path, checkpoint_path) == -1) {
+    // Store the file's chunks (mostly already present from earlier checkpoints) and
+    // write the manifest; the commit lock keeps a concurrent ETIRW from tearing the copy
+    uint64_t size;
+    commit_read_lock(filename);
+    int stored = chunkstore_put(file_path, checkpoint_path, &size);
+    commit_read_unlock(filename);
+    if (stored == -1) {
+        tag_release(checkpoint_path);
         snprintf(response, sizeof(response), 
                 "Error: Failed to create checkpoint\n");
         send(client_sock, response, strlen(response), 0);
@@ -141,7 +350,8 @@ int checkpoint_create(int client_sock, const char *filename, const char *tag,
     
     FILE *meta = fopen(meta_path, "w");
     if (!meta) {
-        remove(checkpoint_path);
+        chunkstore_release(checkpoint_path);
+        tag_release(checkpoint_path);
         snprintf(response, sizeof(response), 
                 "Error: Cannot create metadata file\n");
         send(client_sock, response, strlen(response), 0);
@@ -155,6 +365,19 @@ int checkpoint_create(int client_sock, const char *filename, const char *tag,
     fprintf(meta, "created_by=%s\n", username);
     fclose(meta);
 
+    // Record it in the file's checkpoint index
+    CkptEntry e;
+    memset(&e, 0, sizeof(e));
+    snprintf(e.tag, sizeof(e.tag), "%s", tag);
+    snprintf(e.creator, sizeof(e.creator), "%s", username);
+    e.timestamp = (long)now;
+    e.size = size;
+    pthread_mutex_lock(&index_lock);
+    CkptFile *f = index_file(filename, 1);
+    if (f && !index_find(f, tag) && index_add(f, &e) == 0) list_append(filename, &e, storage_id);
+    pthread_mutex_unlock(&index_lock);
+    tag_release(checkpoint_path);
+
     snprintf(response, sizeof(response), 
             "Success: Checkpoint '%s' created successfully for file '%s'\n", 
             tag, filename);
@@ -193,30 +416,20 @@ int checkpoint_view(int client_sock, const char *filename, const char *tag,
         return -1;
     }
 
-    FILE *ckpt = fopen(checkpoint_path, "r");
-    if (!ckpt) {
-        snprintf(response, sizeof(response), 
-                "Error: Cannot open checkpoint file\n");
-        send(client_sock, response, strlen(response), 0);
-        return -1;
-    }
-
     // Send header
     snprintf(response, sizeof(response), 
             "=== Content of checkpoint '%s' for file '%s' ===\n", 
             tag, filename);
     send(client_sock, response, strlen(response), 0);
     
-    // Send file content in chunks
-    char buffer[MAX_BUFFER];
-    size_t bytes_read;
-    while ((bytes_read = fread(buffer, 1, sizeof(buffer) - 1, ckpt)) > 0) {
-        buffer[bytes_read] = '\0';
-        send(client_sock, buffer, bytes_read, 0);
+    // Send the checkpoint's chunks in order
+    if (chunkstore_read(checkpoint_path, send_sink, &client_sock) != 0) {
+        snprintf(response, sizeof(response), 
+                "\nError: Checkpoint data is incomplete\n");
+        send(client_sock, response, strlen(response), 0);
+        return -1;
     }
     
-    fclose(ckpt);
-    
     // Send footer
     snprintf(response, sizeof(response), "\n=== End of checkpoint ===\n");
     send(client_sock, response, strlen(response), 0);
@@ -260,41 +473,44 @@ int checkpoint_revert(int client_sock, const char *filename, const char *tag,
     snprintf(file_path, MAX_PATH, "%s/storage%d/files/%s", 
              STORAGE_DIR, storage_id, filename);
 
-    // Create backup of current file (optional, for safety)
-    char backup_path[MAX_PATH];
-    snprintf(backup_path, MAX_PATH, "%s/storage%d/files/%s.backup",
+    // Materialise the checkpoint next to the file (a reflink where the filesystem allows,
+    // so constant time), then swap it in with one rename, ordered with WRITE commits
+    // (a session committing later merges onto the reverted text)
+    char restore_path[MAX_PATH];
+    snprintf(restore_path, MAX_PATH, "%s/storage%d/swap/%s.revert",
              STORAGE_DIR, storage_id, filename);
-    
-    if (stat(file_path, &st) == 0) {
-        copy_file(file_path, backup_path);
+    int restored = chunkstore_restore(checkpoint_path, restore_path) == 0;
+    commit_write_lock(filename);
+    if (restored && rename(restore_path, file_path) != 0) restored = 0;
+    if (restored) {
+        sentidx_rebuild(filename);
+        undo_forget(filename);
+        meta_store_bump_version(filename, time(NULL));
     }
-
-    // Restore from checkpoint
-    if (copy_file(checkpoint_path, file_path) == -1) {
+    commit_write_unlock(filename);
+    if (!restored) {
+        unlink(restore_path);
         snprintf(response, sizeof(response), 
                 "Error: Failed to restore from checkpoint\n");
         send(client_sock, response, strlen(response), 0);
-        // Try to restore backup
-        if (stat(backup_path, &st) == 0) {
-            copy_file(backup_path, file_path);
-        }
         return -1;
     }
+    DocCounts counts;
+    doccount_get(filename, NULL, &counts);     // a different text altogether: counted afresh
+    search_index_update(filename);
 
     snprintf(response, sizeof(response), 
             "Success: File '%s' successfully reverted to checkpoint '%s'\n", 
             filename, tag);
     send(client_sock, response, strlen(response), 0);
-    
-    // Remove backup on success
-    remove(backup_path);
     return 0;
 }
 
-// List all checkpoints for a file
-int checkpoint_list(int client_sock, const char *filename, 
-                   const char *username, int storage_id) {
+// List a file's checkpoints from the index, oldest first (or by tag), optionally one page
+int checkpoint_list(int client_sock, const char *filename, const char *username,
+                    int sort_by_tag, int page, int per_page, int storage_id) {
     char response[MAX_BUFFER];
+    (void)storage_id;
     
     // Check read access
     if (!check_read_access(filename, username)) {
@@ -304,121 +520,301 @@ int checkpoint_list(int client_sock, const char *filename,
         send(client_sock, response, strlen(response), 0);
         return -1;
     }
-    
-    char sanitized[MAX_FILENAME];
-    sanitize_filename(filename, sanitized, MAX_FILENAME);
 
-    char checkpoint_dir[MAX_PATH];
-    snprintf(checkpoint_dir, MAX_PATH, "%s/storage%d/checkpoints", 
-             STORAGE_DIR, storage_id);
+    // Snapshot this file's entries; nothing else is looked at
+    pthread_mutex_lock(&index_lock);
+    CkptFile *f = index_file(filename, 0);
+    size_t count = f ? f->count : 0;
+    CkptEntry *entries = count ? malloc(count * sizeof(CkptEntry)) : NULL;
+    if (entries) memcpy(entries, f->entries, count * sizeof(CkptEntry));
+    else count = 0;
+    pthread_mutex_unlock(&index_lock);
 
-    DIR *dir = opendir(checkpoint_dir);
-    if (!dir) {
+    if (count == 0) {
         snprintf(response, sizeof(response), 
                 "No checkpoints found for file '%s'\n", filename);
         send(client_sock, response, strlen(response), 0);
         return 0;
     }
+    if (sort_by_tag) qsort(entries, count, sizeof(CkptEntry), by_tag);
+
+    size_t first = 0, last = count;
+    size_t pages = 1;
+    if (page > 0) {
+        pages = (count + (size_t)per_page - 1) / (size_t)per_page;
+        first = (size_t)(page - 1) * (size_t)per_page;
+        if (first > count) first = count;
+        last = first + (size_t)per_page < count ? first + (size_t)per_page : count;
+    }
 
     // Send header
-    snprintf(response, sizeof(response), 
-            "Checkpoints for file '%s':\n", filename);
-    send(client_sock, response, strlen(response), 0);
-    
-    snprintf(response, sizeof(response), 
-            "%-20s %-30s %-15s %s\n", 
-            "Tag", "Timestamp", "Size", "Created By");
-    send(client_sock, response, strlen(response), 0);
-    
-    snprintf(response, sizeof(response), 
-            "------------------------------------------------------------------------\n");
+    int n = snprintf(response, sizeof(response), 
+            "Checkpoints for file '%s':\n%-20s %-30s %-15s %s\n"
+            "------------------------------------------------------------------------\n",
+            filename, "Tag", "Timestamp", "Size", "Created By");
+    size_t used = (size_t)n;
+
+    for (size_t i = first; i < last; ++i) {
+        char timestamp_str[64];
+        time_t timestamp = (time_t)entries[i].timestamp;
+        struct tm tm_info;
+        localtime_r(&timestamp, &tm_info);
+        strftime(timestamp_str, sizeof(timestamp_str), "%Y-%m-%d %H:%M:%S", &tm_info);
+        char row[MAX_TAG + 192];
+        n = snprintf(row, sizeof(row), "%-20s %-30s %-15llu %s\n", entries[i].tag, timestamp_str,
+                     (unsigned long long)entries[i].size, entries[i].creator);
+        if (used + (size_t)n >= sizeof(response)) {
+            send(client_sock, response, used, 0);
+            used = 0;
+        }
+        memcpy(response + used, row, (size_t)n);
+        used += (size_t)n;
+    }
+    if (used) send(client_sock, response, used, 0);
+    free(entries);
+
+    if (page > 0) {
+        snprintf(response, sizeof(response), 
+                "\nPage %d of %zu (%zu per page), total: %zu checkpoint(s)\n", page, pages, (size_t)per_page, count);
+    } else {
+        snprintf(response, sizeof(response), 
+                "\nTotal: %zu checkpoint(s)\n", count);
+    }
     send(client_sock, response, strlen(response), 0);
+    return 0;
+}
 
-    struct dirent *entry;
-    int count = 0;
-    char prefix[MAX_FILENAME + 2];
-    snprintf(prefix, sizeof(prefix), "%s_", sanitized);
-    size_t prefix_len = strlen(prefix);
-
-    while ((entry = readdir(dir)) != NULL) {
-        // Check if entry matches our file and is a checkpoint file
-        if (strncmp(entry->d_name, prefix, prefix_len) == 0 && 
-            strstr(entry->d_name, ".ckpt") != NULL) {
-            
-            // Extract tag
-            char tag[MAX_TAG];
-            const char *tag_start = entry->d_name + prefix_len;
-            const char *tag_end = strstr(tag_start, ".ckpt");
-            size_t tag_len = tag_end - tag_start;
-            strncpy(tag, tag_start, tag_len);
-            tag[tag_len] = '\0';
-
-            // Get checkpoint file stats
-            char ckpt_path[MAX_PATH];
-            
-
-            int written = snprintf(
-                ckpt_path,
-                sizeof(ckpt_path),
-                "%s/%s",
-                checkpoint_dir,
-                entry->d_name
-            );
-
-            if (written < 0 || written >= (int)sizeof(ckpt_path)) {
-                // Path got truncated or snprintf failed; skip this entry
-                continue;
-            }
-            
-            struct stat st;
-            if (stat(ckpt_path, &st) == 0) {
-                // Try to read metadata
-                char meta_path[MAX_PATH];
-                snprintf(meta_path, MAX_PATH, "%s/storage%d/checkpoints/%s_%s.meta", 
-                        STORAGE_DIR, storage_id, sanitized, tag);
-                
-                char timestamp_str[64] = "N/A";
-                char created_by[64] = "Unknown";
-                
-                FILE *meta = fopen(meta_path, "r");
-                if (meta) {
-                    char line[256];
-                    while (fgets(line, sizeof(line), meta)) {
-                        if (strncmp(line, "timestamp=", 10) == 0) {
-                            long ts = atol(line + 10);
-                            time_t timestamp = (time_t)ts;
-                            struct tm *tm_info = localtime(&timestamp);
-                            strftime(timestamp_str, sizeof(timestamp_str), 
-                                   "%Y-%m-%d %H:%M:%S", tm_info);
-                        }
-                        else if (strncmp(line, "created_by=", 11) == 0) {
-                            strncpy(created_by, line + 11, sizeof(created_by) - 1);
-                            created_by[strcspn(created_by, "\n")] = 0;
-                        }
-                    }
-                    fclose(meta);
-                }
-
-                snprintf(response, sizeof(response), 
-                        "%-20s %-30s %-15ld %s\n", 
-                        tag, timestamp_str, (long)st.st_size, created_by);
-                send(client_sock, response, strlen(response), 0);
-                count++;
-            }
+// One version of a document for DIFF: its text and each sentence's body span and hash
+typedef struct {
+    char *text;
+    size_t len, cap;
+    size_t count, slots;
+    size_t *off, *slen;
+    uint64_t *hash;
+} DiffVersion;
+
+static int buffer_sink(const char *data, size_t len, void *user) {
+    DiffVersion *v = (DiffVersion *)user;
+    if (v->len + len + 1 > v->cap) {
+        size_t cap = (v->cap ? v->cap * 2 : 65536) + len;
+        char *grown = realloc(v->text, cap);
+        if (!grown) return -1;
+        v->text = grown;
+        v->cap = cap;
+    }
+    memcpy(v->text + v->len, data, len);
+    v->len += len;
+    return 0;
+}
+
+static void collect_sentence(size_t off, size_t len, void *user) {
+    DiffVersion *v = (DiffVersion *)user;
+    if (v->count == v->slots) {
+        size_t slots = v->slots ? v->slots * 2 : 256;
+        size_t *o = realloc(v->off, slots * sizeof(size_t));
+        if (o) v->off = o;
+        size_t *l = realloc(v->slen, slots * sizeof(size_t));
+        if (l) v->slen = l;
+        uint64_t *h = realloc(v->hash, slots * sizeof(uint64_t));
+        if (h) v->hash = h;
+        if (!o || !l || !h) return;
+        v->slots = slots;
+    }
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < len; ++i) hash = (hash ^ (unsigned char)v->text[off + i]) * 1099511628211ull;
+    v->off[v->count] = off;
+    v->slen[v->count] = len;
+    v->hash[v->count++] = hash;
+}
+
+// Load a checkpoint (or the live file, for CURRENT) and split it into sentences.
+// Returns 0, -2 if the checkpoint does not exist, -1 on error.
+static int load_version(const char *filename, const char *tag, int storage_id, DiffVersion *v) {
+    char path[MAX_PATH];
+    int rc;
+    if (strcmp(tag, "CURRENT") == 0) {
+        snprintf(path, MAX_PATH, "%s/storage%d/files/%s", STORAGE_DIR, storage_id, filename);
+        commit_read_lock(filename);
+        FILE *fp = fopen(path, "rb");
+        char chunk[MAX_BUFFER];
+        size_t got;
+        rc = fp ? 0 : -2;
+        while (fp && rc == 0 && (got = fread(chunk, 1, sizeof(chunk), fp)) > 0) rc = buffer_sink(chunk, got, v);
+        if (fp) fclose(fp);
+        commit_read_unlock(filename);
+    } else {
+        char sanitized[MAX_FILENAME];
+        sanitize_filename(filename, sanitized, MAX_FILENAME);
+        snprintf(path, MAX_PATH, "%s/storage%d/checkpoints/%s_%s.ckpt", STORAGE_DIR, storage_id, sanitized, tag);
+        struct stat st;
+        rc = stat(path, &st) == 0 ? chunkstore_read(path, buffer_sink, v) : -2;
+    }
+    if (rc != 0) return rc;
+
+    Document *doc = doc_from_text(v->text ? v->text : "", v->len);
+    if (!doc) return -1;
+    doc_each_sentence(doc, 0, collect_sentence, v);
+    size_t expect = doc_sentence_count(doc);
+    doc_free(doc);
+    return v->count == expect ? 0 : -1;
+}
+
+static void free_version(DiffVersion *v) {
+    free(v->text);
+    free(v->off);
+    free(v->slen);
+    free(v->hash);
+}
+
+typedef struct {
+    const DiffVersion *a, *b;
+} DiffPair;
+
+static int sentences_equal(size_t i, size_t j, void *user) {
+    const DiffPair *p = (const DiffPair *)user;
+    return p->a->hash[i] == p->b->hash[j] && p->a->slen[i] == p->b->slen[j] &&
+           memcmp(p->a->text + p->a->off[i], p->b->text + p->b->off[j], p->a->slen[i]) == 0;
+}
+
+// Buffered writer for the hunk stream
+typedef struct {
+    int sock;
+    size_t used;
+    char buf[MAX_BUFFER];
+} DiffOut;
+
+static void out_write(DiffOut *o, const char *data, size_t len) {
+    while (len > 0) {
+        size_t n = sizeof(o->buf) - o->used < len ? sizeof(o->buf) - o->used : len;
+        memcpy(o->buf + o->used, data, n);
+        o->used += n;
+        data += n;
+        len -= n;
+        if (o->used == sizeof(o->buf)) {
+            send(o->sock, o->buf, o->used, MSG_NOSIGNAL);
+            o->used = 0;
         }
     }
+}
 
-    closedir(dir);
+static void out_line(DiffOut *o, char mark, const DiffVersion *v, size_t k) {
+    char prefix[2] = {mark, ' '};
+    out_write(o, prefix, 2);
+    out_write(o, v->text + v->off[k], v->slen[k]);
+    out_write(o, "\n", 1);
+}
 
-    if (count == 0) {
+// Sentence-level diff between two checkpoints, or a checkpoint and the live file
+int checkpoint_diff(int client_sock, const char *filename, const char *tag_a, const char *tag_b,
+                    const char *username, int storage_id) {
+    char response[1024];
+
+    // Check read access
+    if (!check_read_access(filename, username)) {
         snprintf(response, sizeof(response), 
-                "No checkpoints found for this file\n");
+                "Error: Access denied. You do not have read permission for '%s'\n", 
+                filename);
         send(client_sock, response, strlen(response), 0);
-    } else {
-        snprintf(response, sizeof(response), 
-                "\nTotal: %d checkpoint(s)\n", count);
+        return -1;
+    }
+
+    DiffVersion a, b;
+    memset(&a, 0, sizeof(a));
+    memset(&b, 0, sizeof(b));
+    int rc = load_version(filename, tag_a, storage_id, &a);
+    const char *failed = tag_a;
+    if (rc == 0) {
+        rc = load_version(filename, tag_b, storage_id, &b);
+        failed = tag_b;
+    }
+    unsigned char *a_del = NULL, *b_ins = NULL;
+    DiffPair pair = {&a, &b};
+    if (rc == 0) {
+        a_del = calloc(a.count + 1, 1);
+        b_ins = calloc(b.count + 1, 1);
+        rc = a_del && b_ins ? diff_mark(a.count, b.count, sentences_equal, &pair, a_del, b_ins) : -1;
+    }
+    if (rc != 0) {
+        if (rc == -2 && strcmp(failed, "CURRENT") == 0) {
+            snprintf(response, sizeof(response), "Error: File '%s' not found\n", filename);
+        } else if (rc == -2) {
+            snprintf(response, sizeof(response), 
+                    "Error: Checkpoint '%s' not found for file '%s'\n", failed, filename);
+        } else {
+            snprintf(response, sizeof(response), "Error: Failed to compute diff\n");
+        }
         send(client_sock, response, strlen(response), 0);
+        free(a_del);
+        free(b_ins);
+        free_version(&a);
+        free_version(&b);
+        return -1;
     }
 
-    return 0;
-}
\ No newline at end of file
+    // Hunks: "@@ -<first>,<count> +<first>,<count> @@" (sentence numbers as READ uses
+    // them), then the removed sentences ('-') and the added ones ('+')
+    DiffOut *out = malloc(sizeof(DiffOut));
+    if (out) {
+        out->sock = client_sock;
+        out->used = 0;
+        int n = snprintf(response, sizeof(response), "=== Diff of '%s': %s -> %s ===\n", filename, tag_a, tag_b);
+        out_write(out, response, (size_t)n);
+        size_t i = 0, j = 0, hunks = 0, removed = 0, added = 0;
+        while (i < a.count || j < b.count) {
+            if (i < a.count && j < b.count && !a_del[i] && !b_ins[j]) {
+                i++;
+                j++;
+                continue;
+            }
+            size_t i0 = i, j0 = j;
+            while ((i < a.count && a_del[i]) || (j < b.count && b_ins[j])) {
+                if (i < a.count && a_del[i]) i++;
+                else j++;
+            }
+            n = snprintf(response, sizeof(response), "@@ -%zu,%zu +%zu,%zu @@\n", i0, i - i0, j0, j - j0);
+            out_write(out, response, (size_t)n);
+            for (size_t k = i0; k < i; ++k) out_line(out, '-', &a, k);
+            for (size_t k = j0; k < j; ++k) out_line(out, '+', &b, k);
+            hunks++;
+            removed += i - i0;
+            added += j - j0;
+        }
+        if (hunks == 0) {
+            n = snprintf(response, sizeof(response), "No differences (%zu sentence(s))\n", a.count);
+        } else {
+            n = snprintf(response, sizeof(response), "=== %zu hunk(s): %zu sentence(s) removed, %zu added ===\n",
+                         hunks, removed, added);
+        }
+        out_write(out, response, (size_t)n);
+        if (out->used) send(client_sock, out->buf, out->used, MSG_NOSIGNAL);
+        free(out);
+    }
+    free(a_del);
+    free(b_ins);
+    free_version(&a);
+    free_version(&b);
+    return out ? 0 : -1;
+}
+
+// Drop every checkpoint of a deleted file, releasing its chunks
+void checkpoint_remove_all(const char *filename, int storage_id) {
+    char sanitized[MAX_FILENAME];
+    sanitize_filename(filename, sanitized, MAX_FILENAME);
+
+    pthread_mutex_lock(&index_lock);
+    CkptFile *f = index_file(filename, 0);
+    for (size_t i = 0; f && i < f->count; ++i) {
+        char ckpt_path[MAX_PATH], meta_path[MAX_PATH];
+        snprintf(ckpt_path, MAX_PATH, "%s/storage%d/checkpoints/%s_%s.ckpt",
+                 STORAGE_DIR, storage_id, sanitized, f->entries[i].tag);
+        snprintf(meta_path, MAX_PATH, "%s/storage%d/checkpoints/%s_%s.meta",
+                 STORAGE_DIR, storage_id, sanitized, f->entries[i].tag);
+        chunkstore_release(ckpt_path);
+        unlink(meta_path);
+    }
+    if (f) f->count = 0;
+    char path[MAX_PATH];
+    list_path(path, sizeof(path), filename, storage_id);
+    unlink(path);
+    pthread_mutex_unlock(&index_lock);
+}
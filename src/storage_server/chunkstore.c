@@ -0,0 +1,484 @@
+#include "../../include/common.h"
+#include "../../include/chunkstore.h"
+#include "../../include/compress.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#define CHUNK_BUCKETS 4096
+#define CHUNK_HEADER 9          // "DSZ1", raw length (u32), 1 = LZ / 0 = stored
+
+// A chunk's name: two independent 64-bit hashes of its bytes. Storing a chunk whose name
+// is already taken compares the bytes, so a collision fails the checkpoint rather than
+// silently sharing the wrong data.
+typedef struct {
+    uint64_t h[2];
+} ChunkId;
+
+typedef struct ChunkRef {
+    struct ChunkRef *next;
+    ChunkId id;
+    uint32_t refs;
+} ChunkRef;
+
+// Reference counts; store_lock also orders chunk creation against deletion
+static pthread_mutex_t store_lock = PTHREAD_MUTEX_INITIALIZER;
+static ChunkRef *buckets[CHUNK_BUCKETS];
+
+static uint64_t gear[256];
+static pthread_once_t gear_once = PTHREAD_ONCE_INIT;
+
+static void gear_init(void) {
+    uint64_t x = 0x4443535070707031ull;     // fixed, so boundaries are stable across restarts
+    for (int i = 0; i < 256; ++i) {
+        uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        gear[i] = z ^ (z >> 31);
+    }
+}
+
+// Length of the chunk starting at p: the first position past CHUNK_MIN where the top
+// CHUNK_AVG_BITS of the rolling hash (which covers the last 64 bytes) are all zero
+static size_t next_boundary(const unsigned char *p, size_t n) {
+    if (n <= CHUNK_MIN) return n;
+    size_t max = n < CHUNK_MAX ? n : CHUNK_MAX;
+    const uint64_t mask = ~0ull << (64 - CHUNK_AVG_BITS);
+    uint64_t h = 0;
+    for (size_t i = CHUNK_MIN - 64; i < max; ++i) {
+        h = (h << 1) + gear[p[i]];
+        if (i >= CHUNK_MIN && (h & mask) == 0) return i + 1;
+    }
+    return max;
+}
+
+static ChunkId chunk_id(const unsigned char *p, size_t n) {
+    ChunkId id = {{14695981039346656037ull, 0x6a09e667f3bcc908ull ^ n}};
+    for (size_t i = 0; i < n; ++i) {
+        id.h[0] = (id.h[0] ^ p[i]) * 1099511628211ull;
+        id.h[1] = ((id.h[1] ^ p[i]) * 0x9E3779B97F4A7C15ull);
+        id.h[1] ^= id.h[1] >> 29;
+    }
+    return id;
+}
+
+static void chunk_dir(char *buf, size_t sz) {
+    snprintf(buf, sz, "%s/storage%d/chunks", STORAGE_DIR, get_storage_id());
+}
+
+static void chunk_path(char *buf, size_t sz, const ChunkId *id) {
+    snprintf(buf, sz, "%s/storage%d/chunks/%02x/%016llx%016llx", STORAGE_DIR, get_storage_id(),
+             (unsigned)(id->h[0] >> 56), (unsigned long long)id->h[0], (unsigned long long)id->h[1]);
+}
+
+static int parse_id(const char *hex, ChunkId *id) {
+    unsigned long long a, b;
+    if (strlen(hex) < 32 || sscanf(hex, "%16llx%16llx", &a, &b) != 2) return -1;
+    id->h[0] = a;
+    id->h[1] = b;
+    return 0;
+}
+
+// Caller holds store_lock
+static ChunkRef **find_ref(const ChunkId *id) {
+    ChunkRef **pp = &buckets[id->h[0] % CHUNK_BUCKETS];
+    while (*pp && ((*pp)->id.h[0] != id->h[0] || (*pp)->id.h[1] != id->h[1])) pp = &(*pp)->next;
+    return pp;
+}
+
+static int add_ref(const ChunkId *id) {
+    ChunkRef **pp = find_ref(id);
+    if (!*pp) {
+        if ((*pp = calloc(1, sizeof(ChunkRef))) == NULL) return -1;
+        (*pp)->id = *id;
+    }
+    (*pp)->refs++;
+    return 0;
+}
+
+static void drop_ref(const ChunkId *id) {
+    ChunkRef **pp = find_ref(id);
+    if (*pp && --(*pp)->refs == 0) {
+        ChunkRef *dead = *pp;
+        *pp = dead->next;
+        free(dead);
+        char path[512];
+        chunk_path(path, sizeof(path), id);
+        unlink(path);
+    }
+}
+
+static int write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Chunk n bytes long at path into buf: packed (header, then LZ data or the bytes as-is)
+// or, for chunks that did not compress and those from before compression, raw
+static int load_chunk(const char *path, char *buf, size_t n) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size > lz_bound(n) + CHUNK_HEADER) {
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    size_t size = (size_t)st.st_size;
+    char *file = malloc(size + 1);
+    int rc = file && read(fd, file, size) == (ssize_t)size ? 0 : -1;
+    close(fd);
+    uint32_t raw_len;
+    if (rc == 0 && size >= CHUNK_HEADER && memcmp(file, CHUNK_PACKED_MAGIC, 4) == 0 &&
+        (memcpy(&raw_len, file + 4, 4), raw_len == n)) {
+        if (file[8] == 1) rc = lz_decompress(LZ_CHECKPOINT, file + CHUNK_HEADER, size - CHUNK_HEADER, buf, n);
+        else if (size - CHUNK_HEADER == n) memcpy(buf, file + CHUNK_HEADER, n);
+        else rc = -1;
+    } else if (rc == 0 && size == n) {
+        memcpy(buf, file, n);
+    } else {
+        rc = -1;
+    }
+    free(file);
+    return rc;
+}
+
+// On-disk form of a chunk: LZ-packed with a header if that is smaller, else the raw bytes
+// (with a header only if they would otherwise look like one). *len is set; NULL if no memory.
+static char *pack_chunk(const unsigned char *p, size_t n, size_t *len) {
+    char *out = malloc(CHUNK_HEADER + lz_bound(n));
+    if (!out) return NULL;
+    uint32_t raw_len = (uint32_t)n;
+    size_t packed = lz_compress(LZ_CHECKPOINT, (const char *)p, n, out + CHUNK_HEADER);
+    if (packed == 0 && (n < 4 || memcmp(p, CHUNK_PACKED_MAGIC, 4) != 0)) {
+        memcpy(out, p, n);
+        *len = n;
+        return out;
+    }
+    memcpy(out, CHUNK_PACKED_MAGIC, 4);
+    memcpy(out + 4, &raw_len, 4);
+    out[8] = packed ? 1 : 0;
+    if (!packed) memcpy(out + CHUNK_HEADER, p, n);
+    *len = CHUNK_HEADER + (packed ? packed : n);
+    return out;
+}
+
+// Make sure the chunk's bytes are in the store and take a reference on them
+static int store_chunk(const unsigned char *p, size_t n, ChunkId *out) {
+    ChunkId id = chunk_id(p, n);
+    char path[512], tmp[560];
+    chunk_path(path, sizeof(path), &id);
+    *out = id;
+
+    pthread_mutex_lock(&store_lock);
+    int rc = 0;
+    struct stat st;
+    if (stat(path, &st) == 0) {
+        // Already stored: it must hold these exact bytes
+        char *have = malloc(n + 1);
+        rc = have && load_chunk(path, have, n) == 0 && memcmp(have, p, n) == 0 ? 0 : -1;
+        free(have);
+    } else {
+        char dir[512];
+        snprintf(dir, sizeof(dir), "%.*s", (int)(strrchr(path, '/') - path), path);
+        mkdir(dir, 0755);
+        snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+        size_t len;
+        char *packed = pack_chunk(p, n, &len);
+        int fd = packed ? open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644) : -1;
+        rc = fd >= 0 && write_all(fd, packed, len) == 0 ? 0 : -1;
+        free(packed);
+        if (fd >= 0 && close(fd) != 0) rc = -1;
+        if (rc == 0) rc = rename(tmp, path);
+        if (rc != 0) unlink(tmp);
+    }
+    if (rc == 0) rc = add_ref(&id);
+    pthread_mutex_unlock(&store_lock);
+    return rc;
+}
+
+static void release_ids(const ChunkId *ids, size_t n) {
+    pthread_mutex_lock(&store_lock);
+    for (size_t i = 0; i < n; ++i) drop_ref(&ids[i]);
+    pthread_mutex_unlock(&store_lock);
+}
+
+// Set once the filesystem has refused a reflink, so later checkpoints go straight to chunking
+static int reflink_unsupported;
+
+// Make dst a reflink of src: it shares src's blocks (copy-on-write) instead of copying them
+static int clone_file(const char *src, const char *dst) {
+#ifdef FICLONE
+    if (reflink_unsupported) return -1;
+    int in = open(src, O_RDONLY);
+    int out = in >= 0 ? open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0644) : -1;
+    int rc = out >= 0 && ioctl(out, FICLONE, in) == 0 ? 0 : -1;
+    if (rc != 0 && out >= 0 && (errno == EOPNOTSUPP || errno == ENOTTY || errno == EINVAL || errno == EXDEV)) {
+        reflink_unsupported = 1;
+    }
+    if (out >= 0 && close(out) != 0) rc = -1;
+    if (in >= 0) close(in);
+    if (rc != 0 && out >= 0) unlink(dst);
+    return rc;
+#else
+    (void)src;
+    (void)dst;
+    return -1;
+#endif
+}
+
+// Checkpoint as a reflink of the document: constant time whatever the size, and stored
+// raw (read like a full copy). Declined if the content could be mistaken for a manifest.
+static int clone_checkpoint(const char *src_path, const char *manifest_path, uint64_t *size) {
+    char tmp[1100], head[sizeof(CHUNK_MANIFEST_MAGIC)] = "";
+    snprintf(tmp, sizeof(tmp), "%s.tmp", manifest_path);
+    if (clone_file(src_path, tmp) != 0) return -1;
+    struct stat st;
+    int fd = open(tmp, O_RDONLY);
+    int rc = fd >= 0 && fstat(fd, &st) == 0 ? 0 : -1;
+    if (rc == 0 && read(fd, head, sizeof(head) - 1) == (ssize_t)sizeof(head) - 1 &&
+        memcmp(head, CHUNK_MANIFEST_MAGIC, sizeof(head) - 1) == 0) {
+        rc = -1;
+    }
+    if (fd >= 0) close(fd);
+    if (rc == 0) rc = rename(tmp, manifest_path);
+    if (rc != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    *size = (uint64_t)st.st_size;
+    return 0;
+}
+
+int chunkstore_put(const char *src_path, const char *manifest_path, uint64_t *size) {
+    if (clone_checkpoint(src_path, manifest_path, size) == 0) return 0;
+    pthread_once(&gear_once, gear_init);
+    int fd = open(src_path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    size_t len = (size_t)st.st_size;
+    const unsigned char *data = NULL;
+    if (len > 0) {
+        void *m = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m == MAP_FAILED) {
+            close(fd);
+            return -1;
+        }
+        data = (const unsigned char *)m;
+    }
+    close(fd);
+
+    // Chunk list: "<id> <len>" per line after the header
+    size_t cap = len / CHUNK_MIN + 2, n = 0;
+    ChunkId *ids = malloc(cap * sizeof(ChunkId));
+    size_t *lens = malloc(cap * sizeof(size_t));
+    int rc = ids && lens ? 0 : -1;
+    for (size_t off = 0; rc == 0 && off < len; ) {
+        size_t clen = next_boundary(data + off, len - off);
+        rc = store_chunk(data + off, clen, &ids[n]);
+        if (rc == 0) lens[n++] = clen;
+        off += clen;
+    }
+    if (data) munmap((void *)data, len);
+
+    char tmp[1100];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", manifest_path);
+    FILE *fp = rc == 0 ? fopen(tmp, "w") : NULL;
+    if (fp) {
+        fprintf(fp, "%s %zu %zu\n", CHUNK_MANIFEST_MAGIC, len, n);
+        for (size_t i = 0; i < n; ++i) {
+            fprintf(fp, "%016llx%016llx %zu\n", (unsigned long long)ids[i].h[0],
+                    (unsigned long long)ids[i].h[1], lens[i]);
+        }
+        if (fclose(fp) != 0) rc = -1;
+    } else {
+        rc = -1;
+    }
+    if (rc == 0) rc = rename(tmp, manifest_path);
+    if (rc != 0) {
+        unlink(tmp);
+        if (ids) release_ids(ids, n);
+    }
+    free(ids);
+    free(lens);
+    if (rc == 0) *size = len;
+    return rc;
+}
+
+// Open a manifest; returns NULL for a legacy full-copy checkpoint (*legacy set) or error
+static FILE *open_manifest(const char *manifest_path, uint64_t *size, size_t *count, int *legacy) {
+    FILE *fp = fopen(manifest_path, "r");
+    *legacy = 0;
+    if (!fp) return NULL;
+    char magic[8] = "";
+    unsigned long long sz = 0;
+    size_t n = 0;
+    if (fscanf(fp, "%7s %llu %zu", magic, &sz, &n) != 3 || strcmp(magic, CHUNK_MANIFEST_MAGIC) != 0) {
+        fclose(fp);
+        *legacy = 1;
+        return NULL;
+    }
+    *size = sz;
+    *count = n;
+    return fp;
+}
+
+int chunkstore_read(const char *manifest_path, ChunkSink sink, void *user) {
+    uint64_t size;
+    size_t count;
+    int legacy;
+    FILE *fp = open_manifest(manifest_path, &size, &count, &legacy);
+    char *buf = malloc(CHUNK_MAX > 4096 ? CHUNK_MAX : 4096);
+    int rc = buf ? 0 : -1;
+
+    if (!fp && legacy && rc == 0) {
+        FILE *raw = fopen(manifest_path, "rb");
+        size_t got;
+        if (!raw) rc = -1;
+        while (rc == 0 && raw && (got = fread(buf, 1, 4096, raw)) > 0) {
+            if (sink(buf, got, user) != 0) break;
+        }
+        if (raw) fclose(raw);
+    } else if (!fp) {
+        rc = -1;
+    }
+
+    for (size_t i = 0; fp && rc == 0 && i < count; ++i) {
+        char hex[40];
+        size_t clen;
+        ChunkId id;
+        char path[512];
+        if (fscanf(fp, "%39s %zu", hex, &clen) != 2 || parse_id(hex, &id) != 0 || clen > CHUNK_MAX) {
+            rc = -1;
+            break;
+        }
+        chunk_path(path, sizeof(path), &id);
+        if (load_chunk(path, buf, clen) != 0) rc = -1;
+        if (rc == 0 && sink(buf, clen, user) != 0) break;
+    }
+    if (fp) fclose(fp);
+    free(buf);
+    return rc;
+}
+
+static int file_sink(const char *data, size_t len, void *user) {
+    return fwrite(data, 1, len, (FILE *)user) == len ? 0 : -1;
+}
+
+int chunkstore_restore(const char *manifest_path, const char *dest_path) {
+    uint64_t size;
+    size_t count;
+    int legacy;
+    FILE *fp = open_manifest(manifest_path, &size, &count, &legacy);
+    if (fp) fclose(fp);
+    // A raw (reflinked or full-copy) checkpoint can itself be reflinked back
+    if (!fp && legacy && clone_file(manifest_path, dest_path) == 0) return 0;
+
+    FILE *out = fopen(dest_path, "wb");
+    int rc = out ? chunkstore_read(manifest_path, file_sink, out) : -1;
+    if (out && fclose(out) != 0) rc = -1;
+    if (rc != 0) unlink(dest_path);
+    return rc;
+}
+
+int chunkstore_size(const char *manifest_path, uint64_t *size) {
+    size_t count;
+    int legacy;
+    FILE *fp = open_manifest(manifest_path, size, &count, &legacy);
+    if (fp) {
+        fclose(fp);
+        return 0;
+    }
+    struct stat st;
+    if (!legacy || stat(manifest_path, &st) != 0) return -1;
+    *size = (uint64_t)st.st_size;
+    return 0;
+}
+
+// Apply fn to every chunk id in a manifest (nothing for legacy checkpoints)
+static void each_id(const char *manifest_path, void (*fn)(const ChunkId *)) {
+    uint64_t size;
+    size_t count;
+    int legacy;
+    FILE *fp = open_manifest(manifest_path, &size, &count, &legacy);
+    if (!fp) return;
+    char hex[40];
+    size_t clen;
+    ChunkId id;
+    for (size_t i = 0; i < count && fscanf(fp, "%39s %zu", hex, &clen) == 2; ++i) {
+        if (parse_id(hex, &id) == 0) fn(&id);
+    }
+    fclose(fp);
+}
+
+static void each_add(const ChunkId *id) {
+    add_ref(id);
+}
+
+int chunkstore_release(const char *manifest_path) {
+    pthread_mutex_lock(&store_lock);
+    each_id(manifest_path, drop_ref);
+    int rc = unlink(manifest_path);
+    pthread_mutex_unlock(&store_lock);
+    return rc;
+}
+
+void chunkstore_init(void) {
+    char dir[512];
+    snprintf(dir, sizeof(dir), "%s/storage%d/checkpoints", STORAGE_DIR, get_storage_id());
+
+    // Mark: every chunk a manifest lists
+    pthread_mutex_lock(&store_lock);
+    size_t manifests = 0;
+    DIR *d = opendir(dir);
+    struct dirent *entry;
+    while (d && (entry = readdir(d)) != NULL) {
+        size_t n = strlen(entry->d_name);
+        if (n <= 5 || strcmp(entry->d_name + n - 5, ".ckpt") != 0) continue;
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        each_id(path, each_add);
+        manifests++;
+    }
+    if (d) closedir(d);
+
+    // Sweep: chunks (and interrupted writes) nothing references
+    size_t kept = 0, swept = 0;
+    chunk_dir(dir, sizeof(dir));
+    d = opendir(dir);
+    while (d && (entry = readdir(d)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        char sub[800];
+        snprintf(sub, sizeof(sub), "%s/%s", dir, entry->d_name);
+        DIR *sd = opendir(sub);
+        struct dirent *ce;
+        while (sd && (ce = readdir(sd)) != NULL) {
+            if (ce->d_name[0] == '.') continue;
+            ChunkId id;
+            if (strlen(ce->d_name) == 32 && parse_id(ce->d_name, &id) == 0 && *find_ref(&id)) {
+                kept++;
+                continue;
+            }
+            char path[1100];
+            snprintf(path, sizeof(path), "%s/%s", sub, ce->d_name);
+            unlink(path);
+            swept++;
+        }
+        if (sd) closedir(sd);
+    }
+    if (d) closedir(d);
+    pthread_mutex_unlock(&store_lock);
+    printf("Chunk store: %zu manifest(s), %zu chunk(s) in use, %zu unreferenced removed\n",
+           manifests, kept, swept);
+}
@@ -0,0 +1,462 @@
+#include "../../include/common.h"
+#include "../../include/commit.h"
+#include "../../include/doccount.h"
+#include "../../include/meta_store.h"
+#include "../../include/sentidx.h"
+#include "../../include/undo.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/sendfile.h>
+
+typedef struct {
+    char magic[4];
+    uint32_t reserved;
+    uint64_t off;           // where the data goes in the document
+    uint64_t len;           // bytes of data following the header
+    uint64_t size;          // document size after the commit
+    uint64_t sum;           // FNV-1a over the fields above and the data
+} JournalHeader;
+
+// Sentence renumbering done by one commit: sentences after `at` moved by delta
+typedef struct {
+    uint64_t version;
+    size_t at;
+    long delta;
+} Shift;
+
+// Committed versions of one file (since the server started). Guarded by the file's
+// stripe lock, except the table links, which history_lock guards.
+typedef struct FileHistory {
+    struct FileHistory *next;
+    char filename[256];
+    uint64_t version;
+    Shift shifts[COMMIT_HISTORY];   // ring, indexed by version % COMMIT_HISTORY
+} FileHistory;
+
+static pthread_mutex_t history_lock = PTHREAD_MUTEX_INITIALIZER;
+static FileHistory *histories[COMMIT_LOCK_STRIPES * 4];
+
+static pthread_rwlock_t stripes[COMMIT_LOCK_STRIPES];
+static pthread_once_t stripes_once = PTHREAD_ONCE_INIT;
+
+static void stripes_init(void) {
+    for (int i = 0; i < COMMIT_LOCK_STRIPES; ++i) pthread_rwlock_init(&stripes[i], NULL);
+}
+
+static pthread_rwlock_t *stripe(const char *filename) {
+    pthread_once(&stripes_once, stripes_init);
+    uint32_t h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)filename; *p; ++p) h = (h ^ *p) * 16777619u;
+    return &stripes[h % COMMIT_LOCK_STRIPES];
+}
+
+void commit_read_lock(const char *filename) {
+    pthread_rwlock_rdlock(stripe(filename));
+}
+
+void commit_read_unlock(const char *filename) {
+    pthread_rwlock_unlock(stripe(filename));
+}
+
+void commit_write_lock(const char *filename) {
+    pthread_rwlock_wrlock(stripe(filename));
+}
+
+void commit_write_unlock(const char *filename) {
+    pthread_rwlock_unlock(stripe(filename));
+}
+
+int commit_snapshot(int fd, uint64_t off, uint64_t len, uint64_t mem_max, CommitSnapshot *snap) {
+    snap->buf = NULL;
+    snap->fd = -1;
+    snap->len = len;
+    if (len <= mem_max) {
+        snap->buf = malloc(len ? (size_t)len : 1);
+        if (!snap->buf) return -1;
+        for (uint64_t got = 0; got < len;) {
+            ssize_t n = pread(fd, snap->buf + got, (size_t)(len - got), (off_t)(off + got));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                commit_snapshot_free(snap);
+                return -1;
+            }
+            got += (uint64_t)n;
+        }
+        return 0;
+    }
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/storage%d/swap/snapshot.XXXXXX", STORAGE_DIR, get_storage_id());
+    snap->fd = mkstemp(path);
+    if (snap->fd < 0) return -1;
+    unlink(path);
+    // Copied in the kernel; pread / write where sendfile() cannot write to a file
+    off_t pos = (off_t)off;
+    uint64_t done = 0;
+    while (done < len) {
+        ssize_t n = sendfile(snap->fd, fd, &pos, (size_t)(len - done < (1u << 30) ? len - done : (1u << 30)));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        done += (uint64_t)n;
+    }
+    char buf[65536];
+    while (done < len) {
+        size_t want = len - done < sizeof(buf) ? (size_t)(len - done) : sizeof(buf);
+        ssize_t n = pread(fd, buf, want, (off_t)(off + done));
+        if (n <= 0 || pwrite(snap->fd, buf, (size_t)n, (off_t)done) != n) {
+            commit_snapshot_free(snap);
+            return -1;
+        }
+        done += (uint64_t)n;
+    }
+    if (lseek(snap->fd, 0, SEEK_SET) != 0) {
+        commit_snapshot_free(snap);
+        return -1;
+    }
+    return 0;
+}
+
+void commit_snapshot_free(CommitSnapshot *snap) {
+    free(snap->buf);
+    snap->buf = NULL;
+    if (snap->fd >= 0) close(snap->fd);
+    snap->fd = -1;
+}
+
+static FileHistory *history(const char *filename) {
+    uint32_t h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)filename; *p; ++p) h = (h ^ *p) * 16777619u;
+    FileHistory **slot = &histories[h % (COMMIT_LOCK_STRIPES * 4)];
+    pthread_mutex_lock(&history_lock);
+    FileHistory *fh = *slot;
+    while (fh && strcmp(fh->filename, filename) != 0) fh = fh->next;
+    if (!fh && (fh = calloc(1, sizeof(FileHistory))) != NULL) {
+        snprintf(fh->filename, sizeof(fh->filename), "%s", filename);
+        fh->next = *slot;
+        *slot = fh;
+    }
+    pthread_mutex_unlock(&history_lock);
+    return fh;
+}
+
+// Called under the file's stripe lock after every committed change
+static void record_shift(FileHistory *fh, size_t at, long delta) {
+    fh->version++;
+    Shift *sh = &fh->shifts[fh->version % COMMIT_HISTORY];
+    sh->version = fh->version;
+    sh->at = at;
+    sh->delta = delta;
+}
+
+static uint64_t fnv64(uint64_t h, const void *data, size_t n) {
+    const unsigned char *p = (const unsigned char *)data;
+    while (n--) h = (h ^ *p++) * 1099511628211ull;
+    return h;
+}
+
+static uint64_t journal_sum(const JournalHeader *h, const char *data) {
+    uint64_t s = fnv64(14695981039346656037ull, &h->off, sizeof(h->off));
+    s = fnv64(s, &h->len, sizeof(h->len));
+    s = fnv64(s, &h->size, sizeof(h->size));
+    return fnv64(s, data, (size_t)h->len);
+}
+
+static void journal_path(char *buf, size_t sz, const char *filename) {
+    snprintf(buf, sz, "%s/storage%d/swap/%s.journal", STORAGE_DIR, get_storage_id(), filename);
+}
+
+static int write_all(int fd, const char *buf, size_t len, off_t off) {
+    while (len > 0) {
+        ssize_t n = pwrite(fd, buf, len, off);
+        if (n <= 0) return -1;
+        buf += n;
+        len -= (size_t)n;
+        off += n;
+    }
+    return 0;
+}
+
+static int same_file(const struct stat *a, const struct stat *b) {
+    return a->st_ino == b->st_ino && a->st_size == b->st_size &&
+           a->st_mtim.tv_sec == b->st_mtim.tv_sec && a->st_mtim.tv_nsec == b->st_mtim.tv_nsec;
+}
+
+// Apply a journalled region to the open document and make it durable
+static int apply_region(int fd, uint64_t off, const char *data, uint64_t len, uint64_t size) {
+    if (len && write_all(fd, data, (size_t)len, (off_t)off) != 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0) return -1;
+    if ((uint64_t)st.st_size != size && ftruncate(fd, (off_t)size) != 0) return -1;
+    return fdatasync(fd);
+}
+
+// Whole-document fallback: temp file + rename (used when the file moved on since load)
+static int commit_rewrite(const char *filename, const char *path, const Document *doc, struct stat *committed) {
+    char commit_path[512];
+    snprintf(commit_path, sizeof(commit_path), "%s/storage%d/swap/%s.commit", STORAGE_DIR, get_storage_id(), filename);
+    FILE *fp = fopen(commit_path, "w");
+    int saved = fp && doc_write(doc, fp) == 0 && fflush(fp) == 0 && fstat(fileno(fp), committed) == 0;
+    if (fp && fclose(fp) != 0) saved = 0;
+    if (!saved || rename(commit_path, path) != 0) {
+        unlink(commit_path);
+        return -1;
+    }
+    return 0;
+}
+
+// Journal the region, then apply it to fd: `len` bytes of data at `off`, file truncated to
+// `size`. `loaded` is the file's stat before; *committed receives it after.
+static int journal_apply(const char *filename, int fd, uint64_t off, const char *data, uint64_t len,
+                         uint64_t size, const struct stat *loaded, struct stat *committed) {
+    char jpath[512];
+    journal_path(jpath, sizeof(jpath), filename);
+    JournalHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, COMMIT_JOURNAL_MAGIC, 4);
+    h.off = off;
+    h.len = len;
+    h.size = size;
+    h.sum = journal_sum(&h, data);
+
+    int jfd = open(jpath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int rc = (jfd >= 0 && write_all(jfd, (const char *)&h, sizeof(h), 0) == 0 &&
+              write_all(jfd, data, (size_t)h.len, (off_t)sizeof(h)) == 0 && fdatasync(jfd) == 0) ? 0 : -1;
+    if (jfd >= 0) close(jfd);
+    if (rc == 0) rc = apply_region(fd, h.off, data, h.len, h.size);
+    unlink(jpath);
+    if (rc == 0 && fstat(fd, committed) != 0) rc = -1;
+    if (rc == 0 && len > 0 && same_file(committed, loaded)) {
+        // Same size within one clock tick: move mtime on so the change stays detectable
+        struct timespec times[2] = {{0, UTIME_OMIT}, loaded->st_mtim};
+        if (++times[1].tv_nsec == 1000000000L) {
+            times[1].tv_sec++;
+            times[1].tv_nsec = 0;
+        }
+        if (futimens(fd, times) != 0 || fstat(fd, committed) != 0) rc = -1;
+    }
+    return rc;
+}
+
+// Write doc over the file it was loaded from (`loaded`), touching only the bytes from
+// sentence `first` on that changed, and push the change onto the undo history (`delta`:
+// sentences it added from `first` on). Caller holds the file's stripe lock.
+static int commit_range(const char *filename, const char *path, const Document *doc, size_t first,
+                        long delta, const struct stat *loaded, struct stat *committed) {
+    int fd = open(path, O_RDWR);
+    struct stat cur;
+    if (fd < 0 || fstat(fd, &cur) != 0 || !same_file(&cur, loaded)) {
+        if (fd >= 0) close(fd);
+        // No delta against the file as it is now: the history can no longer be replayed
+        undo_forget(filename);
+        return commit_rewrite(filename, path, doc, committed);
+    }
+
+    // Bytes before sentence `first` are unchanged; narrow the rest to the changed region
+    size_t old_total, new_len;
+    const char *old = doc_original(doc, &old_total);
+    size_t off = first < doc_sentence_count(doc) ? doc_sentence_offset(doc, first) : doc_length(doc);
+    if (off > old_total) off = old_total;
+    char *buf = doc_render(doc, first, &new_len);
+    if (!buf) {
+        close(fd);
+        return -1;
+    }
+    old += off;
+    size_t old_len = old_total - off;
+    size_t p = 0;
+    while (p < old_len && p < new_len && old[p] == buf[p]) p++;
+    size_t end = new_len;
+    if (new_len == old_len) {
+        // Same length: patch only the differing bytes in place
+        while (end > p && old[end - 1] == buf[end - 1]) end--;
+    }
+
+    int rc = 0;
+    if (end > p || new_len != old_len) {
+        // The undo history and the counts take only the bytes that differ (common suffix
+        // dropped too)
+        size_t s = 0;
+        while (s < old_len - p && s < new_len - p && old[old_len - 1 - s] == buf[new_len - 1 - s]) s++;
+        DocEdge edge;
+        doccount_edge(old - off, old_total, off + p, off + old_len - s, &edge);
+        rc = journal_apply(filename, fd, off + p, buf + p, end - p, off + new_len, loaded, committed);
+        if (rc == 0) {
+            undo_record(filename, off + p, old + p, old_len - p - s, buf + p, new_len - p - s, first, delta);
+            DocCounts change;
+            doccount_delta(&edge, old + p, old_len - p - s, buf + p, new_len - p - s, &change);
+            doccount_commit(filename, loaded, committed, &change);
+        }
+    } else if (fstat(fd, committed) != 0) {
+        rc = -1;
+    }
+    free(buf);
+    close(fd);
+    return rc;
+}
+
+Document *commit_load(const char *filename, struct stat *st, uint64_t *version) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/storage%d/files/%s", STORAGE_DIR, get_storage_id(), filename);
+    FileHistory *fh = history(filename);
+    pthread_rwlock_t *lock = stripe(filename);
+    pthread_rwlock_rdlock(lock);
+    Document *doc = doc_load(path, st);
+    *version = fh ? fh->version : 0;
+    pthread_rwlock_unlock(lock);
+    return doc;
+}
+
+int commit_edit(const char *filename, Document *doc, size_t at, size_t removed, size_t added,
+                const char *original, uint64_t base, const struct stat *loaded) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/storage%d/files/%s", STORAGE_DIR, get_storage_id(), filename);
+    FileHistory *fh = history(filename);
+    if (!fh) return -1;
+
+    pthread_rwlock_t *lock = stripe(filename);
+    pthread_rwlock_wrlock(lock);
+
+    Document *out = doc, *merged = NULL;
+    size_t before_count = doc_sentence_count(doc) + removed - added;
+    struct stat before = *loaded, committed;
+    size_t idx = at;
+    int rc = 0;
+
+    struct stat cur;
+    if (stat(path, &cur) == 0 && (fh->version != base || !same_file(&cur, loaded))) {
+        // Someone else committed since this session loaded the file: replay the edit onto
+        // the current version. Earlier sentences that were split moved this one down; past
+        // the remembered history there is no telling where it went.
+        if (fh->version - base <= COMMIT_HISTORY) {
+            for (uint64_t v = base + 1; v <= fh->version; ++v) {
+                const Shift *sh = &fh->shifts[v % COMMIT_HISTORY];
+                if (sh->version == v && sh->at < idx) idx = (size_t)((long)idx + sh->delta);
+            }
+            merged = doc_load(path, &before);
+            if (!merged) rc = -1;
+        } else {
+            rc = -2;
+        }
+        if (rc == 0 && idx + removed > (before_count = doc_sentence_count(merged))) rc = -2;
+        if (rc == 0 && removed) {
+            // The sentence must still read as loaded: a change the history does not cover
+            // (REVERT, another writer at its new index) leaves other text at idx
+            char *now = doc_sentence(merged, idx);
+            if (!now) rc = -1;
+            else if (strcmp(now, original) != 0) rc = -2;
+            free(now);
+        }
+        for (size_t i = 0; rc == 0 && i < added; ++i) {
+            char *body = doc_sentence(doc, at + i);
+            if (!body) rc = -1;
+            else if (i < removed) rc = doc_set_sentence(merged, idx + i, body);
+            else rc = doc_insert_sentence(merged, idx + i, body);
+            free(body);
+        }
+        out = merged;
+    }
+
+    long delta = 0;
+    if (rc == 0) {
+        doc_normalize(out, idx, idx + added - 1);
+        delta = (long)doc_sentence_count(out) - (long)before_count;
+        rc = commit_range(filename, path, out, idx, delta, &before, &committed);
+    }
+    if (rc == 0) {
+        record_shift(fh, idx, delta);
+        meta_store_bump_version(filename, time(NULL));
+        // Sentences before the edited one keep their index entries
+        sentidx_update(filename, out, idx, &before, &committed);
+    }
+    pthread_rwlock_unlock(lock);
+    doc_free(merged);
+    return rc;
+}
+
+int commit_splice(const char *filename, uint64_t off, const char *expect, size_t expect_len,
+                  const char *repl, size_t repl_len, size_t at, long delta) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/storage%d/files/%s", STORAGE_DIR, get_storage_id(), filename);
+    FileHistory *fh = history(filename);
+    int fd = open(path, O_RDWR);
+    struct stat before, committed;
+    if (!fh || fd < 0 || fstat(fd, &before) != 0) {
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    uint64_t size = (uint64_t)before.st_size;
+    if (off > size || expect_len > size - off) {
+        close(fd);
+        return -2;
+    }
+
+    // The region to write is the replacement plus, if the length changes, the tail after it
+    size_t tail = repl_len == expect_len ? 0 : (size_t)(size - off - expect_len);
+    char *buf = malloc(expect_len + repl_len + tail + 1);
+    int rc = buf ? 0 : -1;
+    if (rc == 0 && (pread(fd, buf, expect_len, (off_t)off) != (ssize_t)expect_len ||
+                    memcmp(buf, expect, expect_len) != 0)) {
+        rc = -2;
+    }
+    if (rc == 0) {
+        memcpy(buf, repl, repl_len);
+        if (tail && pread(fd, buf + repl_len, tail, (off_t)(off + expect_len)) != (ssize_t)tail) rc = -1;
+    }
+    DocEdge edge;
+    if (rc == 0 && doccount_edge_fd(fd, size, off, off + expect_len, &edge) != 0) rc = -1;
+    if (rc == 0) {
+        rc = journal_apply(filename, fd, off, buf, repl_len + tail, size - expect_len + repl_len,
+                           &before, &committed);
+    }
+    free(buf);
+    close(fd);
+    if (rc == 0) {
+        record_shift(fh, at, delta);
+        DocCounts change;
+        doccount_delta(&edge, expect, expect_len, repl, repl_len, &change);
+        doccount_commit(filename, &before, &committed, &change);
+    }
+    return rc;
+}
+
+void commit_recover(void) {
+    char swap_dir[512];
+    snprintf(swap_dir, sizeof(swap_dir), "%s/storage%d/swap", STORAGE_DIR, get_storage_id());
+    DIR *dir = opendir(swap_dir);
+    if (!dir) return;
+
+    const size_t suffix = strlen(".journal");
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        size_t n = strlen(entry->d_name);
+        if (n <= suffix || strcmp(entry->d_name + n - suffix, ".journal") != 0) continue;
+
+        char jpath[768], filename[256], path[512];
+        snprintf(jpath, sizeof(jpath), "%s/%s", swap_dir, entry->d_name);
+        snprintf(filename, sizeof(filename), "%.*s", (int)(n - suffix), entry->d_name);
+        snprintf(path, sizeof(path), "%s/storage%d/files/%s", STORAGE_DIR, get_storage_id(), filename);
+
+        FILE *jf = fopen(jpath, "rb");
+        JournalHeader h;
+        char *data = NULL;
+        int valid = jf && fread(&h, sizeof(h), 1, jf) == 1 && memcmp(h.magic, COMMIT_JOURNAL_MAGIC, 4) == 0 &&
+                    h.len <= h.size && (data = malloc((size_t)h.len + 1)) != NULL &&
+                    fread(data, 1, (size_t)h.len, jf) == (size_t)h.len && journal_sum(&h, data) == h.sum;
+        if (jf) fclose(jf);
+
+        // An incomplete journal means the document itself was never touched
+        if (valid) {
+            int fd = open(path, O_RDWR);
+            if (fd >= 0 && apply_region(fd, h.off, data, h.len, h.size) == 0) {
+                printf("Recovered interrupted commit of '%s'\n", filename);
+            }
+            if (fd >= 0) close(fd);
+        }
+        free(data);
+        unlink(jpath);
+    }
+    closedir(dir);
+}
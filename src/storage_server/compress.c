@@ -0,0 +1,183 @@
+#include "../../include/common.h"
+#include "../../include/compress.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 14
+#define LZ_MAX_OFFSET 65535
+
+typedef struct {
+    unsigned long long raw, packed;         // bytes in / out of successful compressions
+    unsigned long long skipped;             // bytes left raw (incompressible or disabled)
+    unsigned long long unpacked;            // bytes produced by decompression
+    unsigned long long pack_ns, unpack_ns;  // thread CPU time
+    unsigned long long packs, unpacks;
+} LzStats;
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static LzStats stats[LZ_AREAS];
+static const char *area_names[LZ_AREAS] = {"checkpoints", "undo", "cold"};
+static int enabled = -1;
+
+int lz_enabled(void) {
+    if (enabled < 0) {
+        const char *v = getenv("SS_COMPRESS");
+        enabled = !v || atoi(v) != 0;
+    }
+    return enabled;
+}
+
+size_t lz_bound(size_t n) {
+    return n + n / 255 + 16;
+}
+
+static unsigned long long cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + (unsigned long long)ts.tv_nsec;
+}
+
+static uint32_t read32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// Length beyond the 4-bit field: runs of 255 closed by a smaller byte
+static unsigned char *put_length(unsigned char *op, size_t len) {
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (unsigned char)len;
+    return op;
+}
+
+static unsigned char *put_sequence(unsigned char *op, const unsigned char *lit, size_t lit_len,
+                                   size_t offset, size_t match_len) {
+    size_t m = match_len ? match_len - LZ_MIN_MATCH : 0;
+    *op++ = (unsigned char)(((lit_len < 15 ? lit_len : 15) << 4) | (m < 15 ? m : 15));
+    if (lit_len >= 15) op = put_length(op, lit_len - 15);
+    memcpy(op, lit, lit_len);
+    op += lit_len;
+    if (match_len) {
+        *op++ = (unsigned char)(offset & 0xff);
+        *op++ = (unsigned char)(offset >> 8);
+        if (m >= 15) op = put_length(op, m - 15);
+    }
+    return op;
+}
+
+static size_t compress_block(const unsigned char *src, size_t n, unsigned char *dst) {
+    uint32_t *table = calloc((size_t)1 << LZ_HASH_BITS, sizeof(uint32_t));   // position + 1
+    if (!table) return 0;
+    unsigned char *op = dst;
+    size_t ip = 0, anchor = 0;
+    while (ip + LZ_MIN_MATCH <= n) {
+        uint32_t seq = read32(src + ip);
+        uint32_t h = (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+        size_t cand = table[h];
+        table[h] = (uint32_t)(ip + 1);
+        if (cand && ip - (cand - 1) <= LZ_MAX_OFFSET && read32(src + cand - 1) == seq) {
+            size_t ref = cand - 1, len = LZ_MIN_MATCH;
+            while (ip + len < n && src[ref + len] == src[ip + len]) len++;
+            op = put_sequence(op, src + anchor, ip - anchor, ip - ref, len);
+            ip += len;
+            anchor = ip;
+            if ((size_t)(op - dst) >= n) break;     // not going to pay off
+        } else {
+            ip++;
+        }
+    }
+    if ((size_t)(op - dst) < n) op = put_sequence(op, src + anchor, n - anchor, 0, 0);
+    free(table);
+    size_t out = (size_t)(op - dst);
+    return out < n ? out : 0;
+}
+
+size_t lz_compress(LzArea area, const char *src, size_t n, char *dst) {
+    unsigned long long start = cpu_ns();
+    size_t out = lz_enabled() && n > 0 ? compress_block((const unsigned char *)src, n, (unsigned char *)dst) : 0;
+    unsigned long long spent = cpu_ns() - start;
+    pthread_mutex_lock(&stats_lock);
+    if (out) {
+        stats[area].raw += n;
+        stats[area].packed += out;
+    } else {
+        stats[area].skipped += n;
+    }
+    stats[area].pack_ns += spent;
+    stats[area].packs++;
+    pthread_mutex_unlock(&stats_lock);
+    return out;
+}
+
+static int decompress_block(const unsigned char *src, size_t n, unsigned char *dst, size_t out_len) {
+    size_t ip = 0, op = 0;
+    while (ip < n) {
+        unsigned token = src[ip++];
+        size_t lit = token >> 4;
+        if (lit == 15) {
+            unsigned char b;
+            do {
+                if (ip >= n) return -1;
+                b = src[ip++];
+                lit += b;
+            } while (b == 255);
+        }
+        if (lit > n - ip || lit > out_len - op) return -1;
+        memcpy(dst + op, src + ip, lit);
+        ip += lit;
+        op += lit;
+        if (ip == n) break;     // the final sequence has literals only
+
+        if (n - ip < 2) return -1;
+        size_t offset = (size_t)src[ip] | ((size_t)src[ip + 1] << 8);
+        ip += 2;
+        size_t m = token & 15;
+        if (m == 15) {
+            unsigned char b;
+            do {
+                if (ip >= n) return -1;
+                b = src[ip++];
+                m += b;
+            } while (b == 255);
+        }
+        m += LZ_MIN_MATCH;
+        if (offset == 0 || offset > op || m > out_len - op) return -1;
+        for (size_t i = 0; i < m; ++i, ++op) dst[op] = dst[op - offset];    // may overlap
+    }
+    return op == out_len ? 0 : -1;
+}
+
+int lz_decompress(LzArea area, const char *src, size_t n, char *dst, size_t out_len) {
+    unsigned long long start = cpu_ns();
+    int rc = decompress_block((const unsigned char *)src, n, (unsigned char *)dst, out_len);
+    unsigned long long spent = cpu_ns() - start;
+    pthread_mutex_lock(&stats_lock);
+    if (rc == 0) stats[area].unpacked += out_len;
+    stats[area].unpack_ns += spent;
+    stats[area].unpacks++;
+    pthread_mutex_unlock(&stats_lock);
+    return rc;
+}
+
+void lz_describe(char *out, size_t sz) {
+    LzStats snap[LZ_AREAS];
+    pthread_mutex_lock(&stats_lock);
+    memcpy(snap, stats, sizeof(snap));
+    pthread_mutex_unlock(&stats_lock);
+
+    size_t used = (size_t)snprintf(out, sz, "Compression (%s, since start):\n%-12s %12s %12s %7s %12s %10s %12s %10s\n",
+                                   lz_enabled() ? "on" : "off", "Area", "Raw", "Stored", "Ratio", "Left raw",
+                                   "Pack ms", "Unpacked", "Unpack ms");
+    for (int a = 0; a < LZ_AREAS && used < sz; ++a) {
+        const LzStats *s = &snap[a];
+        double ratio = s->packed ? (double)s->raw / (double)s->packed : 0.0;
+        used += (size_t)snprintf(out + used, sz - used, "%-12s %12llu %12llu %6.2fx %12llu %10.2f %12llu %10.2f\n",
+                                 area_names[a], s->raw, s->packed, ratio, s->skipped, s->pack_ns / 1e6,
+                                 s->unpacked, s->unpack_ns / 1e6);
+    }
+}
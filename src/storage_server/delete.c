@@ -1,6 +1,10 @@
 #include "../../include/common.h"
 #include "../../include/delete.h"
 #include "../../include/acl.h"
+#include "../../include/checkpoint.h"
+#include "../../include/search.h"
+#include "../../include/sentidx.h"
+#include "../../include/undo.h"
 
 int delete_from_storage(int client_sock, const char *filename, const char *username) {
     if (filename == NULL || filename[0] == '\0') {
@@ -29,10 +33,12 @@ int delete_from_storage(int client_sock, const char *filename, const char *usern
         return -1;
     }
     
-    // Also delete metadata file
-    char metapath[512];
-    snprintf(metapath, sizeof(metapath), "%s/storage%d/meta/%s.meta", STORAGE_DIR, get_storage_id(), filename);
-    unlink(metapath); // Ignore errors
+    // Also delete metadata record
+    delete_metadata_file(filename); // Ignore errors
+    search_index_remove(filename);
+    sentidx_remove(filename);
+    undo_forget(filename);
+    checkpoint_remove_all(filename, get_storage_id());
     
     char msg[256];
     snprintf(msg, sizeof(msg), "File '%s' deleted successfully\n", filename);
@@ -0,0 +1,77 @@
+#include "../../include/common.h"
+#include "../../include/diff.h"
+#include <stdint.h>
+
+static void mark_all(size_t a_from, size_t a_to, size_t b_from, size_t b_to,
+                     unsigned char *a_del, unsigned char *b_ins) {
+    for (size_t i = a_from; i < a_to; ++i) a_del[i] = 1;
+    for (size_t j = b_from; j < b_to; ++j) b_ins[j] = 1;
+}
+
+int diff_mark(size_t n, size_t m, DiffEqual eq, void *user, unsigned char *a_del, unsigned char *b_ins) {
+    // Unchanged head and tail never enter the search
+    size_t lo = 0, an = n, bm = m;
+    while (lo < n && lo < m && eq(lo, lo, user)) lo++;
+    while (an > lo && bm > lo && eq(an - 1, bm - 1, user)) {
+        an--;
+        bm--;
+    }
+    long N = (long)(an - lo), M = (long)(bm - lo);
+    if (N == 0 || M == 0) {
+        mark_all(lo, an, lo, bm, a_del, b_ins);
+        return 0;
+    }
+
+    // v[k + off]: furthest x reached on diagonal k. trace[d] keeps v[-d-1 .. d+1] as it was
+    // before step d, which is all the backtrack needs to retrace step d.
+    long dmax = N + M < DIFF_MAX_EDITS ? N + M : DIFF_MAX_EDITS, off = dmax + 1, found = -1;
+    int32_t *v = calloc((size_t)(2 * dmax + 3), sizeof(int32_t));
+    int32_t **trace = calloc((size_t)(dmax + 1), sizeof(int32_t *));
+    int rc = v && trace ? 0 : -1;
+    for (long d = 0; rc == 0 && d <= dmax && found < 0; ++d) {
+        if ((trace[d] = malloc((size_t)(2 * d + 3) * sizeof(int32_t))) == NULL) {
+            rc = -1;
+            break;
+        }
+        memcpy(trace[d], v + off - d - 1, (size_t)(2 * d + 3) * sizeof(int32_t));
+        for (long k = -d; k <= d; k += 2) {
+            long x = (k == -d || (k != d && v[off + k - 1] < v[off + k + 1])) ? v[off + k + 1] : v[off + k - 1] + 1;
+            long y = x - k;
+            while (x < N && y < M && eq(lo + (size_t)x, lo + (size_t)y, user)) {
+                x++;
+                y++;
+            }
+            v[off + k] = (int32_t)x;
+            if (x >= N && y >= M) {
+                found = d;
+                break;
+            }
+        }
+    }
+
+    if (rc == 0 && found < 0) {
+        mark_all(lo, an, lo, bm, a_del, b_ins);   // too different to be worth minimising
+    } else if (rc == 0) {
+        long x = N, y = M;
+        for (long d = found; d >= 0; --d) {
+            const int32_t *tv = trace[d] + d + 1;   // tv[k], k in [-d-1, d+1]
+            long k = x - y;
+            long prev_k = (k == -d || (k != d && tv[k - 1] < tv[k + 1])) ? k + 1 : k - 1;
+            long prev_x = tv[prev_k], prev_y = prev_x - prev_k;
+            while (x > prev_x && y > prev_y) {
+                x--;
+                y--;
+            }
+            if (d > 0) {
+                if (x == prev_x) b_ins[lo + (size_t)prev_y] = 1;
+                else a_del[lo + (size_t)prev_x] = 1;
+            }
+            x = prev_x;
+            y = prev_y;
+        }
+    }
+    for (long d = 0; trace && d <= dmax; ++d) free(trace[d]);
+    free(trace);
+    free(v);
+    return rc;
+}
@@ -0,0 +1,297 @@
+#include "../../include/common.h"
+#include "../../include/dispatch.h"
+#include <pthread.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+
+#define MAX_ACCEPTORS 64
+
+// A connection whose request frame is still being read (acceptor side), then a queued job
+typedef struct PendingConn {
+    int fd;
+    size_t len;
+    time_t started;
+    struct PendingConn *prev, *next;
+    char buf[SS_REQUEST_MAX];
+} PendingConn;
+
+static RequestHandler request_handler = NULL;
+
+// --- worker pool ---
+
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static PendingConn *queue_head = NULL, *queue_tail = NULL;
+static int queued = 0, idle_workers = 0, total_workers = 0;
+static int max_workers = SS_DEFAULT_MAX_WORKERS;
+
+static void *worker_main(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&queue_lock);
+    while (1) {
+        idle_workers++;
+        while (!queue_head) pthread_cond_wait(&queue_cond, &queue_lock);
+        idle_workers--;
+        PendingConn *c = queue_head;
+        queue_head = c->next;
+        if (!queue_head) queue_tail = NULL;
+        queued--;
+        pthread_mutex_unlock(&queue_lock);
+
+        request_handler(c->fd, c->buf);
+        close(c->fd);
+        free(c);
+
+        pthread_mutex_lock(&queue_lock);
+    }
+    return NULL;
+}
+
+// Called with queue_lock held
+static int spawn_worker(void) {
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, SS_WORKER_STACK);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_t tid;
+    int rc = pthread_create(&tid, &attr, worker_main, NULL);
+    pthread_attr_destroy(&attr);
+    if (rc == 0) total_workers++;
+    else fprintf(stderr, "pthread_create: %s\n", strerror(rc));
+    return rc;
+}
+
+// Hand a connection with a complete request frame to the pool
+static void enqueue(PendingConn *c) {
+    int flags = fcntl(c->fd, F_GETFL);
+    fcntl(c->fd, F_SETFL, flags & ~O_NONBLOCK);   // handlers use blocking I/O
+    c->next = NULL;
+
+    pthread_mutex_lock(&queue_lock);
+    if (queue_tail) queue_tail->next = c;
+    else queue_head = c;
+    queue_tail = c;
+    queued++;
+    // Every worker may be parked in an interactive session; grow rather than stall
+    if (queued > idle_workers && total_workers < max_workers) spawn_worker();
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_lock);
+}
+
+// --- framed request reader ---
+
+// Length of the request frame in buf, or 0 if it is not complete yet. The frame ends with
+// the newline of the CMD: line; every sender terminates it, so a CMD: line still without
+// one is waited for (up to SS_REQUEST_MAX bytes and SS_FRAME_TIMEOUT seconds).
+static size_t frame_end(const char *buf, size_t len) {
+    size_t line = 0;
+    while (line < len) {
+        const char *nl = memchr(buf + line, '\n', len - line);
+        if (!nl) break;
+        if (len - line >= 4 && strncmp(buf + line, "CMD:", 4) == 0) return (size_t)(nl - buf) + 1;
+        line = (size_t)(nl - buf) + 1;
+    }
+    return 0;
+}
+
+// Returns 1 when the frame is complete, 0 to wait for more data, -1 to drop the connection.
+// Bytes are peeked first so that only the frame is consumed; anything the client sent
+// after it (e.g. WRITE edit lines) is left for the handler.
+static int conn_read(PendingConn *c) {
+    while (1) {
+        size_t room = SS_REQUEST_MAX - 1 - c->len;
+        if (room == 0) return -1;   // no complete frame fits
+        ssize_t n = recv(c->fd, c->buf + c->len, room, MSG_PEEK);
+        if (n == 0) return -1;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            return -1;
+        }
+
+        size_t end = frame_end(c->buf, c->len + (size_t)n);
+        size_t take = end ? end - c->len : (size_t)n;
+        if (recv(c->fd, c->buf + c->len, take, 0) != (ssize_t)take) return -1;
+        c->len += take;
+        c->buf[c->len] = '\0';
+        if (end) return 1;
+    }
+}
+
+// --- acceptors ---
+
+static void list_remove(PendingConn **head, PendingConn *c) {
+    if (c->prev) c->prev->next = c->next;
+    else *head = c->next;
+    if (c->next) c->next->prev = c->prev;
+    c->prev = c->next = NULL;
+}
+
+static void *acceptor_main(void *arg) {
+    int listen_fd = (int)(intptr_t)arg;
+    int ep = epoll_create1(0);
+    if (ep < 0) {
+        perror("epoll_create1");
+        return NULL;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;   // NULL marks the listening socket
+    epoll_ctl(ep, EPOLL_CTL_ADD, listen_fd, &ev);
+
+    PendingConn *reading = NULL;   // connections still sending their frame
+    time_t last_sweep = time(NULL);
+    struct epoll_event events[64];
+
+    while (1) {
+        int n = epoll_wait(ep, events, 64, 1000);
+        if (n < 0 && errno != EINTR) perror("epoll_wait");
+
+        for (int i = 0; i < n; ++i) {
+            PendingConn *c = (PendingConn *)events[i].data.ptr;
+            if (c) {
+                int r = conn_read(c);
+                if (r == 0) continue;
+                epoll_ctl(ep, EPOLL_CTL_DEL, c->fd, NULL);
+                list_remove(&reading, c);
+                if (r > 0) {
+                    enqueue(c);
+                } else {
+                    close(c->fd);
+                    free(c);
+                }
+                continue;
+            }
+
+            // Listening socket: accept everything that is pending
+            while (1) {
+                int fd = accept(listen_fd, NULL, NULL);
+                if (fd < 0) {
+                    if (errno == EINTR) continue;
+                    if (errno != EAGAIN && errno != EWOULDBLOCK) perror("Accept failed");
+                    break;
+                }
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                PendingConn *nc = calloc(1, sizeof(PendingConn));
+                if (!nc) {
+                    close(fd);
+                    continue;
+                }
+                nc->fd = fd;
+                nc->started = time(NULL);
+
+                struct epoll_event cev;
+                cev.events = EPOLLIN;
+                cev.data.ptr = nc;
+                if (epoll_ctl(ep, EPOLL_CTL_ADD, fd, &cev) < 0) {
+                    close(fd);
+                    free(nc);
+                    continue;
+                }
+                nc->next = reading;
+                if (reading) reading->prev = nc;
+                reading = nc;
+            }
+        }
+
+        // Drop connections that never completed their request frame
+        time_t now = time(NULL);
+        if (now != last_sweep) {
+            last_sweep = now;
+            PendingConn *c = reading;
+            while (c) {
+                PendingConn *next = c->next;
+                if (now - c->started > SS_FRAME_TIMEOUT) {
+                    epoll_ctl(ep, EPOLL_CTL_DEL, c->fd, NULL);
+                    list_remove(&reading, c);
+                    close(c->fd);
+                    free(c);
+                }
+                c = next;
+            }
+        }
+    }
+    return NULL;
+}
+
+static int open_listener(int port, int reuseport, int backlog) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("Socket creation failed");
+        return -1;
+    }
+
+    // Allow immediate reuse of the port
+    int opt = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0 ||
+        (reuseport && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0)) {
+        perror("setsockopt failed");
+        close(fd);
+        return -1;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = INADDR_ANY;
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("Bind failed");
+        close(fd);
+        return -1;
+    }
+    if (listen(fd, backlog) < 0) {
+        perror("Listen failed");
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+static int env_int(const char *name, int def) {
+    const char *v = getenv(name);
+    int n = v ? atoi(v) : 0;
+    return n > 0 ? n : def;
+}
+
+int dispatch_run(int port, RequestHandler handler) {
+    request_handler = handler;
+    int workers = env_int("SS_WORKERS", SS_DEFAULT_WORKERS);
+    max_workers = env_int("SS_MAX_WORKERS", SS_DEFAULT_MAX_WORKERS);
+    if (max_workers < workers) max_workers = workers;
+    int backlog = env_int("SS_BACKLOG", SS_DEFAULT_BACKLOG);
+    int acceptors = env_int("SS_ACCEPTORS", SS_DEFAULT_ACCEPTORS);
+    if (acceptors > MAX_ACCEPTORS) acceptors = MAX_ACCEPTORS;
+
+    // A client that disconnects mid-response must not take the whole server down
+    signal(SIGPIPE, SIG_IGN);
+
+    int fds[MAX_ACCEPTORS];
+    for (int i = 0; i < acceptors; ++i) {
+        fds[i] = open_listener(port, acceptors > 1, backlog);
+        if (fds[i] < 0) {
+            while (i-- > 0) close(fds[i]);
+            return -1;
+        }
+    }
+
+    pthread_mutex_lock(&queue_lock);
+    for (int i = 0; i < workers; ++i) spawn_worker();
+    pthread_mutex_unlock(&queue_lock);
+
+    for (int i = 1; i < acceptors; ++i) {
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, acceptor_main, (void *)(intptr_t)fds[i]) == 0) pthread_detach(tid);
+        else perror("acceptor thread");
+    }
+
+    printf("Storage server started. Listening on port %d (%d acceptor(s), %d-%d workers, backlog %d)...\n",
+           port, acceptors, workers, max_workers, backlog);
+    fflush(stdout);
+    acceptor_main((void *)(intptr_t)fds[0]);
+    return -1;
+}
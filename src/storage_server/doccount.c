@@ -0,0 +1,205 @@
+#include "../../include/common.h"
+#include "../../include/doccount.h"
+#include "../../include/acl.h"
+#include "../../include/commit.h"
+#include "../../include/document.h"
+#include "../../include/meta_store.h"
+#include <fcntl.h>
+
+#define DOCCOUNT_CHUNK 16384        // bytes read at a time when recounting or scanning edges
+
+// Word separators, as VIEW has always counted
+static int word_space(int c) {
+    return c == ' ' || c == '\n' || c == '\t';
+}
+
+// Whitespace the document model skips between sentences
+static int lead_space(int c) {
+    return word_space(c) || c == '\r';
+}
+
+typedef struct {
+    DocCounts n;
+    int in_word;            // the last byte belongs to a word
+    int closed;             // the last non-whitespace byte ended a sentence (or there is none)
+} Counter;
+
+static void count_bytes(Counter *c, const char *p, size_t len) {
+    c->n.chars += (long)len;
+    for (size_t i = 0; i < len; ++i) {
+        int ch = (unsigned char)p[i];
+        if (word_space(ch)) {
+            c->in_word = 0;
+        } else if (!c->in_word) {
+            c->in_word = 1;
+            c->n.words++;
+        }
+        if (lead_space(ch)) continue;
+        if (c->closed) c->n.sentences++;
+        c->closed = doc_is_delim((char)ch);
+    }
+}
+
+static void counter_init(Counter *c) {
+    memset(c, 0, sizeof(*c));
+    c->closed = 1;
+}
+
+// Words and sentences that start inside x, or at the text after it, given what precedes it
+static void region_starts(const DocEdge *edge, const char *x, size_t len, DocCounts *out) {
+    Counter c;
+    memset(&c, 0, sizeof(c));
+    c.in_word = edge->prev >= 0 && !word_space(edge->prev);
+    c.closed = edge->prev_text < 0 || doc_is_delim((char)edge->prev_text);
+    count_bytes(&c, x, len);
+    if (edge->next >= 0 && !word_space(edge->next) && !c.in_word) c.n.words++;
+    if (edge->next_text >= 0 && c.closed) c.n.sentences++;
+    *out = c.n;
+}
+
+void doccount_delta(const DocEdge *edge, const char *old, size_t old_len, const char *repl,
+                    size_t repl_len, DocCounts *delta) {
+    DocCounts before, after;
+    region_starts(edge, old, old_len, &before);
+    region_starts(edge, repl, repl_len, &after);
+    delta->words = after.words - before.words;
+    delta->chars = after.chars - before.chars;
+    delta->sentences = after.sentences - before.sentences;
+}
+
+void doccount_edge(const char *text, size_t len, size_t off, size_t end, DocEdge *edge) {
+    edge->prev = off > 0 ? (unsigned char)text[off - 1] : -1;
+    edge->next = end < len ? (unsigned char)text[end] : -1;
+    edge->prev_text = edge->next_text = -1;
+    for (size_t i = off; i > 0; --i) {
+        if (!lead_space((unsigned char)text[i - 1])) {
+            edge->prev_text = (unsigned char)text[i - 1];
+            break;
+        }
+    }
+    for (size_t i = end; i < len; ++i) {
+        if (!lead_space((unsigned char)text[i])) {
+            edge->next_text = (unsigned char)text[i];
+            break;
+        }
+    }
+}
+
+int doccount_edge_fd(int fd, uint64_t size, uint64_t off, uint64_t end, DocEdge *edge) {
+    char buf[DOCCOUNT_CHUNK];
+    edge->prev = edge->next = edge->prev_text = edge->next_text = -1;
+
+    // Backwards from off, a chunk at a time, to the nearest non-whitespace byte
+    for (uint64_t to = off; to > 0 && edge->prev_text < 0;) {
+        size_t n = to < sizeof(buf) ? (size_t)to : sizeof(buf);
+        if (pread(fd, buf, n, (off_t)(to - n)) != (ssize_t)n) return -1;
+        if (to == off) edge->prev = (unsigned char)buf[n - 1];
+        for (size_t i = n; i > 0; --i) {
+            if (!lead_space((unsigned char)buf[i - 1])) {
+                edge->prev_text = (unsigned char)buf[i - 1];
+                break;
+            }
+        }
+        to -= n;
+    }
+    // And forwards from end
+    for (uint64_t from = end; from < size && edge->next_text < 0;) {
+        size_t n = size - from < sizeof(buf) ? (size_t)(size - from) : sizeof(buf);
+        if (pread(fd, buf, n, (off_t)from) != (ssize_t)n) return -1;
+        if (from == end) edge->next = (unsigned char)buf[0];
+        for (size_t i = 0; i < n; ++i) {
+            if (!lead_space((unsigned char)buf[i])) {
+                edge->next_text = (unsigned char)buf[i];
+                break;
+            }
+        }
+        from += n;
+    }
+    return 0;
+}
+
+static int stamped(const FileMetadata *meta, long long size, const struct timespec *mtime) {
+    return meta->counted_size == size && meta->counted_mtime.tv_sec == mtime->tv_sec &&
+           meta->counted_mtime.tv_nsec == mtime->tv_nsec;
+}
+
+static void store(const char *filename, const DocCounts *counts, const struct stat *st) {
+    FileMetadata meta;
+    memset(&meta, 0, sizeof(meta));
+    meta.words = counts->words;
+    meta.chars = counts->chars;
+    meta.sentences = counts->sentences;
+    meta.counted_size = (long long)st->st_size;
+    meta.counted_mtime = st->st_mtim;
+    meta_store_set_counts(filename, &meta);
+}
+
+void doccount_commit(const char *filename, const struct stat *before, const struct stat *after,
+                     const DocCounts *delta) {
+    FileMetadata meta;
+    // Counts already stale stay so: the next reader recounts
+    if (read_metadata_file(filename, &meta) != 0 || !stamped(&meta, (long long)before->st_size, &before->st_mtim)) {
+        return;
+    }
+    DocCounts counts = {meta.words + delta->words, meta.chars + delta->chars, meta.sentences + delta->sentences};
+    store(filename, &counts, after);
+}
+
+void doccount_store(const char *filename, const struct stat *st, const char *text, size_t len,
+                    DocCounts *out) {
+    Counter c;
+    counter_init(&c);
+    count_bytes(&c, text, len);
+    store(filename, &c.n, st);
+    *out = c.n;
+}
+
+int doccount_get(const char *filename, const struct stat *st, DocCounts *out) {
+    FileMetadata meta;
+    if (st && read_metadata_file(filename, &meta) == 0 && stamped(&meta, (long long)st->st_size, &st->st_mtim)) {
+        out->words = meta.words;
+        out->chars = meta.chars;
+        out->sentences = meta.sentences;
+        return 0;
+    }
+
+    // Stale: count the document once, ordered with commits so the stamp matches the bytes
+    char path[512];
+    snprintf(path, sizeof(path), "%s/storage%d/files/%s", STORAGE_DIR, get_storage_id(), filename);
+    char *buf = malloc(DOCCOUNT_CHUNK);
+    Counter c;
+    counter_init(&c);
+    struct stat now;
+    commit_read_lock(filename);
+    int fd = open(path, O_RDONLY);
+    int rc = buf && fd >= 0 && fstat(fd, &now) == 0 ? 0 : -1;
+    for (off_t pos = 0; rc == 0 && pos < now.st_size;) {
+        ssize_t n = pread(fd, buf, DOCCOUNT_CHUNK, pos);
+        if (n <= 0) {
+            rc = -1;
+            break;
+        }
+        count_bytes(&c, buf, (size_t)n);
+        pos += n;
+    }
+    if (fd >= 0) close(fd);
+    if (rc == 0) store(filename, &c.n, &now);
+    commit_read_unlock(filename);
+    free(buf);
+    if (rc == 0) *out = c.n;
+    return rc;
+}
+
+void doccount_cold(const char *filename, const TierInfo *info, DocCounts *out) {
+    FileMetadata meta;
+    struct timespec mtime = {info->mtime, info->mtime_nsec};
+    if (read_metadata_file(filename, &meta) == 0 && stamped(&meta, (long long)info->size, &mtime)) {
+        out->words = meta.words;
+        out->chars = meta.chars;
+        out->sentences = meta.sentences;
+        return;
+    }
+    out->words = (long)info->words;
+    out->chars = (long)info->size;
+    out->sentences = -1;
+}
@@ -0,0 +1,413 @@
+#include "../../include/common.h"
+#include "../../include/document.h"
+
+#define DOC_ADD_BLOCK 65536
+#define DOC_NODES_PER_BLOCK 256
+
+typedef struct DocNode {
+    struct DocNode *left, *right;
+    unsigned prio;
+    size_t count;           // sentences in this subtree
+    size_t bytes;           // serialised bytes in this subtree
+    const char *text;       // span: lead whitespace + body (original or add buffer)
+    size_t len;
+    size_t lead;
+} DocNode;
+
+typedef struct AddBlock {
+    struct AddBlock *next;
+    size_t used, size;
+    char data[];
+} AddBlock;
+
+typedef struct NodeBlock {
+    struct NodeBlock *next;
+    size_t used;
+    DocNode nodes[DOC_NODES_PER_BLOCK];
+} NodeBlock;
+
+struct Document {
+    char *orig;             // original file contents (never modified)
+    size_t orig_len;
+    const char *tail;       // whitespace after the last sentence
+    size_t tail_len;
+    DocNode *root;
+    AddBlock *add;          // append-only buffer for edited text; spans stay valid
+    NodeBlock *nodes;
+    unsigned rng;
+};
+
+int doc_is_delim(char c) {
+    return (c == '.' || c == '!' || c == '?');
+}
+
+size_t doc_next_sentence(const char *text, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        if (doc_is_delim(text[i])) return i + 1;
+    }
+    return len;
+}
+
+static int is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// --- allocation ---
+
+static const char *add_text(Document *doc, const char *a, size_t alen, const char *b, size_t blen) {
+    size_t need = alen + blen;
+    AddBlock *blk = doc->add;
+    if (!blk || blk->size - blk->used < need) {
+        size_t size = need > DOC_ADD_BLOCK ? need : DOC_ADD_BLOCK;
+        blk = malloc(sizeof(AddBlock) + size);
+        if (!blk) return NULL;
+        blk->size = size;
+        blk->used = 0;
+        blk->next = doc->add;
+        doc->add = blk;
+    }
+    char *dst = blk->data + blk->used;
+    memcpy(dst, a, alen);
+    memcpy(dst + alen, b, blen);
+    blk->used += need;
+    return dst;
+}
+
+static DocNode *new_node(Document *doc, const char *text, size_t len, size_t lead) {
+    NodeBlock *blk = doc->nodes;
+    if (!blk || blk->used == DOC_NODES_PER_BLOCK) {
+        blk = malloc(sizeof(NodeBlock));
+        if (!blk) return NULL;
+        blk->used = 0;
+        blk->next = doc->nodes;
+        doc->nodes = blk;
+    }
+    DocNode *n = &blk->nodes[blk->used++];
+    doc->rng ^= doc->rng << 13;
+    doc->rng ^= doc->rng >> 17;
+    doc->rng ^= doc->rng << 5;
+    n->left = n->right = NULL;
+    n->prio = doc->rng;
+    n->count = 1;
+    n->bytes = len;
+    n->text = text;
+    n->len = len;
+    n->lead = lead;
+    return n;
+}
+
+// --- treap (implicit key = sentence index) ---
+
+static size_t n_count(const DocNode *n) { return n ? n->count : 0; }
+static size_t n_bytes(const DocNode *n) { return n ? n->bytes : 0; }
+
+static void update(DocNode *n) {
+    n->count = 1 + n_count(n->left) + n_count(n->right);
+    n->bytes = n->len + n_bytes(n->left) + n_bytes(n->right);
+}
+
+static DocNode *merge(DocNode *a, DocNode *b) {
+    if (!a) return b;
+    if (!b) return a;
+    if (a->prio > b->prio) {
+        a->right = merge(a->right, b);
+        update(a);
+        return a;
+    }
+    b->left = merge(a, b->left);
+    update(b);
+    return b;
+}
+
+// First k sentences go to *l, the rest to *r
+static void split(DocNode *t, size_t k, DocNode **l, DocNode **r) {
+    if (!t) {
+        *l = *r = NULL;
+        return;
+    }
+    if (n_count(t->left) < k) {
+        split(t->right, k - n_count(t->left) - 1, &t->right, r);
+        update(t);
+        *l = t;
+    } else {
+        split(t->left, k, l, &t->left);
+        update(t);
+        *r = t;
+    }
+}
+
+static DocNode *nth(DocNode *t, size_t k) {
+    while (t) {
+        size_t lc = n_count(t->left);
+        if (k < lc) {
+            t = t->left;
+        } else if (k == lc) {
+            return t;
+        } else {
+            k -= lc + 1;
+            t = t->right;
+        }
+    }
+    return NULL;
+}
+
+// --- construction ---
+
+// Build a document over buf (takes ownership)
+static Document *doc_adopt(char *buf, size_t len) {
+    Document *doc = calloc(1, sizeof(Document));
+    if (!doc) {
+        free(buf);
+        return NULL;
+    }
+    doc->orig = buf;
+    doc->orig_len = len;
+    doc->rng = 2463534242u ^ (unsigned)len;
+
+    size_t pos = 0;
+    while (pos < len) {
+        size_t lead = 0;
+        while (pos + lead < len && is_space(buf[pos + lead])) lead++;
+        if (pos + lead == len) {
+            doc->tail = buf + pos;
+            doc->tail_len = lead;
+            break;
+        }
+        size_t body = doc_next_sentence(buf + pos + lead, len - pos - lead);
+        DocNode *n = new_node(doc, buf + pos, lead + body, lead);
+        if (!n) {
+            doc_free(doc);
+            return NULL;
+        }
+        doc->root = merge(doc->root, n);
+        pos += lead + body;
+    }
+    return doc;
+}
+
+Document *doc_from_text(const char *text, size_t len) {
+    char *buf = malloc(len + 1);
+    if (!buf) return NULL;
+    memcpy(buf, text, len);
+    buf[len] = '\0';
+    return doc_adopt(buf, len);
+}
+
+Document *doc_load(const char *path, struct stat *st_out) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return NULL;
+    struct stat st;
+    if (fstat(fileno(fp), &st) != 0) {
+        fclose(fp);
+        return NULL;
+    }
+    if (st_out) *st_out = st;
+    size_t size = (size_t)st.st_size;
+    char *buf = malloc(size + 1);
+    if (!buf) {
+        fclose(fp);
+        return NULL;
+    }
+    size_t got = fread(buf, 1, size, fp);
+    fclose(fp);
+    buf[got] = '\0';
+    return doc_adopt(buf, got);
+}
+
+void doc_free(Document *doc) {
+    if (!doc) return;
+    while (doc->add) {
+        AddBlock *next = doc->add->next;
+        free(doc->add);
+        doc->add = next;
+    }
+    while (doc->nodes) {
+        NodeBlock *next = doc->nodes->next;
+        free(doc->nodes);
+        doc->nodes = next;
+    }
+    free(doc->orig);
+    free(doc);
+}
+
+// --- queries ---
+
+size_t doc_sentence_count(const Document *doc) {
+    return n_count(doc->root);
+}
+
+size_t doc_length(const Document *doc) {
+    return n_bytes(doc->root) + doc->tail_len;
+}
+
+int doc_ends_with_delim(const Document *doc) {
+    size_t count = n_count(doc->root);
+    if (count == 0) return 1;
+    const DocNode *last = nth(doc->root, count - 1);
+    return last->len > last->lead && doc_is_delim(last->text[last->len - 1]);
+}
+
+char *doc_sentence(const Document *doc, size_t k) {
+    const DocNode *n = nth(doc->root, k);
+    if (!n) return NULL;
+    size_t body = n->len - n->lead;
+    char *out = malloc(body + 1);
+    if (!out) return NULL;
+    memcpy(out, n->text + n->lead, body);
+    out[body] = '\0';
+    return out;
+}
+
+size_t doc_sentence_offset(const Document *doc, size_t k) {
+    size_t off = 0;
+    const DocNode *t = doc->root;
+    while (t) {
+        size_t lc = n_count(t->left);
+        if (k <= lc) {
+            t = t->left;
+        } else {
+            off += n_bytes(t->left) + t->len;
+            k -= lc + 1;
+            t = t->right;
+        }
+    }
+    return off;
+}
+
+static void each_node(const DocNode *n, size_t base_idx, size_t base_off, size_t first,
+                      void (*cb)(size_t off, size_t len, void *user), void *user) {
+    while (n) {
+        size_t idx = base_idx + n_count(n->left);
+        size_t off = base_off + n_bytes(n->left);
+        if (first < idx) each_node(n->left, base_idx, base_off, first, cb, user);
+        if (idx >= first) cb(off + n->lead, n->len - n->lead, user);
+        // Right subtree iteratively (keeps recursion to the left spine)
+        base_idx = idx + 1;
+        base_off = off + n->len;
+        n = n->right;
+    }
+}
+
+void doc_each_sentence(const Document *doc, size_t first,
+                       void (*cb)(size_t off, size_t len, void *user), void *user) {
+    each_node(doc->root, 0, 0, first, cb, user);
+}
+
+// --- edits ---
+
+int doc_set_sentence(Document *doc, size_t k, const char *body) {
+    size_t count = n_count(doc->root);
+    if (k == count) return doc_insert_sentence(doc, k, body);
+    if (k > count) return -1;
+
+    DocNode *a, *bc, *b, *c;
+    split(doc->root, k, &a, &bc);
+    split(bc, 1, &b, &c);
+    const char *text = add_text(doc, b->text, b->lead, body, strlen(body));
+    if (text) {
+        b->len = b->lead + strlen(body);
+        b->text = text;
+        update(b);
+    }
+    doc->root = merge(merge(a, b), c);
+    return text ? 0 : -1;
+}
+
+int doc_insert_sentence(Document *doc, size_t k, const char *body) {
+    size_t count = n_count(doc->root);
+    if (k > count) return -1;
+
+    // New sentences are separated by a single space (none at the start of the document)
+    const char *lead = k == 0 ? "" : " ";
+    const char *text = add_text(doc, lead, strlen(lead), body, strlen(body));
+    if (!text) return -1;
+    DocNode *n = new_node(doc, text, strlen(lead) + strlen(body), strlen(lead));
+    if (!n) return -1;
+
+    DocNode *a, *b;
+    split(doc->root, k, &a, &b);
+    if (k == 0 && b) {
+        // The old first sentence now follows another one: give it a separator
+        DocNode *rest, *first;
+        split(b, 1, &first, &rest);
+        const char *moved = add_text(doc, " ", 1, first->text + first->lead, first->len - first->lead);
+        if (moved) {
+            first->len = first->len - first->lead + 1;
+            first->lead = 1;
+            first->text = moved;
+            update(first);
+        }
+        b = merge(first, rest);
+    }
+    doc->root = merge(merge(a, n), b);
+    return 0;
+}
+
+void doc_normalize(Document *doc, size_t first, size_t last) {
+    size_t k = first;
+    while (k <= last && k + 1 < n_count(doc->root)) {
+        DocNode *n = nth(doc->root, k);
+        if (n->len > n->lead && doc_is_delim(n->text[n->len - 1])) {
+            k++;
+            continue;
+        }
+        DocNode *a, *bc, *b, *c, *next;
+        split(doc->root, k, &a, &bc);
+        split(bc, 1, &b, &c);
+        split(c, 1, &next, &c);
+        const char *text = add_text(doc, b->text, b->len, next->text, next->len);
+        if (!text) {
+            doc->root = merge(merge(merge(a, b), next), c);
+            return;
+        }
+        b->text = text;
+        b->len += next->len;
+        update(b);
+        doc->root = merge(merge(a, b), c);
+        if (last > first) last--;
+    }
+}
+
+// --- output ---
+
+static int write_node(const DocNode *n, FILE *fp) {
+    if (!n) return 0;
+    if (write_node(n->left, fp) != 0) return -1;
+    if (n->len && fwrite(n->text, 1, n->len, fp) != n->len) return -1;
+    return write_node(n->right, fp);
+}
+
+int doc_write(const Document *doc, FILE *fp) {
+    if (write_node(doc->root, fp) != 0) return -1;
+    if (doc->tail_len && fwrite(doc->tail, 1, doc->tail_len, fp) != doc->tail_len) return -1;
+    return 0;
+}
+
+static void render_node(const DocNode *n, size_t base_idx, size_t first, char **dst) {
+    while (n) {
+        size_t idx = base_idx + n_count(n->left);
+        if (first < idx) render_node(n->left, base_idx, first, dst);
+        if (idx >= first) {
+            memcpy(*dst, n->text, n->len);
+            *dst += n->len;
+        }
+        base_idx = idx + 1;
+        n = n->right;
+    }
+}
+
+char *doc_render(const Document *doc, size_t first, size_t *len) {
+    size_t from = first < n_count(doc->root) ? doc_sentence_offset(doc, first) : n_bytes(doc->root);
+    *len = doc_length(doc) - from;
+    char *out = malloc(*len + 1);
+    if (!out) return NULL;
+    char *dst = out;
+    render_node(doc->root, 0, first, &dst);
+    if (doc->tail_len) memcpy(dst, doc->tail, doc->tail_len);
+    return out;
+}
+
+const char *doc_original(const Document *doc, size_t *len) {
+    *len = doc->orig_len;
+    return doc->orig;
+}
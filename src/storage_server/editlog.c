@@ -0,0 +1,200 @@
+#include "../../include/common.h"
+#include "../../include/editlog.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+
+struct EditLog {
+    int fd;
+    char path[512];
+    int dirty;              // appended since the last sync pass picked it up
+    int in_flight;          // being fdatasync'd by the current leader
+    EditLog *next_dirty;
+    EditLog *next_batch;
+};
+
+// Group commit: appenders queue their journal as dirty; one of them (the leader) syncs
+// every dirty journal in a single pass while the others wait for it
+static pthread_mutex_t gc_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gc_cv = PTHREAD_COND_INITIALIZER;
+static EditLog *dirty_head;
+static uint64_t gc_written, gc_synced;
+static int gc_leader;
+static int sync_mode = -1;
+
+static int want_sync(void) {
+    if (sync_mode < 0) {
+        const char *v = getenv("SS_EDIT_SYNC");
+        sync_mode = v && atoi(v) > 0;
+    }
+    return sync_mode;
+}
+
+static void group_sync(EditLog *log) {
+    pthread_mutex_lock(&gc_lock);
+    if (!log->dirty) {
+        log->dirty = 1;
+        log->next_dirty = dirty_head;
+        dirty_head = log;
+    }
+    uint64_t mine = ++gc_written;
+    while (gc_synced < mine) {
+        if (gc_leader) {
+            pthread_cond_wait(&gc_cv, &gc_lock);
+            continue;
+        }
+        gc_leader = 1;
+        uint64_t upto = gc_written;
+        EditLog *batch = dirty_head;
+        dirty_head = NULL;
+        for (EditLog *l = batch; l; l = l->next_dirty) {
+            l->dirty = 0;
+            l->in_flight = 1;
+            l->next_batch = l->next_dirty;
+        }
+        pthread_mutex_unlock(&gc_lock);
+        for (EditLog *l = batch; l; l = l->next_batch) fdatasync(l->fd);
+        pthread_mutex_lock(&gc_lock);
+        for (EditLog *l = batch; l; l = l->next_batch) l->in_flight = 0;
+        gc_synced = upto;
+        gc_leader = 0;
+        pthread_cond_broadcast(&gc_cv);
+    }
+    pthread_mutex_unlock(&gc_lock);
+}
+
+static int write_record(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// "<prefix> <len>\n<bytes>\n" as one buffer, so each record is a single append
+static char *make_record(const char *prefix, const char *text, size_t *len) {
+    size_t tlen = strlen(text);
+    char *rec = malloc(strlen(prefix) + tlen + 32);
+    if (!rec) return NULL;
+    int n = sprintf(rec, "%s %zu\n", prefix, tlen);
+    memcpy(rec + n, text, tlen);
+    rec[n + tlen] = '\n';
+    *len = (size_t)n + tlen + 1;
+    return rec;
+}
+
+// Parse "<prefix...> <len>\n<bytes>\n" at *p; returns the malloc'd bytes or NULL if torn
+static char *read_record(const char **p, const char *end, char *head, size_t headsz) {
+    const char *nl = memchr(*p, '\n', (size_t)(end - *p));
+    if (!nl || (size_t)(nl - *p) >= headsz) return NULL;
+    memcpy(head, *p, (size_t)(nl - *p));
+    head[nl - *p] = '\0';
+    char *sp = strrchr(head, ' ');
+    if (!sp) return NULL;
+    size_t len = (size_t)strtoul(sp + 1, NULL, 10);
+    *sp = '\0';
+    const char *body = nl + 1;
+    if ((size_t)(end - body) < len + 1 || body[len] != '\n') return NULL;
+    char *out = malloc(len + 1);
+    if (!out) return NULL;
+    memcpy(out, body, len);
+    out[len] = '\0';
+    *p = body + len + 1;
+    return out;
+}
+
+static char *slurp(const char *path, size_t *len) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return NULL;
+    struct stat st;
+    char *buf = NULL;
+    if (fstat(fileno(fp), &st) == 0 && (buf = malloc((size_t)st.st_size + 1)) != NULL) {
+        *len = fread(buf, 1, (size_t)st.st_size, fp);
+    }
+    fclose(fp);
+    return buf;
+}
+
+EditLog *editlog_open(const char *filename, int sentence, const char *owner, const char *original,
+                      EditReplay replay, void *user, int *replayed) {
+    EditLog *log = calloc(1, sizeof(EditLog));
+    if (!log) return NULL;
+    snprintf(log->path, sizeof(log->path), "%s/storage%d/swap/%s.%d.edits", STORAGE_DIR, get_storage_id(), filename, sentence);
+    *replayed = 0;
+
+    // A journal already here belongs to an interrupted session
+    size_t old_len = 0;
+    char *old = slurp(log->path, &old_len);
+    unlink(log->path);   // a lapsed session may still hold the old inode open
+
+    log->fd = open(log->path, O_WRONLY | O_CREAT | O_EXCL | O_APPEND, 0644);
+    size_t hlen = 0;
+    char prefix[128];
+    snprintf(prefix, sizeof(prefix), "%s %s", EDITLOG_MAGIC, owner);
+    char *header = make_record(prefix, original, &hlen);
+    if (log->fd < 0 || !header || write_record(log->fd, header, hlen) != 0) {
+        if (log->fd >= 0) close(log->fd);
+        free(header);
+        free(old);
+        free(log);
+        return NULL;
+    }
+    free(header);
+
+    if (old) {
+        const char *p = old, *end = old + old_len;
+        char head[128], expect[128];
+        char *orig = read_record(&p, end, head, sizeof(head));
+        snprintf(expect, sizeof(expect), "%s %s", EDITLOG_MAGIC, owner);
+        // Only resume the same user's draft of the sentence as it still reads now
+        if (orig && strcmp(head, expect) == 0 && strcmp(orig, original) == 0) {
+            char *content;
+            while ((content = read_record(&p, end, head, sizeof(head))) != NULL) {
+                long index;
+                if (sscanf(head, "+ %ld", &index) == 1 && replay(index, content, user) == 0 &&
+                    editlog_append(log, index, content) == 0) {
+                    (*replayed)++;
+                }
+                free(content);
+            }
+        }
+        free(orig);
+        free(old);
+    }
+    return log;
+}
+
+int editlog_append(EditLog *log, long index, const char *content) {
+    char prefix[32];
+    snprintf(prefix, sizeof(prefix), "+ %ld", index);
+    size_t len;
+    char *rec = make_record(prefix, content, &len);
+    int rc = rec ? write_record(log->fd, rec, len) : -1;
+    free(rec);
+    if (rc == 0 && want_sync()) group_sync(log);
+    return rc;
+}
+
+void editlog_close(EditLog *log) {
+    if (!log) return;
+    pthread_mutex_lock(&gc_lock);
+    while (log->in_flight) pthread_cond_wait(&gc_cv, &gc_lock);
+    if (log->dirty) {
+        EditLog **pp = &dirty_head;
+        while (*pp && *pp != log) pp = &(*pp)->next_dirty;
+        if (*pp) *pp = log->next_dirty;
+    }
+    pthread_mutex_unlock(&gc_lock);
+
+    // Remove the journal unless a newer session already replaced it
+    struct stat mine, cur;
+    if (fstat(log->fd, &mine) == 0 && stat(log->path, &cur) == 0 && mine.st_ino == cur.st_ino) {
+        unlink(log->path);
+    }
+    close(log->fd);
+    free(log);
+}
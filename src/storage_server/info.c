@@ -1,6 +1,9 @@
 #include "../../include/common.h"
 #include "../../include/info.h"
 #include "../../include/acl.h"
+#include "../../include/atime.h"
+#include "../../include/doccount.h"
+#include "../../include/tier.h"
 
 // Helper: convert mode to rwx string (like ls -l)
 void get_permissions_string(mode_t mode, char *perm_str) {
@@ -16,6 +19,20 @@ void get_permissions_string(mode_t mode, char *perm_str) {
     perm_str[9] = '\0';
 }
 
+// stat() of the document, or of its archived copy if it is in the cold tier
+static int document_stat(const char *filename, struct stat *st) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/storage%d/files/%s", STORAGE_DIR, get_storage_id(), filename);
+    if (stat(path, st) == 0) return 0;
+    TierInfo info;
+    if (!tier_lookup(filename, &info)) return -1;
+    memset(st, 0, sizeof(*st));
+    st->st_mode = S_IFREG | 0644;
+    st->st_size = (off_t)info.size;
+    st->st_mtime = info.mtime;
+    return 0;
+}
+
 void file_info(int client_sock, const char *filename, const char *username) {
     // Check read access
     if (!check_read_access(filename, username)) {
@@ -25,12 +42,10 @@ void file_info(int client_sock, const char *filename, const char *username) {
         return;
     }
     
-    char path[512];
-    sprintf(path, "%s/storage%d/files/%s", STORAGE_DIR, get_storage_id(), filename);
     struct stat st;
 
     // Check if file exists
-    if (stat(path, &st) != 0) {
+    if (document_stat(filename, &st) != 0) {
         char err[256];
         sprintf(err, "ERROR: File '%s' not found or inaccessible.\n", filename);
         send(client_sock, err, strlen(err), 0);
@@ -45,22 +60,41 @@ void file_info(int client_sock, const char *filename, const char *username) {
     char write_users_str[512] = "N/A";
     char atime[64] = "N/A";
     char mtime[64] = "N/A";
+    struct tm tm_buf;
     
     if (read_metadata_file(filename, &meta) == 0) {
+        meta.last_accessed = atime_effective(filename, meta.last_accessed);
         strncpy(owner_str, meta.owner, sizeof(owner_str) - 1);
         if (meta.created_time > 0) {
-            strftime(created_str, sizeof(created_str), "%Y-%m-%d %H:%M:%S", localtime(&meta.created_time));
+            strftime(created_str, sizeof(created_str), "%Y-%m-%d %H:%M:%S", localtime_r(&meta.created_time, &tm_buf));
         }
         if (meta.last_accessed > 0) {
-            strftime(atime, sizeof(atime), "%Y-%m-%d %H:%M:%S", localtime(&meta.last_accessed));
+            strftime(atime, sizeof(atime), "%Y-%m-%d %H:%M:%S", localtime_r(&meta.last_accessed, &tm_buf));
         }
         if (meta.last_modified > 0) {
-            strftime(mtime, sizeof(mtime), "%Y-%m-%d %H:%M:%S", localtime(&meta.last_modified));
+            strftime(mtime, sizeof(mtime), "%Y-%m-%d %H:%M:%S", localtime_r(&meta.last_modified, &tm_buf));
         }
         strncpy(read_users_str, meta.read_users, sizeof(read_users_str) - 1);
         strncpy(write_users_str, meta.write_users, sizeof(write_users_str) - 1);
     }
 
+    // Counts from the metadata (recounted only if stale); cold documents are not promoted
+    char words_str[32] = "N/A", chars_str[32] = "N/A", sentences_str[32] = "N/A";
+    DocCounts counts;
+    TierInfo cold;
+    int counted = 0;
+    if (tier_lookup(filename, &cold)) {
+        doccount_cold(filename, &cold, &counts);
+        counted = 1;
+    } else {
+        counted = doccount_get(filename, &st, &counts) == 0;
+    }
+    if (counted) {
+        snprintf(words_str, sizeof(words_str), "%ld", counts.words);
+        snprintf(chars_str, sizeof(chars_str), "%ld", counts.chars);
+        if (counts.sentences >= 0) snprintf(sentences_str, sizeof(sentences_str), "%ld", counts.sentences);
+    }
+
     char response[2048];
     char perm_str[10];
     get_permissions_string(st.st_mode, perm_str);
@@ -69,6 +103,9 @@ void file_info(int client_sock, const char *filename, const char *username) {
         "------------------- FILE INFO -------------------\n"
         "File Name      : %s\n"
         "File Size      : %ld bytes\n"
+        "Words          : %s\n"
+        "Characters     : %s\n"
+        "Sentences      : %s\n"
         "Owner          : %s\n"
         "Permissions    : %s\n"
         "Created        : %s\n"
@@ -79,6 +116,9 @@ void file_info(int client_sock, const char *filename, const char *username) {
         "-------------------------------------------------\n",
         filename,
         st.st_size,
+        words_str,
+        chars_str,
+        sentences_str,
         owner_str,
         perm_str,
         created_str,
@@ -90,3 +130,18 @@ void file_info(int client_sock, const char *filename, const char *username) {
 
     send(client_sock, response, strlen(response), 0);
 }
+
+// Compact metadata trailer for the name server (see META_TRAILER_MARK in common.h)
+void send_meta_trailer(int client_sock, const char *filename, const char *username) {
+    if (!check_read_access(filename, username)) return;
+
+    struct stat st;
+    FileMetadata meta;
+    if (document_stat(filename, &st) != 0 || read_metadata_file(filename, &meta) != 0) return;
+    meta.last_accessed = atime_effective(filename, meta.last_accessed);
+
+    char trailer[META_TRAILER_MAX];
+    snprintf(trailer, sizeof(trailer), "%cMETA %ld %lld %ld %ld\n", META_TRAILER_MARK,
+             meta.version, (long long)st.st_size, (long)meta.last_modified, (long)meta.last_accessed);
+    send(client_sock, trailer, strlen(trailer), 0);
+}
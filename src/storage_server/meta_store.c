@@ -0,0 +1,532 @@
+#include "../../include/common.h"
+#include "../../include/meta_store.h"
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <pthread.h>
+
+#define META_MAGIC "DOCSMETA"
+#define META_FORMAT 1
+#define META_HEADER_SIZE 4096
+
+#define SLOT_LIVE 1
+#define SLOT_DELETED 2
+
+typedef struct {
+    char magic[8];
+    uint32_t format;
+    uint32_t record_size;   // sizeof(MetaRecord) when the table was written
+    uint64_t capacity;      // number of slots
+    uint32_t moved;         // set once the table was rebuilt into a new file (remap)
+    // Shared by all workers, only changed under the writer lock; recomputed on open
+    uint64_t next_gen;
+    uint64_t live_count;
+    uint64_t used_count;    // live + deleted slots (probe chains)
+} MetaStoreHeader;
+
+typedef struct {
+    uint32_t crc;           // CRC-32 over the rest of the record
+    uint32_t state;         // SLOT_LIVE / SLOT_DELETED
+    uint64_t gen;           // store-wide write generation (0 = never written)
+    char name[256];
+    FileMetadata meta;      // kept last so the layout can grow (see store_rebuild)
+} MetaRecord;
+
+static int store_id = 0;
+static int lock_fd = -1;
+static pthread_mutex_t store_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Current mapping. Only replaced under the writer lock; lock-free readers take a snapshot
+// (current_map) and old mappings are never unmapped, so a snapshot stays readable.
+static unsigned char *db_map = NULL;
+static MetaStoreHeader *hdr = NULL;
+
+// --- helpers ---
+
+static uint32_t crc_table[256];
+
+static uint32_t crc32_buf(const unsigned char *p, size_t n) {
+    if (crc_table[1] == 0) {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            crc_table[i] = c;
+        }
+    }
+    uint32_t c = 0xFFFFFFFFu;
+    while (n--) c = crc_table[(c ^ *p++) & 0xFF] ^ (c >> 8);
+    return c ^ 0xFFFFFFFFu;
+}
+
+static unsigned long name_hash(const char *str) {
+    unsigned long hash = 5381;
+    int c;
+    while ((c = *str++)) hash = ((hash << 5) + hash) + c;
+    return hash;
+}
+
+static void store_path(char *buf, size_t sz, const char *leaf) {
+    snprintf(buf, sz, "%s/storage%d/%s", STORAGE_DIR, store_id, leaf);
+}
+
+// Writer lock: a mutex between worker threads plus an fcntl lock against other processes
+static void store_lock(void) {
+    pthread_mutex_lock(&store_mutex);
+    struct flock fl = {0};
+    fl.l_type = F_WRLCK;
+    fl.l_whence = SEEK_SET;
+    while (fcntl(lock_fd, F_SETLKW, &fl) < 0 && errno == EINTR) {}
+}
+
+static void store_unlock(void) {
+    struct flock fl = {0};
+    fl.l_type = F_UNLCK;
+    fl.l_whence = SEEK_SET;
+    fcntl(lock_fd, F_SETLK, &fl);
+    pthread_mutex_unlock(&store_mutex);
+}
+
+static unsigned char *record_at(unsigned char *map, size_t rs, uint64_t slot, int copy) {
+    return map + META_HEADER_SIZE + (slot * 2 + (uint64_t)copy) * rs;
+}
+
+// Copy the newest intact copy of a slot into out (zero-extended to the current layout).
+// Returns 0 if the slot was never (successfully) written.
+static int read_slot(unsigned char *map, size_t rs, uint64_t slot, MetaRecord *out) {
+    int found = 0;
+    for (int c = 0; c < 2; ++c) {
+        unsigned char *src = record_at(map, rs, slot, c);
+        MetaRecord tmp;
+        memset(&tmp, 0, sizeof(tmp));
+        uint32_t crc;
+        if (rs == sizeof(MetaRecord)) {
+            // Copy first, then verify: a concurrent writer only ever touches the other copy
+            memcpy(&tmp, src, sizeof(tmp));
+            crc = crc32_buf((unsigned char *)&tmp + 4, sizeof(tmp) - 4);
+        } else {
+            crc = crc32_buf(src + 4, rs - 4);
+            memcpy(&tmp, src, rs < sizeof(tmp) ? rs : sizeof(tmp));
+        }
+        if (tmp.gen == 0 || tmp.crc != crc) continue;
+        if (!found || tmp.gen > out->gen) {
+            *out = tmp;
+            found = 1;
+        }
+    }
+    return found;
+}
+
+// Write a new version of a slot into its older copy
+static void write_slot(uint64_t slot, const char *name, uint32_t state, const FileMetadata *meta, int durable) {
+    MetaRecord cur;
+    int target = 0;
+    if (read_slot(db_map, sizeof(MetaRecord), slot, &cur)) {
+        MetaRecord *c0 = (MetaRecord *)record_at(db_map, sizeof(MetaRecord), slot, 0);
+        target = (c0->gen == cur.gen) ? 1 : 0;
+    }
+    MetaRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.state = state;
+    rec.gen = hdr->next_gen++;
+    strncpy(rec.name, name, sizeof(rec.name) - 1);
+    if (meta) rec.meta = *meta;
+    rec.crc = crc32_buf((unsigned char *)&rec + 4, sizeof(rec) - 4);
+
+    unsigned char *dst = record_at(db_map, sizeof(MetaRecord), slot, target);
+    memcpy(dst, &rec, sizeof(rec));
+    if (durable && META_STORE_SYNC) {
+        long page = sysconf(_SC_PAGESIZE);
+        uintptr_t start = (uintptr_t)dst & ~((uintptr_t)page - 1);
+        msync((void *)start, (uintptr_t)dst + sizeof(rec) - start, MS_SYNC);
+    }
+}
+
+// Probe for name. Returns the slot holding it (live) or -1; *free_slot gets the first
+// reusable slot on the probe path (deleted or empty), or -1 if the table is full.
+static int64_t find_slot(unsigned char *map, const char *name, MetaRecord *out, int64_t *free_slot) {
+    uint64_t cap = ((MetaStoreHeader *)map)->capacity;
+    uint64_t h = name_hash(name) % cap;
+    if (free_slot) *free_slot = -1;
+    for (uint64_t probe = 0; probe < cap; ++probe) {
+        uint64_t slot = (h + probe) % cap;
+        MetaRecord rec;
+        if (!read_slot(map, sizeof(MetaRecord), slot, &rec)) {
+            if (free_slot && *free_slot < 0) *free_slot = (int64_t)slot;
+            return -1;
+        }
+        if (rec.state == SLOT_LIVE && strcmp(rec.name, name) == 0) {
+            if (out) *out = rec;
+            return (int64_t)slot;
+        }
+        if (rec.state == SLOT_DELETED && free_slot && *free_slot < 0) *free_slot = (int64_t)slot;
+    }
+    return -1;
+}
+
+// --- mapping / rebuild ---
+
+static int map_db(void) {
+    char path[512];
+    store_path(path, sizeof(path), "meta.db");
+    int fd = open(path, O_RDWR);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < META_HEADER_SIZE) { close(fd); return -1; }
+    unsigned char *map = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) { close(fd); return -1; }
+    MetaStoreHeader *h = (MetaStoreHeader *)map;
+    if (memcmp(h->magic, META_MAGIC, 8) != 0 ||
+        META_HEADER_SIZE + h->capacity * 2 * h->record_size > (uint64_t)st.st_size) {
+        munmap(map, (size_t)st.st_size);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    hdr = h;
+    __atomic_store_n(&db_map, map, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static int create_db(const char *path, uint64_t capacity) {
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+    MetaStoreHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, META_MAGIC, 8);
+    h.format = META_FORMAT;
+    h.record_size = sizeof(MetaRecord);
+    h.capacity = capacity;
+    int ok = ftruncate(fd, (off_t)(META_HEADER_SIZE + capacity * 2 * sizeof(MetaRecord))) == 0 &&
+             pwrite(fd, &h, sizeof(h), 0) == (ssize_t)sizeof(h);
+    close(fd);
+    return ok ? 0 : -1;
+}
+
+// Recompute counters and the generation counter from the table itself
+static void scan_db(void) {
+    hdr->live_count = hdr->used_count = 0;
+    hdr->next_gen = 1;
+    for (uint64_t i = 0; i < hdr->capacity; ++i) {
+        MetaRecord rec;
+        if (!read_slot(db_map, hdr->record_size, i, &rec)) continue;
+        hdr->used_count++;
+        if (rec.state == SLOT_LIVE) hdr->live_count++;
+        if (rec.gen >= hdr->next_gen) hdr->next_gen = rec.gen + 1;
+    }
+}
+
+// Copy every live record into a fresh table (new capacity and/or record layout), then
+// swap it in with rename(). Other processes notice hdr->moved and remap; the old mapping
+// stays valid for readers still holding a snapshot.
+static int store_rebuild(uint64_t capacity) {
+    char path[512], tmp[520];
+    store_path(path, sizeof(path), "meta.db");
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    if (create_db(tmp, capacity) != 0) return -1;
+
+    int fd = open(tmp, O_RDWR);
+    if (fd < 0) return -1;
+    size_t size = META_HEADER_SIZE + capacity * 2 * sizeof(MetaRecord);
+    unsigned char *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) { unlink(tmp); return -1; }
+
+    size_t old_rs = hdr->record_size;
+    for (uint64_t i = 0; i < hdr->capacity; ++i) {
+        MetaRecord rec;
+        if (!read_slot(db_map, old_rs, i, &rec) || rec.state != SLOT_LIVE) continue;
+        rec.crc = crc32_buf((unsigned char *)&rec + 4, sizeof(rec) - 4);
+        uint64_t h = name_hash(rec.name) % capacity;
+        while (((MetaRecord *)record_at(map, sizeof(MetaRecord), h, 0))->gen != 0) h = (h + 1) % capacity;
+        memcpy(record_at(map, sizeof(MetaRecord), h, 0), &rec, sizeof(rec));
+    }
+    int ok = msync(map, size, MS_SYNC) == 0;
+    munmap(map, size);
+    if (!ok || rename(tmp, path) != 0) { unlink(tmp); return -1; }
+
+    hdr->moved = 1;
+    msync(db_map, META_HEADER_SIZE, MS_SYNC);
+    if (map_db() != 0) return -1;
+    scan_db();
+    printf("[META] Rebuilt metadata store: %lu slots, %lu live records\n",
+           (unsigned long)hdr->capacity, (unsigned long)hdr->live_count);
+    return 0;
+}
+
+// Remap if another process rebuilt the table (it already set the new header's counters).
+// Called with the writer lock held.
+static void ensure_current(void) {
+    while (hdr && hdr->moved) {
+        if (map_db() != 0) break;
+    }
+}
+
+// Snapshot of the current mapping for lock-free readers
+static unsigned char *current_map(void) {
+    unsigned char *map = __atomic_load_n(&db_map, __ATOMIC_ACQUIRE);
+    if (map && ((MetaStoreHeader *)map)->moved) {
+        store_lock();
+        ensure_current();
+        store_unlock();
+        map = __atomic_load_n(&db_map, __ATOMIC_ACQUIRE);
+    }
+    return map;
+}
+
+// --- public API ---
+
+int meta_store_open(int storage_id) {
+    store_id = storage_id;
+    char path[512];
+    store_path(path, sizeof(path), "meta.lock");
+    lock_fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (lock_fd < 0) return -1;
+
+    store_lock();
+    int fresh = 0;
+    store_path(path, sizeof(path), "meta.db");
+    if (access(path, F_OK) != 0) {
+        if (create_db(path, META_STORE_INITIAL_SLOTS) != 0) { store_unlock(); return -1; }
+        fresh = 1;
+    }
+    if (map_db() != 0) { store_unlock(); return -1; }
+    scan_db();
+    if (hdr->record_size != sizeof(MetaRecord) || hdr->format != META_FORMAT) {
+        // Record layout changed (e.g. new FileMetadata fields): migrate in place
+        if (store_rebuild(hdr->capacity) != 0) { store_unlock(); return -1; }
+    }
+    store_unlock();
+
+    if (fresh) {
+        char meta_dir[512];
+        store_path(meta_dir, sizeof(meta_dir), "meta");
+        int n = meta_store_import(meta_dir);
+        if (n > 0) printf("[META] Imported %d .meta file(s) into metadata store\n", n);
+    }
+    return 0;
+}
+
+int meta_store_get(const char *name, FileMetadata *out, MetaRef *ref) {
+    unsigned char *map = current_map();
+    if (!map) return -1;
+    MetaRecord rec;
+    int64_t slot = find_slot(map, name, &rec, NULL);
+    if (slot < 0) {
+        // Lock-free probe may race with a writer reusing both copies; confirm under the lock
+        store_lock();
+        ensure_current();
+        slot = find_slot(db_map, name, &rec, NULL);
+        store_unlock();
+        if (slot < 0) return -1;
+    }
+    if (out) *out = rec.meta;
+    if (ref) {
+        ref->slot = (uint64_t)slot;
+        ref->gen = rec.gen;
+    }
+    return 0;
+}
+
+// Cheap staleness check: the newest generation in the slot must still be the one the
+// caller saw. A write in progress or a rebuild only ever makes this fail (safe miss).
+int meta_store_ref_valid(const MetaRef *ref) {
+    unsigned char *map = current_map();
+    if (!map || ref->slot >= ((MetaStoreHeader *)map)->capacity) return 0;
+    uint64_t g0 = __atomic_load_n(&((MetaRecord *)record_at(map, sizeof(MetaRecord), ref->slot, 0))->gen, __ATOMIC_ACQUIRE);
+    uint64_t g1 = __atomic_load_n(&((MetaRecord *)record_at(map, sizeof(MetaRecord), ref->slot, 1))->gen, __ATOMIC_ACQUIRE);
+    return (g0 > g1 ? g0 : g1) == ref->gen;
+}
+
+int meta_store_put(const char *name, const FileMetadata *meta) {
+    if (!db_map || strlen(name) >= sizeof(((MetaRecord *)0)->name)) return -1;
+    store_lock();
+    ensure_current();
+    int64_t free_slot;
+    int64_t slot = find_slot(db_map, name, NULL, &free_slot);
+    if (slot < 0) {
+        if (free_slot < 0 || (hdr->used_count + 1) * 100 > hdr->capacity * META_STORE_MAX_LOAD) {
+            if (store_rebuild(hdr->capacity * 2) != 0) { store_unlock(); return -1; }
+            find_slot(db_map, name, NULL, &free_slot);
+            if (free_slot < 0) { store_unlock(); return -1; }
+        }
+        MetaRecord prev;
+        if (!read_slot(db_map, sizeof(MetaRecord), (uint64_t)free_slot, &prev)) hdr->used_count++;
+        hdr->live_count++;
+        slot = free_slot;
+    }
+    write_slot((uint64_t)slot, name, SLOT_LIVE, meta, 1);
+    store_unlock();
+    return 0;
+}
+
+int meta_store_delete(const char *name) {
+    if (!db_map) return -1;
+    store_lock();
+    ensure_current();
+    int64_t slot = find_slot(db_map, name, NULL, NULL);
+    if (slot >= 0) {
+        write_slot((uint64_t)slot, name, SLOT_DELETED, NULL, 1);
+        hdr->live_count--;
+    }
+    store_unlock();
+    return slot >= 0 ? 0 : -1;
+}
+
+// Content change: version + 1 and LAST_MODIFIED, no other field touched. Callers hold the
+// document's commit write lock, so every commit counts and an ACL change that lands
+// meanwhile is kept.
+int meta_store_bump_version(const char *name, time_t mtime) {
+    if (!db_map) return -1;
+    store_lock();
+    ensure_current();
+    MetaRecord rec;
+    int64_t slot = find_slot(db_map, name, &rec, NULL);
+    if (slot >= 0) {
+        rec.meta.version++;
+        rec.meta.last_modified = mtime;
+        write_slot((uint64_t)slot, name, SLOT_LIVE, &rec.meta, 1);
+    }
+    store_unlock();
+    return slot >= 0 ? 0 : -1;
+}
+
+// ACL change: edit() adjusts the record's read / write user lists in place under the store
+// lock, so concurrent grants and revokes on one file all land. A non-zero return from edit()
+// leaves the record unwritten and is returned.
+int meta_store_edit_acl(const char *name, int (*edit)(FileMetadata *meta, void *arg), void *arg) {
+    if (!db_map) return -1;
+    store_lock();
+    ensure_current();
+    MetaRecord rec;
+    int64_t slot = find_slot(db_map, name, &rec, NULL);
+    int rc = -1;
+    if (slot >= 0) {
+        rc = edit(&rec.meta, arg);
+        if (rc == 0) write_slot((uint64_t)slot, name, SLOT_LIVE, &rec.meta, 1);
+    }
+    store_unlock();
+    return rc;
+}
+
+// Access times are advisory: written without msync (the shadow copy keeps them torn-safe)
+int meta_store_set_atime(const char *name, time_t when) {
+    if (!db_map) return -1;
+    store_lock();
+    ensure_current();
+    MetaRecord rec;
+    int64_t slot = find_slot(db_map, name, &rec, NULL);
+    if (slot >= 0 && when > rec.meta.last_accessed) {
+        rec.meta.last_accessed = when;
+        write_slot((uint64_t)slot, name, SLOT_LIVE, &rec.meta, 0);
+    }
+    store_unlock();
+    return slot >= 0 ? 0 : -1;
+}
+
+// Content counts are derived (stamped, recounted if lost): also written without msync.
+// Only the count fields of `counts` are taken.
+int meta_store_set_counts(const char *name, const FileMetadata *counts) {
+    if (!db_map) return -1;
+    store_lock();
+    ensure_current();
+    MetaRecord rec;
+    int64_t slot = find_slot(db_map, name, &rec, NULL);
+    if (slot >= 0) {
+        rec.meta.words = counts->words;
+        rec.meta.chars = counts->chars;
+        rec.meta.sentences = counts->sentences;
+        rec.meta.counted_size = counts->counted_size;
+        rec.meta.counted_mtime = counts->counted_mtime;
+        write_slot((uint64_t)slot, name, SLOT_LIVE, &rec.meta, 0);
+    }
+    store_unlock();
+    return slot >= 0 ? 0 : -1;
+}
+
+void meta_store_iter(void (*cb)(const char *name, const FileMetadata *meta, void *user), void *user) {
+    unsigned char *map = current_map();
+    if (!map) return;
+    uint64_t capacity = ((MetaStoreHeader *)map)->capacity;
+    for (uint64_t i = 0; i < capacity; ++i) {
+        MetaRecord rec;
+        if (read_slot(map, sizeof(MetaRecord), i, &rec) && rec.state == SLOT_LIVE) {
+            cb(rec.name, &rec.meta, user);
+        }
+    }
+}
+
+// --- .meta text import / export ---
+
+static int parse_meta_text(const char *path, FileMetadata *meta) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) return -1;
+
+    char line[1024];
+    memset(meta, 0, sizeof(FileMetadata));
+    while (fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\n")] = 0;
+
+        if (strncmp(line, "OWNER:", 6) == 0) {
+            strncpy(meta->owner, line + 6, sizeof(meta->owner) - 1);
+        } else if (strncmp(line, "CREATED:", 8) == 0) {
+            meta->created_time = (time_t)atol(line + 8);
+        } else if (strncmp(line, "LAST_MODIFIED:", 14) == 0) {
+            meta->last_modified = (time_t)atol(line + 14);
+        } else if (strncmp(line, "LAST_ACCESS:", 12) == 0) {
+            meta->last_accessed = (time_t)atol(line + 12);
+        } else if (strncmp(line, "VERSION:", 8) == 0) {
+            meta->version = atol(line + 8);
+        } else if (strncmp(line, "READ_USERS:", 11) == 0) {
+            strncpy(meta->read_users, line + 11, sizeof(meta->read_users) - 1);
+        } else if (strncmp(line, "WRITE_USERS:", 12) == 0) {
+            strncpy(meta->write_users, line + 12, sizeof(meta->write_users) - 1);
+        }
+    }
+    fclose(fp);
+    return 0;
+}
+
+int meta_store_import(const char *dir) {
+    DIR *d = opendir(dir);
+    if (!d) return 0;
+    int imported = 0;
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        size_t len = strlen(entry->d_name);
+        if (len <= 5 || strcmp(entry->d_name + len - 5, ".meta") != 0) continue;
+        char name[256], path[1024];
+        snprintf(name, sizeof(name), "%.*s", (int)(len - 5), entry->d_name);
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        FileMetadata meta;
+        if (parse_meta_text(path, &meta) == 0 && meta_store_put(name, &meta) == 0) imported++;
+    }
+    closedir(d);
+    return imported;
+}
+
+typedef struct {
+    const char *dir;
+    int count;
+} ExportCtx;
+
+static void export_one(const char *name, const FileMetadata *meta, void *user) {
+    ExportCtx *ctx = (ExportCtx *)user;
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s.meta", ctx->dir, name);
+    FILE *fp = fopen(path, "w");
+    if (!fp) return;
+    fprintf(fp, "OWNER:%s\n", meta->owner);
+    fprintf(fp, "CREATED:%ld\n", (long)meta->created_time);
+    fprintf(fp, "LAST_MODIFIED:%ld\n", (long)meta->last_modified);
+    fprintf(fp, "LAST_ACCESS:%ld\n", (long)meta->last_accessed);
+    fprintf(fp, "VERSION:%ld\n", meta->version);
+    fprintf(fp, "READ_USERS:%s\n", meta->read_users);
+    fprintf(fp, "WRITE_USERS:%s\n", meta->write_users);
+    fclose(fp);
+    ctx->count++;
+}
+
+int meta_store_export(const char *dir) {
+    ExportCtx ctx = {dir, 0};
+    meta_store_iter(export_one, &ctx);
+    return ctx.count;
+}
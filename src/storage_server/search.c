@@ -0,0 +1,1281 @@
+#include "../../include/common.h"
+#include "../../include/search.h"
+#include "../../include/acl.h"
+#include "../../include/commit.h"
+#include "../../include/tier.h"
+#include <ctype.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+
+#define LOG_MAGIC "SIX1"
+#define SEGMENT_MAGIC "DSI2"        // per-file segments of older servers, imported once
+#define SEGMENT_MAGIC_V1 "DSIX"
+#define DOC_BUCKETS 1024
+
+// --- Varint helpers (LEB128, 7 bits per byte) ---
+
+static size_t varint_put(unsigned char *out, uint32_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        out[n++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    out[n++] = (unsigned char)v;
+    return n;
+}
+
+static int varint_get(const unsigned char **p, const unsigned char *end, uint32_t *v) {
+    uint32_t result = 0;
+    int shift = 0;
+    while (*p < end && shift < 35) {
+        unsigned char b = *(*p)++;
+        result |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) { *v = result; return 0; }
+        shift += 7;
+    }
+    return -1;
+}
+
+static uint64_t fnv(uint64_t h, const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char *)data;
+    for (size_t i = 0; i < len; ++i) h = (h ^ p[i]) * 1099511628211ull;
+    return h;
+}
+
+static int is_term_char(unsigned char c) {
+    return isalnum(c) || c >= 0x80;
+}
+
+// --- The index ---
+//
+// Term dictionary: each term's postings list every document it occurs in, ascending by
+// document id, as [doc id delta][sentence count][sentence id deltas...]. Sentence ids are
+// stable per document: an edit gives new ids to the sentences it rewrote and leaves the
+// others (and their postings) alone; the document maps ids to current sentence numbers.
+
+typedef struct Term {
+    char *text;
+    uint32_t id;
+    uint32_t ndocs;             // documents with a posting (df)
+    unsigned char *post;
+    size_t len, cap;
+    struct Term *next;
+} Term;
+
+typedef struct {
+    uint64_t size, ino;
+    int64_t mtime_sec, mtime_nsec;
+} Stamp;
+
+typedef struct {
+    uint64_t fp;                // hash of the sentence's distinct terms
+    uint32_t sid;
+    uint32_t nterms;
+    uint32_t *terms;            // distinct term ids, in term order
+} Sentence;
+
+typedef struct Doc {
+    char name[256];
+    uint32_t id;
+    Stamp stamp;                // of the document bytes last indexed
+    Sentence *sent;             // in document order
+    uint32_t nsent, cap;
+    uint32_t *ord;              // sentence id -> sentence number
+    uint32_t next_sid, ord_cap;
+    struct Doc *next;
+} Doc;
+
+// Parsed text of one sentence: its distinct terms, sorted, and their hash
+typedef struct {
+    char **terms;
+    uint32_t nterms;
+    uint64_t fp;
+} SentenceText;
+
+// Readers (SEARCH) share index_lock; changes and journal appends take it exclusively
+static pthread_rwlock_t index_lock = PTHREAD_RWLOCK_INITIALIZER;
+static Term **term_buckets = NULL;
+static size_t term_nbuckets = 0;
+static Term **terms_by_id = NULL;
+static uint32_t term_count = 0, term_cap = 0;
+static Doc *doc_buckets[DOC_BUCKETS];
+static Doc **docs_by_id = NULL;
+static uint32_t doc_next_id = 0, doc_cap = 0;
+static size_t live_docs = 0;
+
+// Journal: every change as a record, replayed at startup, rewritten when mostly superseded
+static int log_fd = -1;
+static uint64_t log_size = 0, log_compacted = 0;
+static int compacting = 0;
+
+typedef struct {
+    char magic[4];
+    uint32_t len;               // payload bytes that follow
+    uint64_t sum;               // fnv of the payload
+} LogHeader;
+
+static unsigned long name_hash(const char *s) {
+    unsigned long h = 5381;
+    int c;
+    while ((c = (unsigned char)*s++)) h = ((h << 5) + h) + (unsigned long)c;
+    return h;
+}
+
+static void search_path(char *buf, size_t sz, const char *name) {
+    snprintf(buf, sz, "%s/storage%d/search/%s", STORAGE_DIR, get_storage_id(), name);
+}
+
+static void document_path(char *buf, size_t sz, const char *filename) {
+    snprintf(buf, sz, "%s/storage%d/files/%s", STORAGE_DIR, get_storage_id(), filename);
+}
+
+static void stamp_of(const struct stat *st, Stamp *s) {
+    s->size = (uint64_t)st->st_size;
+    s->ino = (uint64_t)st->st_ino;
+    s->mtime_sec = (int64_t)st->st_mtim.tv_sec;
+    s->mtime_nsec = (int64_t)st->st_mtim.tv_nsec;
+}
+
+static int stamp_equal(const Stamp *a, const Stamp *b) {
+    return a->size == b->size && a->ino == b->ino && a->mtime_sec == b->mtime_sec && a->mtime_nsec == b->mtime_nsec;
+}
+
+static Term *term_find(const char *text, int create) {
+    if (term_nbuckets) {
+        for (Term *t = term_buckets[name_hash(text) % term_nbuckets]; t; t = t->next) {
+            if (strcmp(t->text, text) == 0) return t;
+        }
+    }
+    if (!create) return NULL;
+
+    if (term_count >= term_nbuckets * 2) {
+        size_t nb = term_nbuckets ? term_nbuckets * 4 : 4096;
+        Term **buckets = calloc(nb, sizeof(Term *));
+        if (!buckets) return NULL;
+        for (uint32_t i = 0; i < term_count; ++i) {
+            Term *t = terms_by_id[i];
+            size_t b = name_hash(t->text) % nb;
+            t->next = buckets[b];
+            buckets[b] = t;
+        }
+        free(term_buckets);
+        term_buckets = buckets;
+        term_nbuckets = nb;
+    }
+    if (term_count == term_cap) {
+        uint32_t cap = term_cap ? term_cap * 2 : 4096;
+        Term **by_id = realloc(terms_by_id, cap * sizeof(Term *));
+        if (!by_id) return NULL;
+        terms_by_id = by_id;
+        term_cap = cap;
+    }
+    Term *t = calloc(1, sizeof(Term));
+    if (!t || !(t->text = strdup(text))) {
+        free(t);
+        return NULL;
+    }
+    t->id = term_count;
+    terms_by_id[term_count++] = t;
+    size_t b = name_hash(text) % term_nbuckets;
+    t->next = term_buckets[b];
+    term_buckets[b] = t;
+    return t;
+}
+
+static Doc *doc_find(const char *name, int create) {
+    unsigned long b = name_hash(name) % DOC_BUCKETS;
+    for (Doc *d = doc_buckets[b]; d; d = d->next) {
+        if (strcmp(d->name, name) == 0) return d;
+    }
+    if (!create) return NULL;
+    if (doc_next_id == doc_cap) {
+        uint32_t cap = doc_cap ? doc_cap * 2 : 256;
+        Doc **by_id = realloc(docs_by_id, cap * sizeof(Doc *));
+        if (!by_id) return NULL;
+        docs_by_id = by_id;
+        doc_cap = cap;
+    }
+    Doc *d = calloc(1, sizeof(Doc));
+    if (!d) return NULL;
+    snprintf(d->name, sizeof(d->name), "%s", name);
+    d->id = doc_next_id;
+    docs_by_id[doc_next_id++] = d;
+    d->next = doc_buckets[b];
+    doc_buckets[b] = d;
+    live_docs++;
+    return d;
+}
+
+// --- Postings ---
+
+// Where a document's block sits in a term's postings: bytes [start, stop) cover the block
+// (if any) and the doc delta of the block after it, both of which change together
+typedef struct {
+    size_t start, stop;
+    uint32_t prev;              // document id of the block before
+    int had, has_next;
+    uint32_t next_doc;
+    const unsigned char *sids;  // the block's sentence id deltas
+    uint32_t count;
+} Block;
+
+static void block_find(const Term *t, uint32_t doc, Block *b) {
+    const unsigned char *base = t->post, *p = base, *end = base + t->len;
+    memset(b, 0, sizeof(*b));
+    b->start = b->stop = t->len;
+    uint32_t prev = 0, v, count;
+    while (p < end) {
+        const unsigned char *block = p;
+        if (varint_get(&p, end, &v) != 0) break;
+        uint32_t cur = prev + v;
+        if (cur > doc) {
+            b->start = (size_t)(block - base);
+            b->stop = (size_t)(p - base);
+            b->has_next = 1;
+            b->next_doc = cur;
+            break;
+        }
+        if (varint_get(&p, end, &count) != 0) break;
+        const unsigned char *sids = p;
+        for (uint32_t i = 0; i < count && varint_get(&p, end, &v) == 0; ++i) {}
+        if (cur == doc) {
+            b->had = 1;
+            b->sids = sids;
+            b->count = count;
+            b->start = (size_t)(block - base);
+            b->stop = (size_t)(p - base);
+            const unsigned char *q = p;
+            if (q < end && varint_get(&q, end, &v) == 0) {
+                b->has_next = 1;
+                b->next_doc = cur + v;
+                b->stop = (size_t)(q - base);
+            }
+            break;
+        }
+        prev = cur;
+    }
+    b->prev = prev;
+}
+
+// Replace doc's sentence ids in t with sids (ascending; n == 0 removes the document)
+static int term_set_doc(Term *t, uint32_t doc, const uint32_t *sids, uint32_t n) {
+    Block b;
+    block_find(t, doc, &b);
+    unsigned char *rep = malloc((size_t)n * 5 + 16);
+    if (!rep) return -1;
+    size_t rlen = 0;
+    if (n > 0) {
+        rlen += varint_put(rep + rlen, doc - b.prev);
+        rlen += varint_put(rep + rlen, n);
+        for (uint32_t i = 0; i < n; ++i) rlen += varint_put(rep + rlen, sids[i] - (i ? sids[i - 1] : 0));
+    }
+    if (b.has_next) rlen += varint_put(rep + rlen, b.next_doc - (n > 0 ? doc : b.prev));
+
+    size_t len = t->len - (b.stop - b.start) + rlen;
+    if (len > t->cap) {
+        size_t cap = t->cap ? t->cap : 16;
+        while (cap < len) cap *= 2;
+        unsigned char *post = realloc(t->post, cap);
+        if (!post) {
+            free(rep);
+            return -1;
+        }
+        t->post = post;
+        t->cap = cap;
+    }
+    memmove(t->post + b.start + rlen, t->post + b.stop, t->len - b.stop);
+    memcpy(t->post + b.start, rep, rlen);
+    t->len = len;
+    free(rep);
+    if (b.had && n == 0) t->ndocs--;
+    if (!b.had && n > 0) t->ndocs++;
+    return 0;
+}
+
+typedef struct {
+    uint32_t term;
+    uint32_t sid;
+    int add;
+} Change;
+
+static int change_cmp(const void *a, const void *b) {
+    const Change *x = a, *y = b;
+    if (x->term != y->term) return x->term < y->term ? -1 : 1;
+    if (x->sid != y->sid) return x->sid < y->sid ? -1 : 1;
+    return 0;
+}
+
+// Apply per-term posting changes for one document. Added sentence ids are always newer
+// (larger) than the document's existing ones, so they go after the survivors.
+static void apply_changes(Doc *d, Change *ch, size_t n) {
+    qsort(ch, n, sizeof(Change), change_cmp);
+    for (size_t i = 0; i < n;) {
+        size_t j = i;
+        while (j < n && ch[j].term == ch[i].term) j++;
+        Term *t = terms_by_id[ch[i].term];
+        Block b;
+        block_find(t, d->id, &b);
+        uint32_t *sids = malloc(((size_t)b.count + (j - i)) * sizeof(uint32_t));
+        if (!sids) return;
+        uint32_t m = 0, acc = 0, v;
+        const unsigned char *p = b.sids, *end = t->post + t->len;
+        for (uint32_t k = 0; k < b.count && varint_get(&p, end, &v) == 0; ++k) {
+            acc += v;
+            int gone = 0;
+            for (size_t r = i; r < j && !gone; ++r) gone = !ch[r].add && ch[r].sid == acc;
+            if (!gone) sids[m++] = acc;
+        }
+        for (size_t r = i; r < j; ++r) {
+            if (ch[r].add) sids[m++] = ch[r].sid;
+        }
+        term_set_doc(t, d->id, sids, m);
+        free(sids);
+        i = j;
+    }
+}
+
+static int changes_push(Change **ch, size_t *n, size_t *cap, const Sentence *s, int add) {
+    if (*n + s->nterms > *cap) {
+        size_t c = *cap ? *cap : 256;
+        while (c < *n + s->nterms) c *= 2;
+        Change *nc = realloc(*ch, c * sizeof(Change));
+        if (!nc) return -1;
+        *ch = nc;
+        *cap = c;
+    }
+    for (uint32_t k = 0; k < s->nterms; ++k) (*ch)[(*n)++] = (Change){s->terms[k], s->sid, add};
+    return 0;
+}
+
+static void doc_map_sentences(Doc *d, uint32_t from) {
+    for (uint32_t i = from; i < d->nsent; ++i) d->ord[d->sent[i].sid] = i;
+}
+
+// Sentence ids are renumbered from 0 once edits have used up twice as many as are live
+static void doc_renumber(Doc *d) {
+    Change *ch = NULL;
+    size_t n = 0, cap = 0;
+    for (uint32_t i = 0; i < d->nsent; ++i) changes_push(&ch, &n, &cap, &d->sent[i], 0);
+    apply_changes(d, ch, n);
+    n = 0;
+    for (uint32_t i = 0; i < d->nsent; ++i) {
+        d->sent[i].sid = i;
+        changes_push(&ch, &n, &cap, &d->sent[i], 1);
+    }
+    d->next_sid = d->nsent;
+    apply_changes(d, ch, n);
+    free(ch);
+    doc_map_sentences(d, 0);
+}
+
+// Replace sentences [at, at + removed) of d with `added` parsed ones. Only the postings of
+// those sentences change; the sentences after them just move.
+static int doc_splice(Doc *d, uint32_t at, uint32_t removed, const SentenceText *add, uint32_t added) {
+    if (at > d->nsent || removed > d->nsent - at) return -1;
+    uint32_t nsent = d->nsent - removed + added;
+    if (nsent > d->cap) {
+        uint32_t cap = d->cap ? d->cap : 16;
+        while (cap < nsent) cap *= 2;
+        Sentence *sent = realloc(d->sent, cap * sizeof(Sentence));
+        if (!sent) return -1;
+        d->sent = sent;
+        d->cap = cap;
+    }
+    if (d->next_sid + added > d->ord_cap) {
+        uint32_t cap = d->ord_cap ? d->ord_cap : 16;
+        while (cap < d->next_sid + added) cap *= 2;
+        uint32_t *ord = realloc(d->ord, cap * sizeof(uint32_t));
+        if (!ord) return -1;
+        d->ord = ord;
+        d->ord_cap = cap;
+    }
+
+    Change *ch = NULL;
+    size_t n = 0, cap = 0;
+    for (uint32_t i = at; i < at + removed; ++i) {
+        changes_push(&ch, &n, &cap, &d->sent[i], 0);
+        free(d->sent[i].terms);
+    }
+    memmove(d->sent + at + added, d->sent + at + removed, (d->nsent - at - removed) * sizeof(Sentence));
+    for (uint32_t i = 0; i < added; ++i) {
+        Sentence *s = &d->sent[at + i];
+        s->fp = add[i].fp;
+        s->sid = d->next_sid++;
+        s->nterms = 0;
+        s->terms = malloc((add[i].nterms ? add[i].nterms : 1) * sizeof(uint32_t));
+        for (uint32_t k = 0; s->terms && k < add[i].nterms; ++k) {
+            Term *t = term_find(add[i].terms[k], 1);
+            if (t) s->terms[s->nterms++] = t->id;
+        }
+        changes_push(&ch, &n, &cap, s, 1);
+    }
+    d->nsent = nsent;
+    apply_changes(d, ch, n);
+    free(ch);
+    doc_map_sentences(d, at);
+    if (d->next_sid > 2 * d->nsent + 64) doc_renumber(d);
+    return 0;
+}
+
+static void doc_drop(Doc *d) {
+    doc_splice(d, 0, d->nsent, NULL, 0);
+    unsigned long b = name_hash(d->name) % DOC_BUCKETS;
+    for (Doc **pp = &doc_buckets[b]; *pp; pp = &(*pp)->next) {
+        if (*pp == d) {
+            *pp = d->next;
+            break;
+        }
+    }
+    docs_by_id[d->id] = NULL;
+    live_docs--;
+    free(d->sent);
+    free(d->ord);
+    free(d);
+}
+
+// --- Parsing ---
+
+static int str_cmp(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static uint64_t sentence_fp(char **terms, uint32_t n) {
+    uint64_t h = 1469598103934665603ull;
+    for (uint32_t k = 0; k < n; ++k) h = fnv(h, terms[k], strlen(terms[k]) + 1);
+    return h;
+}
+
+typedef struct {
+    char *buf;                  // lower-cased text, each term NUL-terminated in place
+    char **pool;                // term pointers, grouped by sentence
+    SentenceText *sent;
+    uint32_t nsent;
+} Parsed;
+
+static void parsed_free(Parsed *p) {
+    free(p->buf);
+    free(p->pool);
+    free(p->sent);
+}
+
+// Sentences end at '.', '!' and '?' (so the last one may be empty); terms are runs of
+// letters / digits / non-ASCII bytes, lower-cased, at most SEARCH_MAX_TERM long
+static int parse_text(const char *text, size_t len, Parsed *p) {
+    memset(p, 0, sizeof(*p));
+    size_t pcap = 256, pn = 0;
+    uint32_t scap = 64, ns = 0;
+    uint32_t *starts = malloc(scap * sizeof(uint32_t));
+    p->buf = malloc(len + 1);
+    p->pool = malloc(pcap * sizeof(char *));
+    if (!starts || !p->buf || !p->pool) goto fail;
+    starts[0] = 0;
+
+    size_t i = 0;
+    while (i < len) {
+        unsigned char c = (unsigned char)text[i];
+        if (!is_term_char(c)) {
+            p->buf[i++] = '\0';
+            if (c == '.' || c == '!' || c == '?') {
+                if (ns + 2 > scap) {
+                    uint32_t *ns_starts = realloc(starts, (scap *= 2) * sizeof(uint32_t));
+                    if (!ns_starts) goto fail;
+                    starts = ns_starts;
+                }
+                starts[++ns] = (uint32_t)pn;
+            }
+            continue;
+        }
+        size_t start = i;
+        while (i < len && is_term_char((unsigned char)text[i])) {
+            p->buf[i] = (char)tolower((unsigned char)text[i]);
+            i++;
+        }
+        if (i - start > SEARCH_MAX_TERM) continue;
+        if (pn == pcap) {
+            char **pool = realloc(p->pool, (pcap *= 2) * sizeof(char *));
+            if (!pool) goto fail;
+            p->pool = pool;
+        }
+        p->pool[pn++] = p->buf + start;
+    }
+    p->buf[len] = '\0';
+    starts[++ns] = (uint32_t)pn;
+
+    p->nsent = ns;
+    p->sent = malloc(ns * sizeof(SentenceText));
+    if (!p->sent) goto fail;
+    for (uint32_t s = 0; s < ns; ++s) {
+        char **terms = p->pool + starts[s];
+        uint32_t n = starts[s + 1] - starts[s], m = 0;
+        qsort(terms, n, sizeof(char *), str_cmp);
+        for (uint32_t k = 0; k < n; ++k) {
+            if (m == 0 || strcmp(terms[k], terms[m - 1]) != 0) terms[m++] = terms[k];
+        }
+        p->sent[s] = (SentenceText){terms, m, sentence_fp(terms, m)};
+    }
+    free(starts);
+    return 0;
+
+fail:
+    free(starts);
+    parsed_free(p);
+    return -1;
+}
+
+// --- Journal ---
+
+typedef struct {
+    unsigned char *p;
+    size_t len, cap;
+} Buf;
+
+static int buf_put(Buf *b, const void *data, size_t len) {
+    if (b->len + len > b->cap) {
+        size_t cap = b->cap ? b->cap : 256;
+        while (cap < b->len + len) cap *= 2;
+        unsigned char *np = realloc(b->p, cap);
+        if (!np) return -1;
+        b->p = np;
+        b->cap = cap;
+    }
+    memcpy(b->p + b->len, data, len);
+    b->len += len;
+    return 0;
+}
+
+static int buf_varint(Buf *b, uint32_t v) {
+    unsigned char tmp[5];
+    return buf_put(b, tmp, varint_put(tmp, v));
+}
+
+static int buf_str(Buf *b, const char *s) {
+    size_t len = strlen(s);
+    return buf_varint(b, (uint32_t)len) || buf_put(b, s, len);
+}
+
+// Records: 'S' name stamp at removed added {nterms {term}...}... (a splice, or a stamp
+// change when removed == added == 0) and 'D' name (document gone). Each is framed by a
+// LogHeader; b starts with room for it.
+static void record_begin(Buf *b, char type) {
+    LogHeader h;
+    memset(&h, 0, sizeof(h));
+    b->len = 0;
+    buf_put(b, &h, sizeof(h));
+    buf_put(b, &type, 1);
+}
+
+static void record_end(Buf *b) {
+    LogHeader h;
+    memcpy(h.magic, LOG_MAGIC, 4);
+    h.len = (uint32_t)(b->len - sizeof(h));
+    h.sum = fnv(1469598103934665603ull, b->p + sizeof(h), h.len);
+    memcpy(b->p, &h, sizeof(h));
+}
+
+static void record_splice(Buf *b, const Doc *d, uint32_t at, uint32_t removed, const SentenceText *add,
+                          uint32_t added) {
+    record_begin(b, 'S');
+    buf_str(b, d->name);
+    buf_put(b, &d->stamp, sizeof(d->stamp));
+    buf_varint(b, at);
+    buf_varint(b, removed);
+    buf_varint(b, added);
+    for (uint32_t i = 0; i < added; ++i) {
+        buf_varint(b, add[i].nterms);
+        for (uint32_t k = 0; k < add[i].nterms; ++k) buf_str(b, add[i].terms[k]);
+    }
+    record_end(b);
+}
+
+// Appended under the exclusive index lock, so the journal is in index order. Not synced:
+// a lost tail only leaves stale stamps, and startup reindexes those documents.
+static void log_append(const Buf *b) {
+    if (log_fd < 0) return;
+    if (pwrite(log_fd, b->p, b->len, (off_t)log_size) == (ssize_t)b->len) {
+        log_size += b->len;
+    } else {
+        perror("search: journal append");
+        if (ftruncate(log_fd, (off_t)log_size) != 0) perror("search: journal truncate");
+    }
+}
+
+// Rebuild a record's added sentences: term strings are copied NUL-terminated into *store
+static int record_sentences(const unsigned char **p, const unsigned char *end, uint32_t added,
+                            SentenceText **out, char ***terms_out, char **store) {
+    size_t bytes = (size_t)(end - *p);
+    *store = malloc(bytes + 1);
+    *terms_out = malloc((bytes + 1) * sizeof(char *));
+    *out = malloc((added ? added : 1) * sizeof(SentenceText));
+    if (!*store || !*terms_out || !*out) return -1;
+    size_t used = 0, nterms = 0;
+    for (uint32_t i = 0; i < added; ++i) {
+        uint32_t n, len;
+        if (varint_get(p, end, &n) != 0 || n > bytes) return -1;
+        char **terms = *terms_out + nterms;
+        for (uint32_t k = 0; k < n; ++k) {
+            if (varint_get(p, end, &len) != 0 || len > (size_t)(end - *p)) return -1;
+            memcpy(*store + used, *p, len);
+            (*store)[used + len] = '\0';
+            terms[k] = *store + used;
+            used += len + 1;
+            *p += len;
+        }
+        nterms += n;
+        (*out)[i] = (SentenceText){terms, n, sentence_fp(terms, n)};
+    }
+    return 0;
+}
+
+static int replay_record(const unsigned char *p, const unsigned char *end) {
+    char type = (char)*p++;
+    uint32_t len;
+    char name[256];
+    if (varint_get(&p, end, &len) != 0 || len == 0 || len >= sizeof(name) || len > (size_t)(end - p)) return -1;
+    memcpy(name, p, len);
+    name[len] = '\0';
+    p += len;
+    if (type == 'D') {
+        Doc *d = doc_find(name, 0);
+        if (d) doc_drop(d);
+        return 0;
+    }
+    Stamp stamp;
+    uint32_t at, removed, added;
+    if (type != 'S' || (size_t)(end - p) < sizeof(stamp)) return -1;
+    memcpy(&stamp, p, sizeof(stamp));
+    p += sizeof(stamp);
+    if (varint_get(&p, end, &at) != 0 || varint_get(&p, end, &removed) != 0 || varint_get(&p, end, &added) != 0 ||
+        added > (size_t)(end - p)) {
+        return -1;
+    }
+    SentenceText *add = NULL;
+    char **terms = NULL, *store = NULL;
+    Doc *d = doc_find(name, 1);
+    int rc = d && record_sentences(&p, end, added, &add, &terms, &store) == 0 ? doc_splice(d, at, removed, add, added) : -1;
+    if (rc == 0) d->stamp = stamp;
+    free(add);
+    free(terms);
+    free(store);
+    return rc;
+}
+
+static void replay(void) {
+    struct stat st;
+    if (fstat(log_fd, &st) != 0) return;
+    uint64_t pos = 0, size = (uint64_t)st.st_size;
+    unsigned char *payload = NULL;
+    size_t payload_cap = 0;
+    while (pos + sizeof(LogHeader) <= size) {
+        LogHeader h;
+        if (pread(log_fd, &h, sizeof(h), (off_t)pos) != (ssize_t)sizeof(h) || memcmp(h.magic, LOG_MAGIC, 4) != 0 ||
+            h.len == 0 || pos + sizeof(h) + h.len > size) {
+            break;
+        }
+        if (h.len > payload_cap) {
+            unsigned char *np = realloc(payload, h.len);
+            if (!np) break;
+            payload = np;
+            payload_cap = h.len;
+        }
+        if (pread(log_fd, payload, h.len, (off_t)(pos + sizeof(h))) != (ssize_t)h.len ||
+            fnv(1469598103934665603ull, payload, h.len) != h.sum || replay_record(payload, payload + h.len) != 0) {
+            break;
+        }
+        pos += sizeof(h) + h.len;
+    }
+    free(payload);
+    if (pos < size) {
+        printf("[SEARCH] Discarding %llu byte(s) at the end of the index journal\n", (unsigned long long)(size - pos));
+        if (ftruncate(log_fd, (off_t)pos) != 0) perror("search: journal truncate");
+    }
+    log_size = pos;
+}
+
+// Write the live index as one splice per document into a new journal, then swap it in.
+// The copy is made from a snapshot; records appended meanwhile are carried over.
+static void compact(void) {
+    if (__atomic_exchange_n(&compacting, 1, __ATOMIC_ACQ_REL)) return;
+    Buf out = {NULL, 0, 0}, rec = {NULL, 0, 0};
+    SentenceText *add = NULL;
+    char **terms = NULL;
+    size_t add_cap = 0, terms_cap = 0;
+
+    pthread_rwlock_rdlock(&index_lock);
+    uint64_t from = log_size;
+    int ok = 1;
+    for (uint32_t id = 0; ok && id < doc_next_id; ++id) {
+        Doc *d = docs_by_id[id];
+        if (!d) continue;
+        size_t nterms = 0;
+        for (uint32_t i = 0; i < d->nsent; ++i) nterms += d->sent[i].nterms;
+        if (d->nsent > add_cap || nterms > terms_cap) {
+            add_cap = d->nsent > add_cap ? d->nsent : add_cap;
+            terms_cap = nterms > terms_cap ? nterms : terms_cap;
+            free(add);
+            free(terms);
+            add = malloc((add_cap ? add_cap : 1) * sizeof(SentenceText));
+            terms = malloc((terms_cap ? terms_cap : 1) * sizeof(char *));
+            if (!add || !terms) {
+                ok = 0;
+                break;
+            }
+        }
+        size_t used = 0;
+        for (uint32_t i = 0; i < d->nsent; ++i) {
+            for (uint32_t k = 0; k < d->sent[i].nterms; ++k) terms[used + k] = terms_by_id[d->sent[i].terms[k]]->text;
+            add[i] = (SentenceText){terms + used, d->sent[i].nterms, d->sent[i].fp};
+            used += d->sent[i].nterms;
+        }
+        record_splice(&rec, d, 0, 0, add, d->nsent);
+        ok = rec.p && buf_put(&out, rec.p, rec.len) == 0;
+    }
+    pthread_rwlock_unlock(&index_lock);
+    free(add);
+    free(terms);
+    free(rec.p);
+
+    char path[512], tmp[512];
+    search_path(path, sizeof(path), "index.log");
+    search_path(tmp, sizeof(tmp), "index.log.tmp");
+    int fd = ok ? open(tmp, O_RDWR | O_CREAT | O_TRUNC, 0644) : -1;
+    ok = fd >= 0 && (out.len == 0 || pwrite(fd, out.p, out.len, 0) == (ssize_t)out.len) && fsync(fd) == 0;
+    if (ok) {
+        pthread_rwlock_wrlock(&index_lock);
+        uint64_t size = out.len;
+        char chunk[65536];
+        for (uint64_t pos = from; ok && pos < log_size;) {
+            size_t n = log_size - pos < sizeof(chunk) ? (size_t)(log_size - pos) : sizeof(chunk);
+            ok = pread(log_fd, chunk, n, (off_t)pos) == (ssize_t)n && pwrite(fd, chunk, n, (off_t)size) == (ssize_t)n;
+            pos += n;
+            size += n;
+        }
+        if (ok && rename(tmp, path) == 0) {
+            close(log_fd);
+            log_fd = fd;
+            printf("[SEARCH] Compacted the index journal: %llu -> %llu bytes\n", (unsigned long long)log_size,
+                   (unsigned long long)size);
+            log_size = size;
+            log_compacted = out.len;
+            fd = -1;
+        }
+        pthread_rwlock_unlock(&index_lock);
+    }
+    if (fd >= 0) {
+        close(fd);
+        unlink(tmp);
+    }
+    free(out.p);
+    __atomic_store_n(&compacting, 0, __ATOMIC_RELEASE);
+}
+
+static void compact_if_due(void) {
+    pthread_rwlock_rdlock(&index_lock);
+    int due = log_size >= SEARCH_COMPACT_MIN && log_size > 2 * log_compacted;
+    pthread_rwlock_unlock(&index_lock);
+    if (due) compact();
+}
+
+// --- Updates ---
+
+static void remove_locked(const char *filename) {
+    Doc *d = doc_find(filename, 0);
+    if (!d) return;
+    doc_drop(d);
+    Buf b = {NULL, 0, 0};
+    record_begin(&b, 'D');
+    buf_str(&b, filename);
+    record_end(&b);
+    if (b.p) log_append(&b);
+    free(b.p);
+}
+
+// Bring one document's entry up to date with its bytes. Called after every content change
+// (ETIRW, UNDO, REVERT): the text is read and split into sentences, and only the run of
+// sentences that differs from the indexed ones is re-posted.
+int search_index_update(const char *filename) {
+    char path[512];
+    document_path(path, sizeof(path), filename);
+
+    // Held until the index has the result, so updates land in commit order
+    commit_read_lock(filename);
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0) close(fd);
+        TierInfo info;
+        if (!tier_lookup(filename, &info)) {
+            pthread_rwlock_wrlock(&index_lock);
+            remove_locked(filename);
+            pthread_rwlock_unlock(&index_lock);
+        }
+        commit_read_unlock(filename);
+        return -1;
+    }
+    Stamp stamp;
+    stamp_of(&st, &stamp);
+    pthread_rwlock_rdlock(&index_lock);
+    Doc *d = doc_find(filename, 0);
+    int current = d && stamp_equal(&d->stamp, &stamp);
+    pthread_rwlock_unlock(&index_lock);
+    if (current) {
+        close(fd);
+        commit_read_unlock(filename);
+        return 0;
+    }
+
+    char *text = malloc((size_t)st.st_size + 1);
+    size_t got = 0;
+    int ok = text != NULL;
+    while (ok && got < (size_t)st.st_size) {
+        ssize_t n = pread(fd, text + got, (size_t)st.st_size - got, (off_t)got);
+        if (n <= 0) ok = 0;
+        else got += (size_t)n;
+    }
+    close(fd);
+    Parsed parsed;
+    if (!ok || parse_text(text, got, &parsed) != 0) {
+        free(text);
+        commit_read_unlock(filename);
+        return -1;
+    }
+    free(text);
+
+    Buf rec = {NULL, 0, 0};
+    int rc = -1;
+    pthread_rwlock_wrlock(&index_lock);
+    d = doc_find(filename, 1);
+    if (d) {
+        // Sentences kept at either end are matched by content; the run between is replaced
+        uint32_t head = 0, tail = 0;
+        while (head < d->nsent && head < parsed.nsent && d->sent[head].fp == parsed.sent[head].fp) head++;
+        while (tail < d->nsent - head && tail < parsed.nsent - head &&
+               d->sent[d->nsent - 1 - tail].fp == parsed.sent[parsed.nsent - 1 - tail].fp) {
+            tail++;
+        }
+        uint32_t removed = d->nsent - head - tail, added = parsed.nsent - head - tail;
+        rc = doc_splice(d, head, removed, parsed.sent + head, added);
+        if (rc == 0) {
+            d->stamp = stamp;
+            record_splice(&rec, d, head, removed, parsed.sent + head, added);
+            if (rec.p) log_append(&rec);
+        }
+    }
+    pthread_rwlock_unlock(&index_lock);
+    commit_read_unlock(filename);
+    free(rec.p);
+    parsed_free(&parsed);
+    compact_if_due();
+    return rc;
+}
+
+void search_index_remove(const char *filename) {
+    pthread_rwlock_wrlock(&index_lock);
+    remove_locked(filename);
+    pthread_rwlock_unlock(&index_lock);
+    compact_if_due();
+}
+
+void search_index_sync(void) {
+    pthread_rwlock_rdlock(&index_lock);
+    if (log_fd >= 0 && fdatasync(log_fd) != 0) perror("search: journal sync");
+    pthread_rwlock_unlock(&index_lock);
+}
+
+// --- Startup ---
+
+typedef struct {
+    char magic[4];
+    uint32_t nterms;
+    uint64_t file_size;
+    uint64_t ino;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+} SegmentHeader;
+
+// One walk over a segment's dictionary (length-prefixed term, posting count, sentence
+// number deltas). Without sent it only finds the sentence count and posting total; with
+// it, counts each sentence's terms (fill == NULL) or stores them (in dictionary order,
+// which is term order), copying the terms NUL-terminated into store.
+static int segment_walk(const unsigned char *p, const unsigned char *end, uint32_t nterms, char *store,
+                        SentenceText *sent, uint32_t *fill, uint32_t *nsent, size_t *total) {
+    size_t used = 0;
+    for (uint32_t t = 0; t < nterms; ++t) {
+        uint32_t len, count, acc = 0, v;
+        if (varint_get(&p, end, &len) != 0 || len > (size_t)(end - p)) return -1;
+        char *term = store + used;
+        if (fill) {
+            memcpy(term, p, len);
+            term[len] = '\0';
+        }
+        used += len + 1;
+        p += len;
+        if (varint_get(&p, end, &count) != 0) return -1;
+        for (uint32_t k = 0; k < count; ++k) {
+            if (varint_get(&p, end, &v) != 0) return -1;
+            acc += v;
+            if (!sent) {
+                if (acc + 1 > *nsent) *nsent = acc + 1;
+                (*total)++;
+            } else if (acc < *nsent) {
+                if (fill) sent[acc].terms[fill[acc]++] = term;
+                else sent[acc].nterms++;
+            }
+        }
+    }
+    return 0;
+}
+
+// A cold document indexed by an older server only has its per-file segment; its sentences
+// are rebuilt from that
+static void import_segment(const char *filename, const TierInfo *info, void *user) {
+    pthread_rwlock_rdlock(&index_lock);
+    int known = doc_find(filename, 0) != NULL;
+    pthread_rwlock_unlock(&index_lock);
+    if (known) return;
+    char spath[512], name[300];
+    snprintf(name, sizeof(name), "%s.idx", filename);
+    search_path(spath, sizeof(spath), name);
+    FILE *fp = fopen(spath, "rb");
+    struct stat sst;
+    if (!fp) return;
+    unsigned char *buf = NULL;
+    int ok = fstat(fileno(fp), &sst) == 0 && sst.st_size >= 8 && (buf = malloc((size_t)sst.st_size)) != NULL &&
+             fread(buf, 1, (size_t)sst.st_size, fp) == (size_t)sst.st_size;
+    fclose(fp);
+    size_t size = ok ? (size_t)sst.st_size : 0, header = 0;
+    uint32_t nterms = 0;
+    if (ok && memcmp(buf, SEGMENT_MAGIC, 4) == 0 && size >= sizeof(SegmentHeader)) header = sizeof(SegmentHeader);
+    else if (ok && memcmp(buf, SEGMENT_MAGIC_V1, 4) == 0) header = 8;
+    if (header) memcpy(&nterms, buf + 4, sizeof(nterms));
+    if (!header || header + (size_t)nterms * 4 > size) {
+        free(buf);
+        return;
+    }
+    const unsigned char *data = buf + header + (size_t)nterms * 4, *end = buf + size;
+
+    uint32_t nsent = 0, *fill = NULL;
+    size_t total = 0;
+    char **terms = NULL, *store = malloc(size + 1);
+    SentenceText *sent = NULL;
+    if (!store || segment_walk(data, end, nterms, store, NULL, NULL, &nsent, &total) != 0) goto done;
+    sent = calloc(nsent ? nsent : 1, sizeof(SentenceText));
+    fill = calloc(nsent ? nsent : 1, sizeof(uint32_t));
+    terms = malloc((total ? total : 1) * sizeof(char *));
+    if (!sent || !fill || !terms || segment_walk(data, end, nterms, store, sent, NULL, &nsent, &total) != 0) goto done;
+    size_t at = 0;
+    for (uint32_t s = 0; s < nsent; ++s) {
+        sent[s].terms = terms + at;
+        at += sent[s].nterms;
+    }
+    if (segment_walk(data, end, nterms, store, sent, fill, &nsent, &total) != 0) goto done;
+    for (uint32_t s = 0; s < nsent; ++s) sent[s].fp = sentence_fp(sent[s].terms, sent[s].nterms);
+
+    pthread_rwlock_wrlock(&index_lock);
+    Doc *d = doc_find(filename, 1);
+    if (d && doc_splice(d, 0, d->nsent, sent, nsent) == 0) {
+        memset(&d->stamp, 0, sizeof(d->stamp));
+        d->stamp.size = info->size;
+        d->stamp.mtime_sec = (int64_t)info->mtime;
+        d->stamp.mtime_nsec = info->mtime_nsec;
+        Buf rec = {NULL, 0, 0};
+        record_splice(&rec, d, 0, 0, sent, nsent);
+        if (rec.p) log_append(&rec);
+        free(rec.p);
+    }
+    pthread_rwlock_unlock(&index_lock);
+
+done:
+    free(sent);
+    free(fill);
+    free(terms);
+    free(store);
+    free(buf);
+}
+
+typedef struct {
+    char (*names)[256];
+    size_t count, cap;
+} NameList;
+
+static void name_push(NameList *l, const char *name) {
+    if (l->count == l->cap) {
+        size_t cap = l->cap ? l->cap * 2 : 64;
+        char (*names)[256] = realloc(l->names, cap * sizeof(*names));
+        if (!names) return;
+        l->names = names;
+        l->cap = cap;
+    }
+    snprintf(l->names[l->count++], sizeof(l->names[0]), "%s", name);
+}
+
+void search_init(void) {
+    char path[512];
+    search_path(path, sizeof(path), "index.log");
+    log_fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (log_fd < 0) {
+        perror("search: journal");
+        return;
+    }
+    pthread_rwlock_wrlock(&index_lock);
+    replay();
+    pthread_rwlock_unlock(&index_lock);
+    tier_foreach(import_segment, NULL);
+
+    // Reconcile with the documents: index what changed while the server was down, and
+    // forget what is gone. Cold documents cannot have changed.
+    NameList gone = {NULL, 0, 0};
+    pthread_rwlock_rdlock(&index_lock);
+    for (uint32_t id = 0; id < doc_next_id; ++id) {
+        if (docs_by_id[id]) name_push(&gone, docs_by_id[id]->name);
+    }
+    pthread_rwlock_unlock(&index_lock);
+    for (size_t i = 0; i < gone.count; ++i) {
+        char doc[512];
+        TierInfo info;
+        document_path(doc, sizeof(doc), gone.names[i]);
+        if (access(doc, F_OK) != 0 && !tier_lookup(gone.names[i], &info)) search_index_remove(gone.names[i]);
+    }
+    free(gone.names);
+
+    char files_dir[512];
+    snprintf(files_dir, sizeof(files_dir), "%s/storage%d/files", STORAGE_DIR, get_storage_id());
+    DIR *dir = opendir(files_dir);
+    struct dirent *entry;
+    while (dir && (entry = readdir(dir)) != NULL) {
+        if (entry->d_type == DT_REG) search_index_update(entry->d_name);
+    }
+    if (dir) closedir(dir);
+
+    // Per-file segments of older servers are superseded by the journal
+    char search_dir[512];
+    snprintf(search_dir, sizeof(search_dir), "%s/storage%d/search", STORAGE_DIR, get_storage_id());
+    dir = opendir(search_dir);
+    while (dir && (entry = readdir(dir)) != NULL) {
+        size_t len = strlen(entry->d_name);
+        if (len > 4 && strcmp(entry->d_name + len - 4, ".idx") == 0) {
+            search_path(path, sizeof(path), entry->d_name);
+            unlink(path);
+        }
+    }
+    if (dir) closedir(dir);
+
+    pthread_rwlock_wrlock(&index_lock);
+    if (fdatasync(log_fd) != 0) perror("search: journal sync");
+    log_compacted = log_size;
+    printf("[SEARCH] %zu document(s), %u term(s) indexed; journal %llu bytes\n", live_docs, term_count,
+           (unsigned long long)log_size);
+    pthread_rwlock_unlock(&index_lock);
+}
+
+// --- Query ---
+
+typedef struct {
+    char name[256];
+    Stamp stamp;
+    uint32_t tf[SEARCH_MAX_TERMS];  // matching sentences per query term
+    uint32_t *sentences;            // union of matching sentence numbers (sorted)
+    uint32_t nsent;
+    double score;
+} SearchHit;
+
+static int hit_cmp(const void *a, const void *b) {
+    const SearchHit *ha = a, *hb = b;
+    if (ha->score != hb->score) return ha->score < hb->score ? 1 : -1;
+    return strcmp(ha->name, hb->name);
+}
+
+static int u32_cmp(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+typedef struct {
+    const unsigned char *p, *end;
+    uint32_t doc;
+    int live;
+} Cursor;
+
+static void cursor_next(Cursor *c) {
+    uint32_t v;
+    c->live = c->p < c->end && varint_get(&c->p, c->end, &v) == 0;
+    if (c->live) c->doc += v;
+}
+
+// Every document holding a query term, from a walk of the terms' postings in document
+// order; *ndocs and df[] get the server's totals for ranking across servers
+static SearchHit *collect_hits(char (*terms)[SEARCH_MAX_TERM + 1], int nterms, size_t *nhits, size_t *ndocs,
+                               uint32_t *df) {
+    size_t cap = 32, n = 0;
+    SearchHit *hits = malloc(cap * sizeof(SearchHit));
+    uint32_t *ords = NULL;
+    size_t ord_cap = 0;
+    Cursor cur[SEARCH_MAX_TERMS];
+
+    pthread_rwlock_rdlock(&index_lock);
+    *ndocs = live_docs;
+    for (int t = 0; t < nterms; ++t) {
+        Term *term = term_find(terms[t], 0);
+        df[t] = term ? term->ndocs : 0;
+        cur[t] = (Cursor){term ? term->post : NULL, term ? term->post + term->len : NULL, 0, 0};
+        cursor_next(&cur[t]);
+    }
+    while (hits) {
+        int any = 0;
+        uint32_t doc = 0;
+        for (int t = 0; t < nterms; ++t) {
+            if (cur[t].live && (!any || cur[t].doc < doc)) doc = cur[t].doc;
+            any |= cur[t].live;
+        }
+        if (!any) break;
+        Doc *d = doc < doc_next_id ? docs_by_id[doc] : NULL;
+
+        SearchHit hit;
+        memset(&hit, 0, sizeof(hit));
+        size_t nords = 0;
+        for (int t = 0; t < nterms; ++t) {
+            if (!cur[t].live || cur[t].doc != doc) continue;
+            uint32_t count, acc = 0, v;
+            if (varint_get(&cur[t].p, cur[t].end, &count) != 0) count = 0;
+            if (nords + count > ord_cap) {
+                ord_cap = (nords + count) * 2;
+                uint32_t *no = realloc(ords, ord_cap * sizeof(uint32_t));
+                if (!no) break;
+                ords = no;
+            }
+            for (uint32_t k = 0; k < count && varint_get(&cur[t].p, cur[t].end, &v) == 0; ++k) {
+                acc += v;
+                if (d && acc < d->next_sid) ords[nords++] = d->ord[acc];
+            }
+            hit.tf[t] = count;
+            cursor_next(&cur[t]);
+        }
+        if (!d || nords == 0) continue;
+
+        snprintf(hit.name, sizeof(hit.name), "%s", d->name);
+        hit.stamp = d->stamp;
+        qsort(ords, nords, sizeof(uint32_t), u32_cmp);
+        hit.sentences = malloc(nords * sizeof(uint32_t));
+        for (size_t k = 0; hit.sentences && k < nords; ++k) {
+            if (hit.nsent == 0 || ords[k] != hit.sentences[hit.nsent - 1]) hit.sentences[hit.nsent++] = ords[k];
+        }
+        if (n == cap) {
+            SearchHit *nh = realloc(hits, cap * 2 * sizeof(SearchHit));
+            if (!nh) {
+                free(hit.sentences);
+                break;
+            }
+            hits = nh;
+            cap *= 2;
+        }
+        hits[n++] = hit;
+    }
+    pthread_rwlock_unlock(&index_lock);
+    free(ords);
+    *nhits = n;
+    return hits;
+}
+
+// A matching document whose bytes are not the ones indexed (changed behind the server's
+// back) is reindexed before it is reported; cold documents cannot change
+static int hit_stale(const SearchHit *hit) {
+    TierInfo info;
+    if (tier_lookup(hit->name, &info)) return 0;
+    char path[512];
+    struct stat st;
+    Stamp now;
+    document_path(path, sizeof(path), hit->name);
+    if (stat(path, &st) != 0) return 1;
+    stamp_of(&st, &now);
+    return !stamp_equal(&now, &hit->stamp);
+}
+
+static void hits_free(SearchHit *hits, size_t n) {
+    for (size_t h = 0; h < n; ++h) free(hits[h].sentences);
+    free(hits);
+}
+
+// Responds with "DF <documents> <df per term...>" (this server's totals, so the NM can rank
+// across servers), then "RESULT <score> <file> <s1,s2,...> <tf per term,...>" lines for the
+// readable matches (best first by this server's own statistics) and a final "END <n>"
+void search_files(int client_sock, const char *query, const char *username) {
+    char terms[SEARCH_MAX_TERMS][SEARCH_MAX_TERM + 1];
+    int nterms = 0;
+    for (const char *p = query; *p && nterms < SEARCH_MAX_TERMS; ) {
+        while (*p && !is_term_char((unsigned char)*p)) p++;
+        size_t len = 0;
+        while (p[len] && is_term_char((unsigned char)p[len])) len++;
+        if (len > 0 && len <= SEARCH_MAX_TERM) {
+            for (size_t i = 0; i < len; ++i) terms[nterms][i] = (char)tolower((unsigned char)p[i]);
+            terms[nterms][len] = '\0';
+            nterms++;
+        }
+        p += len;
+    }
+    if (nterms == 0) {
+        const char *msg = "Error: SEARCH requires at least one term\n";
+        send(client_sock, msg, strlen(msg), 0);
+        return;
+    }
+
+    size_t nhits = 0, ndocs = 0;
+    uint32_t df[SEARCH_MAX_TERMS];
+    SearchHit *hits = NULL;
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        hits = collect_hits(terms, nterms, &nhits, &ndocs, df);
+        int stale = 0;
+        for (size_t h = 0; hits && h < nhits; ++h) {
+            if (hit_stale(&hits[h])) {
+                search_index_update(hits[h].name);
+                stale = 1;
+            }
+        }
+        if (!stale || attempt == 1) break;
+        hits_free(hits, nhits);
+        hits = NULL;
+    }
+    if (!hits) nhits = 0;
+
+    // Read ACLs apply to results only; the totals describe the whole server
+    size_t kept = 0;
+    for (size_t h = 0; h < nhits; ++h) {
+        if (check_read_access(hits[h].name, username)) hits[kept++] = hits[h];
+        else free(hits[h].sentences);
+    }
+    nhits = kept;
+
+    // tf-idf over sentences: each matching sentence counts, rarer terms weigh more
+    for (size_t h = 0; h < nhits; ++h) {
+        double score = 0.0;
+        for (int t = 0; t < nterms; ++t) {
+            if (!hits[h].tf[t] || !df[t]) continue;
+            double idf = log(1.0 + (double)ndocs / (double)df[t]);
+            score += (1.0 + log((double)hits[h].tf[t])) * idf;
+        }
+        hits[h].score = score;
+    }
+    if (nhits > 0) qsort(hits, nhits, sizeof(SearchHit), hit_cmp);
+
+    char line[1024];
+    int len = snprintf(line, sizeof(line), "DF %zu", ndocs);
+    for (int t = 0; t < nterms; ++t) len += snprintf(line + len, sizeof(line) - len, " %u", df[t]);
+    snprintf(line + len, sizeof(line) - len, "\n");
+    send(client_sock, line, strlen(line), 0);
+
+    // Every readable match goes out: the NM re-ranks with the totals of all servers
+    for (size_t h = 0; h < nhits; ++h) {
+        len = snprintf(line, sizeof(line), "RESULT %.4f %s ", hits[h].score, hits[h].name);
+        int list = len;
+        for (uint32_t s = 0; s < hits[h].nsent && len - list < SEARCH_MAX_SENTENCE_LIST - 12; ++s) {
+            len += snprintf(line + len, sizeof(line) - len, s ? ",%u" : "%u", hits[h].sentences[s]);
+        }
+        for (int t = 0; t < nterms; ++t) len += snprintf(line + len, sizeof(line) - len, t ? ",%u" : " %u", hits[h].tf[t]);
+        snprintf(line + len, sizeof(line) - len, "\n");
+        send(client_sock, line, strlen(line), 0);
+    }
+    char end[64];
+    snprintf(end, sizeof(end), "END %zu\n", nhits);
+    send(client_sock, end, strlen(end), 0);
+    hits_free(hits, nhits);
+}
@@ -0,0 +1,161 @@
+#include "../../include/common.h"
+#include "../../include/sentidx.h"
+#include <fcntl.h>
+#include <pthread.h>
+
+extern int get_storage_id(void);
+
+#define SENTIDX_VERSION 1
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t file_size;     // stamp of the document the entries describe
+    uint64_t ino;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t count;
+} SentIdxHeader;
+
+// Serialises index writers (readers only need a consistent stamp)
+static pthread_mutex_t sentidx_lock = PTHREAD_MUTEX_INITIALIZER;
+
+typedef struct {
+    uint64_t off;           // body start (after the sentence's leading whitespace)
+    uint64_t len;
+} SentIdxEntry;
+
+static void index_path(char *buf, size_t sz, const char *filename) {
+    snprintf(buf, sz, "%s/storage%d/sentidx/%s.sidx", STORAGE_DIR, get_storage_id(), filename);
+}
+
+static void document_path(char *buf, size_t sz, const char *filename) {
+    snprintf(buf, sz, "%s/storage%d/files/%s", STORAGE_DIR, get_storage_id(), filename);
+}
+
+static int stamp_matches(const SentIdxHeader *h, const struct stat *st) {
+    return memcmp(h->magic, SENTIDX_MAGIC, 4) == 0 && h->version == SENTIDX_VERSION &&
+           h->file_size == (uint64_t)st->st_size && h->ino == (uint64_t)st->st_ino &&
+           h->mtime_sec == (int64_t)st->st_mtim.tv_sec && h->mtime_nsec == (int64_t)st->st_mtim.tv_nsec;
+}
+
+typedef struct {
+    FILE *fp;
+    int ok;
+} EntryWriter;
+
+static void write_entry(size_t off, size_t len, void *user) {
+    EntryWriter *w = (EntryWriter *)user;
+    SentIdxEntry e = {off, len};
+    if (fwrite(&e, sizeof(e), 1, w->fp) != 1) w->ok = 0;
+}
+
+int sentidx_update(const char *filename, const Document *doc, size_t from,
+                   const struct stat *before, const struct stat *now) {
+    char ipath[512];
+    index_path(ipath, sizeof(ipath), filename);
+
+    pthread_mutex_lock(&sentidx_lock);
+    FILE *fp = fopen(ipath, "r+b");
+    SentIdxHeader h;
+    if (!fp || fread(&h, sizeof(h), 1, fp) != 1 || !before || !stamp_matches(&h, before) || from > h.count) {
+        // No usable previous index: write it from scratch
+        if (fp) fclose(fp);
+        fp = fopen(ipath, "w+b");
+        if (!fp) {
+            pthread_mutex_unlock(&sentidx_lock);
+            return -1;
+        }
+        from = 0;
+    }
+
+    // Invalidate first so a crash mid-update leaves a stale (rebuildable) index
+    memset(&h, 0, sizeof(h));
+    fseek(fp, 0, SEEK_SET);
+    fwrite(&h, sizeof(h), 1, fp);
+
+    EntryWriter w = {fp, 1};
+    fseek(fp, (long)(sizeof(h) + from * sizeof(SentIdxEntry)), SEEK_SET);
+    doc_each_sentence(doc, from, write_entry, &w);
+
+    memcpy(h.magic, SENTIDX_MAGIC, 4);
+    h.version = SENTIDX_VERSION;
+    h.file_size = (uint64_t)now->st_size;
+    h.ino = (uint64_t)now->st_ino;
+    h.mtime_sec = (int64_t)now->st_mtim.tv_sec;
+    h.mtime_nsec = (int64_t)now->st_mtim.tv_nsec;
+    h.count = doc_sentence_count(doc);
+    fflush(fp);
+    int ok = w.ok && ftruncate(fileno(fp), (off_t)(sizeof(h) + h.count * sizeof(SentIdxEntry))) == 0;
+    if (ok) {
+        fseek(fp, 0, SEEK_SET);
+        ok = fwrite(&h, sizeof(h), 1, fp) == 1;
+    }
+    if (fclose(fp) != 0) ok = 0;
+    pthread_mutex_unlock(&sentidx_lock);
+    return ok ? 0 : -1;
+}
+
+int sentidx_rebuild(const char *filename) {
+    char dpath[512];
+    document_path(dpath, sizeof(dpath), filename);
+    // Stamp with the stat of the very bytes that are parsed
+    FILE *fp = fopen(dpath, "rb");
+    if (!fp) return -1;
+    struct stat st;
+    char *buf = NULL;
+    size_t got = 0;
+    if (fstat(fileno(fp), &st) == 0 && (buf = malloc((size_t)st.st_size + 1)) != NULL) {
+        got = fread(buf, 1, (size_t)st.st_size, fp);
+    }
+    fclose(fp);
+    if (!buf || got != (size_t)st.st_size) {
+        free(buf);
+        return -1;
+    }
+    Document *doc = doc_from_text(buf, got);
+    free(buf);
+    if (!doc) return -1;
+    int rc = sentidx_update(filename, doc, 0, NULL, &st);
+    doc_free(doc);
+    return rc;
+}
+
+void sentidx_remove(const char *filename) {
+    char ipath[512];
+    index_path(ipath, sizeof(ipath), filename);
+    unlink(ipath);
+}
+
+int sentidx_range(const char *filename, const struct stat *st, size_t first, size_t last,
+                  uint64_t *off, uint64_t *len, uint64_t *count) {
+    char ipath[512];
+    index_path(ipath, sizeof(ipath), filename);
+
+    for (int attempt = 0; attempt < 3; ++attempt) {
+        int fd = open(ipath, O_RDONLY);
+        SentIdxHeader h, again;
+        if (fd >= 0 && pread(fd, &h, sizeof(h), 0) == (ssize_t)sizeof(h) && stamp_matches(&h, st)) {
+            *count = h.count;
+            if (first > last || last >= h.count) {
+                close(fd);
+                return -2;
+            }
+            SentIdxEntry a, b;
+            int ok = pread(fd, &a, sizeof(a), (off_t)(sizeof(h) + first * sizeof(a))) == (ssize_t)sizeof(a) &&
+                     pread(fd, &b, sizeof(b), (off_t)(sizeof(h) + last * sizeof(b))) == (ssize_t)sizeof(b) &&
+                     pread(fd, &again, sizeof(again), 0) == (ssize_t)sizeof(again);
+            close(fd);
+            // A writer invalidates the header before touching entries: re-check it
+            if (!ok || memcmp(&h, &again, sizeof(h)) != 0) continue;
+            if (b.off + b.len > (uint64_t)st->st_size || b.off + b.len < a.off) return -1;
+            *off = a.off;
+            *len = b.off + b.len - a.off;
+            return 0;
+        }
+        if (fd >= 0) close(fd);
+        // Missing or stale (document changed by another path): rebuild
+        if (sentidx_rebuild(filename) != 0) return -1;
+    }
+    return -1;
+}
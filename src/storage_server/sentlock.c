@@ -0,0 +1,207 @@
+#include "../../include/common.h"
+#include "../../include/sentlock.h"
+#include <pthread.h>
+
+typedef struct Waiter {
+    struct Waiter *next;
+    pthread_cond_t cv;
+    const char *owner;
+    uint64_t token;         // set when the lock is handed over
+} Waiter;
+
+typedef struct LockEntry {
+    struct LockEntry *next;
+    char filename[256];
+    int sentence;
+    int held;
+    uint64_t token;
+    char owner[64];
+    time_t since;           // wall clock, for display
+    struct timespec expires;
+    Waiter *head, *tail;    // FIFO wait queue
+} LockEntry;
+
+static pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;
+static LockEntry *buckets[SENTLOCK_BUCKETS];
+static uint64_t next_token = 1;
+
+static void now_mono(struct timespec *ts) {
+    clock_gettime(CLOCK_MONOTONIC, ts);
+}
+
+static int ts_before(const struct timespec *a, const struct timespec *b) {
+    return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+static int expired(const LockEntry *e) {
+    struct timespec now;
+    now_mono(&now);
+    return !ts_before(&now, &e->expires);
+}
+
+static unsigned bucket_of(const char *filename, int sentence) {
+    uint32_t h = 2166136261u ^ (uint32_t)sentence;
+    for (const unsigned char *p = (const unsigned char *)filename; *p; ++p) h = (h ^ *p) * 16777619u;
+    return h % SENTLOCK_BUCKETS;
+}
+
+static LockEntry *find(const char *filename, int sentence, int create) {
+    unsigned b = bucket_of(filename, sentence);
+    for (LockEntry *e = buckets[b]; e; e = e->next) {
+        if (e->sentence == sentence && strcmp(e->filename, filename) == 0) return e;
+    }
+    if (!create) return NULL;
+    LockEntry *e = calloc(1, sizeof(LockEntry));
+    if (!e) return NULL;
+    snprintf(e->filename, sizeof(e->filename), "%s", filename);
+    e->sentence = sentence;
+    e->next = buckets[b];
+    buckets[b] = e;
+    return e;
+}
+
+// Drop entries nobody holds or waits for
+static void maybe_free(LockEntry *e) {
+    if (e->held || e->head) return;
+    LockEntry **pp = &buckets[bucket_of(e->filename, e->sentence)];
+    while (*pp && *pp != e) pp = &(*pp)->next;
+    if (*pp) *pp = e->next;
+    free(e);
+}
+
+static uint64_t grant(LockEntry *e, const char *owner) {
+    e->held = 1;
+    e->token = next_token++;
+    snprintf(e->owner, sizeof(e->owner), "%s", owner);
+    e->since = time(NULL);
+    now_mono(&e->expires);
+    e->expires.tv_sec += WRITE_LOCK_LEASE;
+    return e->token;
+}
+
+// Free (or lapsed while someone is queued): hand the lock to the first waiter
+static void hand_off(LockEntry *e) {
+    if (e->held && !(e->head && expired(e))) return;
+    e->held = 0;
+    Waiter *w = e->head;
+    if (!w) return;
+    e->head = w->next;
+    if (!e->head) e->tail = NULL;
+    w->token = grant(e, w->owner);
+    pthread_cond_signal(&w->cv);
+}
+
+uint64_t sentlock_acquire(const char *filename, int sentence, const char *owner, int wait_secs) {
+    pthread_mutex_lock(&table_lock);
+    LockEntry *e = find(filename, sentence, 1);
+    if (!e) {
+        pthread_mutex_unlock(&table_lock);
+        return 0;
+    }
+    hand_off(e);
+    // Free, or held on a lapsed lease with no one queued: take it
+    if (!e->head && (!e->held || expired(e))) {
+        uint64_t token = grant(e, owner);
+        pthread_mutex_unlock(&table_lock);
+        return token;
+    }
+    if (wait_secs <= 0) {
+        pthread_mutex_unlock(&table_lock);
+        return 0;
+    }
+
+    Waiter w = {NULL, PTHREAD_COND_INITIALIZER, owner, 0};
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&w.cv, &attr);
+    pthread_condattr_destroy(&attr);
+    if (e->tail) e->tail->next = &w;
+    else e->head = &w;
+    e->tail = &w;
+
+    struct timespec deadline;
+    now_mono(&deadline);
+    deadline.tv_sec += wait_secs;
+    while (!w.token) {
+        // Wake at the holder's lease end too, to take over a lapsed lock
+        const struct timespec *until = ts_before(&e->expires, &deadline) ? &e->expires : &deadline;
+        pthread_cond_timedwait(&w.cv, &table_lock, until);
+        if (w.token) break;
+        hand_off(e);
+        if (w.token) break;
+        struct timespec now;
+        now_mono(&now);
+        if (!ts_before(&now, &deadline)) {
+            // Gave up: leave the queue
+            Waiter **pp = &e->head, *prev = NULL;
+            while (*pp && *pp != &w) {
+                prev = *pp;
+                pp = &(*pp)->next;
+            }
+            if (*pp) *pp = w.next;
+            if (e->tail == &w) e->tail = prev;
+            maybe_free(e);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&table_lock);
+    pthread_cond_destroy(&w.cv);
+    return w.token;
+}
+
+int sentlock_renew(const char *filename, int sentence, uint64_t token) {
+    pthread_mutex_lock(&table_lock);
+    LockEntry *e = find(filename, sentence, 0);
+    int rc = -1;
+    if (e) {
+        hand_off(e);
+        // A lapsed lease nobody else claimed is still ours
+        if (e->held && e->token == token) {
+            now_mono(&e->expires);
+            e->expires.tv_sec += WRITE_LOCK_LEASE;
+            rc = 0;
+        }
+    }
+    pthread_mutex_unlock(&table_lock);
+    return rc;
+}
+
+void sentlock_release(const char *filename, int sentence, uint64_t token) {
+    pthread_mutex_lock(&table_lock);
+    LockEntry *e = find(filename, sentence, 0);
+    if (e && e->held && e->token == token) {
+        e->held = 0;
+        hand_off(e);
+        maybe_free(e);
+    }
+    pthread_mutex_unlock(&table_lock);
+}
+
+void sentlock_describe(const char *filename, char *out, size_t outsz) {
+    size_t used = 0;
+    out[0] = '\0';
+    struct timespec now;
+    now_mono(&now);
+    pthread_mutex_lock(&table_lock);
+    for (int b = 0; b < SENTLOCK_BUCKETS; ++b) {
+        for (LockEntry *e = buckets[b]; e; e = e->next) {
+            if (!e->held || (filename && strcmp(e->filename, filename) != 0)) continue;
+            int waiters = 0;
+            for (Waiter *w = e->head; w; w = w->next) waiters++;
+            long left = (long)(e->expires.tv_sec - now.tv_sec);
+            struct tm tm_buf;
+            char since[32];
+            strftime(since, sizeof(since), "%Y-%m-%d %H:%M:%S", localtime_r(&e->since, &tm_buf));
+            int n = snprintf(out + used, outsz - used, "%s sentence %d: %s since %s, lease %s%lds, %d waiting\n",
+                             e->filename, e->sentence, e->owner, since,
+                             left > 0 ? "" : "lapsed ", left > 0 ? left : -left, waiters);
+            if (n < 0 || (size_t)n >= outsz - used) {
+                pthread_mutex_unlock(&table_lock);
+                return;
+            }
+            used += (size_t)n;
+        }
+    }
+    pthread_mutex_unlock(&table_lock);
+}
@@ -6,64 +6,159 @@
 #include "../../include/stream.h"
 #include "../../include/execute.h"
 #include "../../include/acl.h"
-#include <signal.h>
-#include <sys/wait.h>
 #include "../../include/undo.h" 
 #include "../../include/checkpoint.h"
+#include "../../include/search.h"
+#include "../../include/atime.h"
+#include "../../include/meta_store.h"
+#include "../../include/dispatch.h"
+#include "../../include/doccount.h"
+#include "../../include/sentidx.h"
+#include "../../include/commit.h"
+#include "../../include/sentlock.h"
+#include "../../include/chunkstore.h"
+#include "../../include/compress.h"
+#include "../../include/tier.h"
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/sendfile.h>
 // Global storage server ID so helpers (e.g., write.c) can query it
 static int g_storage_id = 0;
 int get_storage_id(void) { return g_storage_id; }
 
-// Reap zombie processes
-void sigchld_handler(int s) {
-    (void)s;
-    while (waitpid(-1, NULL, WNOHANG) > 0) {}
+static int send_all(int sock, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(sock, buf, len, 0);
+        if (n <= 0) return -1;
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
 }
-// Function to read and send file content to client
-void read_file(int client_sock, const char* filename, const char* username) {
-    char path[512];
-    char response[8192];
-    FILE *fp;
-    
-    // Check read access
+
+// Send len bytes of fd from off: sendfile() straight from the page cache, or pread/send
+// where the file system or socket does not support it. -1 if the client went away.
+static int send_file_range(int sock, int fd, off_t off, uint64_t len) {
+    while (len > 0) {
+        size_t want = len < (1u << 30) ? (size_t)len : (1u << 30);
+        ssize_t n = sendfile(sock, fd, &off, want);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EINVAL || errno == ENOSYS)) break;
+        if (n <= 0) return -1;
+        len -= (uint64_t)n;
+    }
+    char buf[65536];
+    while (len > 0) {
+        size_t want = len < sizeof(buf) ? (size_t)len : sizeof(buf);
+        ssize_t n = pread(fd, buf, want, off);
+        if (n <= 0 || send_all(sock, buf, (size_t)n) != 0) return -1;
+        off += n;
+        len -= (uint64_t)n;
+    }
+    return 0;
+}
+
+// Send len bytes of a snapshot from off; -1 if the client went away
+static int send_snapshot(int sock, const CommitSnapshot *snap, uint64_t off, uint64_t len) {
+    if (snap->buf) return send_all(sock, snap->buf + off, (size_t)len);
+    return send_file_range(sock, snap->fd, (off_t)off, len);
+}
+
+// "<first>", "<first>-<last>" or "<first>-" (*last = -1). 0 if well formed.
+static int parse_span(const char *s, long long *first, long long *last) {
+    char *end;
+    if (!isdigit((unsigned char)*s)) return -1;
+    *first = *last = strtoll(s, &end, 10);
+    if (*end == '-') {
+        s = end + 1;
+        if (*s == '\0') {
+            *last = -1;
+            return 0;
+        }
+        if (!isdigit((unsigned char)*s)) return -1;
+        *last = strtoll(s, &end, 10);
+    }
+    return *end == '\0' && *last >= *first ? 0 : -1;
+}
+
+// READ <file> [<k>[-<m>] | BYTES <first>-[<last>]]: the whole document, sentences k..m
+// (their byte range comes from the sentence index) or bytes first..last. The reply is
+// READ_LENGTH_HEADER and the byte count, then exactly that many bytes from sendfile().
+// The commit read lock is held throughout, so the bytes are never a half-applied commit.
+void read_file(int client_sock, const char *filename, const char *range, const char *username) {
+    char response[512];
+
     if (!check_read_access(filename, username)) {
-        sprintf(response, "Error: Access denied. You do not have read permission for '%s'\n", filename);
+        snprintf(response, sizeof(response), "Error: Access denied. You do not have read permission for '%s'\n", filename);
         send(client_sock, response, strlen(response), 0);
         return;
     }
-    
-    // Construct full path
-    sprintf(path, "%s/storage%d/files/%s", STORAGE_DIR, get_storage_id(), filename);
-    
-    // Open file for reading
-    fp = fopen(path, "r");
-    if (!fp) {
-        sprintf(response, "Error: File '%s' not found or cannot be opened\n", filename);
+
+    int bytes = strncmp(range, "BYTES ", 6) == 0;
+    long long first = 0, last = -1;
+    if (range[0] && (parse_span(bytes ? range + 6 : range, &first, &last) != 0 || (!bytes && last < 0))) {
+        snprintf(response, sizeof(response),
+                 "Usage: READ <filename> [<sentence>|<first>-<last>|BYTES <first>-[<last>]]\n");
         send(client_sock, response, strlen(response), 0);
         return;
     }
-    
-    // Read entire file content
-    size_t bytes_read = fread(response, 1, sizeof(response) - 1, fp);
-    response[bytes_read] = '\0';  // Null-terminate
-    
-    fclose(fp);
-    
-    // Update last access time
-    FileMetadata meta;
-    if (read_metadata_file(filename, &meta) == 0) {
-        meta.last_accessed = time(NULL);
-        update_metadata_file(filename, &meta);
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/storage%d/files/%s", STORAGE_DIR, get_storage_id(), filename);
+    // The index lookup and the copy that is sent must see the same version of the file
+    commit_read_lock(filename);
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0) close(fd);
+        commit_read_unlock(filename);
+        snprintf(response, sizeof(response), "Error: File '%s' not found or cannot be opened\n", filename);
+        send(client_sock, response, strlen(response), 0);
+        return;
     }
-    
-    // Send content to client
-    if (bytes_read == 0) {
-        sprintf(response, "(File '%s' is empty)\n", filename);
+
+    uint64_t off = 0, len = (uint64_t)st.st_size, count = 0;
+    int rc = 0;
+    if (bytes) {
+        if ((uint64_t)first >= len) {
+            snprintf(response, sizeof(response), "Error: Byte %lld out of range ('%s' has %llu byte(s))\n",
+                     first, filename, (unsigned long long)len);
+            rc = -1;
+        } else {
+            if (last < 0 || (uint64_t)last >= len) last = (long long)len - 1;
+            off = (uint64_t)first;
+            len = (uint64_t)(last - first + 1);
+        }
+    } else if (range[0]) {
+        rc = sentidx_range(filename, &st, (size_t)first, (size_t)last, &off, &len, &count);
+        if (rc == -2) {
+            snprintf(response, sizeof(response), "Error: Sentence %lld out of range ('%s' has %llu sentence(s))\n",
+                     last, filename, (unsigned long long)count);
+        } else if (rc < 0) {
+            snprintf(response, sizeof(response), "Error: Could not index sentences of '%s'\n", filename);
+        }
     }
-    
-    send(client_sock, response, strlen(response), 0);
-}
+    CommitSnapshot snap;
+    if (rc == 0 && commit_snapshot(fd, off, len, COMMIT_SNAPSHOT_MEM, &snap) != 0) {
+        snprintf(response, sizeof(response), "Error: Could not read '%s'\n", filename);
+        rc = -1;
+    }
+    close(fd);
+    commit_read_unlock(filename);
 
+    if (rc < 0) {
+        send(client_sock, response, strlen(response), 0);
+        return;
+    }
+    // The header rides in the same segment as the start of the body
+    int n = snprintf(response, sizeof(response), READ_LENGTH_HEADER "%llu\n", (unsigned long long)len);
+    if (send(client_sock, response, (size_t)n, MSG_MORE) == n && send_snapshot(client_sock, &snap, 0, len) != 0) {
+        printf("Client disconnected during READ of '%s'.\n", filename);
+    }
+    atime_touch(filename);
+    commit_snapshot_free(&snap);
+}
 
 // Function to create an empty file
 void create_file(int client_sock, const char* filename, const char* username) {
@@ -99,6 +194,8 @@ void create_file(int client_sock, const char* filename, const char* username) {
         send(client_sock, response, strlen(response), 0);
         return;
     }
+    DocCounts counts;
+    doccount_get(filename, NULL, &counts);     // stamp the empty document's counts
     
     sprintf(response, "Success: File '%s' created successfully\n", filename);
     send(client_sock, response, strlen(response), 0);
@@ -135,6 +232,20 @@ void initialize_storage_folders(int ss_id) {
     ensure_dir(tmp);
     sprintf(tmp, "%s/checkpoints", STORAGE_BASE);
     ensure_dir(tmp);
+    sprintf(tmp, "%s/search", STORAGE_BASE);
+    ensure_dir(tmp);
+    sprintf(tmp, "%s/sentidx", STORAGE_BASE);
+    ensure_dir(tmp);
+    sprintf(tmp, "%s/chunks", STORAGE_BASE);
+    ensure_dir(tmp);
+    sprintf(tmp, "%s/cold", STORAGE_BASE);
+    ensure_dir(tmp);
+}
+
+static void list_cold(const char *filename, const TierInfo *info, void *user) {
+    (void)info;
+    strcat((char *)user, filename);
+    strcat((char *)user, ",");
 }
 
 void build_file_list(char *out, size_t max_len) {
@@ -155,6 +266,7 @@ void build_file_list(char *out, size_t max_len) {
         }
     }
     closedir(d);
+    tier_foreach(list_cold, out);
 }
 
 int register_with_name_server() {
@@ -208,338 +320,545 @@ int register_with_name_server() {
     return ss_id;
 }
 
-int main() {
-    printf("Starting Storage Server...\n");
-    int ss_id = register_with_name_server();
-    g_storage_id = ss_id; // make ID available to other translation units
-    initialize_storage_folders(ss_id);
-    int MY_PORT = STORAGE_SERVER_PORT + ss_id;
-    printf("Storage folder created: %s\n", STORAGE_BASE);
-    
-    // Set up signal handler to reap zombie processes
-    struct sigaction sa;
-    sa.sa_handler = sigchld_handler;
-    sigemptyset(&sa.sa_mask);
-    sa.sa_flags = SA_RESTART;
-    if (sigaction(SIGCHLD, &sa, NULL) == -1) {
-        perror("sigaction");
-        // not fatal, continue
+// Split a MGET / MSTREAM argument list in place; 0 if it holds nothing or more than max
+static size_t split_names(char *args, char **names, size_t max) {
+    size_t count = 0;
+    char *saveptr = NULL;
+    for (char *tok = strtok_r(args, " \t", &saveptr); tok; tok = strtok_r(NULL, " \t", &saveptr)) {
+        if (count == max) return 0;
+        names[count++] = tok;
     }
-    
-    int server_fd, client_sock;
-    struct sockaddr_in server_addr, client_addr;
-    socklen_t addr_len = sizeof(client_addr);
-    char buffer[1024];
-
-    // Create socket
-    server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_fd < 0) {
-        perror("Socket creation failed");
-        exit(1);
+    return count;
+}
+
+// MGET <f1> <f2> ...: every document on this one connection, framed as in common.h. Each is
+// promoted from the cold tier and copied under its commit read lock, then sent from the copy.
+static void mget_files(int client_sock, char **names, size_t count, const char *username) {
+    char line[512];
+    for (size_t i = 0; i < count; ++i) {
+        const char *name = names[i];
+        int n;
+        if (!check_read_access(name, username)) {
+            n = snprintf(line, sizeof(line), "ERROR %s Access denied\n", name);
+            if (send(client_sock, line, (size_t)n, MSG_NOSIGNAL) != n) return;
+            continue;
+        }
+
+        char path[512];
+        snprintf(path, sizeof(path), "%s/storage%d/files/%s", STORAGE_DIR, get_storage_id(), name);
+        if (tier_acquire(name) != 0) {
+            tier_release(name);
+            n = snprintf(line, sizeof(line), "ERROR %s Archived and could not be restored\n", name);
+            if (send(client_sock, line, (size_t)n, MSG_NOSIGNAL) != n) return;
+            continue;
+        }
+        commit_read_lock(name);
+        int fd = open(path, O_RDONLY);
+        struct stat st;
+        CommitSnapshot snap;
+        int copied = fd >= 0 && fstat(fd, &st) == 0 &&
+                     commit_snapshot(fd, 0, (uint64_t)st.st_size, COMMIT_SNAPSHOT_MEM, &snap) == 0;
+        if (fd >= 0) close(fd);
+        commit_read_unlock(name);
+        tier_release(name);
+
+        int gone = 0;
+        if (!copied) {
+            n = snprintf(line, sizeof(line), "ERROR %s File not found or cannot be opened\n", name);
+            gone = send(client_sock, line, (size_t)n, MSG_NOSIGNAL) != n;
+        } else {
+            for (uint64_t off = 0; off < snap.len && !gone; off += MULTI_PIECE_MAX) {
+                uint64_t len = snap.len - off < MULTI_PIECE_MAX ? snap.len - off : MULTI_PIECE_MAX;
+                n = snprintf(line, sizeof(line), "FILE %s %llu\n", name, (unsigned long long)len);
+                gone = send(client_sock, line, (size_t)n, MSG_MORE | MSG_NOSIGNAL) != n ||
+                       send_snapshot(client_sock, &snap, off, len) != 0;
+            }
+            n = snprintf(line, sizeof(line), "DONE %s\n", name);
+            if (!gone) gone = send(client_sock, line, (size_t)n, MSG_NOSIGNAL) != n;
+            atime_touch(name);
+            commit_snapshot_free(&snap);
+        }
+        if (gone) {
+            printf("Client disconnected during MGET.\n");
+            return;
+        }
     }
+}
 
-    // Allow immediate reuse of the port
-    int opt = 1;
-    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
-        perror("setsockopt failed");
-        exit(1);
+// Maintenance commands answer only the admin account. They are sent straight to the SS,
+// so the password is checked here against storage/users.txt as the Name Server does.
+static int is_admin(const char *username, const char *password) {
+    if (strcmp(username, "admin") != 0) return 0;
+    int authenticated = 0;
+    FILE *users_file = fopen(STORAGE_DIR "/users.txt", "r");
+    if (users_file) {
+        char line[256];
+        while (fgets(line, sizeof(line), users_file)) {
+            line[strcspn(line, "\n")] = 0;
+            if (line[0] == '#' || strlen(line) == 0) continue;
+            char *colon = strchr(line, ':');
+            if (colon) {
+                *colon = '\0';
+                if (strcmp(line, username) == 0 && strcmp(colon + 1, password) == 0) {
+                    authenticated = 1;
+                    break;
+                }
+            }
+        }
+        fclose(users_file);
     }
+    return authenticated;
+}
 
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(MY_PORT);
-    server_addr.sin_addr.s_addr = INADDR_ANY;
+// Commands that read or change a document's bytes; *filename is the document
+static int names_document(const char *cmd, char *filename, size_t sz) {
+    static const char *verbs[] = {"READ ", "STREAM ", "WRITE ", "CREATE ", "DELETE ", "UNDO ",
+                                  "REDO ", "CHECKPOINT ", "REVERT ", "DIFF "};
+    for (size_t i = 0; i < sizeof(verbs) / sizeof(verbs[0]); ++i) {
+        size_t len = strlen(verbs[i]);
+        if (strncmp(cmd, verbs[i], len) == 0) {
+            char fmt[16];
+            snprintf(fmt, sizeof(fmt), "%%%zus", sz - 1);
+            return sscanf(cmd + len, fmt, filename) == 1;
+        }
+    }
+    return 0;
+}
 
-    if (bind(server_fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
-        perror("Bind failed");
-        close(server_fd);
-        exit(1);
+// Handle one client request; `request` is the header frame read by the dispatcher
+static void handle_request(int client_sock, char *request) {
+    char buffer[SS_REQUEST_MAX];
+
+    // Parse authentication credentials
+    char username[64] = "", password[64] = "", command[SS_REQUEST_MAX] = "";
+    int want_meta = 0, want_cursor = 0;
+    char resume[STREAM_VERSION_MAX] = "";
+    char *line_ptr = request;
+    char *saveptr_auth = NULL;
+    char *auth_line = strtok_r(line_ptr, "\n", &saveptr_auth);
+    while (auth_line) {
+        if (strncmp(auth_line, "USER:", 5) == 0) {
+            strncpy(username, auth_line + 5, sizeof(username) - 1);
+        } else if (strncmp(auth_line, "PASS:", 5) == 0) {
+            strncpy(password, auth_line + 5, sizeof(password) - 1);
+        } else if (strncmp(auth_line, "META:", 5) == 0) {
+            want_meta = atoi(auth_line + 5);
+        } else if (strncmp(auth_line, "CURSOR:", 7) == 0) {
+            want_cursor = atoi(auth_line + 7);
+        } else if (strncmp(auth_line, "RESUME:", 7) == 0) {
+            snprintf(resume, sizeof(resume), "%s", auth_line + 7);
+        } else if (strncmp(auth_line, "CMD:", 4) == 0) {
+            strncpy(command, auth_line + 4, sizeof(command) - 1);
+            break;
+        }
+        auth_line = strtok_r(NULL, "\n", &saveptr_auth);
     }
 
-    listen(server_fd, 5);
-    printf("Storage server started. Listening on port %d...\n", MY_PORT);
+    // Use command from here on
+    strncpy(buffer, command, sizeof(buffer) - 1);
+    buffer[sizeof(buffer) - 1] = '\0';
+
+    // Remove newline / carriage return
+    buffer[strcspn(buffer, "\n")] = 0;
+    buffer[strcspn(buffer, "\r")] = 0;
+
+    printf("Command received from '%s': '%s'\n", username, buffer);
+    //printf("Buffer bytes: ");
+    // for (int i = 0; i < strlen(buffer); i++) {
+    //     printf("[%c:%d] ", buffer[i], buffer[i]);
+    // }
+    // printf("\n");
+    // fflush(stdout);
+
+    // A cold document is brought back before any command that reads or changes its bytes,
+    // and is not demoted again until the command is done
+    char held[256] = "";
+    if (names_document(buffer, held, sizeof(held)) && tier_acquire(held) != 0) {
+        // Not run against the missing file: CREATE would put an empty one over the archived copy
+        char msg[384];
+        snprintf(msg, sizeof(msg), "Error: File '%s' is archived and could not be restored; please retry\n", held);
+        send(client_sock, msg, strlen(msg), 0);
+        tier_release(held);
+        return;
+    }
 
-    while (1) {
-        client_sock = accept(server_fd, (struct sockaddr*)&client_addr, &addr_len);
-        if (client_sock < 0) {
-            perror("Accept failed");
-            continue;
+    if (strncmp(buffer, "VIEW ", 5) == 0 || strcmp(buffer, "VIEW") == 0) {
+        // Parse flags from the command
+        int show_all = (strstr(buffer, "-a") != NULL) || (strstr(buffer, "-la") != NULL);
+        int show_long = (strstr(buffer, "-l") != NULL) || (strstr(buffer, "-al") != NULL) || (strstr(buffer, "-la") != NULL);
+        
+        list_files(client_sock, show_all, show_long, username);
+    } 
+    else if (strncmp(buffer, "READ ", 5) == 0) {
+        // Extract filename (and optional sentence / range) from command
+        char filename[256] = "", range[64] = "";
+        sscanf(buffer + 5, "%255s %63[^\n]", filename, range);  // Skip "READ "
+        
+        if (strlen(filename) == 0) {
+            char msg[] = "Error: Please specify a filename\n";
+            send(client_sock, msg, strlen(msg), 0);
+        } else {
+            read_file(client_sock, filename, range, username);
+            if (want_meta) send_meta_trailer(client_sock, filename, username);
         }
-
-        // Fork a child process to handle this client
-        pid_t pid = fork();
-        if (pid < 0) {
-            perror("fork failed");
-            close(client_sock);
-            continue;
+    } 
+    else if (strncmp(buffer, "CREATE ", 7) == 0) {
+        // Extract filename from command
+        char filename[256];
+        sscanf(buffer + 7, "%s", filename);  // Skip "CREATE " and get filename
+        
+        if (strlen(filename) == 0) {
+            char msg[] = "Error: Please specify a filename\n";
+            send(client_sock, msg, strlen(msg), 0);
+        } else {
+            create_file(client_sock, filename, username);
         }
-
-        if (pid > 0) {
-            // Parent: close client socket and continue accepting
-            close(client_sock);
-            continue;
+    }
+    else if (strncmp(buffer, "DELETE ", 7) == 0) {
+        // Extract filename from command
+        char filename[256];
+        sscanf(buffer + 7, "%s", filename);
+        
+        if (strlen(filename) == 0) {
+            char msg[] = "Error: Please specify a filename\n";
+            send(client_sock, msg, strlen(msg), 0);
+        } else {
+            delete_from_storage(client_sock, filename, username);
+        }
+    }
+    else if (strncmp(buffer, "WRITE ", 6) == 0) {
+        // WRITE <file> <n> [WAIT [<seconds>]]
+        char filename[256], opt[16];
+        int sentence_num, wait_secs = 0;
+        int fields = sscanf(buffer + 6, "%255s %d %15s %d", filename, &sentence_num, opt, &wait_secs);
+        if (fields >= 3 && strcmp(opt, "WAIT") == 0) {
+            if (fields == 3) wait_secs = SENTLOCK_DEFAULT_WAIT;
+            if (wait_secs > SENTLOCK_MAX_WAIT) wait_secs = SENTLOCK_MAX_WAIT;
+        } else {
+            wait_secs = 0;
+        }
+        if (fields >= 2) {
+            write_to_file(client_sock, filename, sentence_num, username, wait_secs);
+            // write_to_file handles the interactive loop internally
+            // and will complete when user sends ETIRW
+            if (want_meta) send_meta_trailer(client_sock, filename, username);
+        } else {
+            char msg[] = "Usage: WRITE <filename> <sentence_number> [WAIT [<seconds>]]\n";
+            send(client_sock, msg, strlen(msg), 0);
         }
+        // Don't close or continue here - fall through to normal cleanup
+    }
+    else if (strncmp(buffer, "INFO ", 5) == 0) {
+        char filename[256];
+        sscanf(buffer + 5, "%s", filename);
 
-        // Child process: handle the client
-        close(server_fd); // Child doesn't need the listening socket
-
-        memset(buffer, 0, sizeof(buffer));
-        read(client_sock, buffer, sizeof(buffer));
-
-        // Parse authentication credentials
-        char username[64] = "", password[64] = "", command[1024] = "";
-        char *line_ptr = buffer;
-        char *saveptr_auth = NULL;
-        char *auth_line = strtok_r(line_ptr, "\n", &saveptr_auth);
-        while (auth_line) {
-            if (strncmp(auth_line, "USER:", 5) == 0) {
-                strncpy(username, auth_line + 5, sizeof(username) - 1);
-            } else if (strncmp(auth_line, "PASS:", 5) == 0) {
-                strncpy(password, auth_line + 5, sizeof(password) - 1);
-            } else if (strncmp(auth_line, "CMD:", 4) == 0) {
-                strncpy(command, auth_line + 4, sizeof(command) - 1);
-                break;
-            }
-            auth_line = strtok_r(NULL, "\n", &saveptr_auth);
-        }
-
-        // Use command from here on
-        strncpy(buffer, command, sizeof(buffer) - 1);
-        buffer[sizeof(buffer) - 1] = '\0';
-
-        // Remove newline / carriage return
-        buffer[strcspn(buffer, "\n")] = 0;
-        buffer[strcspn(buffer, "\r")] = 0;
-
-        printf("Command received from '%s': '%s'\n", username, buffer);
-        //printf("Buffer bytes: ");
-        // for (int i = 0; i < strlen(buffer); i++) {
-        //     printf("[%c:%d] ", buffer[i], buffer[i]);
-        // }
-        // printf("\n");
-        // fflush(stdout);
-
-        if (strncmp(buffer, "VIEW ", 5) == 0 || strcmp(buffer, "VIEW") == 0) {
-            // Parse flags from the command
-            int show_all = (strstr(buffer, "-a") != NULL) || (strstr(buffer, "-la") != NULL);
-            int show_long = (strstr(buffer, "-l") != NULL) || (strstr(buffer, "-al") != NULL) || (strstr(buffer, "-la") != NULL);
-            
-            list_files(client_sock, show_all, show_long, username);
-        } 
-        else if (strncmp(buffer, "READ ", 5) == 0) {
-            // Extract filename from command
-            char filename[256];
-            sscanf(buffer + 5, "%s", filename);  // Skip "READ " and get filename
-            
-            if (strlen(filename) == 0) {
-                char msg[] = "Error: Please specify a filename\n";
-                send(client_sock, msg, strlen(msg), 0);
-            } else {
-                read_file(client_sock, filename, username);
-            }
-        } 
-        else if (strncmp(buffer, "CREATE ", 7) == 0) {
-            // Extract filename from command
-            char filename[256];
-            sscanf(buffer + 7, "%s", filename);  // Skip "CREATE " and get filename
-            
-            if (strlen(filename) == 0) {
-                char msg[] = "Error: Please specify a filename\n";
-                send(client_sock, msg, strlen(msg), 0);
-            } else {
-                create_file(client_sock, filename, username);
-            }
+        if (strlen(filename) == 0) {
+            char msg[] = "Error: Please specify a filename\n";
+            send(client_sock, msg, strlen(msg), 0);
+        } else {
+            file_info(client_sock, filename, username);
         }
-        else if (strncmp(buffer, "DELETE ", 7) == 0) {
-            // Extract filename from command
-            char filename[256];
-            sscanf(buffer + 7, "%s", filename);
-            
-            if (strlen(filename) == 0) {
-                char msg[] = "Error: Please specify a filename\n";
-                send(client_sock, msg, strlen(msg), 0);
+    }
+    else if (strncmp(buffer, "STREAM ", 7) == 0) {
+        // STREAM <file> [WORD <n>|BYTE <offset>] [RATE <words/s>|RATE MAX]
+        char filename[256] = "", opt[4][24];
+        int fields = sscanf(buffer + 7, "%255s %23s %23s %23s %23s", filename, opt[0], opt[1], opt[2], opt[3]);
+        StreamRequest req = {STREAM_DEFAULT_RATE, 0, 0, want_cursor, ""};
+        snprintf(req.version, sizeof(req.version), "%s", resume);
+        int valid = fields >= 1 && fields % 2 == 1, have_start = 0, have_rate = 0;
+        for (int i = 0; valid && i + 1 < fields - 1; i += 2) {
+            const char *arg = opt[i + 1];
+            char *end;
+            if (strcmp(opt[i], "RATE") == 0 && !have_rate++) {
+                long rate = 0;
+                if (strcmp(arg, "MAX") == 0) req.rate = 0;
+                else if ((rate = strtol(arg, &end, 10)) < 1 || *end != '\0') valid = 0;
+                else req.rate = rate > STREAM_MAX_RATE ? STREAM_MAX_RATE : (unsigned)rate;
+            } else if ((strcmp(opt[i], "WORD") == 0 || strcmp(opt[i], "BYTE") == 0) && !have_start++) {
+                req.start_at_byte = opt[i][0] == 'B';
+                req.start = strtoull(arg, &end, 10);
+                if (!isdigit((unsigned char)arg[0]) || *end != '\0') valid = 0;
             } else {
-                delete_from_storage(client_sock, filename, username);
+                valid = 0;
             }
         }
-        else if (strncmp(buffer, "WRITE ", 6) == 0) {
-            char filename[256];
-            int sentence_num;
-            if (sscanf(buffer + 6, "%s %d", filename, &sentence_num) == 2) {
-                write_to_file(client_sock, filename, sentence_num, username);
-                // write_to_file handles the interactive loop internally
-                // and will complete when user sends ETIRW
-            } else {
-                char msg[] = "Usage: WRITE <filename> <sentence_number>\n";
-                send(client_sock, msg, strlen(msg), 0);
-            }
-            // Don't close or continue here - fall through to normal cleanup
+
+        if (strlen(filename) == 0) {
+            char msg[] = "Error: Please specify a filename\n";
+            send(client_sock, msg, strlen(msg), 0);
+        } else if (!valid) {
+            char msg[] = "Usage: STREAM <filename> [WORD <n>|BYTE <offset>] [RATE <words_per_second>|RATE MAX]\n";
+            send(client_sock, msg, strlen(msg), 0);
+        } else {
+            stream_file(client_sock, filename, username, &req);
         }
-        else if (strncmp(buffer, "INFO ", 5) == 0) {
-            char filename[256];
-            sscanf(buffer + 5, "%s", filename);
+    }
+    else if (strncmp(buffer, "MGET ", 5) == 0 || strncmp(buffer, "MSTREAM ", 8) == 0) {
+        // MGET <f1> <f2> ... / MSTREAM <f1> <f2> ... [RATE <words/s>|RATE MAX]
+        int mstream = buffer[1] == 'S';
+        char *names[MULTI_MAX_FILES + 2];
+        size_t count = split_names(buffer + (mstream ? 8 : 5), names, mstream ? MULTI_MAX_FILES + 2 : MULTI_MAX_FILES);
+        long rate = STREAM_DEFAULT_RATE;
+        if (mstream && count >= 2 && strcmp(names[count - 2], "RATE") == 0) {
+            char *end;
+            const char *arg = names[count - 1];
+            if (strcmp(arg, "MAX") == 0) rate = 0;
+            else if ((rate = strtol(arg, &end, 10)) < 1 || *end != '\0') count = 0;
+            else if (rate > STREAM_MAX_RATE) rate = STREAM_MAX_RATE;
+            if (count) count -= 2;
+        }
+        if (count > MULTI_MAX_FILES) count = 0;
 
-            if (strlen(filename) == 0) {
-                char msg[] = "Error: Please specify a filename\n";
-                send(client_sock, msg, strlen(msg), 0);
-            } else {
-                file_info(client_sock, filename, username);
-            }
+        if (count == 0) {
+            char msg[128];
+            snprintf(msg, sizeof(msg), "Usage: %s <file1> <file2> ... (at most %d files)%s\n", mstream ? "MSTREAM" : "MGET",
+                     MULTI_MAX_FILES, mstream ? " [RATE <words_per_second>|RATE MAX]" : "");
+            send(client_sock, msg, strlen(msg), 0);
+        } else if (mstream) {
+            stream_files(client_sock, names, count, username, (unsigned)rate);
+        } else {
+            mget_files(client_sock, names, count, username);
         }
-        else if (strncmp(buffer, "STREAM ", 7) == 0) {
-            char filename[256];
-            sscanf(buffer + 7, "%s", filename);
-            
-            if (strlen(filename) == 0) {
-                char msg[] = "Error: Please specify a filename\n";
-                send(client_sock, msg, strlen(msg), 0);
-            } else {
-                stream_file(client_sock, filename, username);
-            }
+    }
+    // else if (strncmp(buffer, "EXEC ", 5) == 0) {
+    //     char filename[256];
+    //     sscanf(buffer + 5, "%s", filename); // extract filename
+
+    //     if (strlen(filename) == 0) {
+    //         char msg[] = "Error: Please specify a filename\n";
+    //         send(client_sock, msg, strlen(msg), 0);
+    //     } else {
+    //         execute_file(client_sock, filename, username);
+    //     }
+    // }
+    else if (strncmp(buffer, "UNDO ", 5) == 0 || strncmp(buffer, "REDO ", 5) == 0) {
+        // UNDO <file> [<n>] / REDO <file> [<n>]: step n entries through the undo history
+        char filename[256] = "";
+        int levels = 1;
+        sscanf(buffer + 5, "%255s %d", filename, &levels);
+        
+        if (strlen(filename) == 0) {
+            char msg[] = "Error: Please specify a filename\n";
+            send(client_sock, msg, strlen(msg), 0);
         }
-        // else if (strncmp(buffer, "EXEC ", 5) == 0) {
-        //     char filename[256];
-        //     sscanf(buffer + 5, "%s", filename); // extract filename
-
-        //     if (strlen(filename) == 0) {
-        //         char msg[] = "Error: Please specify a filename\n";
-        //         send(client_sock, msg, strlen(msg), 0);
-        //     } else {
-        //         execute_file(client_sock, filename, username);
-        //     }
-        // }
-        else if (strncmp(buffer, "UNDO ", 5) == 0) {
-            char filename[256];
-            sscanf(buffer + 5, "%s", filename);
-            
-            if (strlen(filename) == 0) {
-                char msg[] = "Error: Please specify a filename\n";
-                send(client_sock, msg, strlen(msg), 0);
-            }
-            else {
-                undo_last_change(client_sock, filename, username);
-            }
+        else if (levels < 1) {
+            char msg[] = "Error: Number of changes must be at least 1\n";
+            send(client_sock, msg, strlen(msg), 0);
+        }
+        else {
+            if (buffer[0] == 'U') undo_last_change(client_sock, filename, username, levels);
+            else redo_last_change(client_sock, filename, username, levels);
+            if (want_meta) send_meta_trailer(client_sock, filename, username);
         }
+    }
 
-        // Add after the UNDO command handler (around line 200+)
+    // Add after the UNDO command handler (around line 200+)
 
-        else if (strncmp(buffer, "CHECKPOINT ", 11) == 0) {
-            char filename[256], tag[64];
-            if (sscanf(buffer + 11, "%s %s", filename, tag) == 2) {
-                checkpoint_create(client_sock, filename, tag, username, g_storage_id);
-            } else {
-                char msg[] = "Usage: CHECKPOINT <filename> <tag>\n";
-                send(client_sock, msg, strlen(msg), 0);
-            }
-        }
-        else if (strncmp(buffer, "VIEWCHECKPOINT ", 15) == 0) {
-            char filename[256], tag[64];
-            if (sscanf(buffer + 15, "%s %s", filename, tag) == 2) {
-                checkpoint_view(client_sock, filename, tag, username, g_storage_id);
-            } else {
-                char msg[] = "Usage: VIEWCHECKPOINT <filename> <tag>\n";
-                send(client_sock, msg, strlen(msg), 0);
-            }
+    else if (strncmp(buffer, "CHECKPOINT ", 11) == 0) {
+        char filename[256], tag[64];
+        if (sscanf(buffer + 11, "%s %s", filename, tag) == 2) {
+            checkpoint_create(client_sock, filename, tag, username, g_storage_id);
+        } else {
+            char msg[] = "Usage: CHECKPOINT <filename> <tag>\n";
+            send(client_sock, msg, strlen(msg), 0);
         }
-        else if (strncmp(buffer, "REVERT ", 7) == 0) {
-            char filename[256], tag[64];
-            if (sscanf(buffer + 7, "%s %s", filename, tag) == 2) {
-                checkpoint_revert(client_sock, filename, tag, username, g_storage_id);
-            } else {
-                char msg[] = "Usage: REVERT <filename> <tag>\n";
-                send(client_sock, msg, strlen(msg), 0);
-            }
+    }
+    else if (strncmp(buffer, "VIEWCHECKPOINT ", 15) == 0) {
+        char filename[256], tag[64];
+        if (sscanf(buffer + 15, "%s %s", filename, tag) == 2) {
+            checkpoint_view(client_sock, filename, tag, username, g_storage_id);
+        } else {
+            char msg[] = "Usage: VIEWCHECKPOINT <filename> <tag>\n";
+            send(client_sock, msg, strlen(msg), 0);
         }
-        else if (strncmp(buffer, "LISTCHECKPOINTS ", 16) == 0) {
-            char filename[256];
-            if (sscanf(buffer + 16, "%s", filename) == 1) {
-                checkpoint_list(client_sock, filename, username, g_storage_id);
-            } else {
-                char msg[] = "Usage: LISTCHECKPOINTS <filename>\n";
-                send(client_sock, msg, strlen(msg), 0);
-            }
+    }
+    else if (strncmp(buffer, "REVERT ", 7) == 0) {
+        char filename[256], tag[64];
+        if (sscanf(buffer + 7, "%s %s", filename, tag) == 2) {
+            checkpoint_revert(client_sock, filename, tag, username, g_storage_id);
+            if (want_meta) send_meta_trailer(client_sock, filename, username);
+        } else {
+            char msg[] = "Usage: REVERT <filename> <tag>\n";
+            send(client_sock, msg, strlen(msg), 0);
         }
-        else if (strncmp(buffer, "ADDACCESS ", 10) == 0) {
-            // Parse: ADDACCESS -R|-W <filename> <target_username>
-            char flag[8], filename[256], target_user[64];
-            char response[512];
-            
-            if (sscanf(buffer + 10, "%s %s %s", flag, filename, target_user) != 3) {
-                char msg[] = "Usage: ADDACCESS -R|-W <filename> <target_username>\n";
-                send(client_sock, msg, strlen(msg), 0);
-            } else {
-                // Check if file exists and requester is the owner
-                FileMetadata meta;
-                if (read_metadata_file(filename, &meta) != 0) {
-                    snprintf(response, sizeof(response), "Error: File '%s' not found\n", filename);
-                    send(client_sock, response, strlen(response), 0);
-                } else if (strcmp(meta.owner, username) != 0) {
-                    snprintf(response, sizeof(response), "Error: Only the owner can grant access to '%s'\n", filename);
-                    send(client_sock, response, strlen(response), 0);
+    }
+    else if (strncmp(buffer, "LISTCHECKPOINTS ", 16) == 0) {
+        // LISTCHECKPOINTS <file> [SORT TIME|TAG] [PAGE <n> [<per_page>]]
+        char filename[256], word[16], key[16];
+        int offset = 0, sort_by_tag = 0, page = 0, per_page = CHECKPOINT_PAGE_SIZE, valid = 1;
+        if (sscanf(buffer + 16, "%255s%n", filename, &offset) == 1) {
+            const char *args = buffer + 16 + offset;
+            int used;
+            while (valid && sscanf(args, "%15s%n", word, &used) == 1) {
+                args += used;
+                if (strcasecmp(word, "SORT") == 0 && sscanf(args, "%15s%n", key, &used) == 1) {
+                    args += used;
+                    if (strcasecmp(key, "TAG") == 0) sort_by_tag = 1;
+                    else if (strcasecmp(key, "TIME") == 0) sort_by_tag = 0;
+                    else valid = 0;
+                } else if (strcasecmp(word, "PAGE") == 0 && sscanf(args, "%d%n", &page, &used) == 1 && page > 0) {
+                    args += used;
+                    if (sscanf(args, "%d%n", &per_page, &used) == 1) args += used;
+                    if (per_page < 1) valid = 0;
                 } else {
-                    // Add access
-                    int result = -1;
-                    if (strcmp(flag, "-R") == 0) {
-                        result = add_read_access(filename, target_user);
-                        if (result == 0) {
-                            snprintf(response, sizeof(response), "Success: Read access granted to '%s' for file '%s'\n", target_user, filename);
-                        } else {
-                            snprintf(response, sizeof(response), "Info: User '%s' already has read access to '%s'\n", target_user, filename);
-                        }
-                    } else if (strcmp(flag, "-W") == 0) {
-                        result = add_write_access(filename, target_user);
-                        if (result == 0) {
-                            snprintf(response, sizeof(response), "Success: Write access granted to '%s' for file '%s'\n", target_user, filename);
-                        } else {
-                            snprintf(response, sizeof(response), "Info: User '%s' already has write access to '%s'\n", target_user, filename);
-                        }
-                    } else {
-                        snprintf(response, sizeof(response), "Error: Invalid flag '%s'. Use -R for read or -W for write\n", flag);
-                    }
-                    send(client_sock, response, strlen(response), 0);
+                    valid = 0;
                 }
             }
+        } else {
+            valid = 0;
+        }
+        if (valid) {
+            checkpoint_list(client_sock, filename, username, sort_by_tag, page, per_page, g_storage_id);
+        } else {
+            char msg[] = "Usage: LISTCHECKPOINTS <filename> [SORT TIME|TAG] [PAGE <n> [<per_page>]]\n";
+            send(client_sock, msg, strlen(msg), 0);
         }
-        else if (strncmp(buffer, "REMACCESS ", 10) == 0) {
-            // Parse: REMACCESS <filename> <target_username>
-            char filename[256], target_user[64];
-            char response[512];
-            
-            if (sscanf(buffer + 10, "%s %s", filename, target_user) != 2) {
-                char msg[] = "Usage: REMACCESS <filename> <target_username>\n";
-                send(client_sock, msg, strlen(msg), 0);
+    }
+    else if (strncmp(buffer, "DIFF ", 5) == 0) {
+        // DIFF <file> <tagA> [<tagB>|CURRENT]: tagB defaults to the live file
+        char filename[256], tag_a[64], tag_b[64] = "CURRENT";
+        if (sscanf(buffer + 5, "%255s %63s %63s", filename, tag_a, tag_b) >= 2) {
+            checkpoint_diff(client_sock, filename, tag_a, tag_b, username, g_storage_id);
+        } else {
+            char msg[] = "Usage: DIFF <filename> <tagA> [<tagB>|CURRENT]\n";
+            send(client_sock, msg, strlen(msg), 0);
+        }
+    }
+    else if (strncmp(buffer, "SEARCH ", 7) == 0) {
+        search_files(client_sock, buffer + 7, username);
+    }
+    else if (strcmp(buffer, "LOCKS") == 0 || strncmp(buffer, "LOCKS ", 6) == 0) {
+        // LOCKS [<file>]: sentence write locks currently held on this server
+        char filename[256] = "";
+        sscanf(buffer + 5, "%255s", filename);
+        char listing[8192];
+        sentlock_describe(filename[0] ? filename : NULL, listing, sizeof(listing));
+        if (listing[0] == '\0') snprintf(listing, sizeof(listing), "No sentence locks held.\n");
+        send(client_sock, listing, strlen(listing), 0);
+    }
+    else if (strcmp(buffer, "STATS") == 0) {
+        // Compression ratio and CPU cost per storage area, and the cold tier, since startup
+        char stats[2048];
+        lz_describe(stats, sizeof(stats));
+        size_t used = strlen(stats);
+        tier_describe(stats + used, sizeof(stats) - used);
+        send(client_sock, stats, strlen(stats), 0);
+    }
+    else if (strcmp(buffer, "EXPORTMETA") == 0) {
+        // Dump the metadata store as per-file .meta text files (backup / inspection); these
+        // hold every file's owner and ACLs, so only the admin may ask for them
+        char meta_dir[512], response[640];
+        if (!is_admin(username, password)) {
+            snprintf(response, sizeof(response), "Error: EXPORTMETA is restricted to the admin user\n");
+        } else {
+            snprintf(meta_dir, sizeof(meta_dir), "%s/meta", STORAGE_BASE);
+            int n = meta_store_export(meta_dir);
+            snprintf(response, sizeof(response), "Success: Exported %d metadata record(s) to %s\n", n, meta_dir);
+        }
+        send(client_sock, response, strlen(response), 0);
+    }
+    else if (strncmp(buffer, "ADDACCESS ", 10) == 0) {
+        // Parse: ADDACCESS -R|-W <filename> <target_username>
+        char flag[8], filename[256], target_user[64];
+        char response[512];
+        
+        if (sscanf(buffer + 10, "%s %s %s", flag, filename, target_user) != 3) {
+            char msg[] = "Usage: ADDACCESS -R|-W <filename> <target_username>\n";
+            send(client_sock, msg, strlen(msg), 0);
+        } else {
+            // Check if file exists and requester is the owner
+            FileMetadata meta;
+            if (read_metadata_file(filename, &meta) != 0) {
+                snprintf(response, sizeof(response), "Error: File '%s' not found\n", filename);
+                send(client_sock, response, strlen(response), 0);
+            } else if (strcmp(meta.owner, username) != 0) {
+                snprintf(response, sizeof(response), "Error: Only the owner can grant access to '%s'\n", filename);
+                send(client_sock, response, strlen(response), 0);
             } else {
-                // Check if file exists and requester is the owner
-                FileMetadata meta;
-                if (read_metadata_file(filename, &meta) != 0) {
-                    snprintf(response, sizeof(response), "Error: File '%s' not found\n", filename);
-                    send(client_sock, response, strlen(response), 0);
-                } else if (strcmp(meta.owner, username) != 0) {
-                    snprintf(response, sizeof(response), "Error: Only the owner can revoke access to '%s'\n", filename);
-                    send(client_sock, response, strlen(response), 0);
-                } else if (strcmp(target_user, username) == 0) {
-                    snprintf(response, sizeof(response), "Error: Cannot revoke owner's access\n");
-                    send(client_sock, response, strlen(response), 0);
-                } else {
-                    // Remove access
-                    int result = remove_all_access(filename, target_user);
+                // Add access
+                int result = -1;
+                if (strcmp(flag, "-R") == 0) {
+                    result = add_read_access(filename, target_user);
                     if (result == 0) {
-                        snprintf(response, sizeof(response), "Success: All access revoked for '%s' on file '%s'\n", target_user, filename);
+                        snprintf(response, sizeof(response), "Success: Read access granted to '%s' for file '%s'\n", target_user, filename);
                     } else {
-                        snprintf(response, sizeof(response), "Error: Failed to revoke access\n");
+                        snprintf(response, sizeof(response), "Info: User '%s' already has read access to '%s'\n", target_user, filename);
                     }
-                    send(client_sock, response, strlen(response), 0);
+                } else if (strcmp(flag, "-W") == 0) {
+                    result = add_write_access(filename, target_user);
+                    if (result == 0) {
+                        snprintf(response, sizeof(response), "Success: Write access granted to '%s' for file '%s'\n", target_user, filename);
+                    } else {
+                        snprintf(response, sizeof(response), "Info: User '%s' already has write access to '%s'\n", target_user, filename);
+                    }
+                } else {
+                    snprintf(response, sizeof(response), "Error: Invalid flag '%s'. Use -R for read or -W for write\n", flag);
                 }
+                send(client_sock, response, strlen(response), 0);
             }
         }
-        else {
-            char msg[] = "Invalid command.\n";
+    }
+    else if (strncmp(buffer, "REMACCESS ", 10) == 0) {
+        // Parse: REMACCESS <filename> <target_username>
+        char filename[256], target_user[64];
+        char response[512];
+        
+        if (sscanf(buffer + 10, "%s %s", filename, target_user) != 2) {
+            char msg[] = "Usage: REMACCESS <filename> <target_username>\n";
             send(client_sock, msg, strlen(msg), 0);
+        } else {
+            // Check if file exists and requester is the owner
+            FileMetadata meta;
+            if (read_metadata_file(filename, &meta) != 0) {
+                snprintf(response, sizeof(response), "Error: File '%s' not found\n", filename);
+                send(client_sock, response, strlen(response), 0);
+            } else if (strcmp(meta.owner, username) != 0) {
+                snprintf(response, sizeof(response), "Error: Only the owner can revoke access to '%s'\n", filename);
+                send(client_sock, response, strlen(response), 0);
+            } else if (strcmp(target_user, username) == 0) {
+                snprintf(response, sizeof(response), "Error: Cannot revoke owner's access\n");
+                send(client_sock, response, strlen(response), 0);
+            } else {
+                // Remove access
+                int result = remove_all_access(filename, target_user);
+                if (result == 0) {
+                    snprintf(response, sizeof(response), "Success: All access revoked for '%s' on file '%s'\n", target_user, filename);
+                } else {
+                    snprintf(response, sizeof(response), "Error: Failed to revoke access\n");
+                }
+                send(client_sock, response, strlen(response), 0);
+            }
         }
+    }
+    else {
+        char msg[] = "Invalid command.\n";
+        send(client_sock, msg, strlen(msg), 0);
+    }
+    if (held[0]) tier_release(held);
+}
 
-        close(client_sock);
-        exit(0); // Child process exits after handling the client
+int main() {
+    printf("Starting Storage Server...\n");
+    int ss_id = register_with_name_server();
+    g_storage_id = ss_id; // make ID available to other translation units
+    initialize_storage_folders(ss_id);
+    commit_recover();
+    // The Name Server builds its index of this server from a VIEW right after registering,
+    // which must already list the cold documents
+    tier_init();
+    chunkstore_init();
+    checkpoint_index_init(ss_id);
+    if (meta_store_open(ss_id) != 0) {
+        printf("Failed to open metadata store. Exiting.\n");
+        exit(1);
     }
+    acl_cache_init();
+    int MY_PORT = STORAGE_SERVER_PORT + ss_id;
+    printf("Storage folder created: %s\n", STORAGE_BASE);
 
-    close(server_fd);
-    return 0;
-}
\ No newline at end of file
+    search_init();      // after tier_init: cold documents stay indexed
+    atime_init();
+    tier_start();
+    dispatch_run(MY_PORT, handle_request);   // only returns if the listening socket fails
+    exit(1);
+}
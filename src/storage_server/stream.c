@@ -1,49 +1,476 @@
-#ifndef _XOPEN_SOURCE
-#define _XOPEN_SOURCE 500
-#endif
-
 #include "../../include/common.h"
+#include "../../include/stream.h"
 #include "../../include/acl.h"
-#include <unistd.h>
-#include <time.h>  // for nanosleep()
-
-void stream_file(int client_sock, const char *filename, const char *username) {
-    // Check read access
-    if (!check_read_access(filename, username)) {
-        char msg[256];
-        sprintf(msg, "ERROR: Access denied. You do not have permission to stream '%s'.\n", filename);
-        send(client_sock, msg, strlen(msg), 0);
+#include "../../include/atime.h"
+#include "../../include/commit.h"
+#include "../../include/tier.h"
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/sendfile.h>
+
+#define STREAM_READ_CHUNK (64 * 1024)
+
+typedef struct {
+    char name[256];
+    int fd;                     // copy taken at the start; -1 if it cannot be streamed (error says why)
+    char error[96];
+    char version[STREAM_VERSION_MAX];   // of the copy: size and mtime
+} StreamDoc;
+
+typedef struct Stream {
+    struct Stream *next;        // in its wheel slot
+    int sock;
+    StreamDoc *docs;            // the document, or MSTREAM's documents in order
+    size_t ndocs, cur;
+    int multi;                  // MSTREAM: FILE / DONE / ERROR frames (common.h)
+    unsigned rate;              // words per second
+    unsigned rounds;            // wheel turns left before it is due
+    uint64_t last_tick;         // words are credited for the ticks since
+    double credit;              // words earned and not sent yet
+    char *in;                   // window of the file being scanned for words
+    size_t in_len, in_pos;
+    uint64_t base;              // file offset of in[0]
+    int cursor;                 // framed output (STREAM_CURSOR_MARK)
+    int eof, ended;             // document exhausted / last bytes queued
+    char *out;                  // bytes waiting for the socket
+    size_t out_len, out_sent;
+} Stream;
+
+// The wheel: a stream due in d ticks sits in slot (tick + d) % STREAM_WHEEL_SLOTS with
+// (d - 1) / STREAM_WHEEL_SLOTS turns to wait. Only the pacer thread takes streams out.
+static pthread_mutex_t wheel_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wheel_cond = PTHREAD_COND_INITIALIZER;
+static pthread_once_t pacer_once = PTHREAD_ONCE_INIT;
+static Stream *wheel[STREAM_WHEEL_SLOTS];
+static uint64_t wheel_tick;
+static size_t active;
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+// Caller holds wheel_lock
+static void schedule(Stream *s, unsigned delay) {
+    Stream **slot = &wheel[(wheel_tick + delay) % STREAM_WHEEL_SLOTS];
+    s->rounds = (delay - 1) / STREAM_WHEEL_SLOTS;
+    s->next = *slot;
+    *slot = s;
+}
+
+// Next whitespace-separated word, as [*word, *word + *len) inside s->in; 0 at the end
+static int next_word(Stream *s, const char **word, size_t *len) {
+    while (1) {
+        while (s->in_pos < s->in_len && isspace((unsigned char)s->in[s->in_pos])) s->in_pos++;
+        size_t end = s->in_pos;
+        while (end < s->in_len && !isspace((unsigned char)s->in[end])) end++;
+        // A word running into the end of the window may continue past it, unless the
+        // window is already full of it
+        if (end > s->in_pos && (end < s->in_len || s->eof || (s->in_pos == 0 && s->in_len == STREAM_READ_CHUNK))) {
+            *word = s->in + s->in_pos;
+            *len = end - s->in_pos;
+            s->in_pos = end;
+            return 1;
+        }
+        if (s->eof) return 0;
+        memmove(s->in, s->in + s->in_pos, s->in_len - s->in_pos);
+        s->in_len -= s->in_pos;
+        s->base += s->in_pos;
+        s->in_pos = 0;
+        ssize_t n = read(s->docs[s->cur].fd, s->in + s->in_len, STREAM_READ_CHUNK - s->in_len);
+        if (n <= 0) s->eof = 1;
+        else s->in_len += (size_t)n;
+    }
+}
+
+// Send what is queued without blocking. 0: all sent or the socket is full, -1: gone.
+static int flush(Stream *s) {
+    while (s->out_sent < s->out_len) {
+        ssize_t n = send(s->sock, s->out + s->out_sent, s->out_len - s->out_sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n > 0) {
+            s->out_sent += (size_t)n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else {
+            return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+    }
+    s->out_len = s->out_sent = 0;
+    return 0;
+}
+
+// MSTREAM: move on to the next document that can be streamed, reporting those that cannot
+static void next_doc(Stream *s) {
+    while (s->cur < s->ndocs && s->docs[s->cur].fd < 0) {
+        s->out_len += (size_t)sprintf(s->out + s->out_len, "ERROR %s %s\n", s->docs[s->cur].name,
+                                      s->docs[s->cur].error);
+        s->cur++;
+    }
+    s->in_len = s->in_pos = 0;
+    s->base = 0;
+    s->eof = 0;
+    if (s->cur == s->ndocs) s->ended = 1;
+}
+
+// One turn of a due stream: send the words it has earned as a single write. Returns the
+// ticks until its next turn, or 0 when it is finished (or the client went away).
+static unsigned stream_turn(Stream *s, uint64_t tick) {
+    if (s->out_len > 0) {
+        // The client has not taken the last batch yet; earn nothing while it catches up
+        s->last_tick = tick;
+        if (flush(s) != 0) return 0;
+        if (s->out_len > 0) return 1;
+    }
+    if (s->ended) return 0;
+
+    s->credit += (double)(tick - s->last_tick) * s->rate * STREAM_TICK_MS / 1000.0;
+    s->last_tick = tick;
+    // Words go in after room for their frame header, which is filled in once their
+    // length and the resume offset are known
+    size_t room = s->cursor || s->multi ? STREAM_FRAME_ROOM : 0;
+    s->out_sent = s->out_len = room;
+    const char *word;
+    size_t len;
+    int exhausted = 0;
+    while (s->credit >= 1.0 && s->out_len - room < STREAM_BATCH_MAX) {
+        if (!next_word(s, &word, &len)) {
+            exhausted = 1;
+            break;
+        }
+        memcpy(s->out + s->out_len, word, len);
+        s->out[s->out_len + len] = ' ';
+        s->out_len += len + 1;
+        s->credit -= 1.0;
+    }
+    if (room && s->out_len > room) {
+        char head[STREAM_FRAME_ROOM];
+        int n = s->multi ? snprintf(head, sizeof(head), "FILE %s %zu\n", s->docs[s->cur].name, s->out_len - room)
+                         : snprintf(head, sizeof(head), "%cW %zu %llu\n", STREAM_CURSOR_MARK, s->out_len - room,
+                                    (unsigned long long)(s->base + s->in_pos));
+        s->out_sent = room - (size_t)n;
+        memcpy(s->out + s->out_sent, head, (size_t)n);
+    }
+    if (exhausted && s->multi) {
+        // This document is done; the next one starts on the next turn
+        s->out_len += (size_t)sprintf(s->out + s->out_len, "DONE %s\n", s->docs[s->cur].name);
+        s->cur++;
+        next_doc(s);
+        if (!s->ended && s->credit >= 1.0) {
+            if (flush(s) != 0) return 0;
+            return 1;
+        }
+    } else if (exhausted) {
+        // Out of words with credit to spare: the document is done
+        if (s->cursor) {
+            s->out[s->out_len++] = STREAM_CURSOR_MARK;
+            memcpy(s->out + s->out_len, "E\n", 2);
+            s->out_len += 2;
+        }
+        memcpy(s->out + s->out_len, STREAM_END_MARK, strlen(STREAM_END_MARK));
+        s->out_len += strlen(STREAM_END_MARK);
+        s->ended = 1;
+    }
+    if (flush(s) != 0) return 0;
+    if (s->out_len > 0 || s->credit >= 1.0) return 1;
+    if (s->ended) return 0;
+
+    // Ticks until the next word is earned
+    double ticks = (1.0 - s->credit) * 1000.0 / ((double)s->rate * STREAM_TICK_MS);
+    return ticks < 1.0 ? 1 : (unsigned)(ticks + 0.999);
+}
+
+static void stream_free(Stream *s) {
+    if (s->sock >= 0) close(s->sock);
+    for (size_t i = 0; i < s->ndocs; ++i) {
+        if (s->docs[i].fd >= 0) close(s->docs[i].fd);
+    }
+    free(s->docs);
+    free(s->in);
+    free(s->out);
+    free(s);
+}
+
+static void stream_close(Stream *s) {
+    if (!s->ended || s->out_len > 0) printf("Client disconnected during stream.\n");
+    for (size_t i = 0; i < s->ndocs; ++i) {
+        if (s->docs[i].fd >= 0) atime_touch(s->docs[i].name);
+    }
+    stream_free(s);
+}
+
+static void *pacer_main(void *arg) {
+    (void)arg;
+    uint64_t next = now_ms();
+    pthread_mutex_lock(&wheel_lock);
+    while (1) {
+        while (active == 0) {
+            pthread_cond_wait(&wheel_cond, &wheel_lock);
+            next = now_ms();
+        }
+        pthread_mutex_unlock(&wheel_lock);
+
+        next += STREAM_TICK_MS;
+        uint64_t now = now_ms();
+        if (next > now) {
+            struct timespec ts = {(time_t)((next - now) / 1000), (long)((next - now) % 1000) * 1000000L};
+            nanosleep(&ts, NULL);
+        } else if (now - next > 1000) {
+            next = now;     // far behind (e.g. suspended): do not replay the missed ticks
+        }
+
+        pthread_mutex_lock(&wheel_lock);
+        uint64_t tick = ++wheel_tick;
+        Stream **slot = &wheel[tick % STREAM_WHEEL_SLOTS];
+        Stream *s = *slot, *due = NULL;
+        *slot = NULL;
+        while (s) {
+            Stream *following = s->next;
+            if (s->rounds > 0) {
+                s->rounds--;
+                s->next = *slot;
+                *slot = s;
+            } else {
+                s->next = due;
+                due = s;
+            }
+            s = following;
+        }
+        pthread_mutex_unlock(&wheel_lock);
+
+        while (due) {
+            s = due;
+            due = s->next;
+            unsigned delay = stream_turn(s, tick);
+            pthread_mutex_lock(&wheel_lock);
+            if (delay) schedule(s, delay);
+            else active--;
+            pthread_mutex_unlock(&wheel_lock);
+            if (!delay) stream_close(s);
+        }
+        pthread_mutex_lock(&wheel_lock);
+    }
+    return NULL;
+}
+
+static void start_pacer(void) {
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, pacer_main, NULL) != 0) {
+        perror("stream pacer");
         return;
     }
-    
-    char path[512];
-    sprintf(path, "%s/storage%d/files/%s", STORAGE_DIR, get_storage_id(), filename);
+    pthread_detach(tid);
+}
+
+// Send all of [pos, end) of fd with sendfile(); -1 if the client went away
+static int send_span(int sock, int fd, off_t pos, off_t end) {
+    while (pos < end) {
+        ssize_t n = sendfile(sock, fd, &pos, (size_t)(end - pos));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+    }
+    return 0;
+}
+
+// RATE MAX: the rest of each document goes out with sendfile(), corked so frame headers
+// and the end marker share segments with it
+static void stream_unthrottled(int client_sock, Stream *s) {
+    int on = 1, off = 0, gone = 0;
+    setsockopt(client_sock, IPPROTO_TCP, TCP_CORK, &on, sizeof(on));
+    for (; s->cur < s->ndocs && !gone; s->cur++) {
+        StreamDoc *d = &s->docs[s->cur];
+        char head[STREAM_FRAME_ROOM];
+        int n = 0;
+        struct stat st;
+        if (d->fd < 0 || fstat(d->fd, &st) != 0) {
+            n = snprintf(head, sizeof(head), "ERROR %s %s\n", d->name, d->fd < 0 ? d->error : "Cannot read file");
+            gone = send(client_sock, head, (size_t)n, MSG_NOSIGNAL) != n;
+            continue;
+        }
+        off_t pos = (off_t)(s->base + s->in_pos);
+        if (pos > st.st_size) pos = st.st_size;
+        if (s->multi) {
+            for (; pos < st.st_size && !gone; pos += n) {
+                n = st.st_size - pos < MULTI_PIECE_MAX ? (int)(st.st_size - pos) : MULTI_PIECE_MAX;
+                int h = snprintf(head, sizeof(head), "FILE %s %d\n", d->name, n);
+                gone = send(client_sock, head, (size_t)h, MSG_NOSIGNAL) != h ||
+                       send_span(client_sock, d->fd, pos, pos + n) != 0;
+            }
+            n = snprintf(head, sizeof(head), "DONE %s\n", d->name);
+            if (!gone) gone = send(client_sock, head, (size_t)n, MSG_NOSIGNAL) != n;
+        } else {
+            if (s->cursor) {
+                n = snprintf(head, sizeof(head), "%cB %llu %llu\n", STREAM_CURSOR_MARK,
+                             (unsigned long long)(st.st_size - pos), (unsigned long long)st.st_size);
+                gone = send(client_sock, head, (size_t)n, MSG_NOSIGNAL) != n;
+            }
+            if (!gone) gone = send_span(client_sock, d->fd, pos, st.st_size) != 0;
+            if (s->cursor && !gone) {
+                char end[] = {STREAM_CURSOR_MARK, 'E', '\n'};
+                gone = send(client_sock, end, sizeof(end), MSG_NOSIGNAL) != (ssize_t)sizeof(end);
+            }
+            if (!gone) {
+                gone = send(client_sock, STREAM_END_MARK, strlen(STREAM_END_MARK), MSG_NOSIGNAL) !=
+                       (ssize_t)strlen(STREAM_END_MARK);
+            }
+        }
+        atime_touch(d->name);
+        s->base = s->in_pos = 0;
+    }
+    if (gone) printf("Client disconnected during stream.\n");
+    setsockopt(client_sock, IPPROTO_TCP, TCP_CORK, &off, sizeof(off));
+}
 
-    FILE *fp = fopen(path, "r");
-    if (!fp) {
-        char msg[256];
-        sprintf(msg, "ERROR: Cannot open file '%s'\n", filename);
+// Open the documents (the caller has checked nothing yet) and hand the stream over: RATE
+// MAX runs here, a paced stream moves to the pacer
+static void stream_start(int client_sock, Stream *s, const char *username, const StreamRequest *req) {
+    for (size_t i = 0; i < s->ndocs; ++i) {
+        StreamDoc *d = &s->docs[i];
+        d->fd = -1;
+        if (!check_read_access(d->name, username)) {
+            snprintf(d->error, sizeof(d->error), "Access denied");
+            continue;
+        }
+        char path[512];
+        snprintf(path, sizeof(path), "%s/storage%d/files/%s", STORAGE_DIR, get_storage_id(), d->name);
+        // STREAM's one document was promoted by the dispatcher; MSTREAM's are promoted here
+        // just for the open, the descriptor keeping them readable afterwards
+        if (s->multi && tier_acquire(d->name) != 0) {
+            tier_release(d->name);
+            snprintf(d->error, sizeof(d->error), "Archived and could not be restored");
+            continue;
+        }
+        // Streamed from a copy, so commits (which rewrite in place) neither wait for the
+        // client nor change the bytes under it
+        commit_read_lock(d->name);
+        int fd = open(path, O_RDONLY);
+        struct stat st;
+        CommitSnapshot snap;
+        if (fd >= 0 && fstat(fd, &st) == 0 && commit_snapshot(fd, 0, (uint64_t)st.st_size, 0, &snap) == 0) {
+            d->fd = snap.fd;
+            snprintf(d->version, sizeof(d->version), "%llu-%lld.%09ld", (unsigned long long)st.st_size,
+                     (long long)st.st_mtim.tv_sec, (long)st.st_mtim.tv_nsec);
+        }
+        if (fd >= 0) close(fd);
+        commit_read_unlock(d->name);
+        if (s->multi) tier_release(d->name);
+        if (d->fd < 0) snprintf(d->error, sizeof(d->error), "Cannot open file");
+    }
+    if (!s->multi && s->docs[0].fd < 0) {
+        char msg[512];
+        if (strcmp(s->docs[0].error, "Access denied") == 0) {
+            snprintf(msg, sizeof(msg), "ERROR: Access denied. You do not have permission to stream '%s'.\n", s->docs[0].name);
+        } else {
+            snprintf(msg, sizeof(msg), "ERROR: Cannot open file '%s'\n", s->docs[0].name);
+        }
         send(client_sock, msg, strlen(msg), 0);
+        stream_free(s);
         return;
     }
+    s->rate = req->rate;
+    s->cursor = req->cursor && !s->multi;
 
-    char word[252], buffer[256];
-    while (fscanf(fp, "%251s", word) == 1) {
-        int len = snprintf(buffer, sizeof(buffer), "%s ", word);
-        if (len < 0 || len >= (int)sizeof(buffer)) continue;
-
-        if (send(client_sock, buffer, strlen(buffer), 0) <= 0) {
+    // A resume continues the bytes of the version it started on, or not at all
+    if (!s->multi && req->version[0] && strcmp(req->version, s->docs[0].version) != 0) {
+        char msg[512];
+        snprintf(msg, sizeof(msg), "ERROR: '%s' has changed since the stream started; cannot resume it\n",
+                 s->docs[0].name);
+        send(client_sock, msg, strlen(msg), MSG_NOSIGNAL);
+        stream_free(s);
+        return;
+    }
+    if (s->cursor) {
+        char head[STREAM_FRAME_ROOM];
+        int n = snprintf(head, sizeof(head), "%cV %s\n", STREAM_CURSOR_MARK, s->docs[0].version);
+        if (send(client_sock, head, (size_t)n, MSG_NOSIGNAL) != n) {
             printf("Client disconnected during stream.\n");
-            break;
+            stream_free(s);
+            return;
         }
+    }
+
+    // Start position (STREAM only): a byte offset is a seek; n words have to be scanned past
+    if (req->start_at_byte) {
+        s->base = req->start;
+        if (lseek(s->docs[0].fd, (off_t)req->start, SEEK_SET) < 0) s->eof = 1;
+    } else if (req->start) {
+        const char *word;
+        size_t len;
+        for (uint64_t i = 0; i < req->start && next_word(s, &word, &len); ++i) {}
+    }
+
+    if (req->rate == 0) {
+        stream_unthrottled(client_sock, s);
+        stream_free(s);
+        return;
+    }
+
+    // Paced: the pacer takes over a duplicate of the connection, so the worker is free
+    // once this returns (the dispatcher closing client_sock leaves the duplicate open)
+    s->sock = dup(client_sock);
+    if (s->sock < 0) {
+        stream_free(s);
+        char msg[] = "ERROR: Server out of resources for streaming\n";
+        send(client_sock, msg, strlen(msg), 0);
+        return;
+    }
+    if (s->multi) next_doc(s);  // report leading documents that cannot be streamed
+    s->credit = 1.0;            // the first word goes out on the first tick
+
+    pthread_once(&pacer_once, start_pacer);
+    pthread_mutex_lock(&wheel_lock);
+    s->last_tick = wheel_tick;
+    schedule(s, 1);
+    active++;
+    pthread_cond_signal(&wheel_cond);
+    pthread_mutex_unlock(&wheel_lock);
+}
 
-        // ✅ 0.1 second delay (nanosleep = POSIX safe)
-        struct timespec ts = {0, 100000000L};
-        nanosleep(&ts, NULL);
+static Stream *stream_alloc(size_t ndocs) {
+    Stream *s = calloc(1, sizeof(Stream));
+    if (!s) return NULL;
+    s->sock = -1;
+    s->docs = calloc(ndocs, sizeof(StreamDoc));
+    s->in = malloc(STREAM_READ_CHUNK);
+    s->out = malloc(STREAM_FRAME_ROOM + STREAM_BATCH_MAX + STREAM_READ_CHUNK + sizeof(STREAM_END_MARK) + 3 +
+                    MULTI_MAX_FILES * (sizeof(((StreamDoc *)0)->name) + sizeof(((StreamDoc *)0)->error) + 8));
+    if (!s->docs || !s->in || !s->out) {
+        free(s->docs);
+        free(s->in);
+        free(s->out);
+        free(s);
+        return NULL;
     }
+    for (size_t i = 0; i < ndocs; ++i) s->docs[i].fd = -1;
+    s->ndocs = ndocs;
+    return s;
+}
 
-    fclose(fp);
+void stream_file(int client_sock, const char *filename, const char *username, const StreamRequest *req) {
+    Stream *s = stream_alloc(1);
+    if (!s) {
+        char msg[] = "ERROR: Server out of resources for streaming\n";
+        send(client_sock, msg, strlen(msg), 0);
+        return;
+    }
+    snprintf(s->docs[0].name, sizeof(s->docs[0].name), "%s", filename);
+    stream_start(client_sock, s, username, req);
+}
 
-    char done[] = "\n--- End of Stream ---\n";
-    send(client_sock, done, strlen(done), 0);
+void stream_files(int client_sock, char *const *filenames, size_t count, const char *username, unsigned rate) {
+    Stream *s = count > 0 && count <= MULTI_MAX_FILES ? stream_alloc(count) : NULL;
+    if (!s) {
+        char msg[] = "ERROR: Server out of resources for streaming\n";
+        send(client_sock, msg, strlen(msg), 0);
+        return;
+    }
+    s->multi = 1;
+    for (size_t i = 0; i < count; ++i) snprintf(s->docs[i].name, sizeof(s->docs[i].name), "%s", filenames[i]);
+    StreamRequest req = {rate, 0, 0, 0, ""};
+    stream_start(client_sock, s, username, &req);
 }
@@ -0,0 +1,593 @@
+#include "../../include/common.h"
+#include "../../include/tier.h"
+#include "../../include/atime.h"
+#include "../../include/compress.h"
+#include "../../include/doccount.h"
+#include "../../include/meta_store.h"
+#include "../../include/search.h"
+#include <fcntl.h>
+#include <pthread.h>
+
+#define TIER_BUCKETS 1024
+
+typedef struct {
+    char magic[4];
+    uint32_t name_len;
+    uint64_t raw_len;       // document bytes; TIER_TOMBSTONE: the document is hot again
+    uint64_t stored_len;    // payload bytes (raw_len if stored uncompressed)
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint32_t words;
+    uint32_t mode;
+    uint64_t sum;           // FNV-1a over the fields above, the name and the raw document
+} TierRecord;
+
+// A document the tier knows about: cold, or hot and held by running commands
+typedef struct TierEntry {
+    struct TierEntry *next;
+    char filename[256];
+    int busy;               // commands holding it (tier_acquire); never demoted while > 0
+    int cold;
+    int promoting;          // being restored; other commands on it wait on tier_cond
+    uint64_t offset;        // its record in the archive, while cold
+    uint64_t rec_len;
+    TierInfo info;
+} TierEntry;
+
+// Locks, in the order they are taken:
+//   archive_rw    promotions reading a record (shared) / compaction swapping the archive
+//   archive_lock  appends; archive_fd and archive_size change only under it
+//   tier_lock     the index and counters, never held across document or archive I/O, so
+//                 one promotion or demotion does not stall commands on other documents
+static pthread_rwlock_t archive_rw = PTHREAD_RWLOCK_INITIALIZER;
+static pthread_mutex_t archive_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t tier_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t tier_cond = PTHREAD_COND_INITIALIZER;
+static TierEntry *entries[TIER_BUCKETS];
+static int archive_fd = -1;
+static uint64_t archive_size, dead_bytes;
+static size_t cold_count;
+static uint64_t cold_raw, cold_packed;
+static unsigned long demoted, promoted;
+static long cold_after = TIER_DEFAULT_COLD_AFTER;
+
+static void archive_path(char *buf, size_t sz, const char *suffix) {
+    snprintf(buf, sz, "%s/storage%d/cold/archive%s", STORAGE_DIR, get_storage_id(), suffix);
+}
+
+static void document_path(char *buf, size_t sz, const char *filename) {
+    snprintf(buf, sz, "%s/storage%d/files/%s", STORAGE_DIR, get_storage_id(), filename);
+}
+
+static uint64_t fnv(uint64_t h, const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char *)data;
+    for (size_t i = 0; i < len; ++i) h = (h ^ p[i]) * 1099511628211ull;
+    return h;
+}
+
+static uint64_t record_sum(const TierRecord *r, const char *name, const char *doc) {
+    uint64_t h = fnv(14695981039346656037ull, r, offsetof(TierRecord, sum));
+    h = fnv(h, name, r->name_len);
+    return r->raw_len == TIER_TOMBSTONE ? h : fnv(h, doc, (size_t)r->raw_len);
+}
+
+// Caller holds tier_lock
+static TierEntry *find_entry(const char *filename, int create) {
+    uint32_t h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)filename; *p; ++p) h = (h ^ *p) * 16777619u;
+    TierEntry **slot = &entries[h % TIER_BUCKETS];
+    TierEntry *e = *slot;
+    while (e && strcmp(e->filename, filename) != 0) e = e->next;
+    if (!e && create && strlen(filename) < sizeof(e->filename) && (e = calloc(1, sizeof(TierEntry))) != NULL) {
+        strcpy(e->filename, filename);
+        e->next = *slot;
+        *slot = e;
+    }
+    return e;
+}
+
+// Caller holds tier_lock; entries neither cold nor held are not kept
+static void drop_if_idle(TierEntry *e) {
+    if (e->cold || e->busy > 0) return;
+    uint32_t h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)e->filename; *p; ++p) h = (h ^ *p) * 16777619u;
+    TierEntry **slot = &entries[h % TIER_BUCKETS];
+    while (*slot && *slot != e) slot = &(*slot)->next;
+    if (*slot) *slot = e->next;
+    free(e);
+}
+
+static int write_at(int fd, const void *data, size_t len, off_t off) {
+    const char *p = (const char *)data;
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, off);
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+        off += n;
+    }
+    return 0;
+}
+
+static int read_at(int fd, void *data, size_t len, off_t off) {
+    char *p = (char *)data;
+    while (len > 0) {
+        ssize_t n = pread(fd, p, len, off);
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+        off += n;
+    }
+    return 0;
+}
+
+static void mark_hot(TierEntry *e) {
+    cold_count--;
+    cold_raw -= e->info.size;
+    cold_packed -= e->rec_len;
+    dead_bytes += e->rec_len;
+    e->cold = 0;
+}
+
+static void mark_cold(TierEntry *e, uint64_t offset, uint64_t rec_len, const TierInfo *info) {
+    if (e->cold) mark_hot(e);
+    e->cold = 1;
+    e->offset = offset;
+    e->rec_len = rec_len;
+    e->info = *info;
+    cold_count++;
+    cold_raw += info->size;
+    cold_packed += rec_len;
+}
+
+// Caller holds archive_lock: add data at the end of the archive; *at gets its offset
+static int append_record(const void *data, size_t len, uint64_t *at) {
+    if (write_at(archive_fd, data, len, (off_t)archive_size) != 0) return -1;
+    if (at) *at = archive_size;
+    archive_size += len;
+    return 0;
+}
+
+// Caller holds archive_lock. The document is hot again; a lost tombstone is harmless,
+// since the copy in files/ wins at startup. Returns the bytes appended (0 on failure).
+static size_t append_tombstone(const char *filename) {
+    char rec[sizeof(TierRecord) + 256];
+    TierRecord r;
+    memset(&r, 0, sizeof(r));
+    memcpy(r.magic, TIER_MAGIC, 4);
+    r.name_len = (uint32_t)strlen(filename);
+    r.raw_len = TIER_TOMBSTONE;
+    r.sum = record_sum(&r, filename, NULL);
+    memcpy(rec, &r, sizeof(r));
+    memcpy(rec + sizeof(r), filename, r.name_len);
+    return append_record(rec, sizeof(r) + r.name_len, NULL) == 0 ? sizeof(r) + r.name_len : 0;
+}
+
+// Write the document back to files/ (via swap/, then rename). Called without tier_lock,
+// with e->promoting set: e stays cold and held until the caller clears it.
+static int promote(TierEntry *e) {
+    pthread_rwlock_rdlock(&archive_rw);
+    pthread_mutex_lock(&tier_lock);
+    uint64_t offset = e->offset;        // only compaction moves it, under archive_rw
+    pthread_mutex_unlock(&tier_lock);
+
+    TierRecord r;
+    char name[256];
+    char *doc = NULL, *packed = NULL;
+    int rc = -1;
+    if (read_at(archive_fd, &r, sizeof(r), (off_t)offset) == 0 && memcmp(r.magic, TIER_MAGIC, 4) == 0 &&
+        r.name_len < sizeof(name) && r.stored_len <= r.raw_len &&
+        read_at(archive_fd, name, r.name_len, (off_t)(offset + sizeof(r))) == 0) {
+        name[r.name_len] = '\0';
+        doc = malloc((size_t)r.raw_len + 1);
+        packed = doc && r.stored_len < r.raw_len ? malloc((size_t)r.stored_len + 1) : NULL;
+        char *dst = r.stored_len < r.raw_len ? packed : doc;
+        rc = dst && strcmp(name, e->filename) == 0 &&
+             read_at(archive_fd, dst, (size_t)r.stored_len, (off_t)(offset + sizeof(r) + r.name_len)) == 0 ? 0 : -1;
+    }
+    pthread_rwlock_unlock(&archive_rw);
+    if (rc == 0) {
+        rc = (r.stored_len == r.raw_len ||
+              lz_decompress(LZ_COLD, packed, (size_t)r.stored_len, doc, (size_t)r.raw_len) == 0) &&
+             record_sum(&r, name, doc) == r.sum ? 0 : -1;
+    }
+    free(packed);
+
+    char tmp[512], path[512];
+    snprintf(tmp, sizeof(tmp), "%s/storage%d/swap/%s.promote", STORAGE_DIR, get_storage_id(), e->filename);
+    document_path(path, sizeof(path), e->filename);
+    int fd = rc == 0 ? open(tmp, O_WRONLY | O_CREAT | O_TRUNC, r.mode ? (mode_t)(r.mode & 0777) : 0644) : -1;
+    struct timespec times[2] = {{0, UTIME_OMIT}, {(time_t)r.mtime_sec, (long)r.mtime_nsec}};
+    rc = fd >= 0 && write_at(fd, doc, (size_t)r.raw_len, 0) == 0 && futimens(fd, times) == 0 && fsync(fd) == 0 ? 0 : -1;
+    if (fd >= 0 && close(fd) != 0) rc = -1;
+    if (rc == 0) rc = rename(tmp, path);
+    if (rc != 0 && fd >= 0) unlink(tmp);
+    free(doc);
+    if (rc != 0) return -1;
+
+    pthread_mutex_lock(&archive_lock);
+    size_t tomb = append_tombstone(e->filename);
+    pthread_mutex_lock(&tier_lock);
+    dead_bytes += tomb;
+    mark_hot(e);
+    promoted++;
+    pthread_mutex_unlock(&tier_lock);
+    pthread_mutex_unlock(&archive_lock);
+    printf("[TIER] Promoted '%s' (%llu bytes)\n", e->filename, (unsigned long long)r.raw_len);
+    return 0;
+}
+
+int tier_acquire(const char *filename) {
+    pthread_mutex_lock(&tier_lock);
+    TierEntry *e = find_entry(filename, 1);
+    int rc = 0;
+    if (e) {
+        e->busy++;
+        while (e->promoting) pthread_cond_wait(&tier_cond, &tier_lock);
+        if (e->cold) {
+            // Restore it without the lock; commands on this document wait for the outcome
+            e->promoting = 1;
+            pthread_mutex_unlock(&tier_lock);
+            rc = promote(e);
+            pthread_mutex_lock(&tier_lock);
+            e->promoting = 0;
+            pthread_cond_broadcast(&tier_cond);
+            if (rc != 0) printf("[TIER] Could not promote '%s'\n", filename);
+        }
+    }
+    pthread_mutex_unlock(&tier_lock);
+    return rc;
+}
+
+void tier_release(const char *filename) {
+    pthread_mutex_lock(&tier_lock);
+    TierEntry *e = find_entry(filename, 0);
+    if (e && e->busy > 0) {
+        e->busy--;
+        drop_if_idle(e);
+    }
+    pthread_mutex_unlock(&tier_lock);
+}
+
+int tier_lookup(const char *filename, TierInfo *info) {
+    pthread_mutex_lock(&tier_lock);
+    TierEntry *e = find_entry(filename, 0);
+    int cold = e && e->cold;
+    if (cold && info) *info = e->info;
+    pthread_mutex_unlock(&tier_lock);
+    return cold;
+}
+
+void tier_foreach(void (*cb)(const char *filename, const TierInfo *info, void *user), void *user) {
+    pthread_mutex_lock(&tier_lock);
+    for (int b = 0; b < TIER_BUCKETS; ++b) {
+        for (TierEntry *e = entries[b]; e; e = e->next) {
+            if (e->cold) cb(e->filename, &e->info, user);
+        }
+    }
+    pthread_mutex_unlock(&tier_lock);
+}
+
+// The document at path is still the one stat'ed as st
+static int unchanged(const char *path, const struct stat *st) {
+    struct stat now;
+    return stat(path, &now) == 0 && now.st_ino == st->st_ino && now.st_size == st->st_size &&
+           now.st_mtim.tv_sec == st->st_mtim.tv_sec && now.st_mtim.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+// Move one idle document into the archive. The copy is taken without the lock; the
+// document is only removed if nothing acquired or changed it in the meantime.
+static int demote(const char *filename) {
+    char path[512];
+    document_path(path, sizeof(path), filename);
+    // SEARCH keeps using the document's postings while it is cold; they must be durable
+    search_index_update(filename);
+    search_index_sync();
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    size_t n = (size_t)st.st_size, name_len = strlen(filename);
+    char *doc = malloc(n + 1);
+    char *rec = malloc(sizeof(TierRecord) + name_len + lz_bound(n));
+    int rc = doc && rec && read_at(fd, doc, n, 0) == 0 ? 0 : -1;
+    close(fd);
+    if (rc != 0) {
+        free(doc);
+        free(rec);
+        return -1;
+    }
+
+    TierRecord r;
+    memset(&r, 0, sizeof(r));
+    memcpy(r.magic, TIER_MAGIC, 4);
+    r.name_len = (uint32_t)name_len;
+    r.raw_len = n;
+    r.mtime_sec = (int64_t)st.st_mtim.tv_sec;
+    r.mtime_nsec = (int64_t)st.st_mtim.tv_nsec;
+    DocCounts counts;
+    doccount_store(filename, &st, doc, n, &counts);     // VIEW / INFO read these while it is cold
+    r.words = (uint32_t)counts.words;
+    r.mode = (uint32_t)(st.st_mode & 0777);
+    char *payload = rec + sizeof(r) + name_len;
+    size_t packed = lz_compress(LZ_COLD, doc, n, payload);
+    if (!packed) memcpy(payload, doc, n);
+    r.stored_len = packed ? packed : n;
+    r.sum = record_sum(&r, filename, doc);
+    free(doc);
+    memcpy(rec, &r, sizeof(r));
+    memcpy(rec + sizeof(r), filename, name_len);
+    size_t rec_len = sizeof(r) + name_len + (size_t)r.stored_len;
+
+    // Appended and synced under archive_lock only; the index is checked before and after
+    pthread_mutex_lock(&archive_lock);
+    pthread_mutex_lock(&tier_lock);
+    TierEntry *e = find_entry(filename, 1);
+    int idle = e && e->busy == 0 && !e->cold && unchanged(path, &st);
+    if (e) drop_if_idle(e);
+    pthread_mutex_unlock(&tier_lock);
+    uint64_t at = 0;
+    int written = idle && append_record(rec, rec_len, &at) == 0 && fdatasync(archive_fd) == 0;
+
+    pthread_mutex_lock(&tier_lock);
+    e = find_entry(filename, 1);
+    rc = -1;
+    if (written && e && e->busy == 0 && !e->cold && unchanged(path, &st) && unlink(path) == 0) {
+        TierInfo info = {n, r.words, st.st_mtime, st.st_mtim.tv_nsec};
+        mark_cold(e, at, rec_len, &info);
+        demoted++;
+        rc = 0;
+    } else if (written) {
+        dead_bytes += rec_len;          // still hot; the copy in files/ wins at startup
+    }
+    if (e) drop_if_idle(e);
+    pthread_mutex_unlock(&tier_lock);
+    pthread_mutex_unlock(&archive_lock);
+    free(rec);
+    if (rc == 0) printf("[TIER] Demoted '%s' (%zu -> %zu bytes)\n", filename, n, rec_len);
+    return rc;
+}
+
+// A cold record as compaction found it, and where it goes in the new archive
+typedef struct {
+    uint64_t offset, rec_len, moved_to;
+    int still_cold;
+    char filename[256];
+} Kept;
+
+static int kept_cmp(const void *a, const void *b) {
+    const Kept *ka = a, *kb = b;
+    return (ka->offset > kb->offset) - (ka->offset < kb->offset);
+}
+
+// Rewrite the archive with only the cold documents' records. Runs on the demotion thread,
+// so no record is added meanwhile, only tombstones. The records are copied from a snapshot
+// of their offsets without any lock; promotions go on reading the old archive until the
+// swap, and the ones promoted meanwhile get a tombstone in the new archive.
+static void compact(void) {
+    pthread_mutex_lock(&tier_lock);
+    size_t n = 0, cap = cold_count;
+    Kept *kept = malloc((cap ? cap : 1) * sizeof(Kept));
+    for (int b = 0; b < TIER_BUCKETS && kept; ++b) {
+        for (TierEntry *e = entries[b]; e && n < cap; e = e->next) {
+            if (!e->cold) continue;
+            kept[n].offset = e->offset;
+            kept[n].rec_len = e->rec_len;
+            strcpy(kept[n].filename, e->filename);
+            n++;
+        }
+    }
+    pthread_mutex_unlock(&tier_lock);
+    if (!kept) return;
+    qsort(kept, n, sizeof(Kept), kept_cmp);
+
+    char path[512], tmp[512];
+    archive_path(path, sizeof(path), "");
+    archive_path(tmp, sizeof(tmp), ".tmp");
+    int fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    uint64_t size = 0;
+    char *buf = NULL;
+    size_t buf_cap = 0;
+    int rc = fd >= 0 ? 0 : -1;
+    for (size_t i = 0; i < n && rc == 0; ++i) {
+        if (kept[i].rec_len > buf_cap) {
+            char *nb = realloc(buf, (size_t)kept[i].rec_len);
+            if (!nb) {
+                rc = -1;
+                break;
+            }
+            buf = nb;
+            buf_cap = (size_t)kept[i].rec_len;
+        }
+        rc = read_at(archive_fd, buf, (size_t)kept[i].rec_len, (off_t)kept[i].offset) == 0 &&
+             write_at(fd, buf, (size_t)kept[i].rec_len, (off_t)size) == 0 ? 0 : -1;
+        kept[i].moved_to = size;
+        size += kept[i].rec_len;
+    }
+    free(buf);
+    if (rc == 0 && fsync(fd) != 0) rc = -1;
+
+    pthread_rwlock_wrlock(&archive_rw);
+    pthread_mutex_lock(&archive_lock);
+    pthread_mutex_lock(&tier_lock);
+    uint64_t old_size = archive_size;
+    for (int b = 0; b < TIER_BUCKETS && rc == 0; ++b) {
+        for (TierEntry *e = entries[b]; e && rc == 0; e = e->next) {
+            if (!e->cold) continue;
+            Kept key = {.offset = e->offset};
+            Kept *k = bsearch(&key, kept, n, sizeof(Kept), kept_cmp);
+            if (k) k->still_cold = 1;
+            else rc = -1;               // not in the snapshot: leave the archive as it is
+        }
+    }
+    int old_fd = archive_fd;
+    if (rc == 0) {
+        // New archive in place: tombstones for the records promoted during the copy
+        archive_fd = fd;
+        archive_size = size;
+        for (size_t i = 0; i < n && rc == 0; ++i) {
+            if (!kept[i].still_cold && append_tombstone(kept[i].filename) == 0) rc = -1;
+        }
+        if (rc == 0 && rename(tmp, path) != 0) rc = -1;
+        if (rc != 0) {
+            archive_fd = old_fd;
+            archive_size = old_size;
+        }
+    }
+    if (rc == 0) {
+        for (int b = 0; b < TIER_BUCKETS; ++b) {
+            for (TierEntry *e = entries[b]; e; e = e->next) {
+                if (!e->cold) continue;
+                Kept key = {.offset = e->offset};
+                e->offset = ((Kept *)bsearch(&key, kept, n, sizeof(Kept), kept_cmp))->moved_to;
+            }
+        }
+        printf("[TIER] Compacted archive: %llu -> %llu bytes\n", (unsigned long long)old_size,
+               (unsigned long long)archive_size);
+        close(old_fd);
+        dead_bytes = archive_size - cold_packed;
+    }
+    pthread_mutex_unlock(&tier_lock);
+    pthread_mutex_unlock(&archive_lock);
+    pthread_rwlock_unlock(&archive_rw);
+    if (rc != 0 && fd >= 0) {
+        close(fd);
+        unlink(tmp);
+    }
+    free(kept);
+}
+
+typedef struct {
+    time_t cutoff;
+    char (*names)[256];
+    size_t count;
+} DemoteScan;
+
+static void collect_cold(const char *name, const FileMetadata *meta, void *user) {
+    DemoteScan *scan = (DemoteScan *)user;
+    if (scan->count >= TIER_BATCH || strlen(name) >= sizeof(scan->names[0])) return;
+    time_t last = atime_effective(name, meta->last_accessed);
+    if (meta->last_modified > last) last = meta->last_modified;
+    if (meta->created_time > last) last = meta->created_time;
+    if (last >= scan->cutoff || tier_lookup(name, NULL)) return;
+    strcpy(scan->names[scan->count++], name);
+}
+
+static void *tier_daemon(void *arg) {
+    (void)arg;
+    unsigned interval = cold_after < TIER_SCAN_INTERVAL ? (unsigned)cold_after : TIER_SCAN_INTERVAL;
+    char (*names)[256] = malloc(TIER_BATCH * sizeof(*names));
+    if (!names) return NULL;
+    while (1) {
+        sleep(interval);
+        DemoteScan scan = {time(NULL) - cold_after, names, 0};
+        meta_store_iter(collect_cold, &scan);
+        for (size_t i = 0; i < scan.count; ++i) demote(names[i]);
+
+        pthread_mutex_lock(&archive_lock);
+        pthread_mutex_lock(&tier_lock);
+        int due = dead_bytes >= TIER_COMPACT_MIN && dead_bytes > archive_size - dead_bytes;
+        pthread_mutex_unlock(&tier_lock);
+        pthread_mutex_unlock(&archive_lock);
+        if (due) compact();
+    }
+    return NULL;
+}
+
+void tier_init(void) {
+    const char *v = getenv("SS_COLD_AFTER");
+    if (v) cold_after = atol(v);
+
+    char path[512];
+    archive_path(path, sizeof(path), "");
+    archive_fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (archive_fd < 0) {
+        perror("tier: archive");
+        return;
+    }
+    struct stat st;
+    if (fstat(archive_fd, &st) != 0) return;
+
+    // Replay the archive; later records for a name supersede earlier ones
+    uint64_t pos = 0, size = (uint64_t)st.st_size;
+    pthread_mutex_lock(&archive_lock);
+    pthread_mutex_lock(&tier_lock);
+    while (pos + sizeof(TierRecord) <= size) {
+        TierRecord r;
+        char name[256];
+        if (read_at(archive_fd, &r, sizeof(r), (off_t)pos) != 0 || memcmp(r.magic, TIER_MAGIC, 4) != 0 ||
+            r.name_len == 0 || r.name_len >= sizeof(name)) {
+            break;
+        }
+        uint64_t payload = r.raw_len == TIER_TOMBSTONE ? 0 : r.stored_len;
+        uint64_t rec_len = sizeof(r) + r.name_len + payload;
+        if (payload > size || pos + rec_len > size ||
+            read_at(archive_fd, name, r.name_len, (off_t)(pos + sizeof(r))) != 0) {
+            break;
+        }
+        name[r.name_len] = '\0';
+        TierEntry *e = find_entry(name, 1);
+        if (e && r.raw_len == TIER_TOMBSTONE) {
+            if (e->cold) mark_hot(e);
+            dead_bytes += rec_len;
+            drop_if_idle(e);
+        } else if (e) {
+            TierInfo info = {r.raw_len, r.words, (time_t)r.mtime_sec, (long)r.mtime_nsec};
+            mark_cold(e, pos, rec_len, &info);
+        }
+        pos += rec_len;
+    }
+    if (pos < size) {
+        printf("[TIER] Discarding %llu torn byte(s) at the end of the archive\n", (unsigned long long)(size - pos));
+        if (ftruncate(archive_fd, (off_t)pos) != 0) perror("tier: truncate");
+    }
+    archive_size = pos;
+
+    // A document in files/ as well was mid-move when the server stopped; that copy wins
+    for (int b = 0; b < TIER_BUCKETS; ++b) {
+        TierEntry *e = entries[b];
+        while (e) {
+            TierEntry *next = e->next;
+            char doc[512];
+            document_path(doc, sizeof(doc), e->filename);
+            if (e->cold && access(doc, F_OK) == 0) {
+                dead_bytes += append_tombstone(e->filename);
+                mark_hot(e);
+                drop_if_idle(e);
+            }
+            e = next;
+        }
+    }
+    printf("[TIER] %zu cold document(s) in the archive\n", cold_count);
+    pthread_mutex_unlock(&tier_lock);
+    pthread_mutex_unlock(&archive_lock);
+}
+
+void tier_start(void) {
+    if (cold_after <= 0 || archive_fd < 0) return;
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, tier_daemon, NULL) != 0) {
+        perror("tier daemon");
+        return;
+    }
+    pthread_detach(tid);
+}
+
+void tier_describe(char *out, size_t sz) {
+    pthread_mutex_lock(&archive_lock);
+    pthread_mutex_lock(&tier_lock);
+    if (cold_after > 0) {
+        snprintf(out, sz,
+                 "Cold tier (after %lds idle): %zu document(s), %llu bytes in %llu archived; "
+                 "archive %llu bytes (%llu reclaimable); %lu demoted, %lu promoted since start\n",
+                 cold_after, cold_count, (unsigned long long)cold_raw, (unsigned long long)cold_packed,
+                 (unsigned long long)archive_size, (unsigned long long)dead_bytes, demoted, promoted);
+    } else {
+        snprintf(out, sz, "Cold tier: off; %zu document(s) still archived, %lu promoted since start\n",
+                 cold_count, promoted);
+    }
+    pthread_mutex_unlock(&tier_lock);
+    pthread_mutex_unlock(&archive_lock);
+}
@@ -1,90 +1,284 @@
 #include "../../include/common.h"
+#include "../../include/undo.h"
 #include "../../include/acl.h"
+#include "../../include/commit.h"
+#include "../../include/compress.h"
+#include "../../include/meta_store.h"
+#include "../../include/search.h"
+#include "../../include/sentidx.h"
+#include <fcntl.h>
 #include <sys/stat.h>
 
-void undo_last_change(int client_sock, const char* filename, const char* username) {
+// Log layout: UndoHeader, then `count` records (UndoRecord, then the old bytes followed by
+// the new bytes, LZ-compressed when that is smaller), oldest first. Entries [0, cursor) can
+// be undone, [cursor, count) redone.
+typedef struct {
+    char magic[4];
+    uint32_t count;
+    uint32_t cursor;
+    uint32_t reserved;
+} UndoHeader;
+
+typedef struct {
+    uint64_t off;           // where the change starts in the document
+    uint64_t old_len;       // bytes there before the commit
+    uint64_t new_len;       // bytes there after it
+    uint64_t at;            // first sentence the commit rewrote
+    int64_t delta;          // sentences it added from there on (negative: removed)
+    uint64_t stored_len;    // body bytes in the log: old_len + new_len, or less if compressed
+    uint64_t sum;           // FNV-1a over the fields above and both (uncompressed) byte strings
+} UndoRecord;
+
+// Bodies shorter than this are not worth a compression attempt
+#define UNDO_PACK_MIN 64
+
+// The log grows to twice the kept depth before the oldest entries are dropped in one pass
+#define UNDO_MAX (2 * UNDO_LEVELS)
+
+static void log_path(char *buf, size_t sz, const char *filename) {
+    snprintf(buf, sz, "%s/storage%d/undo/%s", STORAGE_DIR, get_storage_id(), filename);
+}
+
+static uint64_t record_sum(const UndoRecord *r, const char *body) {
+    uint64_t h = 14695981039346656037ull;
+    const unsigned char *p = (const unsigned char *)r;
+    for (size_t i = 0; i < offsetof(UndoRecord, sum); ++i) h = (h ^ p[i]) * 1099511628211ull;
+    p = (const unsigned char *)body;
+    for (uint64_t i = 0; i < r->old_len + r->new_len; ++i) h = (h ^ p[i]) * 1099511628211ull;
+    return h;
+}
+
+static int write_at(int fd, const void *data, size_t len, off_t off) {
+    const char *p = (const char *)data;
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, off);
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+        off += n;
+    }
+    return 0;
+}
+
+static void read_header(int fd, UndoHeader *h) {
+    if (pread(fd, h, sizeof(*h), 0) != (ssize_t)sizeof(*h) || memcmp(h->magic, UNDO_MAGIC, 4) != 0) {
+        memset(h, 0, sizeof(*h));
+        memcpy(h->magic, UNDO_MAGIC, 4);
+    }
+    if (h->count > UNDO_MAX) h->count = UNDO_MAX;
+    if (h->cursor > h->count) h->cursor = h->count;
+}
+
+// Record boundaries of the first `want` entries: offs[i] is where entry i starts, offs[n]
+// where the last one found ends. Returns n (fewer than want if the log is short or torn).
+static uint32_t scan_log(int fd, uint32_t want, off_t *offs) {
+    struct stat st;
+    off_t pos = (off_t)sizeof(UndoHeader);
+    uint32_t n = 0;
+    offs[0] = pos;
+    if (fstat(fd, &st) != 0) return 0;
+    while (n < want) {
+        UndoRecord r;
+        if (pread(fd, &r, sizeof(r), pos) != (ssize_t)sizeof(r)) break;
+        uint64_t next = (uint64_t)pos + sizeof(r) + r.stored_len;
+        if (r.stored_len > (uint64_t)st.st_size || next > (uint64_t)st.st_size) break;
+        pos = (off_t)next;
+        offs[++n] = pos;
+    }
+    return n;
+}
+
+// Entry at pos with its old and new bytes (malloc'd, back to back); NULL if damaged
+static char *load_record(int fd, off_t pos, UndoRecord *r) {
+    if (pread(fd, r, sizeof(*r), pos) != (ssize_t)sizeof(*r)) return NULL;
+    size_t len = (size_t)(r->old_len + r->new_len), stored = (size_t)r->stored_len;
+    if (stored > len || r->old_len > len) return NULL;
+    char *body = malloc(len + 1);
+    char *packed = body && stored < len ? malloc(stored + 1) : NULL;
+    char *dst = stored < len ? packed : body;
+    int ok = dst && pread(fd, dst, stored, pos + (off_t)sizeof(*r)) == (ssize_t)stored &&
+             (stored == len || lz_decompress(LZ_UNDO, packed, stored, body, len) == 0) && record_sum(r, body) == r->sum;
+    free(packed);
+    if (!ok) {
+        free(body);
+        body = NULL;
+    }
+    return body;
+}
+
+void undo_record(const char *filename, uint64_t off, const char *old, size_t old_len,
+                 const char *new_text, size_t new_len, size_t at, long delta) {
+    char path[512];
+    log_path(path, sizeof(path), filename);
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return;
+
+    size_t len = old_len + new_len;
+    UndoRecord r = {off, old_len, new_len, at, delta, len, 0};
+    char *body = malloc(len + 1);
+    char *rec = malloc(sizeof(r) + lz_bound(len));
+    if (!body || !rec) {
+        free(body);
+        free(rec);
+        close(fd);
+        unlink(path);   // a history missing this change would undo the wrong bytes
+        return;
+    }
+    memcpy(body, old, old_len);
+    memcpy(body + old_len, new_text, new_len);
+    size_t packed = len >= UNDO_PACK_MIN ? lz_compress(LZ_UNDO, body, len, rec + sizeof(r)) : 0;
+    if (packed) r.stored_len = packed;
+    else memcpy(rec + sizeof(r), body, len);
+    r.sum = record_sum(&r, body);
+    free(body);
+    memcpy(rec, &r, sizeof(r));
+    size_t rec_len = sizeof(r) + (size_t)r.stored_len;
+
+    UndoHeader h;
+    off_t offs[UNDO_MAX + 1];
+    read_header(fd, &h);
+    // Entries past the cursor (undone, not redone) are dropped by the new change
+    uint32_t n = scan_log(fd, h.cursor, offs);
+
+    int rc;
+    if (n < UNDO_MAX) {
+        h.count = h.cursor = n + 1;
+        rc = write_at(fd, rec, rec_len, offs[n]) == 0 && ftruncate(fd, offs[n] + (off_t)rec_len) == 0 &&
+             write_at(fd, &h, sizeof(h), 0) == 0 ? 0 : -1;
+        close(fd);
+    } else {
+        // Full: keep the newest UNDO_LEVELS - 1 entries plus this one, in a fresh log
+        size_t keep = (size_t)(offs[n] - offs[n - (UNDO_LEVELS - 1)]);
+        char *kept = malloc(keep + 1);
+        rc = kept && pread(fd, kept, keep, offs[n - (UNDO_LEVELS - 1)]) == (ssize_t)keep ? 0 : -1;
+        close(fd);
+
+        char tmp[600];
+        snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+        h.count = h.cursor = UNDO_LEVELS;
+        int tfd = rc == 0 ? open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644) : -1;
+        rc = tfd >= 0 && write_at(tfd, &h, sizeof(h), 0) == 0 && write_at(tfd, kept, keep, sizeof(h)) == 0 &&
+             write_at(tfd, rec, rec_len, (off_t)(sizeof(h) + keep)) == 0 ? 0 : -1;
+        if (tfd >= 0 && close(tfd) != 0) rc = -1;
+        if (rc == 0) rc = rename(tmp, path);
+        if (rc != 0) unlink(tmp);
+        free(kept);
+    }
+    if (rc != 0) unlink(path);
+    free(rec);
+}
+
+void undo_forget(const char *filename) {
+    char path[512];
+    log_path(path, sizeof(path), filename);
+    unlink(path);
+}
+
+// Move the cursor `levels` entries back (UNDO) or forward (REDO), applying each entry's
+// delta to the document. Returns the number applied; *rc is -2 if the document no longer
+// matched the history (which is then discarded), -1 on error.
+static int history_move(const char *filename, int levels, int redo, int *rc) {
+    char path[512];
+    log_path(path, sizeof(path), filename);
+    int fd = open(path, O_RDWR);
+    int done = 0;
+    *rc = 0;
+    if (fd < 0) return 0;
+
+    UndoHeader h;
+    off_t offs[UNDO_MAX + 1];
+    read_header(fd, &h);
+    h.count = scan_log(fd, h.count, offs);
+    if (h.cursor > h.count) h.cursor = h.count;
+
+    while (done < levels && *rc == 0 && (redo ? h.cursor < h.count : h.cursor > 0)) {
+        UndoRecord r;
+        char *body = load_record(fd, offs[redo ? h.cursor : h.cursor - 1], &r);
+        if (!body) {
+            *rc = -1;
+            break;
+        }
+        const char *before = body, *after = body + r.old_len;
+        if (redo) {
+            *rc = commit_splice(filename, r.off, before, (size_t)r.old_len, after, (size_t)r.new_len,
+                                (size_t)r.at, (long)r.delta);
+        } else {
+            *rc = commit_splice(filename, r.off, after, (size_t)r.new_len, before, (size_t)r.old_len,
+                                (size_t)r.at, -(long)r.delta);
+        }
+        free(body);
+        if (*rc == 0) {
+            h.cursor += redo ? 1 : -1;
+            done++;
+        }
+    }
+    if (*rc == 0 || done > 0) write_at(fd, &h, sizeof(h), 0);
+    close(fd);
+    if (*rc == -2) unlink(path);
+    return done;
+}
+
+static void undo_redo(int client_sock, const char *filename, const char *username, int levels, int redo) {
     char response[512];
-    char current_path[512];
-    char undo_path[512];
-    char temp_path[512];
-    
+    const char *verb = redo ? "Redo" : "Undo";
+
     // Check write access
     if (!check_write_access(filename, username)) {
         sprintf(response, "Error: Access denied. You do not have write permission for '%s'\n", filename);
         send(client_sock, response, strlen(response), 0);
         return;
     }
-    
-    // Construct paths
+
+    char current_path[512];
+    struct stat st;
     sprintf(current_path, "%s/storage%d/files/%s", STORAGE_DIR, get_storage_id(), filename);
-    sprintf(undo_path, "%s/storage%d/undo/%s", STORAGE_DIR, get_storage_id(), filename);
-    sprintf(temp_path, "%s/storage%d/swap/%s.tmp", STORAGE_DIR, get_storage_id(), filename);
-    
-    // Check if current file exists
-    FILE *current_fp = fopen(current_path, "r");
-    if (!current_fp) {
+    if (stat(current_path, &st) != 0) {
         sprintf(response, "Error: File '%s' not found\n", filename);
         send(client_sock, response, strlen(response), 0);
         return;
     }
-    fclose(current_fp);
-    
-    // Check if undo backup exists
-    FILE *undo_fp = fopen(undo_path, "r");
-    if (!undo_fp) {
-        sprintf(response, "Error: No undo history available for '%s'\n", filename);
-        send(client_sock, response, strlen(response), 0);
-        return;
-    }
-    fclose(undo_fp);
-    
-    // Step 1: Copy current file to temp (this becomes the new undo backup)
-    FILE *src = fopen(current_path, "r");
-    FILE *dst = fopen(temp_path, "w");
-    if (!src || !dst) {
-        if (src) fclose(src);
-        if (dst) fclose(dst);
-        sprintf(response, "Error: Failed to create temporary backup\n");
-        send(client_sock, response, strlen(response), 0);
-        return;
-    }
-    
-    char buffer[4096];
-    size_t bytes;
-    while ((bytes = fread(buffer, 1, sizeof(buffer), src)) > 0) {
-        fwrite(buffer, 1, bytes, dst);
+
+    // Ordered with WRITE commits, so each delta is applied to the bytes it was taken from
+    int rc;
+    commit_write_lock(filename);
+    int done = history_move(filename, levels, redo, &rc);
+    if (done > 0) {
+        sentidx_rebuild(filename);
+        meta_store_bump_version(filename, time(NULL));
     }
-    fclose(src);
-    fclose(dst);
-    
-    // Step 2: Copy undo backup to current file (restore previous version)
-    src = fopen(undo_path, "r");
-    dst = fopen(current_path, "w");
-    if (!src || !dst) {
-        if (src) fclose(src);
-        if (dst) fclose(dst);
-        sprintf(response, "Error: Failed to restore from undo backup\n");
+    commit_write_unlock(filename);
+
+    if (done == 0) {
+        if (rc == -2) {
+            sprintf(response, "Error: '%s' was changed outside the undo history; history cleared\n", filename);
+        } else if (rc == -1) {
+            sprintf(response, "Error: %s failed for '%s'\n", verb, filename);
+        } else if (redo) {
+            sprintf(response, "Error: Nothing to redo for '%s'\n", filename);
+        } else {
+            sprintf(response, "Error: No undo history available for '%s'\n", filename);
+        }
         send(client_sock, response, strlen(response), 0);
         return;
     }
-    
-    while ((bytes = fread(buffer, 1, sizeof(buffer), src)) > 0) {
-        fwrite(buffer, 1, bytes, dst);
-    }
-    fclose(src);
-    fclose(dst);
-    
-    // Step 3: Move temp to undo (swap the backups)
-    remove(undo_path);
-    rename(temp_path, undo_path);
-    
-    // Update metadata - last modified time
-    FileMetadata meta;
-    if (read_metadata_file(filename, &meta) == 0) {
-        meta.last_modified = time(NULL);
-        update_metadata_file(filename, &meta);
+
+    search_index_update(filename);
+
+    if (levels == 1) {
+        sprintf(response, "%s Successful!\n", verb);
+    } else if (done == levels) {
+        sprintf(response, "%s Successful! %d changes %s.\n", verb, done, redo ? "redone" : "undone");
+    } else {
+        sprintf(response, "%s Successful! %d of %d changes %s (no further history).\n", verb, done, levels,
+                redo ? "redone" : "undone");
     }
-    
-    sprintf(response, "Undo Successful!\n");
     send(client_sock, response, strlen(response), 0);
-}
\ No newline at end of file
+}
+
+void undo_last_change(int client_sock, const char* filename, const char* username, int levels) {
+    undo_redo(client_sock, filename, username, levels, 0);
+}
+
+void redo_last_change(int client_sock, const char* filename, const char* username, int levels) {
+    undo_redo(client_sock, filename, username, levels, 1);
+}
@@ -1,29 +1,57 @@
 #include "../../include/common.h"
 #include "../../include/view.h"
 #include "../../include/acl.h"  // ADD THIS - to use check_read_access()
-
-// Function to count words and characters in a file
-void count_file(const char* path, int* words, int* chars) {
-    FILE *fp = fopen(path, "r");
-    if (!fp) {
-        *words = 0;
-        *chars = 0;
-        return;
-    }
-    int c;
-    int in_word = 0;
-    *words = 0;
-    *chars = 0;
-    while ((c = fgetc(fp)) != EOF) {
-        (*chars)++;
-        if (c == ' ' || c == '\n' || c == '\t') {
-            in_word = 0;
-        } else if (!in_word) {
-            in_word = 1;
-            (*words)++;
+#include "../../include/atime.h"
+#include "../../include/doccount.h"
+#include "../../include/tier.h"
+
+typedef struct {
+    char *response;
+    size_t size;
+    int show_all, show_long;
+    int file_count;
+} ViewList;
+
+// One listing entry; access / modified times default to the file's own when the metadata
+// has none
+static void list_entry(ViewList *v, const char *name, int word_count, int char_count,
+                       time_t last_access_raw, time_t last_mod_raw) {
+    if (!v->show_all && name[0] == '.') return;
+
+    if (v->show_long) {
+        FileMetadata meta;
+        const char *owner = "unknown";
+
+        if (read_metadata_file(name, &meta) == 0) {
+            if (meta.owner[0]) owner = meta.owner;
+            meta.last_accessed = atime_effective(name, meta.last_accessed);
+            if (meta.last_accessed > 0) last_access_raw = meta.last_accessed;
+            if (meta.last_modified > 0) last_mod_raw    = meta.last_modified;
         }
+
+        char access_buf[32], mod_buf[32];
+        struct tm tm_buf;
+        strftime(access_buf, sizeof(access_buf), "%Y-%m-%d %H:%M", localtime_r(&last_access_raw, &tm_buf));
+        strftime(mod_buf,    sizeof(mod_buf),    "%Y-%m-%d %H:%M", localtime_r(&last_mod_raw, &tm_buf));
+
+        char line[256];
+        snprintf(line, sizeof(line),
+            "│ %-19.20s│ %6d │ %6d │ %-18.20s │ %-10.12s │ %-11.12s │\n",
+            name, word_count, char_count, access_buf, owner, mod_buf);
+
+        strncat(v->response, line, v->size - strlen(v->response) - 1);
+    } else {
+        strncat(v->response, name, v->size - strlen(v->response) - 2);
+        strncat(v->response, "\n", v->size - strlen(v->response) - 1);
     }
-    fclose(fp);
+    v->file_count++;
+}
+
+// Cold documents are listed from the tier index (counts taken when they were archived)
+static void list_cold(const char *filename, const TierInfo *info, void *user) {
+    DocCounts counts = {0, 0, 0};
+    if (((ViewList *)user)->show_long) doccount_cold(filename, info, &counts);
+    list_entry((ViewList *)user, filename, (int)counts.words, (int)counts.chars, info->mtime, info->mtime);
 }
 
 // Function to list files
@@ -41,7 +69,7 @@ void list_files(int client_sock, int show_all, int show_long, const char* userna
         return;
     }
 
-    int file_count = 0;
+    ViewList v = {response, sizeof(response), show_all, show_long, 0};
     struct dirent *entry;
 
     if (show_long) {
@@ -69,38 +97,14 @@ void list_files(int client_sock, int show_all, int show_long, const char* userna
         struct stat st;
         if (stat(path, &st) != 0) continue;
 
-        if (show_long) {
-            int word_count = 0, char_count = 0;
-            count_file(path, &word_count, &char_count);
-
-            FileMetadata meta;
-            const char *owner = "unknown";
-            time_t last_access_raw = st.st_atime;
-            time_t last_mod_raw    = st.st_mtime;
-
-            if (read_metadata_file(entry->d_name, &meta) == 0) {
-                if (meta.owner[0]) owner = meta.owner;
-                if (meta.last_accessed > 0) last_access_raw = meta.last_accessed;
-                if (meta.last_modified > 0) last_mod_raw    = meta.last_modified;
-            }
-
-            char access_buf[32], mod_buf[32];
-            strftime(access_buf, sizeof(access_buf), "%Y-%m-%d %H:%M", localtime(&last_access_raw));
-            strftime(mod_buf,    sizeof(mod_buf),    "%Y-%m-%d %H:%M", localtime(&last_mod_raw));
-
-            char line[256];
-            snprintf(line, sizeof(line),
-                "│ %-19.20s│ %6d │ %6d │ %-18.20s │ %-10.12s │ %-11.12s │\n",
-                entry->d_name, word_count, char_count, access_buf, owner, mod_buf);
-
-            strncat(response, line, sizeof(response) - strlen(response) - 1);
-        } else {
-            strncat(response, entry->d_name, sizeof(response) - strlen(response) - 2);
-            strncat(response, "\n", sizeof(response) - strlen(response) - 1);
-        }
-        file_count++;
+        // Counts come from the metadata, kept current by every commit
+        DocCounts counts = {0, 0, 0};
+        if (show_long) doccount_get(entry->d_name, &st, &counts);
+        list_entry(&v, entry->d_name, (int)counts.words, (int)counts.chars, st.st_atime, st.st_mtime);
     }
     closedir(dir);
+    tier_foreach(list_cold, &v);
+    int file_count = v.file_count;
 
     if (show_long) {
         strncat(response,
@@ -115,4 +119,4 @@ void list_files(int client_sock, int show_all, int show_long, const char* userna
     }
 
     send(client_sock, response, strlen(response), 0);
-}
\ No newline at end of file
+}
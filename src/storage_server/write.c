@@ -1,104 +1,90 @@
 #include "../../include/common.h"
 #include "../../include/write.h"
 #include "../../include/acl.h"
-#include <unistd.h>   // for access(), unlink()
+#include "../../include/search.h"
+#include "../../include/document.h"
+#include "../../include/commit.h"
+#include "../../include/sentlock.h"
+#include "../../include/editlog.h"
+#include <stdint.h>
+#include <unistd.h>
 #include <time.h>
 
 // Forward (from server.c)
 extern int get_storage_id(void);
 
-// Swap helpers
-static void make_swap_path(char *buf, size_t sz, const char *filename, int sentence_num) {
-    snprintf(buf, sz, "%s/storage%d/swap/%s.%d.swap", STORAGE_DIR, get_storage_id(), filename, sentence_num);
-}
-
-static int write_swap(const char *filename, int sentence_num, const char *content) {
-    char spath[512];
-    make_swap_path(spath, sizeof(spath), filename, sentence_num);
-    FILE *sf = fopen(spath, "w");
-    if (!sf) return -1;
-    fwrite(content, 1, strlen(content), sf);
-    fclose(sf);
-    return 0;
-}
-
-static int read_swap(const char *filename, int sentence_num, char *out, size_t outsz) {
-    char spath[512];
-    make_swap_path(spath, sizeof(spath), filename, sentence_num);
-    FILE *sf = fopen(spath, "r");
-    if (!sf) return -1;
-    size_t r = fread(out, 1, outsz - 1, sf);
-    out[r] = '\0';
-    fclose(sf);
-    return 0;
-}
-
-static void remove_swap(const char *filename, int sentence_num) {
-    char spath[512];
-    make_swap_path(spath, sizeof(spath), filename, sentence_num);
-    unlink(spath);
-}
-
-#define MAX_SENTENCES 200
-#define MAX_SENT_LEN 4096
-#define MAX_WORDS 512
-
-int is_delim(char c) {
-    return (c == '.' || c == '!' || c == '?');
-}
-
-// --- Helper: split text into sentences ---
-int split_sentences(const char *text, char sentences[MAX_SENTENCES][MAX_SENT_LEN]) {
-    int count = 0, idx = 0;
-    for (int i = 0; text[i] != '\0'; i++) {
-        sentences[count][idx++] = text[i];
-        if (is_delim(text[i])) {
-            sentences[count][idx] = '\0';
-            count++;
-            idx = 0;
+// Insert text before word `index` of sentence (words are separated by spaces; index equal
+// to the word count appends). Returns a malloc'd sentence, or NULL if index is out of range.
+static char *insert_at_word(const char *sentence, int index, const char *text) {
+    char *out = malloc(strlen(sentence) + strlen(text) + 2);
+    if (!out) return NULL;
+    size_t o = 0;
+    int word = 0, inserted = 0;
+    const char *p = sentence;
+    while (1) {
+        while (*p == ' ') p++;
+        if (word == index) {
+            if (o) out[o++] = ' ';
+            memcpy(out + o, text, strlen(text));
+            o += strlen(text);
+            inserted = 1;
         }
+        if (!*p) break;
+        const char *start = p;
+        while (*p && *p != ' ') p++;
+        if (o) out[o++] = ' ';
+        memcpy(out + o, start, (size_t)(p - start));
+        o += (size_t)(p - start);
+        word++;
     }
-    if (idx > 0) {
-        sentences[count][idx] = '\0';
-        count++;
+    out[o] = '\0';
+    if (!inserted) {
+        free(out);
+        return NULL;
     }
-    return count;
+    return out;
 }
 
-// --- Helper: split sentence into words ---
-int split_words(const char *sentence, char words[MAX_WORDS][128]) {
-    int count = 0;
-    char tmp[MAX_SENT_LEN];
-    strcpy(tmp, sentence);
-    char *token = strtok(tmp, " ");
-    while (token && count < MAX_WORDS) {
-        strcpy(words[count++], token);
-        token = strtok(NULL, " ");
+// State of one WRITE session: the document snapshot being edited and its working sentence
+typedef struct {
+    Document *doc;
+    int sentence_num;
+    char *working;          // current text of the locked sentence
+    size_t split_parts;     // sentences split off it, inserted after it in doc
+} WriteSession;
+
+// Apply one "<index> <content>" edit (also used to replay a recovered journal). Returns -1
+// if the word index is out of range.
+static int apply_edit(long index, const char *content, void *user) {
+    WriteSession *session = (WriteSession *)user;
+    char *new_sentence = (index < 0 || index > INT32_MAX) ? NULL : insert_at_word(session->working, (int)index, content);
+    if (!new_sentence) return -1;
+
+    // Now handle sentence splitting if new delimiters introduced: the first sentence
+    // stays the working one, the rest are inserted into the document after it
+    size_t len = strlen(new_sentence);
+    size_t first = doc_next_sentence(new_sentence, len);
+    size_t pos = first;
+    size_t at = (size_t)session->sentence_num + 1;
+    while (pos < len) {
+        while (pos < len && new_sentence[pos] == ' ') pos++;
+        if (pos == len) break;
+        size_t part = doc_next_sentence(new_sentence + pos, len - pos);
+        char saved = new_sentence[pos + part];
+        new_sentence[pos + part] = '\0';
+        doc_insert_sentence(session->doc, at++, new_sentence + pos);
+        session->split_parts++;
+        new_sentence[pos + part] = saved;
+        pos += part;
     }
-    return count;
-}
-
-int is_locked(const char *filename, int sentence_num) {
-    char lock_path[512];
-    sprintf(lock_path, "%s/storage%d/files/%s.%d.lock", STORAGE_DIR, get_storage_id(), filename, sentence_num);
-    return access(lock_path, F_OK) == 0;
-}
-
-void create_lock(const char *filename, int sentence_num) {
-    char lock_path[512];
-    sprintf(lock_path, "%s/storage%d/files/%s.%d.lock", STORAGE_DIR, get_storage_id(), filename, sentence_num);
-    FILE *fp = fopen(lock_path, "w");
-    if (fp) fclose(fp);
-}
-
-void remove_lock(const char *filename, int sentence_num) {
-    char lock_path[512];
-    sprintf(lock_path, "%s/storage%d/files/%s.%d.lock", STORAGE_DIR, get_storage_id(), filename, sentence_num);
-    remove(lock_path);
+    new_sentence[first] = '\0';
+    free(session->working);
+    session->working = new_sentence;   // keep editing current one
+    return 0;
 }
 
 // --- Core WRITE logic ---
-void write_to_file(int client_sock, const char *filename, int sentence_num, const char *username) {
+void write_to_file(int client_sock, const char *filename, int sentence_num, const char *username, int wait_secs) {
     printf("[DEBUG] Entered write_to_file for %s (sentence_num=%d, user=%s)\n", filename, sentence_num, username);
     // Check write access
     if (!check_write_access(filename, username)) {
@@ -107,188 +93,178 @@ void write_to_file(int client_sock, const char *filename, int sentence_num, cons
         send(client_sock, msg, strlen(msg), 0);
         return;
     }
+
+    // Take the sentence lock first (queueing for it if asked to wait), so the document
+    // loaded below is the version this session edits
+    uint64_t lock_token = sentlock_acquire(filename, sentence_num, username, wait_secs);
+    if (!lock_token) {
+        char msg[128];
+        sprintf(msg, "ERROR: Sentence %d is locked by another user.\n", sentence_num);
+        send(client_sock, msg, strlen(msg), 0);
+        return;
+    }
     
     char path[512];
     sprintf(path, "%s/storage%d/files/%s", STORAGE_DIR, get_storage_id(), filename);
     printf("%s\n", path);
 
-    char undo_path[512];
-    sprintf(undo_path, "%s/storage%d/undo/%s", STORAGE_DIR, get_storage_id(), filename);
-    
-    // Check if file exists and create backup
+    // Create the file if it does not exist yet (the undo history is kept by the commit)
     FILE *check_fp = fopen(path, "r");
     if (check_fp) {
-        // File exists, create backup
-        FILE *undo_fp = fopen(undo_path, "w");
-        if (undo_fp) {
-            char backup_buf[4096];
-            size_t backup_bytes;
-            while ((backup_bytes = fread(backup_buf, 1, sizeof(backup_buf), check_fp)) > 0) {
-                fwrite(backup_buf, 1, backup_bytes, undo_fp);
-            }
-            fclose(undo_fp);
-        }
         fclose(check_fp);
-    }
-
-
-    FILE *fp = fopen(path, "r");
-    if (!fp) {
+    } else {
         // Create empty file if it doesn't exist
-        fp = fopen(path, "w");
+        FILE *fp = fopen(path, "w");
         if (!fp) {
             char msg[128];
             sprintf(msg, "ERROR: Could not create file '%s'.\n", filename);
             send(client_sock, msg, strlen(msg), 0);
+            sentlock_release(filename, sentence_num, lock_token);
             return;
         }
         fclose(fp);
-        fp = fopen(path, "r");
     }
 
-    // Read entire file content
-    char file_buf[16384];
-    size_t bytes = fread(file_buf, 1, sizeof(file_buf) - 1, fp);
-    file_buf[bytes] = '\0';
-    fclose(fp);
-
-    // Split into sentences
-    char sentences[MAX_SENTENCES][MAX_SENT_LEN];
-    int sentence_count = split_sentences(file_buf, sentences);
+    // Load the document model (whole file, any size) and the version it reflects
+    struct stat loaded_st;
+    uint64_t loaded_version;
+    Document *doc = commit_load(filename, &loaded_st, &loaded_version);
+    if (!doc) {
+        char msg[] = "ERROR: Unable to read file.\n";
+        send(client_sock, msg, strlen(msg), 0);
+        sentlock_release(filename, sentence_num, lock_token);
+        return;
+    }
+    int sentence_count = (int)doc_sentence_count(doc);
 
     // For empty files, only sentence 0 is valid
     // For non-empty files:
-    // - If last char is delimiter, allow writing up to sentence_count
-    // - If no trailing delimiter, only allow writing up to sentence_count-1
-    int max_sentence;
-    if (bytes == 0) {
-        // Empty file - only allow sentence 0
+    // - If last sentence ends with a delimiter, allow writing up to sentence_count
+    // - If not, only allow writing up to sentence_count-1
+    if (sentence_count == 0) {
         if (sentence_num != 0) {
             char msg[256];
             sprintf(msg, "ERROR: File is empty. Only sentence 0 can be edited.\n");
             send(client_sock, msg, strlen(msg), 0);
+            sentlock_release(filename, sentence_num, lock_token);
+            doc_free(doc);
             return;
         }
-        sentence_count = 0;  // Start fresh
     } else {
-        // Check if file ends with a delimiter
-        char last_char = file_buf[bytes - 1];
-        max_sentence = is_delim(last_char) ? sentence_count : sentence_count - 1;
+        int ends_delim = doc_ends_with_delim(doc);
+        int max_sentence = ends_delim ? sentence_count : sentence_count - 1;
         
         if (sentence_num < 0 || sentence_num > max_sentence) {
             char msg[256];
-            if (max_sentence < 0) max_sentence = 0;
             sprintf(msg, "ERROR: Invalid sentence number. Valid range is 0 to %d%s\n",
                     max_sentence,
-                    is_delim(last_char) ? " (file ends with punctuation)." : ".");
+                    ends_delim ? " (file ends with punctuation)." : ".");
             send(client_sock, msg, strlen(msg), 0);
+            sentlock_release(filename, sentence_num, lock_token);
+            doc_free(doc);
             return;
         }
     }
 
-    if (is_locked(filename, sentence_num)) {
-        char msg[128];
-        sprintf(msg, "ERROR: Sentence %d is locked by another user.\n", sentence_num);
-        send(client_sock, msg, strlen(msg), 0);
-        return;
-    }
-
-    create_lock(filename, sentence_num);
-
-    // Initialize empty working sentence for new sentences
-    char working_sentence[MAX_SENT_LEN] = "";
+    // Working sentence: existing text, or a new (empty) sentence appended to the document.
+    // The session's edit replaces `replaced` sentences with 1 + split_parts sentences.
+    WriteSession session = {doc, sentence_num, NULL, 0};
+    size_t replaced = sentence_num < sentence_count ? 1 : 0;
+    char *original = NULL;      // the sentence as loaded, checked again at commit
     if (sentence_num < sentence_count) {
-        strcpy(working_sentence, sentences[sentence_num]);
+        session.working = doc_sentence(doc, (size_t)sentence_num);
+        original = doc_sentence(doc, (size_t)sentence_num);
+    } else {
+        session.working = strdup("");
+        doc_insert_sentence(doc, (size_t)sentence_num, "");
     }
 
-    char msg[128];
-    sprintf(msg, "Sentence %d locked. You may begin writing.\n", sentence_num);
-    send(client_sock, msg, strlen(msg), 0);
-
-    // After determining working_sentence (existing or new):
-    // Initialize swap file with current working sentence (or empty for new)
-    if (write_swap(filename, sentence_num, working_sentence) != 0) {
-        char msg[] = "ERROR: Could not create swap file.\n";
+    // Start the session's edit journal (resuming an interrupted session's edits, if any)
+    int recovered = 0;
+    EditLog *log = session.working && (original || !replaced) ? editlog_open(filename, sentence_num, username, session.working,
+                                                  apply_edit, &session, &recovered) : NULL;
+    if (!log) {
+        char msg[] = "ERROR: Could not create edit journal.\n";
         send(client_sock, msg, strlen(msg), 0);
-        remove_lock(filename, sentence_num);
+        sentlock_release(filename, sentence_num, lock_token);
+        free(session.working);
+        free(original);
+        doc_free(doc);
         return;
     }
 
+    char msg[192];
+    if (recovered > 0) {
+        sprintf(msg, "Sentence %d locked. Recovered %d unsaved edit(s) from an interrupted session. You may continue writing.\n",
+                sentence_num, recovered);
+    } else {
+        sprintf(msg, "Sentence %d locked. You may begin writing.\n", sentence_num);
+    }
+    send(client_sock, msg, strlen(msg), 0);
+
+    char inbox[1024];
+    size_t buffered = 0;
     while (1) {
         printf("[DEBUG] Top of write loop for %s\n", filename);
-        char recv_buf[1024];
-        memset(recv_buf, 0, sizeof(recv_buf));
-        ssize_t n = read(client_sock, recv_buf, sizeof(recv_buf) - 1);
-        
-        if (n <= 0) {
-            // Connection closed or error
-            remove_lock(filename, sentence_num);
-            return;
+        if (buffered == 0) {
+            ssize_t n = read(client_sock, inbox, sizeof(inbox) - 1);
+            if (n <= 0) {
+                // Connection closed or error
+                break;
+            }
+            buffered = (size_t)n;
         }
-        
-        recv_buf[n] = '\0';
-        
-        // Remove trailing newline/carriage return
-        recv_buf[strcspn(recv_buf, "\n")] = '\0';
+
+        // Take one line (lines may arrive together, e.g. an edit and a RENEW); a read
+        // without a newline is one command
+        char recv_buf[1024];
+        char *nl = memchr(inbox, '\n', buffered);
+        size_t line_len = nl ? (size_t)(nl - inbox) : buffered;
+        memcpy(recv_buf, inbox, line_len);
+        recv_buf[line_len] = '\0';
+        buffered -= nl ? line_len + 1 : line_len;
+        memmove(inbox, inbox + (nl ? line_len + 1 : line_len), buffered);
+
+        // Remove trailing carriage return
         recv_buf[strcspn(recv_buf, "\r")] = '\0';
         printf("[DEBUG] Received command: '%s'\n", recv_buf);
-        printf("recv_buf: %s\n", recv_buf);
+
+        // Any line from the client keeps the lease alive
+        if (sentlock_renew(filename, sentence_num, lock_token) != 0) {
+            char err[160];
+            sprintf(err, "ERROR: Lock on sentence %d lapsed and was taken by another writer. Changes discarded.\n", sentence_num);
+            send(client_sock, err, strlen(err), 0);
+            lock_token = 0;
+            break;
+        }
+        if (strcmp(recv_buf, "RENEW") == 0) continue;   // heartbeat only, no reply
         // ETIRW → finish
         if (strncmp(recv_buf, "ETIRW", 5) == 0) {
-            // On finish: load final sentence from swap (if present)
-            char final_sentence[MAX_SENT_LEN];
-            if (read_swap(filename, sentence_num, final_sentence, sizeof(final_sentence)) == 0) {
-                strcpy(working_sentence, final_sentence);
-            }
-            // Move final sentence into sentences array
-            strcpy(sentences[sentence_num], working_sentence);
-            if (sentence_num >= sentence_count) sentence_count = sentence_num + 1;
-            if (strlen(working_sentence) == 0) strcpy(sentences[sentence_num], ".");
-
-            // Recombine file
-            fp = fopen(path, "w");
-            if (!fp) {
-                char err[] = "ERROR: Unable to save file.\n";
+            // Move final sentence into the document
+            doc_set_sentence(doc, (size_t)sentence_num, session.working[0] ? session.working : ".");
+
+            // Splice the edit into the current version (other sentences may have been
+            // committed meanwhile) and write back only the bytes that changed
+            int rc = commit_edit(filename, doc, (size_t)sentence_num, replaced, 1 + session.split_parts,
+                                 original, loaded_version, &loaded_st);
+            if (rc != 0) {
+                char err[160];
+                if (rc == -2) sprintf(err, "ERROR: Sentence %d was changed or moved by other commits. Changes discarded; please retry.\n", sentence_num);
+                else sprintf(err, "ERROR: Unable to save file.\n");
                 send(client_sock, err, strlen(err), 0);
-                remove_lock(filename, sentence_num);
-                return;
-            }
-            
-            // Write all sentences
-            for (int i = 0; i < sentence_count; i++) {
-                fprintf(fp, "%s", sentences[i]);
-                // Add space between sentences (but not after the last one)
-                if (i < sentence_count - 1) {
-                    fprintf(fp, " ");
-                }
+                break;
             }
-            fclose(fp);
 
-            // Update last_modified in meta file
+            // commit_edit bumped the version; a file written before it had metadata gets some
             FileMetadata meta;
-            printf("[DEBUG] Attempting to update metadata for file: %s\n", filename);
-            int meta_ret = read_metadata_file(filename, &meta);
-            printf("[DEBUG] read_metadata_file returned: %d\n", meta_ret);
-            if (meta_ret == 0) {
-                meta.last_modified = time(NULL);
-                printf("[DEBUG] Updated metadata, calling update_metadata_file\n");
-                update_metadata_file(filename, &meta);
-            } else {
-                printf("[DEBUG] Meta file missing or unreadable, attempting to create meta file for: %s\n", filename);
-                if (create_metadata_file(filename, username) == 0) {
-                    printf("[DEBUG] Meta file created. Now updating last_modified.\n");
-                    if (read_metadata_file(filename, &meta) == 0) {
-                        meta.last_modified = time(NULL);
-                        update_metadata_file(filename, &meta);
-                    } else {
-                        printf("[DEBUG] Still unable to read meta file after creation.\n");
-                    }
-                } else {
-                    printf("[DEBUG] Failed to create meta file for: %s\n", filename);
-                }
+            if (read_metadata_file(filename, &meta) != 0 && create_metadata_file(filename, username) != 0) {
+                printf("[DEBUG] Failed to create meta file for: %s\n", filename);
             }
-            remove_swap(filename, sentence_num);
-            remove_lock(filename, sentence_num);
+            search_index_update(filename);
+            editlog_close(log);
+            log = NULL;
+            sentlock_release(filename, sentence_num, lock_token);
+            lock_token = 0;
 
             char done[] = "Write Successful!\n";
             send(client_sock, done, strlen(done), 0);
@@ -299,59 +275,23 @@ void write_to_file(int client_sock, const char *filename, int sentence_num, cons
         }
 
         // Parse "<word_index> <content...>"
-        int index;
-        char insert_text[512] = {0};
-        if (sscanf(recv_buf, "%d %[^\n]", &index, insert_text) < 2) {
+        char *content = NULL;
+        long index = strtol(recv_buf, &content, 10);
+        if (content == recv_buf || *content != ' ' || content[1] == '\0') {
             char err[] = "ERROR: Invalid format. Use '<word_index> <content>' or 'ETIRW'.\n";
             send(client_sock, err, strlen(err), 0);
             continue;
         }
+        content++;
 
-        // Split into words
-        char words[MAX_WORDS][128];
-        int word_count = split_words(working_sentence, words);
-
-        if (index < 0 || index > word_count) {
+        // Insert new word(s) at position <index>, then record the edit in the journal
+        if (apply_edit(index, content, &session) != 0) {
             char err[] = "ERROR: Word index out of range.\n";
             send(client_sock, err, strlen(err), 0);
             continue;
         }
-
-        // Insert new word(s) at position <index>
-        char new_sentence[MAX_SENT_LEN] = "";
-        for (int i = 0; i < index; i++) {
-            strcat(new_sentence, words[i]);
-            strcat(new_sentence, " ");
-        }
-        strcat(new_sentence, insert_text);
-        if (index < word_count) strcat(new_sentence, " ");
-        for (int i = index; i < word_count; i++) {
-            strcat(new_sentence, words[i]);
-            if (i < word_count - 1) strcat(new_sentence, " ");
-        }
-
-        // Now handle sentence splitting if new delimiters introduced
-        char temp_sentences[MAX_SENTENCES][MAX_SENT_LEN];
-        int new_count = split_sentences(new_sentence, temp_sentences);
-
-        if (new_count > 1) {
-            // Replace the current sentence with the split results
-            // Shift sentences to make space
-            for (int i = sentence_count - 1; i >= sentence_num + 1; i--) {
-                strcpy(sentences[i + new_count - 1], sentences[i]);
-            }
-            for (int j = 0; j < new_count; j++) {
-                strcpy(sentences[sentence_num + j], temp_sentences[j]);
-            }
-            sentence_count += (new_count - 1);
-            strcpy(working_sentence, sentences[sentence_num]); // keep editing current one
-        } else {
-            strcpy(working_sentence, new_sentence);
-        }
-
-        // Persist current working sentence to swap file
-        if (write_swap(filename, sentence_num, working_sentence) != 0) {
-            char err[] = "ERROR: Failed to update swap file.\n";
+        if (editlog_append(log, index, content) != 0) {
+            char err[] = "ERROR: Failed to record edit in journal.\n";
             send(client_sock, err, strlen(err), 0);
             // Do not abort session; continue allowing edits
         }
@@ -360,10 +300,11 @@ void write_to_file(int client_sock, const char *filename, int sentence_num, cons
         send(client_sock, ok, strlen(ok), 0);
     }
 
-    // If loop exits unexpectedly (connection drop), cleanup
-    // (Only cleanup if lock still present; swap is discarded)
-    if (is_locked(filename, sentence_num)) {
-        remove_lock(filename, sentence_num);
-        remove_swap(filename, sentence_num);
-    }
+    // If loop exits unexpectedly (connection drop), cleanup: the journal is discarded (a
+    // lapsed session's journal was already replaced by the next writer's)
+    editlog_close(log);
+    if (lock_token) sentlock_release(filename, sentence_num, lock_token);
+    free(session.working);
+    free(original);
+    doc_free(doc);
 }